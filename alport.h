@@ -17,6 +17,7 @@
 #include "gme.h"
 #include "mp3.h"
 #include "vorbis.h"
+#include "async.h"
 #include "primitive2.h"
 #include "3d.h"
 #include "polygon.h"
@@ -0,0 +1,554 @@
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "alport.h"
+
+enum ASYNC_KIND { ASYNC_DATAFILE, ASYNC_DATAFILE_OBJECT, ASYNC_MP3, ASYNC_VORBIS, ASYNC_GME };
+
+struct ASYNC_LOAD
+{
+   ASYNC_LOAD *next;                   /* next load in the same queue */
+   int kind;                           /* what to load, see ASYNC_KIND */
+   int priority;                       /* queue it waits in */
+   int status;                         /* see ASYNC_STATUS */
+   int cancel;                         /* TRUE once async_load_cancel() is called */
+   char *filename;
+   char *objectname;                   /* for ASYNC_DATAFILE_OBJECT */
+   void *data;                         /* loaded object, NULL on error */
+   ASYNC_CALLBACK callback;
+   void *userdata;
+};
+
+typedef struct ASYNC_QUEUE
+{
+   ASYNC_LOAD *first;
+   ASYNC_LOAD *last;
+} ASYNC_QUEUE;
+
+/* The queues and the status of the loads are protected by async_lock */
+static pthread_mutex_t async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t async_work = PTHREAD_COND_INITIALIZER;   /* new load queued or quit */
+static pthread_cond_t async_done = PTHREAD_COND_INITIALIZER;   /* a load has finished */
+static ASYNC_QUEUE async_queued[ASYNC_PRIORITIES];
+static ASYNC_QUEUE async_finished;
+static pthread_t async_threads[ASYNC_MAX_THREADS];
+static int async_thread_count = 0;
+static int async_quit = FALSE;
+static int async_pending = 0;          /* loads not delivered yet */
+
+
+/* queue_push:
+ *  Appends a load to the end of a queue.
+ */
+static void queue_push(ASYNC_QUEUE *q, ASYNC_LOAD *load)
+{
+   load->next = NULL;
+
+   if (q->last)
+      q->last->next = load;
+   else
+      q->first = load;
+
+   q->last = load;
+}
+
+
+/* queue_pop:
+ *  Takes the first load out of a queue, returns NULL if it is empty.
+ */
+static ASYNC_LOAD *queue_pop(ASYNC_QUEUE *q)
+{
+   ASYNC_LOAD *load = q->first;
+
+   if (load)
+   {
+      q->first = load->next;
+      if (!q->first)
+         q->last = NULL;
+      load->next = NULL;
+   }
+
+   return load;
+}
+
+
+/* queue_remove:
+ *  Takes a load out of a queue wherever it is. Returns FALSE if the
+ * load was not in the queue.
+ */
+static int queue_remove(ASYNC_QUEUE *q, ASYNC_LOAD *load)
+{
+   ASYNC_LOAD *prev = NULL;
+   ASYNC_LOAD *p;
+
+   for (p = q->first; p; prev = p, p = p->next)
+   {
+      if (p == load)
+      {
+         if (prev)
+            prev->next = p->next;
+         else
+            q->first = p->next;
+
+         if (q->last == p)
+            q->last = prev;
+
+         p->next = NULL;
+         return TRUE;
+      }
+   }
+
+   return FALSE;
+}
+
+
+/* run_load:
+ *  Calls the blocking loader of a load. Runs without the lock held,
+ * usually on a loader thread.
+ */
+static void *run_load(ASYNC_LOAD *load)
+{
+   switch (load->kind)
+   {
+      case ASYNC_DATAFILE:
+         return load_datafile(load->filename);
+
+      case ASYNC_DATAFILE_OBJECT:
+         return load_datafile_object(load->filename, load->objectname);
+
+      case ASYNC_MP3:
+         return mp3_load(load->filename);
+
+      case ASYNC_VORBIS:
+         return vorbis_load(load->filename);
+
+      case ASYNC_GME:
+         return gme_load(load->filename);
+   }
+
+   return NULL;
+}
+
+
+/* destroy_result:
+ *  Frees what a load has loaded, used when it gets cancelled late.
+ */
+static void destroy_result(ASYNC_LOAD *load)
+{
+   switch (load->kind)
+   {
+      case ASYNC_DATAFILE:
+         unload_datafile((DATAFILE *)load->data);
+         break;
+
+      case ASYNC_DATAFILE_OBJECT:
+         unload_datafile_object((DATAFILE *)load->data);
+         break;
+
+      case ASYNC_MP3:
+         mp3_destroy(load->data, TRUE);
+         break;
+
+      case ASYNC_VORBIS:
+         vorbis_destroy(load->data, TRUE);
+         break;
+
+      case ASYNC_GME:
+         gme_destroy(load->data);
+         break;
+   }
+
+   load->data = NULL;
+}
+
+
+/* free_load:
+ *  Frees a load handle.
+ */
+static void free_load(ASYNC_LOAD *load)
+{
+   free(load->filename);
+   free(load->objectname);
+   free(load);
+}
+
+
+/* finish_load:
+ *  Stores the result of a load and queues it for delivery. Must be
+ * called with async_lock held.
+ */
+static void finish_load(ASYNC_LOAD *load, void *data)
+{
+   load->data = data;
+
+   if (load->cancel)
+      load->status = ASYNC_CANCELLED;
+   else
+      load->status = (data) ? ASYNC_DONE : ASYNC_FAILED;
+
+   queue_push(&async_finished, load);
+   pthread_cond_broadcast(&async_done);
+}
+
+
+/* deliver_load:
+ *  Calls the callback of a finished load, already taken out of the
+ * finished queue, and frees it. The result of a cancelled load is
+ * destroyed here, on the thread that cancelled it.
+ */
+static void deliver_load(ASYNC_LOAD *load)
+{
+   if (load->cancel)
+   {
+      if (load->data)
+         destroy_result(load);
+      load->status = ASYNC_CANCELLED;
+   }
+
+   load->callback(load, load->data, load->userdata);
+
+   pthread_mutex_lock(&async_lock);
+   async_pending--;
+   pthread_mutex_unlock(&async_lock);
+
+   free_load(load);
+}
+
+
+/* async_worker:
+ *  Loader thread, runs the queued loads highest priority first until
+ * async_loader_exit() is called.
+ */
+static void *async_worker(void *arg)
+{
+   ASYNC_LOAD *load;
+   void *data;
+   int i;
+   (void)arg;
+
+   pthread_mutex_lock(&async_lock);
+
+   while (!async_quit)
+   {
+      load = NULL;
+      for (i = ASYNC_PRIORITIES - 1; (i >= 0) && (!load); i--)
+         load = queue_pop(&async_queued[i]);
+
+      if (!load)
+      {
+         pthread_cond_wait(&async_work, &async_lock);
+         continue;
+      }
+
+      load->status = ASYNC_LOADING;
+      pthread_mutex_unlock(&async_lock);
+
+      data = run_load(load);
+
+      pthread_mutex_lock(&async_lock);
+      finish_load(load, data);
+   }
+
+   pthread_mutex_unlock(&async_lock);
+
+   return NULL;
+}
+
+
+/* queue_load:
+ *  Creates a load and hands it to the loader threads, starting them
+ * if needed. If no thread can be started the load runs right away and
+ * is delivered by the next async_load_poll(). Returns NULL on error.
+ */
+static ASYNC_LOAD *queue_load(int kind, const char *filename, const char *objectname,
+                              int priority, ASYNC_CALLBACK callback, void *userdata)
+{
+   ASYNC_LOAD *load;
+   void *data;
+
+   if ((!filename) || (!callback))
+      return NULL;
+
+   load = (ASYNC_LOAD *)calloc(1, sizeof(ASYNC_LOAD));
+   if (!load)
+      return NULL;
+
+   load->kind = kind;
+   load->priority = CLAMP(ASYNC_PRIORITY_LOW, priority, ASYNC_PRIORITY_HIGH);
+   load->callback = callback;
+   load->userdata = userdata;
+   load->filename = strdup(filename);
+   if (objectname)
+      load->objectname = strdup(objectname);
+
+   if ((!load->filename) || ((objectname) && (!load->objectname)))
+   {
+      free_load(load);
+      return NULL;
+   }
+
+   if (!async_thread_count)
+      async_loader_init(0);
+
+   pthread_mutex_lock(&async_lock);
+   async_pending++;
+
+   if (async_thread_count)
+   {
+      load->status = ASYNC_QUEUED;
+      queue_push(&async_queued[load->priority], load);
+      pthread_cond_signal(&async_work);
+   }
+   else
+   {
+      /* no thread available, load it right away */
+      load->status = ASYNC_LOADING;
+      pthread_mutex_unlock(&async_lock);
+      data = run_load(load);
+      pthread_mutex_lock(&async_lock);
+      finish_load(load, data);
+   }
+
+   pthread_mutex_unlock(&async_lock);
+
+   return load;
+}
+
+
+/* async_loader_init:
+ *  Starts the loader threads, as many as the cpus when threads <= 0.
+ * The async loaders call it on their own if needed. Apart from the
+ * loads running on the loader threads, all of the async functions must
+ * be called from the same thread. Returns TRUE if at least one thread
+ * is running.
+ */
+int async_loader_init(int threads)
+{
+   if (async_thread_count)
+      return TRUE;
+
+   if (threads <= 0)
+      threads = sysconf(_SC_NPROCESSORS_ONLN);
+   threads = CLAMP(1, threads, ASYNC_MAX_THREADS);
+
+   async_quit = FALSE;
+
+   while (async_thread_count < threads)
+   {
+      if (pthread_create(&async_threads[async_thread_count], NULL, async_worker, NULL) != 0)
+         break;
+      async_thread_count++;
+   }
+
+   return (async_thread_count > 0);
+}
+
+
+/* async_loader_exit:
+ *  Cancels the queued loads, waits for the ones being loaded and stops
+ * the loader threads. Loads that were not delivered yet are discarded
+ * without calling their callback and their handles become invalid.
+ */
+void async_loader_exit(void)
+{
+   ASYNC_LOAD *load;
+   int i;
+
+   pthread_mutex_lock(&async_lock);
+
+   async_quit = TRUE;
+   for (i = 0; i < ASYNC_PRIORITIES; i++)
+   {
+      while ((load = queue_pop(&async_queued[i])))
+      {
+         load->cancel = TRUE;
+         finish_load(load, NULL);
+      }
+   }
+
+   pthread_cond_broadcast(&async_work);
+   pthread_mutex_unlock(&async_lock);
+
+   for (i = 0; i < async_thread_count; i++)
+      pthread_join(async_threads[i], NULL);
+
+   async_thread_count = 0;
+   async_quit = FALSE;
+
+   while ((load = queue_pop(&async_finished)))
+   {
+      if (load->data)
+         destroy_result(load);
+      free_load(load);
+   }
+
+   async_pending = 0;
+}
+
+
+/* load_datafile_async:
+ *  Loads a datafile like load_datafile() on a loader thread. The
+ * callback gets the DATAFILE once delivered by async_load_poll().
+ * Returns a handle valid until then, or NULL on error.
+ */
+ASYNC_LOAD *load_datafile_async(const char *filename, int priority,
+                                ASYNC_CALLBACK callback, void *userdata)
+{
+   return queue_load(ASYNC_DATAFILE, filename, NULL, priority, callback, userdata);
+}
+
+
+/* load_datafile_object_async:
+ *  Asynchronous version of load_datafile_object(), see
+ * load_datafile_async().
+ */
+ASYNC_LOAD *load_datafile_object_async(const char *filename, const char *objectname,
+                                       int priority, ASYNC_CALLBACK callback, void *userdata)
+{
+   if (!objectname)
+      return NULL;
+
+   return queue_load(ASYNC_DATAFILE_OBJECT, filename, objectname, priority, callback, userdata);
+}
+
+
+/* mp3_load_async:
+ *  Asynchronous version of mp3_load(), see load_datafile_async().
+ */
+ASYNC_LOAD *mp3_load_async(const char *filename, int priority,
+                           ASYNC_CALLBACK callback, void *userdata)
+{
+   return queue_load(ASYNC_MP3, filename, NULL, priority, callback, userdata);
+}
+
+
+/* vorbis_load_async:
+ *  Asynchronous version of vorbis_load(), see load_datafile_async().
+ */
+ASYNC_LOAD *vorbis_load_async(const char *filename, int priority,
+                              ASYNC_CALLBACK callback, void *userdata)
+{
+   return queue_load(ASYNC_VORBIS, filename, NULL, priority, callback, userdata);
+}
+
+
+/* gme_load_async:
+ *  Asynchronous version of gme_load(), see load_datafile_async().
+ */
+ASYNC_LOAD *gme_load_async(const char *filename, int priority,
+                           ASYNC_CALLBACK callback, void *userdata)
+{
+   return queue_load(ASYNC_GME, filename, NULL, priority, callback, userdata);
+}
+
+
+/* async_load_status:
+ *  Returns the ASYNC_STATUS of a load not delivered yet.
+ */
+int async_load_status(ASYNC_LOAD *load)
+{
+   int status;
+
+   pthread_mutex_lock(&async_lock);
+   status = (load->cancel) ? ASYNC_CANCELLED : load->status;
+   pthread_mutex_unlock(&async_lock);
+
+   return status;
+}
+
+
+/* async_load_cancel:
+ *  Cancels a load not delivered yet. A queued load is dropped, one
+ * being loaded is left to finish and its result is destroyed. Either
+ * way the callback still gets called, with NULL data, by
+ * async_load_poll().
+ */
+void async_load_cancel(ASYNC_LOAD *load)
+{
+   pthread_mutex_lock(&async_lock);
+
+   load->cancel = TRUE;
+   if (load->status == ASYNC_QUEUED)
+   {
+      queue_remove(&async_queued[load->priority], load);
+      finish_load(load, NULL);
+   }
+
+   pthread_mutex_unlock(&async_lock);
+}
+
+
+/* async_load_wait:
+ *  Blocks until a load is finished and delivers it right away. A load
+ * still queued is run on the calling thread instead of waiting for
+ * its turn.
+ */
+void async_load_wait(ASYNC_LOAD *load)
+{
+   void *data;
+
+   pthread_mutex_lock(&async_lock);
+
+   if (load->status == ASYNC_QUEUED)
+   {
+      queue_remove(&async_queued[load->priority], load);
+      load->status = ASYNC_LOADING;
+      pthread_mutex_unlock(&async_lock);
+      data = run_load(load);
+      pthread_mutex_lock(&async_lock);
+      finish_load(load, data);
+   }
+
+   while (load->status == ASYNC_LOADING)
+      pthread_cond_wait(&async_done, &async_lock);
+
+   queue_remove(&async_finished, load);
+   pthread_mutex_unlock(&async_lock);
+
+   deliver_load(load);
+}
+
+
+/* async_load_poll:
+ *  Calls the callbacks of the finished loads, at most max of them if
+ * max > 0, in the order they finished. Callbacks run on the calling
+ * thread and may queue more loads. Returns the number of loads
+ * delivered.
+ */
+int async_load_poll(int max)
+{
+   ASYNC_LOAD *load;
+   int count = 0;
+
+   while ((max <= 0) || (count < max))
+   {
+      pthread_mutex_lock(&async_lock);
+      load = queue_pop(&async_finished);
+      pthread_mutex_unlock(&async_lock);
+
+      if (!load)
+         break;
+
+      deliver_load(load);
+      count++;
+   }
+
+   return count;
+}
+
+
+/* async_load_pending:
+ *  Returns the number of loads queued, being loaded or waiting to be
+ * delivered by async_load_poll().
+ */
+int async_load_pending(void)
+{
+   int pending;
+
+   pthread_mutex_lock(&async_lock);
+   pending = async_pending;
+   pthread_mutex_unlock(&async_lock);
+
+   return pending;
+}
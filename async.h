@@ -0,0 +1,44 @@
+#ifndef ALPORT_ASYNC_H
+#define ALPORT_ASYNC_H
+
+#include "base.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ASYNC_MAX_THREADS  16
+
+enum ASYNC_PRIORITY { ASYNC_PRIORITY_LOW, ASYNC_PRIORITY_NORMAL, ASYNC_PRIORITY_HIGH, ASYNC_PRIORITIES };
+enum ASYNC_STATUS { ASYNC_QUEUED, ASYNC_LOADING, ASYNC_DONE, ASYNC_FAILED, ASYNC_CANCELLED };
+
+typedef struct ASYNC_LOAD ASYNC_LOAD;
+
+/* Called by async_load_poll() or async_load_wait() once a load is over,
+ * data is NULL if it failed or was cancelled */
+typedef void (*ASYNC_CALLBACK)(ASYNC_LOAD *load, void *data, void *userdata);
+
+
+int async_loader_init(int threads);
+void async_loader_exit(void);
+ASYNC_LOAD *load_datafile_async(const char *filename, int priority,
+                                ASYNC_CALLBACK callback, void *userdata);
+ASYNC_LOAD *load_datafile_object_async(const char *filename, const char *objectname,
+                                       int priority, ASYNC_CALLBACK callback, void *userdata);
+ASYNC_LOAD *mp3_load_async(const char *filename, int priority,
+                           ASYNC_CALLBACK callback, void *userdata);
+ASYNC_LOAD *vorbis_load_async(const char *filename, int priority,
+                              ASYNC_CALLBACK callback, void *userdata);
+ASYNC_LOAD *gme_load_async(const char *filename, int priority,
+                           ASYNC_CALLBACK callback, void *userdata);
+int async_load_status(ASYNC_LOAD *load);
+void async_load_cancel(ASYNC_LOAD *load);
+void async_load_wait(ASYNC_LOAD *load);
+int async_load_poll(int max);
+int async_load_pending(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          /* ifndef ALPORT_ASYNC_H */
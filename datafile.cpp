@@ -1,14 +1,27 @@
 #include <string.h>
 #include <strings.h>
 #include <stdlib.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include "alport.h"
 
 
 static void *load_file_object(PACKFILE *f, long size);
+static void destroy_object_data(DATAFILE *dat);
+static void unload_arena_objects(DATAFILE *dat, struct DATAFILE_ARENA *arena);
 void *load_dat_palette(PACKFILE *f, long size);
 void *load_sample_object(PACKFILE *f, long size);
 void unload_sample(SAMPLE *s);
 
+/* chunk header of the last pack_fopen_chunk(), see packfile.cpp */
+extern thread_local int _packfile_filesize;
+extern thread_local int _packfile_type;
+
 
 /* list of objects, and methods for loading and destroying them */
 DATAFILE_TYPE _datafile_type[MAX_DATAFILE_TYPES] =
@@ -30,7 +43,159 @@ DATAFILE_TYPE _datafile_type[MAX_DATAFILE_TYPES] =
 };
 
 
-static void (*datafile_callback)(DATAFILE *) = NULL;
+static thread_local void (*datafile_callback)(DATAFILE *) = NULL;
+
+
+/* hashed index of the full object paths of a loaded datafile */
+typedef struct NAME_INDEX_ENTRY
+{
+   unsigned hash;                      /* hash of the path */
+   long path;                          /* offset of the path in `paths' */
+   DATAFILE *obj;                      /* the object, NULL for a free slot */
+} NAME_INDEX_ENTRY;
+
+typedef struct NAME_INDEX
+{
+   const DATAFILE *dat;                /* the datafile it indexes */
+   struct NAME_INDEX *next;            /* next index in the same bucket */
+   NAME_INDEX_ENTRY *slot;             /* open addressed table */
+   int mask;                           /* table size - 1 */
+   char *paths;                        /* all the paths, '/' separated */
+   long paths_size;
+} NAME_INDEX;
+
+#define NAME_INDEX_BUCKETS    64
+
+static NAME_INDEX *name_indexes[NAME_INDEX_BUCKETS];
+static pthread_mutex_t name_index_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* private property type holding the arena of a datafile */
+#define DAT_ARENA       DAT_ID('a','r','n','a')
+
+/* one block of memory of a DATAFILE_ARENA */
+typedef struct ARENA_BLOCK
+{
+   struct ARENA_BLOCK *next;
+   long size;                          /* bytes of memory after the header */
+   long used;                          /* bytes handed out from it */
+   long pad;                           /* keeps the memory 16 byte aligned */
+} ARENA_BLOCK;
+
+/* memory that all the objects of a load_datafile_arena() come from */
+typedef struct DATAFILE_ARENA
+{
+   ARENA_BLOCK *blocks;                /* the one being filled is first */
+   long next_size;                     /* size of the next block */
+   long used;                          /* bytes handed out */
+   long size;                          /* bytes held in blocks */
+} DATAFILE_ARENA;
+
+#define ARENA_ALIGN(n)        (((n) + 15) & ~15L)
+#define ARENA_HEADER          16       /* holds the size of an allocation */
+#define ARENA_MIN_BLOCK       65536
+#define ARENA_MAX_BLOCK       (64L << 20)
+
+/* the arena being loaded into by this thread, if any */
+static thread_local DATAFILE_ARENA *loading_arena = NULL;
+
+
+/* an object waiting to be decoded by load_datafile_parallel() */
+typedef struct DATAFILE_JOB
+{
+   DATAFILE *obj;
+   const void *data;                   /* its chunk data, NULL if loaded */
+   void *copy;                         /* data, if it had to be read in */
+} DATAFILE_JOB;
+
+typedef struct DATAFILE_POOL
+{
+   pthread_mutex_t lock;
+   DATAFILE_JOB *jobs;                 /* in datafile_callback order */
+   int count;
+   int cap;
+   int next;                           /* next job to be taken by a worker */
+   int failed;
+} DATAFILE_POOL;
+
+#define DATAFILE_MAX_THREADS  16
+
+
+/* private property type holding the lazy loading state of an object */
+#define DAT_LAZY        DAT_ID('l','a','z','y')
+
+/* a datafile loaded by load_datafile_lazy(), kept open for its objects */
+typedef struct LAZY_DATAFILE
+{
+   char *filename;                     /* to reopen it */
+   PACKFILE *f;                        /* open file, or NULL */
+   long pos;                           /* position of f after the magic */
+   pthread_mutex_t lock;
+} LAZY_DATAFILE;
+
+/* an object of it whose data is only loaded on demand */
+typedef struct LAZY_OBJECT
+{
+   LAZY_DATAFILE *file;                /* the datafile it lives in */
+   long offset;                        /* position of its data chunk */
+   long end;                           /* position just past it */
+   int refs;                           /* acquire_datafile_object() count */
+} LAZY_OBJECT;
+
+/* start of the layout of a lazy datafile kept by load_datafile_lazy_indexed() */
+#define LAZY_INDEX_MAGIC      DAT_ID('A','L','L','Z')
+#define LAZY_INDEX_VERSION    1
+
+
+/* private property type holding the mapping of a baked datafile */
+#define DAT_BAKED       DAT_ID('b','a','k','d')
+
+#define BAKED_MAGIC           DAT_ID('A','L','B','K')
+#define BAKED_VERSION         1
+#define BAKED_ORDER           0x01020304  /* reads back swapped on the other byte order */
+#define BAKED_ALIGN(n)        (((n) + 15) & ~15L)
+#define BAKED_PAGE            4096L
+
+/* start of a datafile cache written by save_datafile_cache() */
+typedef struct BAKED_HEADER
+{
+   int32_t magic;
+   int32_t version;
+   int32_t order;                      /* BAKED_ORDER, in the native byte order */
+   int32_t pointer_size;
+   int64_t source_size;                /* stamp of the datafile it was made from */
+   int64_t source_time;
+   int64_t size;                       /* of the whole cache */
+   int64_t root;                       /* offset of the top DATAFILE array */
+   int64_t relocs;                     /* offset of the relocation table */
+   int64_t reloc_count;
+} BAKED_HEADER;
+
+/* one of the two regions of a cache being written */
+typedef struct BAKE_BUFFER
+{
+   unsigned char *data;
+   long size;
+   long cap;
+} BAKE_BUFFER;
+
+/* a pointer of the structures region and where it points to */
+typedef struct BAKE_RELOC
+{
+   long field;                         /* offset of the pointer in the structures */
+   long target;                        /* offset in the region it points to */
+   int bulk;                           /* TRUE if that is the bulk region */
+} BAKE_RELOC;
+
+/* a cache being put together by save_datafile_cache() */
+typedef struct DATAFILE_BAKER
+{
+   BAKE_BUFFER head;                   /* everything holding pointers */
+   BAKE_BUFFER bulk;                   /* object data, never written on load */
+   BAKE_RELOC *reloc;
+   long reloc_count;
+   long reloc_cap;
+} DATAFILE_BAKER;
 
 
 /* register_datafile_object:
@@ -69,6 +234,183 @@ void register_datafile_object(int id, void *(*load)(PACKFILE *f, long size),
 }
 
 
+/* arena_alloc:
+ *  Hands out size bytes from an arena, adding a block to it if needed.
+ *  Big allocations get a block of their own, put behind the one being
+ *  filled so that it can carry on. Returns NULL if out of memory.
+ */
+static void *arena_alloc(DATAFILE_ARENA *arena, size_t size)
+{
+   ARENA_BLOCK *b = arena->blocks;
+   long need = ARENA_HEADER + ARENA_ALIGN((long)size);
+   long bsize;
+   unsigned char *p;
+
+   if ((!b) || (b->used + need > b->size))
+   {
+      bsize = MAX(need, arena->next_size);
+
+      b = (ARENA_BLOCK *)malloc(sizeof(ARENA_BLOCK) + bsize);
+      if (!b)
+         return NULL;
+
+      b->size = bsize;
+      b->used = 0;
+      arena->size += bsize;
+
+      if ((arena->blocks) && (need > arena->next_size / 2))
+      {
+         b->next = arena->blocks->next;
+         arena->blocks->next = b;
+      }
+      else
+      {
+         b->next = arena->blocks;
+         arena->blocks = b;
+         arena->next_size = MIN(arena->next_size * 2, ARENA_MAX_BLOCK);
+      }
+   }
+
+   p = (unsigned char *)(b + 1) + b->used;
+   *(long *)p = size;
+   b->used += need;
+   arena->used += need;
+
+   return p + ARENA_HEADER;
+}
+
+
+/* arena_realloc:
+ *  Resizes an allocation of an arena, in place if it is the last one of
+ *  the block being filled, otherwise by moving it.
+ */
+static void *arena_realloc(DATAFILE_ARENA *arena, void *ptr, size_t size)
+{
+   ARENA_BLOCK *b = arena->blocks;
+   unsigned char *p = (unsigned char *)ptr;
+   long old, grow;
+   void *q;
+
+   if (!p)
+      return arena_alloc(arena, size);
+
+   old = *(long *)(p - ARENA_HEADER);
+   grow = ARENA_ALIGN((long)size) - ARENA_ALIGN(old);
+
+   if ((p + ARENA_ALIGN(old) == (unsigned char *)(b + 1) + b->used) &&
+       (b->used + grow <= b->size))
+   {
+      *(long *)(p - ARENA_HEADER) = size;
+      b->used += grow;
+      arena->used += grow;
+      return p;
+   }
+
+   if ((q = arena_alloc(arena, size)) != NULL)
+      memcpy(q, p, MIN(old, (long)size));
+
+   return q;
+}
+
+
+/* arena_contains:
+ *  Returns non-zero if ptr was handed out by the arena.
+ */
+static int arena_contains(const DATAFILE_ARENA *arena, const void *ptr)
+{
+   const ARENA_BLOCK *b;
+   const unsigned char *p = (const unsigned char *)ptr;
+
+   for (b = arena->blocks; b; b = b->next)
+   {
+      if ((p > (const unsigned char *)(b + 1)) &&
+          (p <= (const unsigned char *)(b + 1) + b->used))
+         return TRUE;
+   }
+
+   return FALSE;
+}
+
+
+/* destroy_arena:
+ *  Frees an arena along with everything that was handed out from it.
+ */
+static void destroy_arena(DATAFILE_ARENA *arena)
+{
+   ARENA_BLOCK *b, *next;
+
+   for (b = arena->blocks; b; b = next)
+   {
+      next = b->next;
+      free(b);
+   }
+
+   free(arena);
+}
+
+
+/* _datafile_malloc:
+ *  Allocates memory for a datafile object that is being loaded. This
+ *  comes from the arena during load_datafile_arena(), and from malloc()
+ *  the rest of the time.
+ */
+void *_datafile_malloc(size_t size)
+{
+   if (loading_arena)
+      return arena_alloc(loading_arena, size);
+
+   return malloc(size);
+}
+
+
+/* _datafile_realloc:
+ *  Resizes memory from _datafile_malloc().
+ */
+void *_datafile_realloc(void *ptr, size_t size)
+{
+   if ((loading_arena) && ((!ptr) || (arena_contains(loading_arena, ptr))))
+      return arena_realloc(loading_arena, ptr, size);
+
+   return realloc(ptr, size);
+}
+
+
+/* _datafile_free:
+ *  Frees memory from _datafile_malloc(). Memory from the arena is only
+ *  given back when the whole datafile is unloaded.
+ */
+void _datafile_free(void *ptr)
+{
+   if ((loading_arena) && (arena_contains(loading_arena, ptr)))
+      return;
+
+   free(ptr);
+}
+
+
+/* _datafile_read_block:
+ *  Like read_block(), but allocates with _datafile_malloc().
+ */
+void *_datafile_read_block(PACKFILE *f, int size)
+{
+   void *p;
+
+   p = _datafile_malloc(size);
+   if (!p)
+      return NULL;
+
+   pack_fread(p, size, f);
+
+   if (pack_ferror(f))
+   {
+      _datafile_free(p);
+      return NULL;
+   }
+
+   return p;
+}
+
+
 /* read_block:
  *  Reads a block of size bytes from a file, allocating memory to store it.
  */
@@ -97,7 +439,26 @@ void *read_block(PACKFILE *f, int size, int alloc_size)
  */
 static void *load_data_object(PACKFILE *f, long size)
 {
-   return read_block(f, size, 0);
+   return _datafile_read_block(f, size);
+}
+
+
+/* decode_object:
+ *  Helper to load the data of an object of the given type from its chunk.
+ */
+static void *decode_object(PACKFILE *f, long size, int type)
+{
+   int i;
+
+   /* look for a load function */
+   for (i = 0; i < MAX_DATAFILE_TYPES; i++)
+   {
+      if (_datafile_type[i].type == type)
+         return _datafile_type[i].load(f, size);
+   }
+
+   /* if not found, load binary data */
+   return load_data_object(f, size);
 }
 
 
@@ -108,29 +469,15 @@ static void *load_data_object(PACKFILE *f, long size)
 static int load_object(DATAFILE *obj, PACKFILE *f, int type)
 {
    PACKFILE *ff;
-   int d, i;
+   int d;
 
    /* load actual data */
    ff = pack_fopen_chunk(f, FALSE);
 
    if (ff)
    {
-      d = ff->normal.todo;
-
-      /* look for a load function */
-      for (i = 0; i < MAX_DATAFILE_TYPES; i++)
-      {
-         if (_datafile_type[i].type == type)
-         {
-            obj->dat = _datafile_type[i].load(ff, d);
-            goto Found;
-         }
-      }
-
-      /* if not found, load binary data */
-      obj->dat = load_data_object(ff, d);
-
-Found:
+      d = ff->normal.todo + ff->normal.buf_size;
+      obj->dat = decode_object(ff, d, type);
       pack_fclose_chunk(ff);
 
       if (!obj->dat)
@@ -141,103 +488,1594 @@ Found:
       return 0;
    }
 
-   return -1;
+   return -1;
+}
+
+
+/* read_property:
+ *  Helper to load a property from a datafile and store it in 'prop',
+ *  adding the number of bytes it took to *pos if pos isn't NULL.
+ *  Returns 0 on success and -1 on failure.
+ */
+static int read_property(DATAFILE_PROPERTY *prop, PACKFILE *f, long *pos)
+{
+   int type, size;
+
+   type = pack_mgetl(f);
+   size = pack_mgetl(f);
+
+   if (pos)
+      *pos += 8 + size;
+
+   prop->type = type;
+   prop->dat = (char *)_datafile_malloc(size + 1); /* '1' for end-of-string delimiter */
+   if (!prop->dat)
+   {
+      pack_fseek(f, size);
+      return -1;
+   }
+
+   /* read the property */
+   pack_fread(prop->dat, size, f);
+   prop->dat[size] = 0;
+
+   return 0;
+}
+
+
+/* _load_property:
+ *  Helper to load a property from a datafile and store it in 'prop'.
+ *  Returns 0 on success and -1 on failure.
+ */
+int _load_property(DATAFILE_PROPERTY *prop, PACKFILE *f)
+{
+   return read_property(prop, f, NULL);
+}
+
+
+/* _add_property:
+ *  Helper to add a new property to a property list. Returns 0 on
+ *  success or -1 on failure.
+ */
+int _add_property(DATAFILE_PROPERTY **list, DATAFILE_PROPERTY *prop)
+{
+   DATAFILE_PROPERTY *iter;
+   int length = 0;
+
+   /* find the length of the list */
+   if (*list)
+   {
+      iter = *list;
+      while (iter->type != DAT_END)
+      {
+         length++;
+         iter++;
+      }
+   }
+
+   /* grow the list */
+   *list = (DATAFILE_PROPERTY *)_datafile_realloc(*list,
+                                                  sizeof(DATAFILE_PROPERTY) * (length + 2));
+   if (!(*list))
+      return -1;
+
+   /* copy the new property */
+   (*list)[length] = *prop;
+
+   /* set end-of-array marker */
+   (*list)[length + 1].type = DAT_END;
+   (*list)[length + 1].dat = NULL;
+
+   return 0;
+}
+
+
+/* _destroy_property_list:
+ *  Helper to destroy a property list.
+ */
+void _destroy_property_list(DATAFILE_PROPERTY *list)
+{
+   int c;
+
+   for (c = 0; list[c].type != DAT_END; c++)
+   {
+      if (list[c].dat)
+         _datafile_free(list[c].dat);
+   }
+
+   _datafile_free(list);
+}
+
+
+/* load_file_object:
+ *  Loads a datafile object.
+ */
+static void *load_file_object(PACKFILE *f, long size)
+{
+   DATAFILE *dat;
+   DATAFILE_PROPERTY prop, *list;
+   int count, c, type, failed;
+
+   (void)size;
+
+   count = pack_mgetl(f);
+
+   dat = (DATAFILE *)_datafile_malloc(sizeof(DATAFILE) * (count + 1));
+   if (!dat)
+      return NULL;
+
+   list = NULL;
+   failed = FALSE;
+
+   /* search the packfile for properties or objects */
+   for (c = 0; c < count;)
+   {
+      type = pack_mgetl(f);
+
+      if (type == DAT_PROPERTY)
+      {
+         if ((_load_property(&prop, f) != 0) || (_add_property(&list, &prop) != 0))
+         {
+            failed = TRUE;
+            break;
+         }
+      }
+      else
+      {
+         if (load_object(&dat[c], f, type) != 0)
+         {
+            failed = TRUE;
+            break;
+         }
+
+         /* attach the property list to the object */
+         dat[c].prop = list;
+         list = NULL;
+
+         if (datafile_callback)
+            datafile_callback(dat + c);
+
+         c++;
+      }
+   }
+
+   /* set end-of-array marker */
+   dat[c].type = DAT_END;
+   dat[c].dat = NULL;
+   dat[c].size = 0;
+   dat[c].prop = NULL;
+
+   /* destroy the property list if not assigned to an object */
+   if (list)
+      _destroy_property_list(list);
+
+   /* gracefully handle failure */
+   if (failed)
+   {
+      unload_datafile(dat);
+      dat = NULL;
+   }
+
+   return dat;
+}
+
+
+/* is_name_separator:
+ *  Returns non-zero if c splits up object paths.
+ */
+static inline int is_name_separator(int c)
+{
+   return ((c == '#') || (c == '/') || (c == OTHER_PATH_SEPARATOR));
+}
+
+
+/* name_index_hash:
+ *  Case insensitive FNV-1a hash of the first len characters of an object
+ *  path, hashing all the path separators alike.
+ */
+static unsigned name_index_hash(const char *path, int len)
+{
+   unsigned hash = 2166136261u;
+   int i, c;
+
+   for (i = 0; i < len; i++)
+   {
+      c = (unsigned char)path[i];
+      c = is_name_separator(c) ? '/' : tolower(c);
+      hash = (hash ^ c) * 16777619u;
+   }
+
+   return hash;
+}
+
+
+/* name_index_match:
+ *  Returns non-zero if the indexed path key is the same as the first len
+ *  characters of path, ignoring case and which separators are used.
+ */
+static int name_index_match(const char *key, const char *path, int len)
+{
+   int i, c;
+
+   for (i = 0; i < len; i++)
+   {
+      c = (unsigned char)path[i];
+      c = is_name_separator(c) ? '/' : tolower(c);
+      if (tolower((unsigned char)key[i]) != c)
+         return FALSE;
+   }
+
+   return (key[len] == 0);
+}
+
+
+/* name_index_find:
+ *  Looks up the first len characters of path in a name index.
+ */
+static DATAFILE *name_index_find(const NAME_INDEX *index, const char *path, int len)
+{
+   unsigned hash = name_index_hash(path, len);
+   int i = hash & index->mask;
+
+   while (index->slot[i].obj)
+   {
+      if ((index->slot[i].hash == hash) &&
+          (name_index_match(index->paths + index->slot[i].path, path, len)))
+         return index->slot[i].obj;
+
+      i = (i + 1) & index->mask;
+   }
+
+   return NULL;
+}
+
+
+/* usable_name:
+ *  Returns the name of an object if it can be looked up by path.
+ */
+static const char *usable_name(const DATAFILE *dat)
+{
+   const char *name = get_datafile_property(dat, DAT_NAME);
+   int i;
+
+   if ((!name) || (!name[0]))
+      return NULL;
+
+   for (i = 0; name[i]; i++)
+   {
+      if (is_name_separator(name[i]))
+         return NULL;
+   }
+
+   return name;
+}
+
+
+/* count_names:
+ *  Counts the named objects of a datafile and its nested datafiles, and
+ *  the room their paths will take.
+ */
+static void count_names(const DATAFILE *dat, int prefix_len, int *count, long *size)
+{
+   const char *name;
+   int pos, len;
+
+   for (pos = 0; dat[pos].type != DAT_END; pos++)
+   {
+      if ((name = usable_name(dat + pos)) == NULL)
+         continue;
+
+      len = prefix_len + (prefix_len ? 1 : 0) + strlen(name);
+      (*count)++;
+      *size += len + 1;
+
+      if ((dat[pos].type == DAT_FILE) && (dat[pos].dat))
+         count_names((const DATAFILE *)dat[pos].dat, len, count, size);
+   }
+}
+
+
+/* add_names:
+ *  Adds the objects of a datafile to a name index, under the path prefix.
+ *  Earlier objects shadow later ones with the same path, and a nested
+ *  datafile is only entered if its own path leads to it, the same as a
+ *  search one level at a time would do.
+ */
+static void add_names(NAME_INDEX *index, DATAFILE *dat, const char *prefix, int prefix_len)
+{
+   const char *name;
+   char *path;
+   int pos, len, i;
+
+   for (pos = 0; dat[pos].type != DAT_END; pos++)
+   {
+      if ((name = usable_name(dat + pos)) == NULL)
+         continue;
+
+      path = index->paths + index->paths_size;
+      memcpy(path, prefix, prefix_len);
+      len = prefix_len;
+      if (prefix_len)
+         path[len++] = '/';
+      strcpy(path + len, name);
+      len += strlen(name);
+
+      i = name_index_hash(path, len) & index->mask;
+      while (index->slot[i].obj)
+         i = (i + 1) & index->mask;
+
+      index->slot[i].hash = name_index_hash(path, len);
+      index->slot[i].path = index->paths_size;
+      index->slot[i].obj = dat + pos;
+      index->paths_size += len + 1;
+
+      if ((dat[pos].type == DAT_FILE) && (dat[pos].dat) &&
+          (name_index_find(index, path, len) == dat + pos))
+         add_names(index, (DATAFILE *)dat[pos].dat, path, len);
+   }
+}
+
+
+/* create_name_index:
+ *  Builds the name index of a freshly loaded datafile, which lets
+ *  find_datafile_object() look up full object paths in one go. The
+ *  index is optional: lookups fall back to searching the datafile when
+ *  it can't be built.
+ */
+static void create_name_index(DATAFILE *dat)
+{
+   NAME_INDEX *index;
+   long size = 0;
+   int count = 0, slots, b;
+
+   count_names(dat, 0, &count, &size);
+
+   for (slots = 16; slots < count * 2; slots <<= 1)
+      ;
+
+   index = (NAME_INDEX *)malloc(sizeof(NAME_INDEX));
+   if (!index)
+      return;
+
+   index->slot = (NAME_INDEX_ENTRY *)calloc(slots, sizeof(NAME_INDEX_ENTRY));
+   index->paths = (char *)malloc(MAX(size, 1));
+   if ((!index->slot) || (!index->paths))
+   {
+      free(index->slot);
+      free(index->paths);
+      free(index);
+      return;
+   }
+
+   index->dat = dat;
+   index->mask = slots - 1;
+   index->paths_size = 0;
+   add_names(index, dat, "", 0);
+
+   b = ((uintptr_t)dat >> 4) % NAME_INDEX_BUCKETS;
+   pthread_mutex_lock(&name_index_lock);
+   index->next = name_indexes[b];
+   name_indexes[b] = index;
+   pthread_mutex_unlock(&name_index_lock);
+}
+
+
+/* find_name_index:
+ *  Returns the name index of a datafile, or NULL if it has none. With
+ *  remove set, the index is also taken off the list.
+ */
+static NAME_INDEX *find_name_index(const DATAFILE *dat, int remove)
+{
+   NAME_INDEX **p, *index;
+
+   pthread_mutex_lock(&name_index_lock);
+
+   p = &name_indexes[((uintptr_t)dat >> 4) % NAME_INDEX_BUCKETS];
+   while ((*p) && ((*p)->dat != dat))
+      p = &(*p)->next;
+
+   index = *p;
+   if ((index) && (remove))
+      *p = index->next;
+
+   pthread_mutex_unlock(&name_index_lock);
+   return index;
+}
+
+
+/* advise_whole_file:
+ *  Tells the kernel that all of the file f is read from is about to be
+ *  read, so it can read ahead the mapping instead of faulting it in a
+ *  page at a time. Does nothing if the file isn't mapped.
+ */
+static void advise_whole_file(PACKFILE *f)
+{
+   while ((f) && (!(f->normal.flags & PACKFILE_FLAG_MAPPED)))
+      f = f->normal.parent;
+
+   if (f)
+      madvise(f->normal.buf, f->normal.buf_cap, MADV_WILLNEED);
+}
+
+
+/* open_datafile:
+ *  Opens a data file and reads its header, returning NULL if it isn't one.
+ *  whole is TRUE if all of it is going to be loaded.
+ */
+static PACKFILE *open_datafile(const char *filename, int whole)
+{
+   PACKFILE *f;
+   int type;
+
+   f = pack_fopen(filename, F_READ_PACKED);
+   if (!f)
+      return NULL;
+
+   if (whole)
+      advise_whole_file(f);
+
+   if ((f->normal.flags & PACKFILE_FLAG_CHUNK)
+         && (!(f->normal.flags & PACKFILE_FLAG_EXEDAT)))
+      type = (_packfile_type == DAT_FILE) ? DAT_MAGIC : 0;
+   else
+      type = pack_mgetl(f);
+
+   if (type != DAT_MAGIC)
+   {
+      pack_fclose(f);
+      return NULL;
+   }
+
+   return f;
+}
+
+
+/* load_datafile:
+ *  Loads an entire data file into memory, and returns a pointer to it.
+ *  On error, sets errno and returns NULL.
+ */
+DATAFILE *load_datafile(const char *filename)
+{
+   return load_datafile_callback(filename, NULL);
+}
+
+
+/* load_datafile_callback:
+ *  Loads an entire data file into memory, and returns a pointer to it.
+ *  On error, sets errno and returns NULL.
+ */
+DATAFILE *load_datafile_callback(const char *filename,
+                                 void (*callback)(DATAFILE *))
+{
+   PACKFILE *f;
+   DATAFILE *dat;
+
+   f = open_datafile(filename, TRUE);
+   if (!f)
+      return NULL;
+
+   datafile_callback = callback;
+   dat = (DATAFILE *)load_file_object(f, 0);
+   datafile_callback = NULL;
+
+   if (dat)
+      create_name_index(dat);
+
+   pack_fclose(f);
+   return dat;
+}
+
+
+/* load_datafile_arena:
+ *  Loads an entire data file into memory like load_datafile() does, but
+ *  takes the memory for all its objects from a few big blocks, which
+ *  unload_datafile() frees in one go. Objects of custom types get their
+ *  memory from wherever their loader takes it.
+ *  On error, sets errno and returns NULL.
+ */
+DATAFILE *load_datafile_arena(const char *filename)
+{
+   DATAFILE_ARENA *arena;
+   DATAFILE_PROPERTY prop, *list = NULL;
+   PACKFILE *f;
+   DATAFILE *dat;
+   int count;
+
+   arena = (DATAFILE_ARENA *)malloc(sizeof(DATAFILE_ARENA));
+   if (!arena)
+      return NULL;
+
+   /* the first block is sized for an uncompressed file */
+   arena->blocks = NULL;
+   arena->next_size = CLAMP(ARENA_MIN_BLOCK, (long)file_size(filename), ARENA_MAX_BLOCK);
+   arena->used = 0;
+   arena->size = 0;
+
+   f = open_datafile(filename, TRUE);
+   if (!f)
+   {
+      destroy_arena(arena);
+      return NULL;
+   }
+
+   loading_arena = arena;
+   dat = (DATAFILE *)load_file_object(f, 0);
+   loading_arena = NULL;
+
+   pack_fclose(f);
+
+   prop.type = DAT_ARENA;
+   prop.dat = (char *)arena;
+
+   if ((!dat) || (_add_property(&list, &prop) != 0))
+   {
+      /* the objects of custom types are on their own */
+      if (dat)
+         unload_arena_objects(dat, arena);
+      destroy_arena(arena);
+      return NULL;
+   }
+
+   /* the end-of-array marker holds on to the arena */
+   for (count = 0; dat[count].type != DAT_END; count++)
+      ;
+   dat[count].prop = list;
+
+   create_name_index(dat);
+   return dat;
+}
+
+
+/* datafile_arena_usage:
+ *  Reports how much memory a datafile from load_datafile_arena() uses:
+ *  used is what was handed out to its objects, size what is held in
+ *  blocks, which is also its peak since the arena never shrinks. Either
+ *  pointer may be NULL. Returns FALSE if the datafile has no arena.
+ */
+int datafile_arena_usage(const DATAFILE *dat, long *used, long *size)
+{
+   const DATAFILE_ARENA *arena;
+   int i;
+
+   for (i = 0; dat[i].type != DAT_END; i++)
+      ;
+
+   if ((!dat[i].prop) || (dat[i].prop->type != DAT_ARENA))
+      return FALSE;
+
+   arena = (const DATAFILE_ARENA *)dat[i].prop->dat;
+
+   if (used)
+      *used = arena->used;
+   if (size)
+      *size = arena->size;
+
+   return TRUE;
+}
+
+
+/* bake_alloc:
+ *  Adds size zeroed bytes, 16 byte aligned, to a region of the cache being
+ *  written. Returns their offset in the region, or -1 on error.
+ */
+static long bake_alloc(BAKE_BUFFER *buf, long size)
+{
+   unsigned char *data;
+   long pos = BAKED_ALIGN(buf->size);
+   long cap;
+
+   if (pos + size > buf->cap)
+   {
+      cap = MAX(pos + size, MAX(65536L, buf->cap * 2));
+      data = (unsigned char *)realloc(buf->data, cap);
+      if (!data)
+         return -1;
+
+      buf->data = data;
+      buf->cap = cap;
+   }
+
+   memset(buf->data + buf->size, 0, pos + size - buf->size);
+   buf->size = pos + size;
+
+   return pos;
+}
+
+
+/* bake_copy:
+ *  Adds a copy of size bytes of src to a region of the cache being written.
+ *  Returns its offset in the region, or -1 on error.
+ */
+static long bake_copy(BAKE_BUFFER *buf, const void *src, long size)
+{
+   long pos = bake_alloc(buf, size);
+
+   if ((pos >= 0) && (size > 0))
+      memcpy(buf->data + pos, src, size);
+
+   return pos;
+}
+
+
+/* bake_pointer:
+ *  Records that the pointer at offset field of the structures points to
+ *  offset target of the structures or of the bulk data. A negative target
+ *  is the error of the bake_alloc() that made it. Returns FALSE on error.
+ */
+static int bake_pointer(DATAFILE_BAKER *baker, long field, long target, int bulk)
+{
+   BAKE_RELOC *reloc;
+   long cap;
+
+   if (target < 0)
+      return FALSE;
+
+   if (baker->reloc_count == baker->reloc_cap)
+   {
+      cap = MAX(1024L, baker->reloc_cap * 2);
+      reloc = (BAKE_RELOC *)realloc(baker->reloc, sizeof(BAKE_RELOC) * cap);
+      if (!reloc)
+         return FALSE;
+
+      baker->reloc = reloc;
+      baker->reloc_cap = cap;
+   }
+
+   reloc = baker->reloc + baker->reloc_count++;
+   reloc->field = field;
+   reloc->target = target;
+   reloc->bulk = bulk;
+
+   return TRUE;
+}
+
+
+/* baked_midi_size:
+ *  Works out the size of a MIDI as rebuilt by read_midi(), from its
+ *  header and the header of each of its tracks.
+ */
+static long baked_midi_size(const unsigned char *midi)
+{
+   long size = 14;
+   int tracks = (midi[10] << 8) | midi[11];
+
+   while (tracks-- > 0)
+   {
+      size += 8 + (((long)midi[size + 4] << 24) | (midi[size + 5] << 16) |
+                   (midi[size + 6] << 8) | midi[size + 7]);
+   }
+
+   return size;
+}
+
+
+/* bake_sample:
+ *  Adds a SAMPLE to the cache being written, pointed to by field.
+ */
+static int bake_sample(DATAFILE_BAKER *baker, long field, const SAMPLE *s)
+{
+   long size = s->len * ((s->bits == 8) ? 1 : sizeof(short)) * ((s->stereo) ? 2 : 1);
+   long pos = bake_copy(&baker->head, s, sizeof(SAMPLE));
+
+   if (!bake_pointer(baker, field, pos, FALSE))
+      return FALSE;
+
+   return bake_pointer(baker, pos + offsetof(SAMPLE, data),
+                       bake_copy(&baker->bulk, s->data, size), TRUE);
+}
+
+
+/* bake_font:
+ *  Adds a FONT to the cache being written, pointed to by field.
+ */
+static int bake_font(DATAFILE_BAKER *baker, long field, const FONT *f)
+{
+   const FONT_GLYPH *gl;
+   long pos, glyphs, size;
+   int i;
+
+   pos = bake_copy(&baker->head, f, sizeof(FONT));
+   if (!bake_pointer(baker, field, pos, FALSE))
+      return FALSE;
+
+   glyphs = bake_copy(&baker->head, f->glyph, sizeof(FONT_GLYPH) * f->total_glyphs);
+   if (!bake_pointer(baker, pos + offsetof(FONT, glyph), glyphs, FALSE))
+      return FALSE;
+
+   for (i = 0; i < f->total_glyphs; i++)
+   {
+      gl = f->glyph + i;
+      size = ((gl->width + 7) / 8) * gl->height;
+
+      if (!bake_pointer(baker, glyphs + sizeof(FONT_GLYPH) * i + offsetof(FONT_GLYPH, data),
+                        bake_copy(&baker->bulk, gl->data, size), TRUE))
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+static long bake_datafile(DATAFILE_BAKER *baker, const DATAFILE *dat);
+
+
+/* bake_object:
+ *  Adds the data of an object to the cache being written, pointed to by
+ *  field. Objects of custom types and lazy objects not loaded can't be
+ *  baked: returns FALSE for those too.
+ */
+static int bake_object(DATAFILE_BAKER *baker, long field, const DATAFILE *obj)
+{
+   void *(*load)(PACKFILE *f, long size) = NULL;
+   int i;
+
+   if (!obj->dat)
+      return FALSE;
+
+   for (i = 0; i < MAX_DATAFILE_TYPES; i++)
+   {
+      if (_datafile_type[i].type == obj->type)
+         load = _datafile_type[i].load;
+   }
+
+   if (!load)
+      return bake_pointer(baker, field, bake_copy(&baker->bulk, obj->dat, obj->size), TRUE);
+   else if (load == load_file_object)
+      return bake_pointer(baker, field, bake_datafile(baker, (DATAFILE *)obj->dat), FALSE);
+   else if (load == load_sample_object)
+      return bake_sample(baker, field, (SAMPLE *)obj->dat);
+   else if (load == load_dat_font)
+      return bake_font(baker, field, (FONT *)obj->dat);
+   else if (load == load_dat_palette)
+      return bake_pointer(baker, field, bake_copy(&baker->bulk, obj->dat, sizeof(PALETTE)), TRUE);
+   else if (load == load_midi_object)
+      return bake_pointer(baker, field,
+                          bake_copy(&baker->bulk, obj->dat,
+                                    baked_midi_size((unsigned char *)obj->dat)), TRUE);
+
+   return FALSE;
+}
+
+
+/* bake_properties:
+ *  Adds the property list of an object to the cache being written, pointed
+ *  to by field, leaving out the private properties of this file.
+ */
+static int bake_properties(DATAFILE_BAKER *baker, long field, const DATAFILE_PROPERTY *prop)
+{
+   DATAFILE_PROPERTY *p;
+   long pos, entry;
+   int count = 0;
+   int i;
+
+   for (i = 0; (prop) && (prop[i].type != DAT_END); i++)
+   {
+      if ((prop[i].type != DAT_LAZY) && (prop[i].type != DAT_ARENA) &&
+          (prop[i].type != DAT_BAKED))
+         count++;
+   }
+
+   if (!count)
+      return TRUE;
+
+   pos = bake_alloc(&baker->head, sizeof(DATAFILE_PROPERTY) * (count + 1));
+   if (!bake_pointer(baker, field, pos, FALSE))
+      return FALSE;
+
+   entry = pos;
+   for (i = 0; prop[i].type != DAT_END; i++)
+   {
+      if ((prop[i].type == DAT_LAZY) || (prop[i].type == DAT_ARENA) ||
+          (prop[i].type == DAT_BAKED))
+         continue;
+
+      p = (DATAFILE_PROPERTY *)(baker->head.data + entry);
+      p->type = prop[i].type;
+
+      /* names are looked at on load, keep them out of the bulk data */
+      if (!bake_pointer(baker, entry + offsetof(DATAFILE_PROPERTY, dat),
+                        bake_copy(&baker->head, prop[i].dat, strlen(prop[i].dat) + 1), FALSE))
+         return FALSE;
+
+      entry += sizeof(DATAFILE_PROPERTY);
+   }
+
+   p = (DATAFILE_PROPERTY *)(baker->head.data + entry);
+   p->type = DAT_END;
+
+   return TRUE;
+}
+
+
+/* bake_datafile:
+ *  Adds a datafile and all of its objects to the cache being written.
+ *  Returns the offset of its DATAFILE array in the structures, or -1 on
+ *  error.
+ */
+static long bake_datafile(DATAFILE_BAKER *baker, const DATAFILE *dat)
+{
+   DATAFILE *obj;
+   long pos, entry;
+   int count, i;
+
+   for (count = 0; dat[count].type != DAT_END; count++)
+      ;
+
+   pos = bake_alloc(&baker->head, sizeof(DATAFILE) * (count + 1));
+   if (pos < 0)
+      return -1;
+
+   for (i = 0; i < count; i++)
+   {
+      /* the buffer moves as it grows, so only hold on to offsets */
+      entry = pos + sizeof(DATAFILE) * i;
+      obj = (DATAFILE *)(baker->head.data + entry);
+      obj->type = dat[i].type;
+      obj->size = dat[i].size;
+
+      if ((!bake_object(baker, entry + offsetof(DATAFILE, dat), dat + i)) ||
+          (!bake_properties(baker, entry + offsetof(DATAFILE, prop), dat[i].prop)))
+         return -1;
+   }
+
+   obj = (DATAFILE *)(baker->head.data + pos + sizeof(DATAFILE) * count);
+   obj->type = DAT_END;
+
+   return pos;
+}
+
+
+/* write_padded:
+ *  Writes size bytes of data to f followed by zeros up to offset end.
+ *  Returns FALSE on error.
+ */
+static int write_padded(PACKFILE *f, const void *data, long size, long pos, long end)
+{
+   if ((size > 0) && (pack_fwrite(data, size, f) < size))
+      return FALSE;
+
+   for (pos += size; pos < end; pos++)
+   {
+      if (pack_putc(0, f) == EOF)
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/* save_datafile_cache:
+ *  Writes a loaded datafile out as a cache that load_datafile_cache() can
+ *  map back in place: native byte order, the objects already converted,
+ *  pointers stored as offsets along with a table of where they are. The
+ *  structures holding pointers come first, the object data after them on
+ *  pages of its own. The cache is stamped with the size and time of the
+ *  source datafile, if given. Datafiles with objects of custom types can't
+ *  be cached. Returns FALSE on error.
+ */
+int save_datafile_cache(const DATAFILE *dat, const char *cachename, const char *source)
+{
+   DATAFILE_BAKER baker;
+   BAKED_HEADER header;
+   PACKFILE *f;
+   struct stat st;
+   int64_t *reloc = NULL;
+   uintptr_t ptr;
+   long head, relocs, bulk, i;
+   int ret = FALSE;
+
+   memset(&baker, 0, sizeof(DATAFILE_BAKER));
+   memset(&header, 0, sizeof(BAKED_HEADER));
+
+   header.root = bake_datafile(&baker, dat);
+   if (header.root < 0)
+      goto Error;
+
+   head = BAKED_ALIGN((long)sizeof(BAKED_HEADER));
+   relocs = head + BAKED_ALIGN(baker.head.size);
+   bulk = (relocs + (long)sizeof(int64_t) * baker.reloc_count + BAKED_PAGE - 1) & ~(BAKED_PAGE - 1);
+
+   reloc = (int64_t *)malloc(sizeof(int64_t) * MAX(baker.reloc_count, 1L));
+   if (!reloc)
+      goto Error;
+
+   /* pointers are stored as offsets from the start of the cache */
+   for (i = 0; i < baker.reloc_count; i++)
+   {
+      ptr = ((baker.reloc[i].bulk) ? bulk : head) + baker.reloc[i].target;
+      *(uintptr_t *)(baker.head.data + baker.reloc[i].field) = ptr;
+      reloc[i] = head + baker.reloc[i].field;
+   }
+
+   header.magic = BAKED_MAGIC;
+   header.version = BAKED_VERSION;
+   header.order = BAKED_ORDER;
+   header.pointer_size = sizeof(void *);
+   header.size = bulk + baker.bulk.size;
+   header.root += head;
+   header.relocs = relocs;
+   header.reloc_count = baker.reloc_count;
+
+   if ((source) && (stat(source, &st) == 0))
+   {
+      header.source_size = st.st_size;
+      header.source_time = st.st_mtime;
+   }
+
+   f = pack_fopen(cachename, F_WRITE);
+   if (!f)
+      goto Error;
+
+   ret = write_padded(f, &header, sizeof(BAKED_HEADER), 0, head) &&
+         write_padded(f, baker.head.data, baker.head.size, head, relocs) &&
+         write_padded(f, reloc, sizeof(int64_t) * baker.reloc_count, relocs, bulk) &&
+         write_padded(f, baker.bulk.data, baker.bulk.size, bulk, bulk);
+
+   pack_fclose(f);
+
+   if (!ret)
+      delete_file(cachename);
+
+Error:
+   free(reloc);
+   free(baker.reloc);
+   free(baker.head.data);
+   free(baker.bulk.data);
+
+   return ret;
+}
+
+
+/* baked_header_valid:
+ *  Checks that a cache was made on this kind of machine, that it is whole,
+ *  and that the source datafile hasn't changed since, if it is there.
+ */
+static int baked_header_valid(const BAKED_HEADER *header, long size, const char *source)
+{
+   struct stat st;
+
+   if ((header->magic != BAKED_MAGIC) || (header->version != BAKED_VERSION) ||
+       (header->order != BAKED_ORDER) || (header->pointer_size != sizeof(void *)))
+      return FALSE;
+
+   if ((header->size != size) || (header->root < (int64_t)sizeof(BAKED_HEADER)) ||
+       (header->root + (int64_t)sizeof(DATAFILE) > header->relocs) ||
+       (header->reloc_count < 0) ||
+       (header->relocs + (int64_t)sizeof(int64_t) * header->reloc_count > size))
+      return FALSE;
+
+   if ((source) && (stat(source, &st) == 0) &&
+       ((header->source_size != st.st_size) || (header->source_time != st.st_mtime)))
+      return FALSE;
+
+   return TRUE;
+}
+
+
+/* load_datafile_cache:
+ *  Maps a cache written by save_datafile_cache() and fixes up its pointers
+ *  in place. Only the pages holding pointers get copied, the object data
+ *  is read straight from the page cache when first used. Returns NULL if
+ *  the cache is missing, broken, made on another kind of machine or older
+ *  than the source datafile, when that is given and exists.
+ */
+DATAFILE *load_datafile_cache(const char *cachename, const char *source)
+{
+   DATAFILE_PROPERTY prop, *list = NULL;
+   BAKED_HEADER *header;
+   DATAFILE *dat;
+   struct stat st;
+   unsigned char *base;
+   int64_t *reloc;
+   int64_t i;
+   int fd, count;
+
+   fd = open(cachename, O_RDONLY);
+   if (fd < 0)
+      return NULL;
+
+   if ((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(BAKED_HEADER)))
+   {
+      close(fd);
+      return NULL;
+   }
+
+   base = (unsigned char *)mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+   close(fd);
+
+   if (base == MAP_FAILED)
+      return NULL;
+
+   header = (BAKED_HEADER *)base;
+   if (!baked_header_valid(header, st.st_size, source))
+      goto Error;
+
+   reloc = (int64_t *)(base + header->relocs);
+   for (i = 0; i < header->reloc_count; i++)
+   {
+      if ((reloc[i] < (int64_t)sizeof(BAKED_HEADER)) ||
+          (reloc[i] + (int64_t)sizeof(uintptr_t) > header->relocs) ||
+          (*(uintptr_t *)(base + reloc[i]) >= (uintptr_t)header->size))
+         goto Error;
+
+      *(uintptr_t *)(base + reloc[i]) += (uintptr_t)base;
+   }
+
+   prop.type = DAT_BAKED;
+   prop.dat = (char *)base;
+
+   if (_add_property(&list, &prop) != 0)
+      goto Error;
+
+   /* the end-of-array marker holds on to the mapping */
+   dat = (DATAFILE *)(base + header->root);
+   for (count = 0; dat[count].type != DAT_END; count++)
+      ;
+   dat[count].prop = list;
+
+   create_name_index(dat);
+   return dat;
+
+Error:
+   munmap(base, st.st_size);
+   return NULL;
+}
+
+
+/* load_datafile_baked:
+ *  Loads a datafile from its cache if it is up to date, otherwise loads
+ *  it with load_datafile() and writes the cache for the next time. The
+ *  cache name defaults to the datafile name with a "bkd" extension.
+ *  On error, returns NULL.
+ */
+DATAFILE *load_datafile_baked(const char *filename, const char *cachename)
+{
+   char buf[1024];
+   DATAFILE *dat;
+
+   if (!cachename)
+      cachename = replace_extension(buf, filename, "bkd");
+
+   dat = load_datafile_cache(cachename, filename);
+   if (dat)
+      return dat;
+
+   dat = load_datafile(filename);
+   if (dat)
+      save_datafile_cache(dat, cachename, filename);
+
+   return dat;
+}
+
+
+/* add_datafile_job:
+ *  Queues an object for load_datafile_parallel(). Returns FALSE if out
+ *  of memory.
+ */
+static int add_datafile_job(DATAFILE_POOL *pool, DATAFILE *obj, const void *data, void *copy)
+{
+   DATAFILE_JOB *jobs;
+
+   if (pool->count == pool->cap)
+   {
+      jobs = (DATAFILE_JOB *)realloc(pool->jobs, sizeof(DATAFILE_JOB) * MAX(64, pool->cap * 2));
+      if (!jobs)
+         return FALSE;
+
+      pool->jobs = jobs;
+      pool->cap = MAX(64, pool->cap * 2);
+   }
+
+   pool->jobs[pool->count].obj = obj;
+   pool->jobs[pool->count].data = data;
+   pool->jobs[pool->count].copy = copy;
+   pool->count++;
+   return TRUE;
+}
+
+
+/* scan_file_object:
+ *  Reads the layout of a datafile like load_file_object() does, but only
+ *  gets the raw data of the objects and queues them to be decoded, in the
+ *  order load_file_object() would have loaded them. Nested datafiles are
+ *  scanned the same way.
+ */
+static DATAFILE *scan_file_object(PACKFILE *f, DATAFILE_POOL *pool)
+{
+   DATAFILE *dat;
+   DATAFILE_PROPERTY prop, *list;
+   PACKFILE *ff;
+   const void *data;
+   void *copy;
+   int count, c, type, d, failed;
+
+   count = pack_mgetl(f);
+
+   dat = (DATAFILE *)malloc(sizeof(DATAFILE) * (count + 1));
+   if (!dat)
+      return NULL;
+
+   list = NULL;
+   failed = FALSE;
+
+   for (c = 0; c < count;)
+   {
+      type = pack_mgetl(f);
+
+      if (type == DAT_PROPERTY)
+      {
+         if ((_load_property(&prop, f) != 0) || (_add_property(&list, &prop) != 0))
+         {
+            failed = TRUE;
+            break;
+         }
+         continue;
+      }
+
+      ff = pack_fopen_chunk(f, FALSE);
+      if (!ff)
+      {
+         failed = TRUE;
+         break;
+      }
+
+      d = ff->normal.todo + ff->normal.buf_size;
+      dat[c].type = type;
+      dat[c].size = d;
+      dat[c].dat = NULL;
+      dat[c].prop = list;
+      list = NULL;
+      data = copy = NULL;
+
+      if (type == DAT_FILE)
+      {
+         dat[c].dat = scan_file_object(ff, pool);
+         failed = (!dat[c].dat);
+      }
+      else if ((data = pack_fview(d, ff)) == NULL)
+      {
+         /* not mapped, so it has to be read in */
+         data = copy = read_block(ff, d, 1);
+         failed = (!copy);
+      }
+
+      pack_fclose_chunk(ff);
+      c++;
+
+      if ((failed) || (!add_datafile_job(pool, dat + c - 1, data, copy)))
+      {
+         free(copy);
+         failed = TRUE;
+         break;
+      }
+   }
+
+   /* set end-of-array marker */
+   dat[c].type = DAT_END;
+   dat[c].dat = NULL;
+   dat[c].size = 0;
+   dat[c].prop = NULL;
+
+   if (list)
+      _destroy_property_list(list);
+
+   if (failed)
+   {
+      unload_datafile(dat);
+      dat = NULL;
+   }
+
+   return dat;
+}
+
+
+/* datafile_worker:
+ *  Decodes queued objects until there are none left.
+ */
+static void *datafile_worker(void *arg)
+{
+   DATAFILE_POOL *pool = (DATAFILE_POOL *)arg;
+   DATAFILE_JOB *job;
+   PACKFILE *f;
+   int n;
+
+   for (;;)
+   {
+      pthread_mutex_lock(&pool->lock);
+      n = pool->next++;
+      pthread_mutex_unlock(&pool->lock);
+
+      if (n >= pool->count)
+         break;
+
+      job = pool->jobs + n;
+      if (!job->data)
+         continue;
+
+      if ((f = pack_fopen_memory(job->data, job->obj->size)) != NULL)
+      {
+         job->obj->dat = decode_object(f, job->obj->size, job->obj->type);
+         pack_fclose(f);
+      }
+
+      free(job->copy);
+      job->copy = NULL;
+
+      if (!job->obj->dat)
+      {
+         pthread_mutex_lock(&pool->lock);
+         pool->failed = TRUE;
+         pthread_mutex_unlock(&pool->lock);
+      }
+   }
+
+   return NULL;
+}
+
+
+/* load_datafile_parallel:
+ *  Loads an entire data file into memory like load_datafile() does, but
+ *  decodes the objects on up to threads threads, counting the calling one
+ *  (0 for one per CPU). The file is read in one go first, so the loaders
+ *  of any custom object types must be safe to run in parallel.
+ *  On error, sets errno and returns NULL.
+ */
+DATAFILE *load_datafile_parallel(const char *filename, int threads)
+{
+   return load_datafile_parallel_callback(filename, NULL, threads);
+}
+
+
+/* load_datafile_parallel_callback:
+ *  Like load_datafile_parallel(), calling callback for every object in
+ *  the same order as load_datafile_callback() does. The calls are made
+ *  from the calling thread once all the objects are decoded.
+ */
+DATAFILE *load_datafile_parallel_callback(const char *filename,
+                                          void (*callback)(DATAFILE *), int threads)
+{
+   pthread_t tid[DATAFILE_MAX_THREADS];
+   DATAFILE_POOL pool;
+   PACKFILE *f;
+   DATAFILE *dat;
+   int i, started;
+
+   f = open_datafile(filename, TRUE);
+   if (!f)
+      return NULL;
+
+   pool.jobs = NULL;
+   pool.count = 0;
+   pool.cap = 0;
+   pool.next = 0;
+   pool.failed = FALSE;
+   pthread_mutex_init(&pool.lock, NULL);
+
+   dat = scan_file_object(f, &pool);
+
+   if (dat)
+   {
+      if (threads <= 0)
+         threads = sysconf(_SC_NPROCESSORS_ONLN);
+      threads = CLAMP(1, threads, MIN(pool.count, DATAFILE_MAX_THREADS));
+
+      for (started = 0; started < threads - 1; started++)
+      {
+         if (pthread_create(&tid[started], NULL, datafile_worker, &pool) != 0)
+            break;
+      }
+
+      datafile_worker(&pool);
+
+      for (i = 0; i < started; i++)
+         pthread_join(tid[i], NULL);
+
+      if (pool.failed)
+      {
+         unload_datafile(dat);
+         dat = NULL;
+      }
+   }
+   else
+   {
+      /* free whatever was read in before it failed */
+      for (i = 0; i < pool.count; i++)
+         free(pool.jobs[i].copy);
+   }
+
+   /* mapped data was used in place, so only close the file now */
+   pack_fclose(f);
+
+   if (dat)
+   {
+      if (callback)
+      {
+         for (i = 0; i < pool.count; i++)
+            callback(pool.jobs[i].obj);
+      }
+
+      create_name_index(dat);
+   }
+
+   pthread_mutex_destroy(&pool.lock);
+   free(pool.jobs);
+   return dat;
+}
+
+
+/* load_lazy_file:
+ *  Reads the objects and properties of a datafile, but not the object
+ *  data, which is skipped and left to acquire_datafile_object(). Nested
+ *  datafiles are read the same way so that all the object paths are
+ *  known, or loaded right away if they are compressed. pos follows the
+ *  position in the file.
+ */
+static DATAFILE *load_lazy_file(LAZY_DATAFILE *file, PACKFILE *f, long *pos)
+{
+   DATAFILE *dat;
+   DATAFILE_PROPERTY prop, *list;
+   LAZY_OBJECT *lazy;
+   PACKFILE *ff;
+   long end;
+   int count, c, type, filesize, datasize, failed;
+
+   count = pack_mgetl(f);
+   *pos += 4;
+
+   dat = (DATAFILE *)malloc(sizeof(DATAFILE) * (count + 1));
+   if (!dat)
+      return NULL;
+
+   list = NULL;
+   failed = FALSE;
+
+   for (c = 0; c < count;)
+   {
+      type = pack_mgetl(f);
+      *pos += 4;
+
+      if (type == DAT_PROPERTY)
+      {
+         if ((read_property(&prop, f, pos) != 0) || (_add_property(&list, &prop) != 0))
+         {
+            failed = TRUE;
+            break;
+         }
+         continue;
+      }
+
+      dat[c].type = type;
+      dat[c].dat = NULL;
+
+      if (type == DAT_FILE)
+      {
+         ff = pack_fopen_chunk(f, FALSE);
+         if (!ff)
+         {
+            failed = TRUE;
+            break;
+         }
+
+         dat[c].size = ff->normal.todo + ff->normal.buf_size;
+         end = *pos + 8 + _packfile_filesize;
+         *pos += 8;
+
+         /* a compressed one can't be seeked into later, so load it now */
+         if (ff->normal.flags & PACKFILE_FLAG_PACK)
+            dat[c].dat = load_file_object(ff, 0);
+         else
+            dat[c].dat = load_lazy_file(file, ff, pos);
+
+         if (!dat[c].dat)
+            failed = TRUE;
+
+         pack_fclose_chunk(ff);
+      }
+      else
+      {
+         /* the chunk header, see pack_fopen_chunk() */
+         filesize = pack_mgetl(f);
+         datasize = pack_mgetl(f);
+         end = *pos + 8 + filesize;
+         dat[c].size = ABS(datasize);
+
+         lazy = (LAZY_OBJECT *)malloc(sizeof(LAZY_OBJECT));
+         prop.type = DAT_LAZY;
+         prop.dat = (char *)lazy;
+
+         if ((!lazy) || (_add_property(&list, &prop) != 0))
+         {
+            free(lazy);
+            failed = TRUE;
+         }
+         else
+         {
+            lazy->file = file;
+            lazy->offset = *pos;
+            lazy->end = end;
+            lazy->refs = 0;
+         }
+
+         pack_fseek(f, filesize);
+      }
+
+      *pos = end;
+      dat[c].prop = list;
+      list = NULL;
+      c++;
+
+      if ((failed) || (pack_ferror(f)))
+      {
+         failed = TRUE;
+         break;
+      }
+   }
+
+   /* set end-of-array marker */
+   dat[c].type = DAT_END;
+   dat[c].dat = NULL;
+   dat[c].size = 0;
+   dat[c].prop = NULL;
+
+   if (list)
+      _destroy_property_list(list);
+
+   if (failed)
+   {
+      unload_datafile(dat);
+      dat = NULL;
+   }
+
+   return dat;
+}
+
+
+/* lazy_object:
+ *  Returns the lazy loading state of an object, or NULL if it has none.
+ */
+static LAZY_OBJECT *lazy_object(const DATAFILE *dat)
+{
+   DATAFILE_PROPERTY *prop;
+
+   if ((prop = dat->prop) != NULL)
+   {
+      for (; prop->type != DAT_END; prop++)
+      {
+         if (prop->type == DAT_LAZY)
+            return (LAZY_OBJECT *)prop->dat;
+      }
+   }
+
+   return NULL;
 }
 
 
-/* _load_property:
- *  Helper to load a property from a datafile and store it in 'prop'.
- *  Returns 0 on success and -1 on failure.
+/* put_stamp:
+ *  Writes a 64 bit value of a lazy index stamp.
  */
-int _load_property(DATAFILE_PROPERTY *prop, PACKFILE *f)
+static void put_stamp(int64_t value, PACKFILE *f)
 {
-   int type, size;
-
-   type = pack_mgetl(f);
-   size = pack_mgetl(f);
+   pack_mputl((long)(value >> 32), f);
+   pack_mputl((long)(value & 0xFFFFFFFF), f);
+}
 
-   prop->type = type;
-   prop->dat = (char *)malloc(size + 1); /* '1' for end-of-string delimiter */
-   if (!prop->dat)
-   {
-      pack_fseek(f, size);
-      return -1;
-   }
 
-   /* read the property */
-   pack_fread(prop->dat, size, f);
-   prop->dat[size] = 0;
+/* get_stamp:
+ *  Reads a 64 bit value written by put_stamp().
+ */
+static int64_t get_stamp(PACKFILE *f)
+{
+   int64_t high = pack_mgetl(f);
+   int64_t low = pack_mgetl(f) & 0xFFFFFFFF;
 
-   return 0;
+   return (high << 32) | low;
 }
 
 
-/* _add_property:
- *  Helper to add a new property to a property list. Returns 0 on
- *  success or -1 on failure.
+/* write_lazy_layout:
+ *  Writes the objects and properties of a datafile from load_lazy_file()
+ *  to its index, with the offsets of the object data instead of the data.
+ *  Returns FALSE if some of it was loaded with a compressed nested
+ *  datafile, as that has no offsets to reuse.
  */
-int _add_property(DATAFILE_PROPERTY **list, DATAFILE_PROPERTY *prop)
+static int write_lazy_layout(const DATAFILE *dat, PACKFILE *f)
 {
-   DATAFILE_PROPERTY *iter;
-   int length = 0;
+   DATAFILE_PROPERTY *prop;
+   LAZY_OBJECT *lazy;
+   int count, c, size;
 
-   /* find the length of the list */
-   if (*list)
+   for (count = 0; dat[count].type != DAT_END; count++)
+      ;
+
+   pack_mputl(count, f);
+
+   for (c = 0; c < count; c++)
    {
-      iter = *list;
-      while (iter->type != DAT_END)
+      for (prop = dat[c].prop; (prop) && (prop->type != DAT_END); prop++)
       {
-         length++;
-         iter++;
+         if (prop->type == DAT_LAZY)
+            continue;
+
+         size = strlen(prop->dat);
+         pack_mputl(DAT_PROPERTY, f);
+         pack_mputl(prop->type, f);
+         pack_mputl(size, f);
+         pack_fwrite(prop->dat, size, f);
       }
-   }
 
-   /* grow the list */
-   *list = (DATAFILE_PROPERTY *)realloc(*list,
-                                        sizeof(DATAFILE_PROPERTY) * (length + 2));
-   if (!(*list))
-      return -1;
+      pack_mputl(dat[c].type, f);
+      pack_mputl(dat[c].size, f);
 
-   /* copy the new property */
-   (*list)[length] = *prop;
+      if (dat[c].type == DAT_FILE)
+      {
+         if (!write_lazy_layout((DATAFILE *)dat[c].dat, f))
+            return FALSE;
+      }
+      else
+      {
+         if ((lazy = lazy_object(dat + c)) == NULL)
+            return FALSE;
 
-   /* set end-of-array marker */
-   (*list)[length + 1].type = DAT_END;
-   (*list)[length + 1].dat = NULL;
+         pack_mputl(lazy->offset, f);
+         pack_mputl(lazy->end, f);
+      }
+   }
 
-   return 0;
+   return !pack_ferror(f);
 }
 
 
-/* _destroy_property_list:
- *  Helper to destroy a property list.
+/* save_lazy_index:
+ *  Writes the layout of a datafile from load_lazy_file() to indexname,
+ *  stamped with the size and time of the datafile. Returns FALSE on error.
  */
-void _destroy_property_list(DATAFILE_PROPERTY *list)
+static int save_lazy_index(const DATAFILE *dat, const char *indexname, const char *source)
 {
-   int c;
+   PACKFILE *f;
+   struct stat st;
+   int ret;
 
-   for (c = 0; list[c].type != DAT_END; c++)
-   {
-      if (list[c].dat)
-         free(list[c].dat);
-   }
+   if (stat(source, &st) != 0)
+      return FALSE;
 
-   free(list);
+   f = pack_fopen(indexname, F_WRITE);
+   if (!f)
+      return FALSE;
+
+   pack_mputl(LAZY_INDEX_MAGIC, f);
+   pack_mputl(LAZY_INDEX_VERSION, f);
+   put_stamp(st.st_size, f);
+   put_stamp(st.st_mtime, f);
+
+   ret = write_lazy_layout(dat, f);
+
+   /* a second magic at the end tells a whole index from a cut off one */
+   pack_mputl(LAZY_INDEX_MAGIC, f);
+   ret = (ret) && (!pack_ferror(f));
+
+   pack_fclose(f);
+
+   if (!ret)
+      delete_file(indexname);
+
+   return ret;
 }
 
 
-/* load_file_object:
- *  Loads a datafile object.
+/* read_lazy_layout:
+ *  Reads back what write_lazy_layout() wrote, giving the objects the same
+ *  lazy loading state load_lazy_file() would have.
  */
-static void *load_file_object(PACKFILE *f, long size)
+static DATAFILE *read_lazy_layout(LAZY_DATAFILE *file, PACKFILE *f)
 {
    DATAFILE *dat;
    DATAFILE_PROPERTY prop, *list;
+   LAZY_OBJECT *lazy;
    int count, c, type, failed;
 
-   (void)size;
-
    count = pack_mgetl(f);
+   if ((count < 0) || (pack_ferror(f)))
+      return NULL;
 
    dat = (DATAFILE *)malloc(sizeof(DATAFILE) * (count + 1));
    if (!dat)
@@ -246,7 +2084,6 @@ static void *load_file_object(PACKFILE *f, long size)
    list = NULL;
    failed = FALSE;
 
-   /* search the packfile for properties or objects */
    for (c = 0; c < count;)
    {
       type = pack_mgetl(f);
@@ -258,35 +2095,67 @@ static void *load_file_object(PACKFILE *f, long size)
             failed = TRUE;
             break;
          }
+         continue;
+      }
+
+      /* what pack_mgetl() returns at the end of a cut off index */
+      if (type == DAT_END)
+      {
+         failed = TRUE;
+         break;
+      }
+
+      dat[c].type = type;
+      dat[c].size = pack_mgetl(f);
+      dat[c].dat = NULL;
+
+      if (type == DAT_FILE)
+      {
+         dat[c].dat = read_lazy_layout(file, f);
+         failed = (!dat[c].dat);
       }
       else
       {
-         if (load_object(&dat[c], f, type) != 0)
+         lazy = (LAZY_OBJECT *)malloc(sizeof(LAZY_OBJECT));
+         prop.type = DAT_LAZY;
+         prop.dat = (char *)lazy;
+
+         if ((!lazy) || (_add_property(&list, &prop) != 0))
          {
+            free(lazy);
             failed = TRUE;
-            break;
          }
+         else
+         {
+            lazy->file = file;
+            lazy->offset = pack_mgetl(f);
+            lazy->end = pack_mgetl(f);
+            lazy->refs = 0;
 
-         /* attach the property list to the object */
-         dat[c].prop = list;
-         list = NULL;
+            failed = ((lazy->offset < 0) || (lazy->end < lazy->offset));
+         }
+      }
 
-         if (datafile_callback)
-            datafile_callback(dat + c);
+      dat[c].prop = list;
+      list = NULL;
+      c++;
 
-         c++;
+      if ((failed) || (pack_ferror(f)))
+      {
+         failed = TRUE;
+         break;
       }
    }
 
    /* set end-of-array marker */
    dat[c].type = DAT_END;
    dat[c].dat = NULL;
+   dat[c].size = 0;
+   dat[c].prop = NULL;
 
-   /* destroy the property list if not assigned to an object */
    if (list)
       _destroy_property_list(list);
 
-   /* gracefully handle failure */
    if (failed)
    {
       unload_datafile(dat);
@@ -297,48 +2166,206 @@ static void *load_file_object(PACKFILE *f, long size)
 }
 
 
-/* load_datafile:
- *  Loads an entire data file into memory, and returns a pointer to it.
- *  On error, sets errno and returns NULL.
+/* read_lazy_index:
+ *  Reads the layout of a lazy datafile from indexname. Returns NULL if the
+ *  index is missing, broken, or doesn't match the datafile any longer.
  */
-DATAFILE *load_datafile(const char *filename)
+static DATAFILE *read_lazy_index(LAZY_DATAFILE *file, const char *indexname)
 {
-   return load_datafile_callback(filename, NULL);
+   PACKFILE *f;
+   DATAFILE *dat = NULL;
+   struct stat st;
+
+   if (stat(file->filename, &st) != 0)
+      return NULL;
+
+   f = pack_fopen(indexname, F_READ);
+   if (!f)
+      return NULL;
+
+   if ((pack_mgetl(f) == LAZY_INDEX_MAGIC) && (pack_mgetl(f) == LAZY_INDEX_VERSION) &&
+       (get_stamp(f) == (int64_t)st.st_size) && (get_stamp(f) == (int64_t)st.st_mtime))
+   {
+      dat = read_lazy_layout(file, f);
+
+      if ((dat) && (pack_mgetl(f) != LAZY_INDEX_MAGIC))
+      {
+         unload_datafile(dat);
+         dat = NULL;
+      }
+   }
+
+   pack_fclose(f);
+   return dat;
 }
 
 
-/* load_datafile_callback:
- *  Loads an entire data file into memory, and returns a pointer to it.
- *  On error, sets errno and returns NULL.
+/* open_lazy_datafile:
+ *  Does the work of load_datafile_lazy() and load_datafile_lazy_indexed(),
+ *  taking the layout from indexname if it is given and up to date, and
+ *  writing it there otherwise.
  */
-DATAFILE *load_datafile_callback(const char *filename,
-                                 void (*callback)(DATAFILE *))
+static DATAFILE *open_lazy_datafile(const char *filename, const char *indexname)
 {
-   PACKFILE *f;
-   DATAFILE *dat;
-   int type;
+   LAZY_DATAFILE *file;
+   DATAFILE_PROPERTY prop, *list = NULL;
+   DATAFILE *dat = NULL;
+   int count;
 
-   f = pack_fopen(filename, F_READ_PACKED);
-   if (!f)
+   file = (LAZY_DATAFILE *)malloc(sizeof(LAZY_DATAFILE));
+   if (!file)
       return NULL;
 
-   if ((f->normal.flags & PACKFILE_FLAG_CHUNK)
-         && (!(f->normal.flags & PACKFILE_FLAG_EXEDAT)))
-      type = (_packfile_type == DAT_FILE) ? DAT_MAGIC : 0;
-   else
-      type = pack_mgetl(f);
+   file->filename = strdup(filename);
+   file->f = NULL;
+   file->pos = 0;
+   pthread_mutex_init(&file->lock, NULL);
 
-   if (type == DAT_MAGIC)
+   prop.type = DAT_LAZY;
+   prop.dat = (char *)file;
+
+   if ((!file->filename) || (_add_property(&list, &prop) != 0))
+      goto Error;
+
+   /* with an index the file is only opened once an object is needed */
+   if (indexname)
+      dat = read_lazy_index(file, indexname);
+
+   if (!dat)
    {
-      datafile_callback = callback;
-      dat = (DATAFILE *)load_file_object(f, 0);
-      datafile_callback = NULL;
+      file->f = open_datafile(filename, FALSE);
+      if (!file->f)
+         goto Error;
+
+      dat = load_lazy_file(file, file->f, &file->pos);
+      if (!dat)
+         goto Error;
+
+      if (indexname)
+         save_lazy_index(dat, indexname, filename);
    }
-   else
-      dat = NULL;
 
-   pack_fclose(f);
+   /* the end-of-array marker holds on to the file */
+   for (count = 0; dat[count].type != DAT_END; count++)
+      ;
+   dat[count].prop = list;
+
+   create_name_index(dat);
    return dat;
+
+Error:
+   if (file->f)
+      pack_fclose(file->f);
+   pthread_mutex_destroy(&file->lock);
+   free(file->filename);
+   free(file);
+   free(list);
+   return NULL;
+}
+
+
+/* load_datafile_lazy:
+ *  Reads the layout of a data file, keeping it open, and returns a
+ *  pointer to it like load_datafile() does. The objects have no data
+ *  until acquire_datafile_object() is called on them, which loads it.
+ *  This is best suited to uncompressed or block packed datafiles, where
+ *  getting to an object doesn't mean unpacking everything before it.
+ *  On error, sets errno and returns NULL.
+ */
+DATAFILE *load_datafile_lazy(const char *filename)
+{
+   return open_lazy_datafile(filename, NULL);
+}
+
+
+/* load_datafile_lazy_indexed:
+ *  Like load_datafile_lazy(), but keeps the layout it reads in an index
+ *  file, so the next time the datafile isn't read at all until an object
+ *  is acquired. The index is rewritten when the datafile has changed
+ *  size or time. The index name defaults to the datafile name with an
+ *  "lzi" extension. Datafiles with compressed nested datafiles in them
+ *  can't be indexed and are read every time.
+ *  On error, returns NULL.
+ */
+DATAFILE *load_datafile_lazy_indexed(const char *filename, const char *indexname)
+{
+   char buf[1024];
+
+   if (!indexname)
+      indexname = replace_extension(buf, filename, "lzi");
+
+   return open_lazy_datafile(filename, indexname);
+}
+
+
+/* acquire_datafile_object:
+ *  Returns the data of an object of a datafile from load_datafile_lazy(),
+ *  loading it if no one is using it yet, or NULL if it can't be loaded.
+ *  Each successful call must be matched by release_datafile_object().
+ *  Objects of other datafiles just have their data returned.
+ */
+void *acquire_datafile_object(DATAFILE *dat)
+{
+   LAZY_OBJECT *lazy = lazy_object(dat);
+   LAZY_DATAFILE *file;
+
+   if (!lazy)
+      return dat->dat;
+
+   file = lazy->file;
+   pthread_mutex_lock(&file->lock);
+
+   if (!dat->dat)
+   {
+      /* files are only read forward, so going back means reopening */
+      if ((file->f) && (lazy->offset < file->pos))
+      {
+         pack_fclose(file->f);
+         file->f = NULL;
+      }
+
+      if (!file->f)
+      {
+         file->f = open_datafile(file->filename, FALSE);
+         file->pos = 0;
+      }
+
+      if ((file->f) && (pack_fseek(file->f, lazy->offset - file->pos) == 0) &&
+          (load_object(dat, file->f, dat->type) == 0))
+         file->pos = lazy->end;
+      else if (file->f)
+      {
+         /* don't know where we are anymore */
+         pack_fclose(file->f);
+         file->f = NULL;
+      }
+   }
+
+   if (dat->dat)
+      lazy->refs++;
+
+   pthread_mutex_unlock(&file->lock);
+   return dat->dat;
+}
+
+
+/* release_datafile_object:
+ *  Gives up an object returned by acquire_datafile_object(), unloading
+ *  its data when no one is using it any longer.
+ */
+void release_datafile_object(DATAFILE *dat)
+{
+   LAZY_OBJECT *lazy = lazy_object(dat);
+
+   if (!lazy)
+      return;
+
+   pthread_mutex_lock(&lazy->file->lock);
+
+   if ((lazy->refs > 0) && (--lazy->refs == 0))
+      destroy_object_data(dat);
+
+   pthread_mutex_unlock(&lazy->file->lock);
 }
 
 
@@ -437,7 +2464,7 @@ DATAFILE *load_datafile_object(const char *filename, const char *objectname)
    DATAFILE *dat;
    DATAFILE_PROPERTY prop, *list;
    char parent[1024], child[1024];
-   char *bufptr, *prevptr, *separator;
+   char *bufptr, *separator;
    int count, c, type, size, found;
 
    /* concatenate to filename#objectname */
@@ -450,14 +2477,14 @@ DATAFILE *load_datafile_object(const char *filename, const char *objectname)
 
 
    /* split into path and actual objectname (for nested files) */
-   prevptr = bufptr = parent;
+   bufptr = parent;
    separator = NULL;
    while ((c = *bufptr) != 0)
    {
       if ((c == '#') || (c == '/') || (c == OTHER_PATH_SEPARATOR))
-         separator = prevptr;
+         separator = bufptr;
 
-      prevptr = bufptr++;
+      bufptr++;
    }
 
    strcpy(child, separator + 1);
@@ -600,36 +2627,64 @@ DATAFILE *load_datafile_object_indexed(const DATAFILE_INDEX *index, int item)
 }
 
 
-/* _unload_datafile_object:
- *  Helper to destroy a datafile object.
+/* destroy_object_data:
+ *  Helper to destroy the data of a datafile object.
  */
-void _unload_datafile_object(DATAFILE *dat)
+static void destroy_object_data(DATAFILE *dat)
 {
    int i;
 
-   /* destroy the property list */
-   if (dat->prop)
-      _destroy_property_list(dat->prop);
+   if (!dat->dat)
+      return;
 
    /* look for a destructor function */
    for (i = 0; i < MAX_DATAFILE_TYPES; i++)
    {
       if (_datafile_type[i].type == dat->type)
       {
-         if (dat->dat)
-         {
-            if (_datafile_type[i].destroy)
-               _datafile_type[i].destroy(dat->dat);
-            else
-               free(dat->dat);
-         }
+         if (_datafile_type[i].destroy)
+            _datafile_type[i].destroy(dat->dat);
+         else
+            free(dat->dat);
+         dat->dat = NULL;
          return;
       }
    }
 
    /* if not found, just free the data */
-   if (dat->dat)
-      free(dat->dat);
+   free(dat->dat);
+   dat->dat = NULL;
+}
+
+
+/* _unload_datafile_object:
+ *  Helper to destroy a datafile object.
+ */
+void _unload_datafile_object(DATAFILE *dat)
+{
+   /* destroy the property list */
+   if (dat->prop)
+      _destroy_property_list(dat->prop);
+
+   destroy_object_data(dat);
+}
+
+
+/* unload_arena_objects:
+ *  Destroys the objects of an arena datafile that a custom loader
+ *  allocated outside the arena. The rest goes with the arena.
+ */
+static void unload_arena_objects(DATAFILE *dat, DATAFILE_ARENA *arena)
+{
+   int i;
+
+   for (i = 0; dat[i].type != DAT_END; i++)
+   {
+      if (!arena_contains(arena, dat[i].dat))
+         destroy_object_data(dat + i);
+      else if (dat[i].type == DAT_FILE)
+         unload_arena_objects((DATAFILE *)dat[i].dat, arena);
+   }
 }
 
 
@@ -638,13 +2693,66 @@ void _unload_datafile_object(DATAFILE *dat)
  */
 void unload_datafile(DATAFILE *dat)
 {
+   DATAFILE_ARENA *arena = NULL;
+   BAKED_HEADER *header;
+   LAZY_DATAFILE *file;
+   NAME_INDEX *index;
    int i;
 
    if (dat)
    {
+      if ((index = find_name_index(dat, TRUE)) != NULL)
+      {
+         free(index->slot);
+         free(index->paths);
+         free(index);
+      }
+
+      for (i = 0; dat[i].type != DAT_END; i++)
+         ;
+
+      /* the end-of-array marker knows how the datafile was loaded */
+      if ((loading_arena) && (arena_contains(loading_arena, dat)))
+         arena = loading_arena;
+      else if ((dat[i].prop) && (dat[i].prop->type == DAT_ARENA))
+         arena = (DATAFILE_ARENA *)dat[i].prop->dat;
+
+      if (arena)
+      {
+         unload_arena_objects(dat, arena);
+
+         if (arena != loading_arena)
+         {
+            /* the end-of-array marker goes with the arena */
+            free(dat[i].prop);
+            destroy_arena(arena);
+         }
+         return;
+      }
+
+      /* a baked datafile is a single mapping of its cache */
+      if ((dat[i].prop) && (dat[i].prop->type == DAT_BAKED))
+      {
+         header = (BAKED_HEADER *)dat[i].prop->dat;
+         free(dat[i].prop);
+         munmap(header, header->size);
+         return;
+      }
+
       for (i = 0; dat[i].type != DAT_END; i++)
          _unload_datafile_object(dat + i);
 
+      /* close the file of a lazy datafile */
+      if ((dat[i].prop) && (dat[i].prop->type == DAT_LAZY))
+      {
+         file = (LAZY_DATAFILE *)dat[i].prop->dat;
+         if (file->f)
+            pack_fclose(file->f);
+         pthread_mutex_destroy(&file->lock);
+         free(file->filename);
+         _destroy_property_list(dat[i].prop);
+      }
+
       free(dat);
    }
 }
@@ -682,34 +2790,33 @@ void unload_datafile_object(DATAFILE *dat)
  */
 DATAFILE *find_datafile_object(const DATAFILE *dat, const char *objectname)
 {
-   char name[512];
-   int recurse = FALSE;
-   int pos, c;
+   const NAME_INDEX *index;
+   const char *name;
+   int pos, len;
 
-   /* split up the object name */
-   pos = 0;
+   /* loaded datafiles know all their paths */
+   if ((index = find_name_index(dat, FALSE)) != NULL)
+      return name_index_find(index, objectname, strlen(objectname));
 
-   while ((c = objectname[pos]) != 0)
+   /* split up the object name */
+   for (len = 0; objectname[len]; len++)
    {
-      if ((c == '#') || (c == '/') || (c == OTHER_PATH_SEPARATOR))
-      {
-         recurse = TRUE;
+      if (is_name_separator(objectname[len]))
          break;
-      }
-      name[pos++] = c;
    }
 
-   name[pos] = 0;
-
    /* search for the requested object */
    for (pos = 0; dat[pos].type != DAT_END; pos++)
    {
-      if (strcasecmp(name, get_datafile_property(dat + pos, DAT_NAME)) == 0)
+      name = get_datafile_property(dat + pos, DAT_NAME);
+
+      if ((name) && (strncasecmp(name, objectname, len) == 0) && (name[len] == 0))
       {
-         if (recurse)
+         if (objectname[len])
          {
             if (dat[pos].type == DAT_FILE)
-               return find_datafile_object((const DATAFILE *)dat[pos].dat, objectname);
+               return find_datafile_object((const DATAFILE *)dat[pos].dat,
+                                           objectname + len + 1);
             else
                return NULL;
          }
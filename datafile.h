@@ -52,20 +52,34 @@ typedef struct DATAFILE_INDEX
 } DATAFILE_INDEX;
 
 
-extern int _packfile_type;
-
-
 DATAFILE *load_datafile(const char *filename);
 DATAFILE *load_datafile_callback(const char *filename,
                                  void (*callback)(DATAFILE *));
+DATAFILE *load_datafile_parallel(const char *filename, int threads);
+DATAFILE *load_datafile_parallel_callback(const char *filename,
+                                          void (*callback)(DATAFILE *), int threads);
+DATAFILE *load_datafile_lazy(const char *filename);
+DATAFILE *load_datafile_lazy_indexed(const char *filename, const char *indexname);
+DATAFILE *load_datafile_arena(const char *filename);
+int datafile_arena_usage(const DATAFILE *dat, long *used, long *size);
+DATAFILE *load_datafile_baked(const char *filename, const char *cachename);
+DATAFILE *load_datafile_cache(const char *cachename, const char *source);
+int save_datafile_cache(const DATAFILE *dat, const char *cachename, const char *source);
 DATAFILE_INDEX *create_datafile_index(const char *filename);
 void unload_datafile(DATAFILE *dat);
 void destroy_datafile_index(DATAFILE_INDEX *index);
 void *read_block(PACKFILE *f, int size, int alloc_size);
 
+void *_datafile_malloc(size_t size);
+void *_datafile_realloc(void *ptr, size_t size);
+void _datafile_free(void *ptr);
+void *_datafile_read_block(PACKFILE *f, int size);
+
 DATAFILE *load_datafile_object(const char *filename, const char *objectname);
 DATAFILE *load_datafile_object_indexed(const DATAFILE_INDEX *index, int item);
 void unload_datafile_object(DATAFILE *dat);
+void *acquire_datafile_object(DATAFILE *dat);
+void release_datafile_object(DATAFILE *dat);
 
 DATAFILE *find_datafile_object(const DATAFILE *dat, const char *objectname);
 const char *get_datafile_property(const DATAFILE *dat, int type);
@@ -35,7 +35,7 @@ static FONT *read_font(PACKFILE *pack)
    if (temp != 1 && temp != 255)
       return NULL;
 
-   f = (FONT *)malloc(sizeof(FONT));
+   f = (FONT *)_datafile_malloc(sizeof(FONT));
    if (!f)
       return NULL;
 
@@ -44,10 +44,10 @@ static FONT *read_font(PACKFILE *pack)
    f->total_glyphs = f->last - f->first;
    f->height = 0; /* initial value */
 
-   gl = (FONT_GLYPH *)malloc(sizeof(FONT_GLYPH) * f->total_glyphs);
+   gl = (FONT_GLYPH *)_datafile_malloc(sizeof(FONT_GLYPH) * f->total_glyphs);
    if (!gl)
    {
-      free(f);
+      _datafile_free(f);
       return NULL;
    }
 
@@ -58,17 +58,17 @@ static FONT *read_font(PACKFILE *pack)
       /* calculate glyph size */
       temp = ((gl[i].width + 7) / 8) * gl[i].height;
       
-      gl[i].data = (unsigned char *)malloc(temp);
+      gl[i].data = (unsigned char *)_datafile_malloc(temp);
       if (!gl[i].data)
       {
          while (i >= 0)
          {
             if (gl[i].data)
-               free(gl[i].data);
+               _datafile_free(gl[i].data);
             i--;
          }
-         free(gl);
-         free(f);
+         _datafile_free(gl);
+         _datafile_free(f);
          return NULL;
       }
 
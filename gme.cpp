@@ -1,4 +1,6 @@
 #include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "alport.h"
 #include "gme/Gbs_Emu.h"
 #include "gme/Nsf_Emu.h"
@@ -6,6 +8,19 @@
 
 #define GME_BIT_DEPTH   16
 #define GME_CHANNELS     2
+#define GME_MAX_THREADS 64
+
+#define GME_SILENCE_LEVEL    8     /* max sample magnitude taken as silence */
+#define GME_IDLE_PROBE_MSEC  250   /* how often an idle GME is really rendered */
+
+typedef struct GME_WORKER_POOL
+{
+   pthread_mutex_t lock;
+   GME_RENDER_JOB *jobs;
+   int count;
+   int next;            /* next job to be taken by a worker */
+   int rendered;        /* # of jobs rendered successfully */
+} GME_WORKER_POOL;
 
 extern void *stream;
 extern unsigned char stream_type;
@@ -15,18 +30,79 @@ extern int stream_voice;
 extern int stream_playing;
 extern int (*stream_audio_render)(short *buf, unsigned int render_size);
 
+static int _track = 0;              /* track being streamed */
+static int _silence_msec = 0;       /* silence that makes the stream idle, 0 = off */
+static int _silence_action = GME_SILENCE_SKIP;
+static long _silent_frames = 0;     /* consecutive silent frames rendered */
+static long _idle_frames = 0;       /* frames fast-forwarded since last probe */
+
+
+/* Data_Reader over a PACKFILE, so emulators read file data
+ * straight into their own storage */
+class Packfile_Reader : public Data_Reader
+{
+   PACKFILE *f;
+   long left;
+
+public:
+   Packfile_Reader(PACKFILE *f, long size) : f(f), left(size) { }
+
+   long read_avail(void *buf, long n)
+   {
+      n = pack_fread(buf, MIN(n, left), f);
+      if (n > 0)
+         left -= n;
+      return n;
+   }
+
+   long remain() const { return left; }
+};
+
+
+/* create_emu:
+ *  Creates the Music_Emu emulator for the GME_TYPE type, set up
+ * to play at the mixer sample rate. Returns NULL on error.
+ */
+static Music_Emu *create_emu(GME_TYPE type)
+{
+   int _rate;
+   Music_Emu *gme = NULL;
+
+   if      (type == GME_TYPE::GME_NSF)
+      gme = new Nsf_Emu;
+   else if (type == GME_TYPE::GME_GBS)
+      gme = new Gbs_Emu;
+   else if (type == GME_TYPE::GME_SPC)
+      gme = new Spc_Emu;
+   else
+      return NULL;
+
+   /* Use the mixer sample rate to generate the GME output 
+    * except for the SNES which native output is 32000 */
+   _rate = (type == GME_TYPE::GME_SPC) ? 32000 : mixer_get_frequency();
+
+   /* Set the rate at which to play the GME */
+   if (_rate <= 0 || gme->set_sample_rate(_rate))
+   {
+      delete gme;
+      return NULL;
+   }
+
+   return gme;
+}
+
 
 /* gme_load:
  *  Load GME file from path location using Allegro's packfile 
  * routines. It returns a pointer to a GME object 
  * that can be used by the GME playing routines.
+ * The file data is read straight into the emulator.
  */
 GME *gme_load(const char* filename)
 {
    PACKFILE *f = NULL;
    long size = 0;
    char *ext = NULL;
-   void *buf = NULL;
    GME_TYPE type = GME_TYPE::GME_NONE;
    Music_Emu *gme = NULL;
 
@@ -34,17 +110,6 @@ GME *gme_load(const char* filename)
    if (size <= 0)
       return NULL;
 
-   f = pack_fopen(filename, F_READ);
-   if (!f)
-      return NULL;
-
-   buf = malloc(size);
-   if (!buf)
-      goto _RETURN;
-
-   if (pack_fread(buf, size, f) < size)
-      goto _RETURN;
-
    /* Calculate the file type based on the extension */
    ext = get_extension(filename);
    if       (!strcmp(ext, "nsf") || !strcmp(ext, "NSF"))
@@ -54,51 +119,76 @@ GME *gme_load(const char* filename)
    else if  (!strcmp(ext, "spc") || !strcmp(ext, "SPC"))
       type = GME_TYPE::GME_SPC;
 
-   /* Load it from buffer and the proper music emulator */
-   gme = (Music_Emu*)gme_create(buf, size, type);
+   gme = create_emu(type);
+   if (!gme)
+      return NULL;
 
-_RETURN:
-   if(buf) free(buf);
-   if(f) pack_fclose(f);
+   f = pack_fopen(filename, F_READ);
+   if (!f)
+      goto _ERROR;
 
+   {
+      Packfile_Reader reader(f, size);
+      if (gme->load(reader))
+         goto _ERROR;
+   }
+
+   pack_fclose(f);
    return gme;
+
+_ERROR:
+   if(f) pack_fclose(f);
+   delete gme;
+
+   return NULL;
 }
 
 
 /* gme_create:
  *  Reads GME data from a buffer, it creates the Music_Emu
- * emulator based on the passed GME_TYPE type.
+ * emulator based on the passed GME_TYPE type. The data is
+ * copied, so buf can be freed afterwards.
  * Return NULL if any error is encountered.
  */
 GME *gme_create(void* buf, size_t size, GME_TYPE type)
 {
-   int _rate;
-   Music_Emu *gme = NULL;
+   Music_Emu *gme = create_emu(type);
    Mem_File_Reader reader(buf, size);
 
-   if      (type == GME_TYPE::GME_NSF)
-      gme = new Nsf_Emu;
-   else if (type == GME_TYPE::GME_GBS)
-      gme = new Gbs_Emu;
-   else if (type == GME_TYPE::GME_SPC)
-      gme = new Spc_Emu;
-   else
+   if (!gme)
       return NULL;
 
-   /* Use the mixer sample rate to generate the GME output 
-    * except for the SNES which native output is 32000 */
-   _rate = (type == GME_TYPE::GME_SPC) ? 32000 : mixer_get_frequency();
-   if (_rate <= 0)
+   if (gme->load(reader))
+   {
+      delete gme;
       return NULL;
+   }
 
-   /* Set the rate at which to play the GME */
-   if (gme->set_sample_rate(_rate))
+   return gme;
+}
+
+
+/* gme_create_shared:
+ *  Like gme_create(), but the emulator plays the ROM data straight
+ * from buf instead of copying it. buf must stay unchanged until the
+ * GME is destroyed, e.g. a memory mapped file or the dat of a
+ * DATAFILE object, and can be shared by any number of GME objects.
+ * Return NULL if any error is encountered.
+ */
+GME *gme_create_shared(const void *buf, size_t size, GME_TYPE type)
+{
+   Music_Emu *gme = create_emu(type);
+
+   if (!gme)
       return NULL;
 
-   if(gme->load(reader))
+   if (gme->load_mem(buf, size))
+   {
+      delete gme;
       return NULL;
+   }
 
-  return gme;
+   return gme;
 }
 
 
@@ -112,17 +202,104 @@ void gme_destroy(GME *gme)
 }
 
 
+/* is_silent:
+ *  Returns TRUE if none of the count samples in buf gets further
+ * than GME_SILENCE_LEVEL from zero.
+ */
+static int is_silent(const short *buf, long count)
+{
+   long i;
+
+   for (i = 0; i < count; i++)
+   {
+      if ((unsigned)(buf[i] + GME_SILENCE_LEVEL) > 2 * GME_SILENCE_LEVEL)
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/* reset_silence:
+ *  Forgets about any silence detected on the streamed GME,
+ * used whenever its playing position changes.
+ */
+static void reset_silence(void)
+{
+   _silent_frames = 0;
+   _idle_frames = 0;
+}
+
+
+/* is_idle:
+ *  Returns TRUE if the streamed GME has ended its track or
+ * has been silent for long enough to take the silence action.
+ */
+static int is_idle(Music_Emu *gme)
+{
+   if (!_silence_msec)
+      return FALSE;
+
+   return gme->track_ended() ||
+          _silent_frames >= (long)_silence_msec * gme->sample_rate() / 1000;
+}
+
+
 /* gme_audio_render:
  *  If a GME is set for playing, it will call this function
  * to fill the buffer with the required data slice
- * ready for the audio mixer. The audio will always loop for GME.
+ * ready for the audio mixer. The audio will always loop for GME
+ * unless silence detection stops it.
  * Returns FALSE if nothing was rendered.
  */
 int gme_audio_render(short *buf, unsigned int render_size)
 {
    Music_Emu *gme = (Music_Emu *)stream;
+   long count = render_size * GME_CHANNELS;
+
+   if (is_idle(gme))
+   {
+      switch (_silence_action)
+      {
+         case GME_SILENCE_END:
+            return FALSE;
+
+         case GME_SILENCE_NEXT:
+            _track = (_track + 1) % MAX(1, gme->track_count());
+            /* fallthrough */
+         case GME_SILENCE_LOOP:
+            gme->start_track(_track);
+            reset_silence();
+            break;
+
+         default:
+            /* an ended track has nothing left to emulate */
+            if (gme->track_ended())
+            {
+               memset(buf, 0, count * sizeof(short));
+               return TRUE;
+            }
+
+            /* fast-forward without synthesis, rendering for real
+             * now and then to find out if it is audible again */
+            if (_idle_frames < (long)GME_IDLE_PROBE_MSEC * gme->sample_rate() / 1000)
+            {
+               memset(buf, 0, count * sizeof(short));
+               gme->skip_silence(count);
+               _idle_frames += render_size;
+               return TRUE;
+            }
+            _idle_frames = 0;
+            break;
+      }
+   }
+
+   gme->play(count, buf);
 
-   gme->play(render_size * GME_CHANNELS, buf);
+   if (_silence_msec && is_silent(buf, count))
+      _silent_frames += render_size;
+   else
+      _silent_frames = 0;
 
    return TRUE;
 }
@@ -161,6 +338,8 @@ int stream_play_gme(GME *gme)
 
    /* Reset GME object to its start position on first track */
    _gme->start_track(0);
+   _track = 0;
+   reset_silence();
 
    /* Sets it as the STREAM to be played */
    stream = _gme;
@@ -207,6 +386,91 @@ void gme_change_track(int track)
    track = CLAMP(0, track, tracks);
 
    gme->start_track(track);
+   _track = track;
+   reset_silence();
+}
+
+
+/* gme_seek:
+ *  Moves the playing position of the actual GME track to
+ * msec milliseconds from its start. Snapshots of the emulator
+ * state taken while playing are restored when possible so only
+ * the time after the nearest one has to be emulated again.
+ * It does nothing if no GME object has been set for playing.
+ */
+void gme_seek(int msec)
+{
+   Music_Emu* gme = (Music_Emu*)stream;
+
+   if (!gme)
+      return;
+
+   if (stream_type != STREAM_GME)
+      return;
+
+   gme->seek(MAX(0, msec));
+   reset_silence();
+}
+
+
+/* gme_tell:
+ *  Returns the position in milliseconds of the actual GME
+ * track or -1 if no GME object has been set for playing.
+ */
+int gme_tell(void)
+{
+   Music_Emu* gme = (Music_Emu*)stream;
+
+   if (!gme || stream_type != STREAM_GME)
+      return -1;
+
+   return gme->tell();
+}
+
+
+/* gme_set_snapshot_period:
+ *  Sets every how many milliseconds of playback a snapshot of
+ * the emulator state is taken for gme_seek (10 seconds by default,
+ * 0 disables them). Takes effect on the next started track.
+ */
+void gme_set_snapshot_period(GME *gme, int msec)
+{
+   if (!gme)
+      return;
+
+   ((Music_Emu *)gme)->set_snapshot_period(MAX(0, msec));
+}
+
+
+/* gme_set_silence:
+ *  Sets up silence detection for the streamed GME. Once its output
+ * stays silent for msec milliseconds (0 disables it, the default)
+ * or its track ends, action is taken: GME_SILENCE_SKIP keeps the
+ * emulation running without synthesizing sound and outputs silence
+ * until it is audible again (checked every GME_IDLE_PROBE_MSEC),
+ * GME_SILENCE_END stops the stream, GME_SILENCE_LOOP restarts the
+ * track and GME_SILENCE_NEXT starts the next one.
+ */
+void gme_set_silence(int msec, int action)
+{
+   _silence_msec = MAX(0, msec);
+   _silence_action = action;
+   reset_silence();
+}
+
+
+/* gme_is_idle:
+ *  Returns TRUE if the streamed GME is currently silent for
+ * longer than set with gme_set_silence(), FALSE otherwise.
+ */
+int gme_is_idle(void)
+{
+   Music_Emu* gme = (Music_Emu*)stream;
+
+   if (!gme || stream_type != STREAM_GME)
+      return FALSE;
+
+   return is_idle(gme);
 }
 
 
@@ -235,3 +499,196 @@ int gme_get_channels(GME *gme)
 
    return GME_CHANNELS;
 }
+
+
+/* gme_voice_count:
+ *  Returns the number of voices (chip channels) of the passed GME
+ * object, or -1 if the passed object is invalid.
+ */
+int gme_voice_count(GME *gme)
+{
+   if (!gme)
+      return -1;
+
+   return ((Music_Emu *)gme)->voice_count();
+}
+
+
+/* gme_render_voices:
+ *  Renders frames mono samples of every voice of the GME in a single
+ * emulation pass, voice n into out[n] (NULL to discard it), so each
+ * chip channel can be mixed on its own. out must hold gme_voice_count()
+ * buffers. The GME can't be the one being played by the stream engine.
+ * Returns TRUE on success, FALSE on error.
+ */
+int gme_render_voices(GME *gme, short **out, long frames)
+{
+   Music_Emu *emu = (Music_Emu *)gme;
+
+   if (!emu || !out || frames <= 0 || gme == stream)
+      return FALSE;
+
+   if (emu->play_voices(frames, out))
+      return FALSE;
+
+   return TRUE;
+}
+
+
+/* render_job:
+ *  Renders a single batch job into its buffer. Returns FALSE if the
+ * job is invalid.
+ */
+static int render_job(GME_RENDER_JOB *job)
+{
+   Music_Emu *gme = (Music_Emu *)job->gme;
+
+   if (!gme || !job->buf || job->frames <= 0)
+      return FALSE;
+
+   /* the streamed GME belongs to the mixer thread */
+   if (gme == stream)
+      return FALSE;
+
+   if (job->track >= 0)
+      gme->start_track(MIN(job->track, gme->track_count() - 1));
+
+   gme->play(job->frames * GME_CHANNELS, job->buf);
+
+   return TRUE;
+}
+
+
+/* render_worker:
+ *  Worker thread of gme_render_batch(), it keeps taking jobs from the
+ * pool until every job has been handed out.
+ */
+static void *render_worker(void *arg)
+{
+   GME_WORKER_POOL *pool = (GME_WORKER_POOL *)arg;
+   int job, ok;
+
+   for (;;)
+   {
+      pthread_mutex_lock(&pool->lock);
+      job = pool->next++;
+      pthread_mutex_unlock(&pool->lock);
+
+      if (job >= pool->count)
+         break;
+
+      ok = render_job(pool->jobs + job);
+
+      if (ok)
+      {
+         pthread_mutex_lock(&pool->lock);
+         pool->rendered++;
+         pthread_mutex_unlock(&pool->lock);
+      }
+   }
+
+   return NULL;
+}
+
+
+/* gme_render_batch:
+ *  Renders count independent jobs in parallel on a pool of worker
+ * threads, each one into its caller provided buffer. Every job must
+ * use a different GME object, and none of them can be the one being
+ * played by the stream engine. If threads is <= 0 one thread per
+ * online CPU is used. Returns the number of jobs rendered.
+ */
+int gme_render_batch(GME_RENDER_JOB *jobs, int count, int threads)
+{
+   pthread_t tid[GME_MAX_THREADS];
+   GME_WORKER_POOL pool;
+   int i, started;
+
+   if (!jobs || count <= 0)
+      return 0;
+
+   if (threads <= 0)
+      threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+   threads = CLAMP(1, threads, MIN(count, GME_MAX_THREADS));
+
+   pool.jobs = jobs;
+   pool.count = count;
+   pool.next = 0;
+   pool.rendered = 0;
+   pthread_mutex_init(&pool.lock, NULL);
+
+   /* the calling thread works too */
+   for (started = 0; started < threads - 1; started++)
+   {
+      if (pthread_create(&tid[started], NULL, render_worker, &pool) != 0)
+         break;
+   }
+
+   render_worker(&pool);
+
+   for (i = 0; i < started; i++)
+      pthread_join(tid[i], NULL);
+
+   pthread_mutex_destroy(&pool.lock);
+
+   return pool.rendered;
+}
+
+
+/* gme_render_previews:
+ *  Renders the first frames of every track of a GME file buffer in
+ * parallel, one emulator per track. out must hold gme_track_count()
+ * buffers of frames stereo frames each. Returns the number of tracks
+ * rendered or -1 on error.
+ */
+int gme_render_previews(void *buf, size_t size, GME_TYPE type,
+                        short **out, long frames, int threads)
+{
+   GME_RENDER_JOB *jobs;
+   Music_Emu *first;
+   int tracks, i, ret = -1;
+
+   if (!out || frames <= 0)
+      return -1;
+
+   /* all the emulators play from the same ROM image */
+   first = (Music_Emu *)gme_create_shared(buf, size, type);
+   if (!first)
+      return -1;
+
+   tracks = first->track_count();
+
+   jobs = (GME_RENDER_JOB *)calloc(tracks, sizeof(GME_RENDER_JOB));
+   if (!jobs)
+      goto _RETURN;
+
+   /* an emulator can only play one track at a time */
+   jobs[0].gme = first;
+   for (i = 1; i < tracks; i++)
+   {
+      jobs[i].gme = gme_create_shared(buf, size, type);
+      if (!jobs[i].gme)
+         goto _RETURN;
+   }
+
+   for (i = 0; i < tracks; i++)
+   {
+      jobs[i].track = i;
+      jobs[i].buf = out[i];
+      jobs[i].frames = frames;
+   }
+
+   ret = gme_render_batch(jobs, tracks, threads);
+
+_RETURN:
+   if (jobs)
+   {
+      for (i = 1; i < tracks; i++)
+         gme_destroy(jobs[i].gme);
+      free(jobs);
+   }
+   gme_destroy(first);
+
+   return ret;
+}
@@ -10,15 +10,37 @@ extern "C" {
 typedef void GME;
 enum GME_TYPE { GME_NSF, GME_GBS, GME_SPC, GME_NONE = 255 };
 
+/* What to do once the streamed GME goes silent, see gme_set_silence() */
+enum GME_SILENCE { GME_SILENCE_SKIP, GME_SILENCE_END, GME_SILENCE_LOOP, GME_SILENCE_NEXT };
+
+typedef struct GME_RENDER_JOB
+{
+   GME *gme;                           /* emulator to render from */
+   int track;                          /* track to start, -1 to continue */
+   short *buf;                         /* caller buffer, stereo interleaved */
+   long frames;                        /* # of stereo frames to render */
+} GME_RENDER_JOB;
+
 
 GME *gme_load(const char *filename);
 GME *gme_create(void *buf, size_t size, GME_TYPE type);
+GME *gme_create_shared(const void *buf, size_t size, GME_TYPE type);
 void gme_destroy(GME *gme);
 int gme_track_count(GME *gme);
 void gme_change_track(int track);
+void gme_seek(int msec);
+int gme_tell(void);
+void gme_set_snapshot_period(GME *gme, int msec);
+void gme_set_silence(int msec, int action);
+int gme_is_idle(void);
 int stream_play_gme(GME *gme);
 int gme_get_samplerate(GME *gme);
 int gme_get_channels(GME *gme);
+int gme_voice_count(GME *gme);
+int gme_render_voices(GME *gme, short **out, long frames);
+int gme_render_batch(GME_RENDER_JOB *jobs, int count, int threads);
+int gme_render_previews(void *buf, size_t size, GME_TYPE type,
+                        short **out, long frames, int threads);
 
 #ifdef __cplusplus
 }
@@ -9,6 +9,10 @@
 #include <stdlib.h>
 #include <math.h>
 
+#if BLIP_BUFFER_SSE2
+	#include <emmintrin.h>
+#endif
+
 /* Copyright (C) 2003-2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
 General Public License as published by the Free Software Foundation; either
@@ -339,6 +343,47 @@ void Blip_Synth_::volume_unit( double new_unit )
 	}
 }
 
+#if BLIP_BUFFER_SSE2
+
+// Saturate 32-bit samples to 16 bits, either packed or into every other sample
+// of 'out' (leaving the other channel untouched).
+static void clamp_samples( int const* in, blip_sample_t* out, int count, int stereo )
+{
+	int i = 0;
+	if ( !stereo )
+	{
+		for ( ; i + 8 <= count; i += 8 )
+		{
+			__m128i lo = _mm_loadu_si128( (__m128i const*) (in + i) );
+			__m128i hi = _mm_loadu_si128( (__m128i const*) (in + i + 4) );
+			_mm_storeu_si128( (__m128i*) (out + i), _mm_packs_epi32( lo, hi ) );
+		}
+	}
+	else
+	{
+		__m128i const other = _mm_set1_epi32( (int) 0xFFFF0000 );
+		__m128i const zero = _mm_setzero_si128();
+		for ( ; i + 4 <= count; i += 4 )
+		{
+			__m128i s = _mm_loadu_si128( (__m128i const*) (in + i) );
+			s = _mm_unpacklo_epi16( _mm_packs_epi32( s, s ), zero );
+			__m128i* p = (__m128i*) (out + i * 2);
+			_mm_storeu_si128( p, _mm_or_si128( s,
+					_mm_and_si128( _mm_loadu_si128( p ), other ) ) );
+		}
+	}
+	
+	for ( ; i < count; i++ )
+	{
+		int s = in [i];
+		if ( (blip_sample_t) s != s )
+			s = 0x7FFF - (s >> 24);
+		out [i << stereo] = (blip_sample_t) s;
+	}
+}
+
+#endif
+
 long Blip_Buffer::read_samples( blip_sample_t* out, long max_samples, int stereo )
 {
 	long count = samples_avail();
@@ -352,9 +397,38 @@ long Blip_Buffer::read_samples( blip_sample_t* out, long max_samples, int stereo
 		long accum = reader_accum;
 		buf_t_* in = buffer_;
 		
+		long remain = count;
+		
+	#if BLIP_BUFFER_SSE2
+		// integrate a block at a time then clamp it with SIMD, until a block has
+		// samples far enough out of range to need the exact clamp below
+		int const block_size = 256;
+		int block [block_size];
+		while ( remain >= block_size )
+		{
+			long a = accum;
+			unsigned long range = 0;
+			for ( int i = 0; i < block_size; i++ )
+			{
+				long s = a >> sample_shift;
+				a += in [i] - (a >> bass_shift);
+				block [i] = (int) s;
+				range |= (unsigned long) (s + 0x800000);
+			}
+			if ( range >> 24 )
+				break;
+			
+			accum = a;
+			in += block_size;
+			clamp_samples( block, out, block_size, stereo );
+			out += block_size << stereo;
+			remain -= block_size;
+		}
+	#endif
+		
 		if ( !stereo )
 		{
-			for ( long n = count; n--; )
+			for ( long n = remain; n--; )
 			{
 				long s = accum >> sample_shift;
 				accum -= accum >> bass_shift;
@@ -368,7 +442,7 @@ long Blip_Buffer::read_samples( blip_sample_t* out, long max_samples, int stereo
 		}
 		else
 		{
-			for ( long n = count; n--; )
+			for ( long n = remain; n--; )
 			{
 				long s = accum >> sample_shift;
 				accum -= accum >> bass_shift;
@@ -120,6 +120,13 @@ private:
 	#define BLIP_BUFFER_ACCURACY 16
 #endif
 
+// Use SSE2 to clamp and interleave samples read out of buffers. Integration itself
+// stays serial, since the bass filter's rounding makes each sample depend exactly
+// on the previous one.
+#if !defined (BLIP_BUFFER_SSE2) && (defined (__SSE2__) || defined (_M_X64))
+	#define BLIP_BUFFER_SSE2 1
+#endif
+
 // Number bits in phase offset. Fewer than 6 bits (64 phase offsets) results in
 // noticeable broadband noise when synthesizing high frequency square waves.
 // Affects size of Blip_Synth objects since they store the waveform directly.
@@ -243,6 +250,12 @@ public:
 	// using Blip_Buffer::remove_samples().
 	void end( Blip_Buffer& b )              { b.reader_accum = accum; }
 	
+	// Read 'count' samples as read() returns them into 'out', advancing as next()
+	// does. Returns false if any sample was outside +/- 0x800000, where clamping
+	// two summed samples is no longer equivalent to 16-bit saturation; the caller
+	// should then rewind to a saved copy of the reader and clamp one at a time.
+	bool read_block( int* out, int count, int bass_shift = 9 );
+	
 private:
 	const Blip_Buffer::buf_t_* buf;
 	long accum;
@@ -347,6 +360,23 @@ inline int Blip_Reader::begin( Blip_Buffer& blip_buf )
 	return blip_buf.bass_shift;
 }
 
+inline bool Blip_Reader::read_block( int* out, int count, int bass_shift )
+{
+	const Blip_Buffer::buf_t_* in = buf;
+	long a = accum;
+	unsigned long range = 0;
+	for ( int i = 0; i < count; i++ )
+	{
+		long s = a >> (blip_sample_bits - 16);
+		a += *in++ - (a >> bass_shift);
+		out [i] = (int) s;
+		range |= (unsigned long) (s + 0x800000);
+	}
+	buf = in;
+	accum = a;
+	return !(range >> 24);
+}
+
 int const blip_max_length = 0;
 int const blip_default_length = 250;
 
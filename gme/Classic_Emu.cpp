@@ -22,11 +22,14 @@ Classic_Emu::Classic_Emu()
 {
 	buf = NULL;
 	stereo_buffer = NULL;
+	mixed_buffer = NULL;
+	stem_buffer = NULL;
 }
 
 Classic_Emu::~Classic_Emu()
 {
 	delete stereo_buffer;
+	delete stem_buffer;
 }
 
 void Classic_Emu::set_equalizer( equalizer_t const& eq )
@@ -81,12 +84,30 @@ blargg_err_t Classic_Emu::setup_buffer( long new_clock_rate )
 	return blargg_success;
 }
 
+// Switch output to another buffer set up at the same sample rate and configure it
+// like the current one. Samples still waiting in the current buffer are lost.
+blargg_err_t Classic_Emu::change_buffer( Multi_Buffer* new_buf )
+{
+	BLARGG_RETURN_ERR( new_buf->set_channel_count( voice_count() ) );
+	buf = new_buf;
+	buf->clock_rate( clock_rate );
+	buf->clear();
+	set_equalizer( equalizer() );
+	remute_voices();
+	return blargg_success;
+}
+
 void Classic_Emu::start_track( int track )
 {
 	Music_Emu::start_track( track );
 	buf->clear();
 }
 
+void Classic_Emu::load_state( void const* )
+{
+	buf->clear();
+}
+
 blip_time_t Classic_Emu::run_clocks( blip_time_t t, bool* )
 {
 	assert( false );
@@ -102,6 +123,9 @@ void Classic_Emu::play( long count, sample_t* out )
 {
 	require( sample_rate() ); // fails if set_sample_rate() hasn't been called yet
 	
+	if ( buf == stem_buffer && mixed_buffer )
+		change_buffer( mixed_buffer ); // can't fail since it was in use before
+	
 	long remain = count;
 	while ( remain )
 	{
@@ -111,7 +135,50 @@ void Classic_Emu::play( long count, sample_t* out )
 			bool added_stereo = false;
 			blip_time_t clocks_emulated = run( buf->length(), &added_stereo );
 			buf->end_frame( clocks_emulated, added_stereo );
+			
+			// emulator state is now just past the samples in buffer
+			state_reached( play_time() + (count - remain) + buf->samples_avail() );
 		}
 	}
+	samples_played( count );
 }
 
+
+blargg_err_t Classic_Emu::play_voices( long count, sample_t* const* out )
+{
+	require( track_count() ); // file must be loaded
+	
+	if ( !stem_buffer )
+	{
+		BLARGG_CHECK_ALLOC( stem_buffer = BLARGG_NEW Stem_Buffer );
+		BLARGG_RETURN_ERR( stem_buffer->set_sample_rate( sample_rate(), buf->length() ) );
+	}
+	
+	if ( buf != stem_buffer )
+	{
+		Multi_Buffer* old_buf = buf;
+		BLARGG_RETURN_ERR( change_buffer( stem_buffer ) );
+		mixed_buffer = old_buf;
+	}
+	
+	long done = 0;
+	while ( done < count )
+	{
+		sample_t* pos [Stem_Buffer::max_channels];
+		for ( int i = 0; i < voice_count(); i++ )
+			pos [i] = out [i] ? out [i] + done : NULL;
+		done += stem_buffer->read_channels( pos, count - done );
+		if ( done < count )
+		{
+			bool added_stereo = false;
+			blip_time_t clocks_emulated = run( buf->length(), &added_stereo );
+			buf->end_frame( clocks_emulated, added_stereo );
+			
+			// positions are counted in stereo samples, as play() outputs them
+			state_reached( play_time() + (done + buf->samples_avail()) * 2 );
+		}
+	}
+	samples_played( count * 2 );
+	
+	return blargg_success;
+}
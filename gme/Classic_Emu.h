@@ -10,6 +10,7 @@
 #include "Music_Emu.h"
 class Blip_Buffer;
 class blip_eq_t;
+class Stem_Buffer;
 typedef long blip_time_t;
 
 class Classic_Emu : public Music_Emu {
@@ -20,6 +21,7 @@ public:
 	void set_buffer( Multi_Buffer* );
 	void mute_voices( int );
 	void play( long, sample_t* );
+	blargg_err_t play_voices( long, sample_t* const* );
 	void start_track( int track );  
 	void set_equalizer( equalizer_t const& );
 public:
@@ -32,10 +34,14 @@ protected:
 	virtual blip_time_t run( int msec, bool* added_stereo );
 	virtual blip_time_t run_clocks( blip_time_t, bool* added_stereo );
 	virtual void update_eq( blip_eq_t const& ) = 0;
+	void load_state( void const* ); // clears buffer; derived emulators restore the rest
 private:
 	Multi_Buffer* buf;
 	Multi_Buffer* stereo_buffer;
+	Multi_Buffer* mixed_buffer; // buffer to go back to after play_voices()
+	Stem_Buffer* stem_buffer;
 	long clock_rate;
+	blargg_err_t change_buffer( Multi_Buffer* );
 };
 
 inline void Classic_Emu::set_buffer( Multi_Buffer* new_buf )
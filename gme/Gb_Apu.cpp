@@ -119,8 +119,72 @@ void Gb_Apu::reset()
 	write_register( 0, status_reg, 0x00 );
 }
 
-// to do: remove
-static unsigned long abs_time;
+void Gb_Apu::save_snapshot( snapshot_t* out ) const
+{
+	memset( out, 0, sizeof *out );
+	for ( int i = 0; i < osc_count; i++ )
+	{
+		Gb_Osc const& osc = *oscs [i];
+		snapshot_t::osc_t& o = out->oscs [i];
+		o.output_select = osc.output_select;
+		o.delay = osc.delay;
+		o.volume = osc.volume;
+		o.length = osc.length;
+		o.enabled = osc.enabled;
+	}
+	out->oscs [0].env_delay = square1.env_delay;
+	out->oscs [1].env_delay = square2.env_delay;
+	out->oscs [3].env_delay = noise.env_delay;
+	
+	out->sweep_delays [0] = square1.sweep_delay;
+	out->sweep_delays [1] = square2.sweep_delay;
+	out->sweep_freqs [0] = square1.sweep_freq;
+	out->sweep_freqs [1] = square2.sweep_freq;
+	out->phases [0] = square1.phase;
+	out->phases [1] = square2.phase;
+	out->noise_bits = noise.bits;
+	out->wave_pos = wave.wave_pos;
+	memcpy( out->wave, wave.wave, sizeof out->wave );
+	memcpy( out->regs, regs, sizeof out->regs );
+	out->next_frame_time = next_frame_time;
+	out->last_time = last_time;
+	out->frame_count = frame_count;
+}
+
+void Gb_Apu::load_snapshot( snapshot_t const& in )
+{
+	for ( int i = 0; i < osc_count; i++ )
+	{
+		Gb_Osc& osc = *oscs [i];
+		snapshot_t::osc_t const& o = in.oscs [i];
+		osc.output_select = o.output_select;
+		osc.output = osc.outputs [osc.output_select];
+		osc.delay = o.delay;
+		osc.volume = o.volume;
+		osc.length = o.length;
+		osc.enabled = o.enabled;
+		osc.last_amp = 0;
+	}
+	square1.env_delay = in.oscs [0].env_delay;
+	square2.env_delay = in.oscs [1].env_delay;
+	noise.env_delay = in.oscs [3].env_delay;
+	
+	square1.sweep_delay = in.sweep_delays [0];
+	square2.sweep_delay = in.sweep_delays [1];
+	square1.sweep_freq = in.sweep_freqs [0];
+	square2.sweep_freq = in.sweep_freqs [1];
+	square1.phase = in.phases [0];
+	square2.phase = in.phases [1];
+	noise.bits = in.noise_bits;
+	wave.wave_pos = in.wave_pos;
+	memcpy( wave.wave, in.wave, sizeof wave.wave );
+	memcpy( regs, in.regs, sizeof regs );
+	next_frame_time = in.next_frame_time;
+	last_time = in.last_time;
+	frame_count = in.frame_count;
+	stereo_found = false;
+	update_volume();
+}
 
 void Gb_Apu::run_until( gb_time_t end_time )
 {
@@ -187,8 +251,6 @@ bool Gb_Apu::end_frame( gb_time_t end_time )
 	if ( end_time > last_time )
 		run_until( end_time );
 	
-	abs_time += end_time;
-	
 	assert( next_frame_time >= end_time );
 	next_frame_time -= end_time;
 	
@@ -55,6 +55,12 @@ public:
 	// to the center buffer.
 	bool end_frame( gb_time_t );
 	
+	// Save/load exact emulation state at the end of a time frame. Loading resets
+	// oscillator amplitudes to zero, so output buffers should be cleared afterwards.
+	struct snapshot_t;
+	void save_snapshot( snapshot_t* ) const;
+	void load_snapshot( snapshot_t const& );
+	
 public:
 	Gb_Apu();
 	~Gb_Apu();
@@ -83,6 +89,30 @@ private:
 	void write_osc( int index, int reg, int data );
 };
 
+struct Gb_Apu::snapshot_t
+{
+	struct osc_t
+	{
+		int output_select;
+		int delay;
+		int volume;
+		int length;
+		int env_delay; // squares and noise
+		bool enabled;
+	};
+	osc_t oscs [osc_count];
+	int sweep_delays [2];
+	int sweep_freqs [2];
+	int phases [2];
+	unsigned noise_bits;
+	int wave_pos;
+	BOOST::uint8_t wave [Gb_Wave::wave_size];
+	BOOST::uint8_t regs [register_count];
+	gb_time_t next_frame_time;
+	gb_time_t last_time;
+	int frame_count;
+};
+
 inline void Gb_Apu::output( Blip_Buffer* b ) { output( b, b, b ); }
 	
 inline void Gb_Apu::osc_output( int i, Blip_Buffer* b ) { osc_output( i, b, b, b ); }
@@ -111,7 +111,9 @@ void Gb_Cpu::map_memory( gb_addr_t start, unsigned long size, reader_t read, wri
 // Note: 'addr' is evaulated more than once in the following macros, so it
 // must not contain side-effects.
 
-#define READ( addr )        (data_reader [(addr) >> page_bits]( callback_data, addr ))
+// Pages without a reader function are read straight from their code mapping
+#define READ( addr )        (data_reader [(addr) >> page_bits] ? \
+		data_reader [(addr) >> page_bits]( callback_data, addr ) : READ_PROG( addr ))
 #define WRITE( addr, data ) (data_writer [(addr) >> page_bits]( callback_data, addr, data ))
 
 #define READ_PROG( addr )   (code_map [(addr) >> page_bits] [PAGE_OFFSET( addr )])
@@ -132,6 +134,20 @@ BOOST::uint8_t* Gb_Cpu::get_code( gb_addr_t addr )
 	return (uint8_t*) &READ_PROG( addr );
 }
 
+void Gb_Cpu::save_snapshot( snapshot_t* out ) const
+{
+	out->r = r;
+	out->interrupts_enabled = interrupts_enabled;
+	memcpy( out->code_map, code_map, sizeof code_map );
+}
+
+void Gb_Cpu::load_snapshot( snapshot_t const& in )
+{
+	r = in.r;
+	interrupts_enabled = in.interrupts_enabled;
+	memcpy( code_map, in.code_map, sizeof code_map );
+}
+
 #ifndef GB_CPU_GLUE_ONLY
 
 const unsigned z_flag = 0x80;
@@ -139,6 +155,27 @@ const unsigned n_flag = 0x40;
 const unsigned h_flag = 0x20;
 const unsigned c_flag = 0x10;
 
+#if BLARGG_COMPUTED_GOTO
+	// Each opcode's case also has a label, which dispatch jumps to directly
+	#define OP( n )         op_##n:
+	#define DISPATCH( op )  __extension__ ({ goto *dispatch [op]; })
+	
+	// Fetch and dispatch next instruction at the end of each handler, giving each
+	// its own indirect branch. Register checks are only made at loop.
+	#define NEXT_INSTR() {                                  \
+		page = code_map [pc >> page_bits];                  \
+		op = page [PAGE_OFFSET( pc )];                      \
+		data = page [PAGE_OFFSET( pc ) + 1];                \
+		pc++;                                               \
+		if ( (remain_ -= cycles_per_instruction) <= 0 )     \
+			goto stop;                                      \
+		DISPATCH( op );                                     \
+	}
+#else
+	#define OP( n )
+	#define NEXT_INSTR() goto loop
+#endif
+
 #include BLARGG_ENABLE_OPTIMIZER
 
 Gb_Cpu::result_t Gb_Cpu::run( long cycle_count )
@@ -150,6 +187,43 @@ Gb_Cpu::result_t Gb_Cpu::run( long cycle_count )
 	
 	Gb_Cpu::result_t result = result_cycles;
 	
+#if BLARGG_COMPUTED_GOTO
+	__extension__ static void* const dispatch [0x100] = {
+		&&op_0x00, &&op_0x01, &&op_0x02, &&op_0x03, &&op_0x04, &&op_0x05, &&op_0x06, &&op_0x07, // 0
+		&&op_0x08, &&op_0x09, &&op_0x0A, &&op_0x0B, &&op_0x0C, &&op_0x0D, &&op_0x0E, &&op_0x0F,
+		&&op_0x10, &&op_0x11, &&op_0x12, &&op_0x13, &&op_0x14, &&op_0x15, &&op_0x16, &&op_0x17, // 1
+		&&op_0x18, &&op_0x19, &&op_0x1A, &&op_0x1B, &&op_0x1C, &&op_0x1D, &&op_0x1E, &&op_0x1F,
+		&&op_0x20, &&op_0x21, &&op_0x22, &&op_0x23, &&op_0x24, &&op_0x25, &&op_0x26, &&op_0x27, // 2
+		&&op_0x28, &&op_0x29, &&op_0x2A, &&op_0x2B, &&op_0x2C, &&op_0x2D, &&op_0x2E, &&op_0x2F,
+		&&op_0x30, &&op_0x31, &&op_0x32, &&op_0x33, &&op_0x34, &&op_0x35, &&op_0x36, &&op_0x37, // 3
+		&&op_0x38, &&op_0x39, &&op_0x3A, &&op_0x3B, &&op_0x3C, &&op_0x3D, &&op_0x3E, &&op_0x3F,
+		&&op_0x40, &&op_0x41, &&op_0x42, &&op_0x43, &&op_0x44, &&op_0x45, &&op_0x46, &&op_0x47, // 4
+		&&op_0x48, &&op_0x49, &&op_0x4A, &&op_0x4B, &&op_0x4C, &&op_0x4D, &&op_0x4E, &&op_0x4F,
+		&&op_0x50, &&op_0x51, &&op_0x52, &&op_0x53, &&op_0x54, &&op_0x55, &&op_0x56, &&op_0x57, // 5
+		&&op_0x58, &&op_0x59, &&op_0x5A, &&op_0x5B, &&op_0x5C, &&op_0x5D, &&op_0x5E, &&op_0x5F,
+		&&op_0x60, &&op_0x61, &&op_0x62, &&op_0x63, &&op_0x64, &&op_0x65, &&op_0x66, &&op_0x67, // 6
+		&&op_0x68, &&op_0x69, &&op_0x6A, &&op_0x6B, &&op_0x6C, &&op_0x6D, &&op_0x6E, &&op_0x6F,
+		&&op_0x70, &&op_0x71, &&op_0x72, &&op_0x73, &&op_0x74, &&op_0x75, &&op_0x76, &&op_0x77, // 7
+		&&op_0x78, &&op_0x79, &&op_0x7A, &&op_0x7B, &&op_0x7C, &&op_0x7D, &&op_0x7E, &&op_0x7F,
+		&&op_0x80, &&op_0x81, &&op_0x82, &&op_0x83, &&op_0x84, &&op_0x85, &&op_0x86, &&op_0x87, // 8
+		&&op_0x88, &&op_0x89, &&op_0x8A, &&op_0x8B, &&op_0x8C, &&op_0x8D, &&op_0x8E, &&op_0x8F,
+		&&op_0x90, &&op_0x91, &&op_0x92, &&op_0x93, &&op_0x94, &&op_0x95, &&op_0x96, &&op_0x97, // 9
+		&&op_0x98, &&op_0x99, &&op_0x9A, &&op_0x9B, &&op_0x9C, &&op_0x9D, &&op_0x9E, &&op_0x9F,
+		&&op_0xA0, &&op_0xA1, &&op_0xA2, &&op_0xA3, &&op_0xA4, &&op_0xA5, &&op_0xA6, &&op_0xA7, // A
+		&&op_0xA8, &&op_0xA9, &&op_0xAA, &&op_0xAB, &&op_0xAC, &&op_0xAD, &&op_0xAE, &&op_0xAF,
+		&&op_0xB0, &&op_0xB1, &&op_0xB2, &&op_0xB3, &&op_0xB4, &&op_0xB5, &&op_0xB6, &&op_0xB7, // B
+		&&op_0xB8, &&op_0xB9, &&op_0xBA, &&op_0xBB, &&op_0xBC, &&op_0xBD, &&op_0xBE, &&op_0xBF,
+		&&op_0xC0, &&op_0xC1, &&op_0xC2, &&op_0xC3, &&op_0xC4, &&op_0xC5, &&op_0xC6, &&op_0xC7, // C
+		&&op_0xC8, &&op_0xC9, &&op_0xCA, &&op_0xCB, &&op_0xCC, &&op_0xCD, &&op_0xCE, &&op_0xCF,
+		&&op_0xD0, &&op_0xD1, &&op_0xD2, &&op_0xD3, &&op_0xD4, &&op_0xD5, &&op_0xD6, &&op_0xD7, // D
+		&&op_0xD8, &&op_0xD9, &&op_0xDA, &&op_0xDB, &&op_0xDC, &&op_0xDD, &&op_0xDE, &&op_0xDF,
+		&&op_0xE0, &&op_0xE1, &&op_0xE2, &&op_0xE3, &&op_0xE4, &&op_0xE5, &&op_0xE6, &&op_0xE7, // E
+		&&op_0xE8, &&op_0xE9, &&op_0xEA, &&op_0xEB, &&op_0xEC, &&op_0xED, &&op_0xEE, &&op_0xEF,
+		&&op_0xF0, &&op_0xF1, &&op_0xF2, &&op_0xF3, &&op_0xF4, &&op_0xF5, &&op_0xF6, &&op_0xF7, // F
+		&&op_0xF8, &&op_0xF9, &&op_0xFA, &&op_0xFB, &&op_0xFC, &&op_0xFD, &&op_0xFE, &&op_0xFF
+	};
+#endif
+	
 #if BLARGG_CPU_POWERPC
 	const reader_t* data_reader = this->data_reader; // cache
 	const writer_t* data_writer = this->data_writer; // cache
@@ -188,7 +262,9 @@ Gb_Cpu::result_t Gb_Cpu::run( long cycle_count )
 	unsigned sp = r.sp;
 	unsigned flags = r.flags;
 	
+#if !BLARGG_COMPUTED_GOTO
 loop:
+#endif
 	
 	int new_remain = remain_ - cycles_per_instruction;
 	
@@ -207,6 +283,10 @@ loop:
 	if ( new_remain <= 0 )
 		goto stop;
 	
+	#if BLARGG_COMPUTED_GOTO
+		DISPATCH( op );
+	#endif
+	
 	switch ( op )
 	{
 
@@ -214,76 +294,76 @@ loop:
 {                               \
 	pc++;                       \
 	int offset = (BOOST::int8_t) data;  \
-	if ( !(cond) ) goto loop;   \
+	if ( !(cond) ) NEXT_INSTR(); \
 	pc += offset;               \
-	goto loop;                  \
+	NEXT_INSTR();               \
 }
 
 // Most Common
 
-	case 0x20: // JR NZ
+	case 0x20: OP( 0x20 ) // JR NZ
 		BRANCH( !(flags & z_flag) )
 	
-	case 0x21: // LD HL,IMM (common)
+	case 0x21: OP( 0x21 ) // LD HL,IMM (common)
 		rp.hl = READ_PROG16( pc );
 		pc += 2;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x28: // JR Z
+	case 0x28: OP( 0x28 ) // JR Z
 		BRANCH( flags & z_flag )
 	
 	{
 		unsigned temp;
 		
-	case 0xF0: // LD A,(0xff00+imm)
+	case 0xF0: OP( 0xF0 ) // LD A,(0xff00+imm)
 		temp = data + 0xff00;
 		pc++;
 		goto ld_a_ind_comm;
 	
-	case 0xF2: // LD A,(0xff00+C)
+	case 0xF2: OP( 0xF2 ) // LD A,(0xff00+C)
 		temp = rg.c + 0xff00;
 		goto ld_a_ind_comm;
 	
-	case 0x0A: // LD A,(BC)
+	case 0x0A: OP( 0x0A ) // LD A,(BC)
 		temp = rp.bc;
 		goto ld_a_ind_comm;
 	
-	case 0x3A: // LD A,(HL-)
+	case 0x3A: OP( 0x3A ) // LD A,(HL-)
 		temp = rp.hl;
 		rp.hl = temp - 1;
 		goto ld_a_ind_comm;
 	
-	case 0x1A: // LD A,(DE)
+	case 0x1A: OP( 0x1A ) // LD A,(DE)
 		temp = rp.de;
 		goto ld_a_ind_comm;
 	
-	case 0x2A: // LD A,(HL+) (common)
+	case 0x2A: OP( 0x2A ) // LD A,(HL+) (common)
 		temp = rp.hl;
 		rp.hl = temp + 1;
 		goto ld_a_ind_comm;
 		
-	case 0xFA: // LD A,IND16 (common)
+	case 0xFA: OP( 0xFA ) // LD A,IND16 (common)
 		temp = READ_PROG16( pc );
 		pc += 2;
 	ld_a_ind_comm:
 		rg.a = READ( temp );
-		goto loop;
+		NEXT_INSTR();
 	}
 	
-	case 0xBE: // CMP (HL)
+	case 0xBE: OP( 0xBE ) // CMP (HL)
 		data = READ( rp.hl );
 		goto cmp_comm;
 	
-	case 0xB8: // CMP B
-	case 0xB9: // CMP C
-	case 0xBA: // CMP D
-	case 0xBB: // CMP E
-	case 0xBC: // CMP H
-	case 0xBD: // CMP L
+	case 0xB8: OP( 0xB8 ) // CMP B
+	case 0xB9: OP( 0xB9 ) // CMP C
+	case 0xBA: OP( 0xBA ) // CMP D
+	case 0xBB: OP( 0xBB ) // CMP E
+	case 0xBC: OP( 0xBC ) // CMP H
+	case 0xBD: OP( 0xBD ) // CMP L
 		data = R8( op & 7 );
 		goto cmp_comm;
 	
-	case 0xFE: // CMP IMM
+	case 0xFE: OP( 0xFE ) // CMP IMM
 		pc++;
 	cmp_comm:
 		op = rg.a;
@@ -293,28 +373,28 @@ loop:
 		flags |= (data >> 4) & c_flag;
 		flags |= n_flag;
 		if ( data & 0xff )
-			goto loop;
+			NEXT_INSTR();
 		flags |= z_flag;
-		goto loop;
-
-	case 0x46: // LD B,(HL)
-	case 0x4E: // LD C,(HL)
-	case 0x56: // LD D,(HL)
-	case 0x5E: // LD E,(HL)
-	case 0x66: // LD H,(HL)
-	case 0x6E: // LD L,(HL)
-	case 0x7E: // LD A,(HL)
+		NEXT_INSTR();
+
+	case 0x46: OP( 0x46 ) // LD B,(HL)
+	case 0x4E: OP( 0x4E ) // LD C,(HL)
+	case 0x56: OP( 0x56 ) // LD D,(HL)
+	case 0x5E: OP( 0x5E ) // LD E,(HL)
+	case 0x66: OP( 0x66 ) // LD H,(HL)
+	case 0x6E: OP( 0x6E ) // LD L,(HL)
+	case 0x7E: OP( 0x7E ) // LD A,(HL)
 		R8( (op >> 3) & 7 ) = READ( rp.hl );
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xC4: // CNZ (next-most-common)
+	case 0xC4: OP( 0xC4 ) // CNZ (next-most-common)
 		pc += 2;
 		if ( flags & z_flag )
-			goto loop;
+			NEXT_INSTR();
 	call:
 		pc -= 2;
 		//fallthrough
-	case 0xCD: // CALL (most-common)
+	case 0xCD: OP( 0xCD ) // CALL (most-common)
 		data = pc + 2;
 		pc = READ_PROG16( pc );
 	push:
@@ -322,32 +402,32 @@ loop:
 		WRITE( sp, data >> 8 );
 		sp = (sp - 1) & 0xFFFF;
 		WRITE( sp, data & 0xff );
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xC8: // RNZ (next-most-common)
+	case 0xC8: OP( 0xC8 ) // RNZ (next-most-common)
 		if ( !(flags & z_flag) )
-			goto loop;
+			NEXT_INSTR();
 		//fallthrough
-	case 0xC9: // RET (most common)
+	case 0xC9: OP( 0xC9 ) // RET (most common)
 	ret:
 		pc = READ( sp );
 		pc += 0x100 * READ( (sp + 1) & 0xFFFF );
 		sp = (sp + 2) & 0xFFFF;
-		goto loop;
-	
-	case 0x00: // NOP
-	case 0x40: // LD B,B
-	case 0x49: // LD C,C
-	case 0x52: // LD D,D
-	case 0x5B: // LD E,E
-	case 0x64: // LD H,H
-	case 0x6D: // LD L,L
-	case 0x7F: // LD A,A
-		goto loop;
+		NEXT_INSTR();
+	
+	case 0x00: OP( 0x00 ) // NOP
+	case 0x40: OP( 0x40 ) // LD B,B
+	case 0x49: OP( 0x49 ) // LD C,C
+	case 0x52: OP( 0x52 ) // LD D,D
+	case 0x5B: OP( 0x5B ) // LD E,E
+	case 0x64: OP( 0x64 ) // LD H,H
+	case 0x6D: OP( 0x6D ) // LD L,L
+	case 0x7F: OP( 0x7F ) // LD A,A
+		NEXT_INSTR();
 	
 // CB Instructions
 
-	case 0xCB:
+	case 0xCB: OP( 0xCB )
 		pc++;
 		// now data is the opcode
 		switch ( data ) {
@@ -386,7 +466,7 @@ loop:
 			flags &= ~n_flag;
 			flags |= h_flag | z_flag;
 			flags ^= (temp << bit) & z_flag;
-			goto loop;
+			NEXT_INSTR();
 		}
 		
 		case 0x86: // RES b,(HL)
@@ -411,7 +491,7 @@ loop:
 			if ( !(data & 0x40) )
 				bit = 0;
 			WRITE( rp.hl, temp | bit );
-			goto loop;
+			NEXT_INSTR();
 		}
 		
 		case 0xC0: case 0xC1: case 0xC2: case 0xC3: // SET b,r
@@ -429,7 +509,7 @@ loop:
 		case 0xF7: case 0xF8: case 0xF9: case 0xFA:
 		case 0xFB: case 0xFC: case 0xFD: case 0xFF:
 			R8( data & 7 ) |= 1 << ((data >> 3) & 7);
-			goto loop;
+			NEXT_INSTR();
 
 		case 0x80: case 0x81: case 0x82: case 0x83: // RES b,r
 		case 0x84: case 0x85: case 0x87: case 0x88:
@@ -446,7 +526,7 @@ loop:
 		case 0xB7: case 0xB8: case 0xB9: case 0xBA:
 		case 0xBB: case 0xBC: case 0xBD: case 0xBF:
 			R8( data & 7 ) &= ~(1 << ((data >> 3) & 7));
-			goto loop;
+			NEXT_INSTR();
 		
 		{
 			int temp;
@@ -503,8 +583,8 @@ loop:
 	} // CB op
 	assert( false ); // unhandled CB op
 
-	case 0x07: // RLCA
-	case 0x17: // RLA
+	case 0x07: OP( 0x07 ) // RLCA
+	case 0x17: OP( 0x17 ) // RLA
 		data = op;
 		op = rg.a;
 	rl_comm:
@@ -516,8 +596,8 @@ loop:
 		// SLA doesn't fill lower bit
 		goto shift_comm;
 	
-	case 0x0F: // RRCA
-	case 0x1F: // RRA
+	case 0x0F: OP( 0x0F ) // RRCA
+	case 0x1F: OP( 0x1F ) // RRA
 		data = op;
 		op = rg.a;
 	rr_comm:
@@ -535,197 +615,204 @@ loop:
 		if ( data == 6 )
 			goto write_hl_op_ff;
 		R8( data ) = op;
-		goto loop;
+		NEXT_INSTR();
 
 // Load
 
-	case 0x70: // LD (HL),B
-	case 0x71: // LD (HL),C
-	case 0x72: // LD (HL),D
-	case 0x73: // LD (HL),E
-	case 0x74: // LD (HL),H
-	case 0x75: // LD (HL),L
-	case 0x77: // LD (HL),A
+	case 0x70: OP( 0x70 ) // LD (HL),B
+	case 0x71: OP( 0x71 ) // LD (HL),C
+	case 0x72: OP( 0x72 ) // LD (HL),D
+	case 0x73: OP( 0x73 ) // LD (HL),E
+	case 0x74: OP( 0x74 ) // LD (HL),H
+	case 0x75: OP( 0x75 ) // LD (HL),L
+	case 0x77: OP( 0x77 ) // LD (HL),A
 		op = R8( op & 7 );
 	write_hl_op_ff:
 		WRITE( rp.hl, op & 0xff );
-		goto loop;
-
-	case 0x41: case 0x42: case 0x43: case 0x44: case 0x45: case 0x47: // LD r,r
-	case 0x48: case 0x4A: case 0x4B: case 0x4C: case 0x4D: case 0x4F:
-	case 0x50: case 0x51: case 0x53: case 0x54: case 0x55: case 0x57:
-	case 0x58: case 0x59: case 0x5A: case 0x5C: case 0x5D: case 0x5F:
-	case 0x60: case 0x61: case 0x62: case 0x63: case 0x65: case 0x67:
-	case 0x68: case 0x69: case 0x6A: case 0x6B: case 0x6C: case 0x6F:
-	case 0x78: case 0x79: case 0x7A: case 0x7B: case 0x7C: case 0x7D:
+		NEXT_INSTR();
+
+	case 0x41: OP( 0x41 ) case 0x42: OP( 0x42 ) case 0x43: OP( 0x43 ) case 0x44: OP( 0x44 ) // LD r,r
+	case 0x45: OP( 0x45 ) case 0x47: OP( 0x47 )
+	case 0x48: OP( 0x48 ) case 0x4A: OP( 0x4A ) case 0x4B: OP( 0x4B ) case 0x4C: OP( 0x4C )
+	case 0x4D: OP( 0x4D ) case 0x4F: OP( 0x4F )
+	case 0x50: OP( 0x50 ) case 0x51: OP( 0x51 ) case 0x53: OP( 0x53 ) case 0x54: OP( 0x54 )
+	case 0x55: OP( 0x55 ) case 0x57: OP( 0x57 )
+	case 0x58: OP( 0x58 ) case 0x59: OP( 0x59 ) case 0x5A: OP( 0x5A ) case 0x5C: OP( 0x5C )
+	case 0x5D: OP( 0x5D ) case 0x5F: OP( 0x5F )
+	case 0x60: OP( 0x60 ) case 0x61: OP( 0x61 ) case 0x62: OP( 0x62 ) case 0x63: OP( 0x63 )
+	case 0x65: OP( 0x65 ) case 0x67: OP( 0x67 )
+	case 0x68: OP( 0x68 ) case 0x69: OP( 0x69 ) case 0x6A: OP( 0x6A ) case 0x6B: OP( 0x6B )
+	case 0x6C: OP( 0x6C ) case 0x6F: OP( 0x6F )
+	case 0x78: OP( 0x78 ) case 0x79: OP( 0x79 ) case 0x7A: OP( 0x7A ) case 0x7B: OP( 0x7B )
+	case 0x7C: OP( 0x7C ) case 0x7D: OP( 0x7D )
 		R8( (op >> 3) & 7 ) = R8( op & 7 );
-		goto loop;
+		NEXT_INSTR();
 
-	case 0x08: // LD IND16,SP
+	case 0x08: OP( 0x08 ) // LD IND16,SP
 		data = READ_PROG16( pc );
 		pc += 2;
 		WRITE( data, sp&0xff );
 		data++;
 		WRITE( data, sp >> 8 );
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xF9: // LD SP,HL
+	case 0xF9: OP( 0xF9 ) // LD SP,HL
 		sp = rp.hl;
-		goto loop;
+		NEXT_INSTR();
 
-	case 0x31: // LD SP,IMM
+	case 0x31: OP( 0x31 ) // LD SP,IMM
 		sp = READ_PROG16( pc );
 		pc += 2;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x01: // LD BC,IMM
-	case 0x11: // LD DE,IMM
+	case 0x01: OP( 0x01 ) // LD BC,IMM
+	case 0x11: OP( 0x11 ) // LD DE,IMM
 		r16 [op >> 4] = READ_PROG16( pc );
 		pc += 2;
-		goto loop;
+		NEXT_INSTR();
 	
 	{
 		unsigned temp;
-	case 0xE0: // LD (0xff00+imm),A
+	case 0xE0: OP( 0xE0 ) // LD (0xff00+imm),A
 		temp = data + 0xff00;
 		pc++;
 		goto write_data_rg_a;
 	
-	case 0xE2: // LD (0xff00+C),A
+	case 0xE2: OP( 0xE2 ) // LD (0xff00+C),A
 		temp = rg.c + 0xff00;
 		goto write_data_rg_a;
 
-	case 0x32: // LD (HL-),A
+	case 0x32: OP( 0x32 ) // LD (HL-),A
 		temp = rp.hl;
 		rp.hl = temp - 1;
 		goto write_data_rg_a;
 	
-	case 0x02: // LD (BC),A
+	case 0x02: OP( 0x02 ) // LD (BC),A
 		temp = rp.bc;
 		goto write_data_rg_a;
 	
-	case 0x12: // LD (DE),A
+	case 0x12: OP( 0x12 ) // LD (DE),A
 		temp = rp.de;
 		goto write_data_rg_a;
 	
-	case 0x22: // LD (HL+),A
+	case 0x22: OP( 0x22 ) // LD (HL+),A
 		temp = rp.hl;
 		rp.hl = temp + 1;
 		goto write_data_rg_a;
 		
-	case 0xEA: // LD IND16,A (common)
+	case 0xEA: OP( 0xEA ) // LD IND16,A (common)
 		temp = READ_PROG16( pc );
 		pc += 2;
 	write_data_rg_a:
 		WRITE( temp, rg.a );
-		goto loop;
+		NEXT_INSTR();
 	}
 	
-	case 0x06: // LD B,IMM
+	case 0x06: OP( 0x06 ) // LD B,IMM
 		rg.b = data;
 		pc++;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x0E: // LD C,IMM
+	case 0x0E: OP( 0x0E ) // LD C,IMM
 		rg.c = data;
 		pc++;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x16: // LD D,IMM
+	case 0x16: OP( 0x16 ) // LD D,IMM
 		rg.d = data;
 		pc++;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x1E: // LD E,IMM
+	case 0x1E: OP( 0x1E ) // LD E,IMM
 		rg.e = data;
 		pc++;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x26: // LD H,IMM
+	case 0x26: OP( 0x26 ) // LD H,IMM
 		rg.h = data;
 		pc++;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x2E: // LD L,IMM
+	case 0x2E: OP( 0x2E ) // LD L,IMM
 		rg.l = data;
 		pc++;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x36: // LD (HL),IMM
+	case 0x36: OP( 0x36 ) // LD (HL),IMM
 		WRITE( rp.hl, data );
 		pc++;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x3E: // LD A,IMM
+	case 0x3E: OP( 0x3E ) // LD A,IMM
 		rg.a = data;
 		pc++;
-		goto loop;
+		NEXT_INSTR();
 
 // Increment/Decrement
 
-	case 0x03: // INC BC
-	case 0x13: // INC DE
-	case 0x23: // INC HL
+	case 0x03: OP( 0x03 ) // INC BC
+	case 0x13: OP( 0x13 ) // INC DE
+	case 0x23: OP( 0x23 ) // INC HL
 		r16 [op >> 4]++;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x33: // INC SP
+	case 0x33: OP( 0x33 ) // INC SP
 		sp = (sp + 1) & 0xFFFF;
-		goto loop;
+		NEXT_INSTR();
 
-	case 0x0B: // DEC BC
-	case 0x1B: // DEC DE
-	case 0x2B: // DEC HL
+	case 0x0B: OP( 0x0B ) // DEC BC
+	case 0x1B: OP( 0x1B ) // DEC DE
+	case 0x2B: OP( 0x2B ) // DEC HL
 		r16 [op >> 4]--;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x3B: // DEC SP
+	case 0x3B: OP( 0x3B ) // DEC SP
 		sp = (sp - 1) & 0xFFFF;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x34: // INC (HL)
+	case 0x34: OP( 0x34 ) // INC (HL)
 		op = rp.hl;
 		data = READ( op );
 		data++;
 		WRITE( op, data & 0xff );
 		goto inc_comm;
 	
-	case 0x04: // INC B
-	case 0x0C: // INC C (common)
-	case 0x14: // INC D
-	case 0x1C: // INC E
-	case 0x24: // INC H
-	case 0x2C: // INC L
-	case 0x3C: // INC A
+	case 0x04: OP( 0x04 ) // INC B
+	case 0x0C: OP( 0x0C ) // INC C (common)
+	case 0x14: OP( 0x14 ) // INC D
+	case 0x1C: OP( 0x1C ) // INC E
+	case 0x24: OP( 0x24 ) // INC H
+	case 0x2C: OP( 0x2C ) // INC L
+	case 0x3C: OP( 0x3C ) // INC A
 		op = (op >> 3) & 7;
 		R8( op ) = data = R8( op ) + 1;
 	inc_comm:
 		flags = (flags & c_flag) | (((data & 15) - 1) & h_flag) | ((data >> 1) & z_flag);
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x35: // DEC (HL)
+	case 0x35: OP( 0x35 ) // DEC (HL)
 		op = rp.hl;
 		data = READ( op );
 		data--;
 		WRITE( op, data & 0xff );
 		goto dec_comm;
 	
-	case 0x05: // DEC B
-	case 0x0D: // DEC C
-	case 0x15: // DEC D
-	case 0x1D: // DEC E
-	case 0x25: // DEC H
-	case 0x2D: // DEC L
-	case 0x3D: // DEC A
+	case 0x05: OP( 0x05 ) // DEC B
+	case 0x0D: OP( 0x0D ) // DEC C
+	case 0x15: OP( 0x15 ) // DEC D
+	case 0x1D: OP( 0x1D ) // DEC E
+	case 0x25: OP( 0x25 ) // DEC H
+	case 0x2D: OP( 0x2D ) // DEC L
+	case 0x3D: OP( 0x3D ) // DEC A
 		op = (op >> 3) & 7;
 		data = R8( op ) - 1;
 		R8( op ) = data;
 	dec_comm:
 		flags = (flags & c_flag) | n_flag | (((data & 15) + 0x31) & h_flag);
 		if ( data & 0xff )
-			goto loop;
+			NEXT_INSTR();
 		flags |= z_flag;
-		goto loop;
+		NEXT_INSTR();
 
 // Add 16-bit
 
@@ -733,7 +820,7 @@ loop:
 		unsigned long temp; // need more than 16 bits for carry
 		unsigned prev;
 		
-	case 0xF8: // LD HL,SP+imm
+	case 0xF8: OP( 0xF8 ) // LD HL,SP+imm
 		temp = BOOST::int8_t (data); // sign-extend to 16 bits
 		pc++;
 		flags = 0;
@@ -741,7 +828,7 @@ loop:
 		prev = sp;
 		goto add_16_hl;
 	
-	case 0xE8: // ADD SP,IMM
+	case 0xE8: OP( 0xE8 ) // ADD SP,IMM
 		temp = BOOST::int8_t (data); // sign-extend to 16 bits
 		pc++;
 		flags = 0;
@@ -750,13 +837,13 @@ loop:
 		sp = temp & 0xffff;
 		goto add_16_comm;
 
-	case 0x39: // ADD HL,SP
+	case 0x39: OP( 0x39 ) // ADD HL,SP
 		temp = sp;
 		goto add_hl_comm;
 	
-	case 0x09: // ADD HL,BC
-	case 0x19: // ADD HL,DE
-	case 0x29: // ADD HL,HL
+	case 0x09: OP( 0x09 ) // ADD HL,BC
+	case 0x19: OP( 0x19 ) // ADD HL,DE
+	case 0x29: OP( 0x29 ) // ADD HL,HL
 		temp = r16 [op >> 4];
 	add_hl_comm:
 		prev = rp.hl;
@@ -767,24 +854,24 @@ loop:
 	add_16_comm:
 		flags |= (temp >> 12) & c_flag;
 		flags |= (((temp & 0x0fff) - (prev & 0x0fff)) >> 7) & h_flag;
-		goto loop;
+		NEXT_INSTR();
 	}
 	
-	case 0x86: // ADD (HL)
+	case 0x86: OP( 0x86 ) // ADD (HL)
 		data = READ( rp.hl );
 		goto add_comm;
 	
-	case 0x80: // ADD B
-	case 0x81: // ADD C
-	case 0x82: // ADD D
-	case 0x83: // ADD E
-	case 0x84: // ADD H
-	case 0x85: // ADD L
-	case 0x87: // ADD A
+	case 0x80: OP( 0x80 ) // ADD B
+	case 0x81: OP( 0x81 ) // ADD C
+	case 0x82: OP( 0x82 ) // ADD D
+	case 0x83: OP( 0x83 ) // ADD E
+	case 0x84: OP( 0x84 ) // ADD H
+	case 0x85: OP( 0x85 ) // ADD L
+	case 0x87: OP( 0x87 ) // ADD A
 		data = R8( op & 7 );
 		goto add_comm;
 	
-	case 0xC6: // ADD IMM
+	case 0xC6: OP( 0xC6 ) // ADD IMM
 		pc++;
 	add_comm:
 		flags = rg.a;
@@ -793,48 +880,48 @@ loop:
 		flags |= (data >> 4) & c_flag;
 		rg.a = data;
 		if ( data & 0xff )
-			goto loop;
+			NEXT_INSTR();
 		flags |= z_flag;
-		goto loop;
+		NEXT_INSTR();
 
 // Add/Subtract
 
-	case 0x8E: // ADC (HL)
+	case 0x8E: OP( 0x8E ) // ADC (HL)
 		data = READ( rp.hl );
 		goto adc_comm;
 	
-	case 0x88: // ADC B
-	case 0x89: // ADC C
-	case 0x8A: // ADC D
-	case 0x8B: // ADC E
-	case 0x8C: // ADC H
-	case 0x8D: // ADC L
-	case 0x8F: // ADC A
+	case 0x88: OP( 0x88 ) // ADC B
+	case 0x89: OP( 0x89 ) // ADC C
+	case 0x8A: OP( 0x8A ) // ADC D
+	case 0x8B: OP( 0x8B ) // ADC E
+	case 0x8C: OP( 0x8C ) // ADC H
+	case 0x8D: OP( 0x8D ) // ADC L
+	case 0x8F: OP( 0x8F ) // ADC A
 		data = R8( op & 7 );
 		goto adc_comm;
 	
-	case 0xCE: // ADC IMM
+	case 0xCE: OP( 0xCE ) // ADC IMM
 		pc++;
 	adc_comm:
 		data += (flags >> 4) & 1;
 		data &= 0xff; // to do: does carry get set when sum + carry = 0x100?
 		goto add_comm;
 
-	case 0x96: // SUB (HL)
+	case 0x96: OP( 0x96 ) // SUB (HL)
 		data = READ( rp.hl );
 		goto sub_comm;
 	
-	case 0x90: // SUB B
-	case 0x91: // SUB C
-	case 0x92: // SUB D
-	case 0x93: // SUB E
-	case 0x94: // SUB H
-	case 0x95: // SUB L
-	case 0x97: // SUB A
+	case 0x90: OP( 0x90 ) // SUB B
+	case 0x91: OP( 0x91 ) // SUB C
+	case 0x92: OP( 0x92 ) // SUB D
+	case 0x93: OP( 0x93 ) // SUB E
+	case 0x94: OP( 0x94 ) // SUB H
+	case 0x95: OP( 0x95 ) // SUB L
+	case 0x97: OP( 0x97 ) // SUB A
 		data = R8( op & 7 );
 		goto sub_comm;
 	
-	case 0xD6: // SUB IMM
+	case 0xD6: OP( 0xD6 ) // SUB IMM
 		pc++;
 	sub_comm:
 		op = rg.a;
@@ -842,21 +929,21 @@ loop:
 		rg.a = data;
 		goto sub_set_flags;
 
-	case 0x9E: // SBC (HL)
+	case 0x9E: OP( 0x9E ) // SBC (HL)
 		data = READ( rp.hl );
 		goto sbc_comm;
 	
-	case 0x98: // SBC B
-	case 0x99: // SBC C
-	case 0x9A: // SBC D
-	case 0x9B: // SBC E
-	case 0x9C: // SBC H
-	case 0x9D: // SBC L
-	case 0x9F: // SBC A
+	case 0x98: OP( 0x98 ) // SBC B
+	case 0x99: OP( 0x99 ) // SBC C
+	case 0x9A: OP( 0x9A ) // SBC D
+	case 0x9B: OP( 0x9B ) // SBC E
+	case 0x9C: OP( 0x9C ) // SBC H
+	case 0x9D: OP( 0x9D ) // SBC L
+	case 0x9F: OP( 0x9F ) // SBC A
 		data = R8( op & 7 );
 		goto sbc_comm;
 	
-	case 0xDE: // SBC IMM
+	case 0xDE: OP( 0xDE ) // SBC IMM
 		pc++;
 	sbc_comm:
 		data += (flags >> 4) & 1;
@@ -865,234 +952,236 @@ loop:
 
 // Logical
 
-	case 0xA0: // AND B
-	case 0xA1: // AND C
-	case 0xA2: // AND D
-	case 0xA3: // AND E
-	case 0xA4: // AND H
-	case 0xA5: // AND L
+	case 0xA0: OP( 0xA0 ) // AND B
+	case 0xA1: OP( 0xA1 ) // AND C
+	case 0xA2: OP( 0xA2 ) // AND D
+	case 0xA3: OP( 0xA3 ) // AND E
+	case 0xA4: OP( 0xA4 ) // AND H
+	case 0xA5: OP( 0xA5 ) // AND L
 		data = R8( op & 7 );
 		goto and_comm;
 	
-	case 0xA6: // AND (HL)
+	case 0xA6: OP( 0xA6 ) // AND (HL)
 		data = READ( rp.hl );
 		pc--;
 		//fallthrough
-	case 0xE6: // AND IMM
+	case 0xE6: OP( 0xE6 ) // AND IMM
 		pc++;
 	and_comm:
 		rg.a &= data;
 		//fallthrough
-	case 0xA7: // AND A
+	case 0xA7: OP( 0xA7 ) // AND A
 		flags = h_flag | (((rg.a - 1) >> 1) & z_flag);
-		goto loop;
-
-	case 0xB0: // OR B
-	case 0xB1: // OR C
-	case 0xB2: // OR D
-	case 0xB3: // OR E
-	case 0xB4: // OR H
-	case 0xB5: // OR L
+		NEXT_INSTR();
+
+	case 0xB0: OP( 0xB0 ) // OR B
+	case 0xB1: OP( 0xB1 ) // OR C
+	case 0xB2: OP( 0xB2 ) // OR D
+	case 0xB3: OP( 0xB3 ) // OR E
+	case 0xB4: OP( 0xB4 ) // OR H
+	case 0xB5: OP( 0xB5 ) // OR L
 		data = R8( op & 7 );
 		goto or_comm;
 	
-	case 0xB6: // OR (HL)
+	case 0xB6: OP( 0xB6 ) // OR (HL)
 		data = READ( rp.hl );
 		pc--;
 		//fallthrough
-	case 0xF6: // OR IMM
+	case 0xF6: OP( 0xF6 ) // OR IMM
 		pc++;
 	or_comm:
 		rg.a |= data;
 		//fallthrough
-	case 0xB7: // OR A
+	case 0xB7: OP( 0xB7 ) // OR A
 		flags = ((rg.a - 1) >> 1) & z_flag;
-		goto loop;
-
-	case 0xA8: // XOR B
-	case 0xA9: // XOR C
-	case 0xAA: // XOR D
-	case 0xAB: // XOR E
-	case 0xAC: // XOR H
-	case 0xAD: // XOR L
+		NEXT_INSTR();
+
+	case 0xA8: OP( 0xA8 ) // XOR B
+	case 0xA9: OP( 0xA9 ) // XOR C
+	case 0xAA: OP( 0xAA ) // XOR D
+	case 0xAB: OP( 0xAB ) // XOR E
+	case 0xAC: OP( 0xAC ) // XOR H
+	case 0xAD: OP( 0xAD ) // XOR L
 		data = R8( op & 7 );
 		goto xor_comm;
 	
-	case 0xAE: // XOR (HL)
+	case 0xAE: OP( 0xAE ) // XOR (HL)
 		data = READ( rp.hl );
 		pc--;
 		//fallthrough
-	case 0xEE: // XOR IMM
+	case 0xEE: OP( 0xEE ) // XOR IMM
 		pc++;
 	xor_comm:
 		data ^= rg.a;
 		rg.a = data;
 		data--;
 		flags = (data >> 1) & z_flag;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xAF: // XOR A
+	case 0xAF: OP( 0xAF ) // XOR A
 		rg.a = 0;
 		flags = z_flag;
-		goto loop;
+		NEXT_INSTR();
 
 // Stack
 
-	case 0xC1: // POP BC
-	case 0xD1: // POP DE
-	case 0xE1:{// POP HL (common)
+	case 0xC1: OP( 0xC1 ) // POP BC
+	case 0xD1: OP( 0xD1 ) // POP DE
+	case 0xE1: OP( 0xE1 ){// POP HL (common)
 		int temp = READ( sp );
 		r16 [(op >> 4) & 3] = temp + 0x100 * READ( (sp + 1) & 0xFFFF );
 		sp = (sp + 2) & 0xFFFF;
-		goto loop;
+		NEXT_INSTR();
 	}
 	
-	case 0xF1: // POP FA
+	case 0xF1: OP( 0xF1 ) // POP FA
 		rg.a = READ( sp );
 		flags = READ( (sp + 1) & 0xFFFF ) & 0xf0;
 		sp = (sp + 2) & 0xFFFF;
-		goto loop;
+		NEXT_INSTR();
 
-	case 0xC5: // PUSH BC
+	case 0xC5: OP( 0xC5 ) // PUSH BC
 		data = rp.bc;
 		goto push;
 	
-	case 0xD5: // PUSH DE
+	case 0xD5: OP( 0xD5 ) // PUSH DE
 		data = rp.de;
 		goto push;
 	
-	case 0xE5: // PUSH HL
+	case 0xE5: OP( 0xE5 ) // PUSH HL
 		data = rp.hl;
 		goto push;
 	
-	case 0xF5: // PUSH FA
+	case 0xF5: OP( 0xF5 ) // PUSH FA
 		data = (flags << 8) | rg.a;
 		goto push;
 
 // Flow control
 
-	case 0xC7: case 0xCF: case 0xD7: case 0xDF:  // RST
-	case 0xE7: case 0xEF: case 0xF7: case 0xFF:
+	case 0xC7: OP( 0xC7 ) case 0xCF: OP( 0xCF ) case 0xD7: OP( 0xD7 ) case 0xDF: OP( 0xDF )  // RST
+	case 0xE7: OP( 0xE7 ) case 0xEF: OP( 0xEF ) case 0xF7: OP( 0xF7 ) case 0xFF: OP( 0xFF )
 		data = pc;
 		pc = (op & 0x38) + rst_base;
 		goto push;
 
-	case 0xCC: // CZ
+	case 0xCC: OP( 0xCC ) // CZ
 		pc += 2;
 		if ( flags & z_flag )
 			goto call;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xD4: // CNC
+	case 0xD4: OP( 0xD4 ) // CNC
 		pc += 2;
 		if ( !(flags & c_flag) )
 			goto call;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xDC: // CC
+	case 0xDC: OP( 0xDC ) // CC
 		pc += 2;
 		if ( flags & c_flag )
 			goto call;
-		goto loop;
+		NEXT_INSTR();
 
-	case 0xD9: // RETI
+	case 0xD9: OP( 0xD9 ) // RETI
 		Gb_Cpu::interrupts_enabled = 1;
 		goto ret;
 	
-	case 0xC0: // RZ
+	case 0xC0: OP( 0xC0 ) // RZ
 		if ( !(flags & z_flag) )
 			goto ret;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xD0: // RNC
+	case 0xD0: OP( 0xD0 ) // RNC
 		if ( !(flags & c_flag) )
 			goto ret;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xD8: // RC
+	case 0xD8: OP( 0xD8 ) // RC
 		if ( flags & c_flag )
 			goto ret;
-		goto loop;
+		NEXT_INSTR();
 
-	case 0x18: // JR
+	case 0x18: OP( 0x18 ) // JR
 		BRANCH( true )
 	
-	case 0x30: // JR NC
+	case 0x30: OP( 0x30 ) // JR NC
 		BRANCH( !(flags & c_flag) )
 	
-	case 0x38: // JR C
+	case 0x38: OP( 0x38 ) // JR C
 		BRANCH( flags & c_flag )
 	
-	case 0xE9: // JP_HL
+	case 0xE9: OP( 0xE9 ) // JP_HL
 		pc = rp.hl;
-		goto loop;
+		NEXT_INSTR();
 
-	case 0xC3: // JP (next-most-common)
+	case 0xC3: OP( 0xC3 ) // JP (next-most-common)
 		pc = READ_PROG16( pc );
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xC2: // JP NZ
+	case 0xC2: OP( 0xC2 ) // JP NZ
 		pc += 2;
 		if ( !(flags & z_flag) )
 			goto jp_taken;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xCA: // JP Z (most common)
+	case 0xCA: OP( 0xCA ) // JP Z (most common)
 		pc += 2;
 		if ( !(flags & z_flag) )
-			goto loop;
+			NEXT_INSTR();
 	jp_taken:
 		pc -= 2;
 		pc = READ_PROG16( pc );
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xD2: // JP NC
+	case 0xD2: OP( 0xD2 ) // JP NC
 		pc += 2;
 		if ( !(flags & c_flag) )
 			goto jp_taken;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xDA: // JP C
+	case 0xDA: OP( 0xDA ) // JP C
 		pc += 2;
 		if ( flags & c_flag )
 			goto jp_taken;
-		goto loop;
+		NEXT_INSTR();
 
 // Flags
 
-	case 0x2F: // CPL
+	case 0x2F: OP( 0x2F ) // CPL
 		rg.a = ~rg.a;
 		flags |= n_flag | h_flag;
-		goto loop;
+		NEXT_INSTR();
 
-	case 0x3F: // CCF
+	case 0x3F: OP( 0x3F ) // CCF
 		flags = (flags ^ c_flag) & ~(n_flag | h_flag);
-		goto loop;
+		NEXT_INSTR();
 
-	case 0x37: // SCF
+	case 0x37: OP( 0x37 ) // SCF
 		flags = (flags | c_flag) & ~(n_flag | h_flag);
-		goto loop;
+		NEXT_INSTR();
 
-	case 0xF3: // DI
+	case 0xF3: OP( 0xF3 ) // DI
 		interrupts_enabled = 0;
-		goto loop;
+		NEXT_INSTR();
 
-	case 0xFB: // EI
+	case 0xFB: OP( 0xFB ) // EI
 		interrupts_enabled = 1;
-		goto loop;
+		NEXT_INSTR();
 
 // Special
 
-	case 0xDD: case 0xD3: case 0xDB: case 0xE3: case 0xE4: // ?
-	case 0xEB: case 0xEC: case 0xF4: case 0xFD: case 0xFC:
-	case 0x10: // STOP
-	case 0x27: // DAA (I'll have to implement this eventually...)
-	case 0xBF:
-	case 0xED: // Z80 prefix
+	case 0xDD: OP( 0xDD ) case 0xD3: OP( 0xD3 ) case 0xDB: OP( 0xDB ) case 0xE3: OP( 0xE3 ) // ?
+	case 0xE4: OP( 0xE4 )
+	case 0xEB: OP( 0xEB ) case 0xEC: OP( 0xEC ) case 0xF4: OP( 0xF4 ) case 0xFD: OP( 0xFD )
+	case 0xFC: OP( 0xFC )
+	case 0x10: OP( 0x10 ) // STOP
+	case 0x27: OP( 0x27 ) // DAA (I'll have to implement this eventually...)
+	case 0xBF: OP( 0xBF )
+	case 0xED: OP( 0xED ) // Z80 prefix
 		result = Gb_Cpu::result_badop;
 		goto stop;
 	
-	case 0x76: // HALT
+	case 0x76: OP( 0x76 ) // HALT
 		result = Gb_Cpu::result_halt;
 		goto stop;
 	}
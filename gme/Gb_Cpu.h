@@ -38,7 +38,8 @@ public:
 	// Map code memory to 'code' (memory accessed via the program counter)
 	void map_code( gb_addr_t start, unsigned long size, const void* code );
 	
-	// Map data memory to read and write functions
+	// Map data memory to read and write functions. A NULL reader reads directly from
+	// the code memory mapped there, avoiding a function call.
 	void map_memory( gb_addr_t start, unsigned long size, reader_t, writer_t );
 	
 	// Access memory as the emulated CPU does.
@@ -84,6 +85,13 @@ public:
 	// Number of clock cycles remaining for most recent run() call
 	long remain() const;
 	
+	// Save/load CPU state between calls to run(). Code mapping is saved as page
+	// pointers, so a snapshot can only be loaded back into the same CPU with the
+	// same memory still mapped.
+	struct snapshot_t;
+	void save_snapshot( snapshot_t* ) const;
+	void load_snapshot( snapshot_t const& );
+	
 private:
 	// noncopyable
 	Gb_Cpu( const Gb_Cpu& );
@@ -94,6 +102,13 @@ private:
 	void set_code_page( int, uint8_t const* );
 };
 
+struct Gb_Cpu::snapshot_t
+{
+	registers_t r;
+	bool interrupts_enabled;
+	uint8_t const* code_map [page_count + 1];
+};
+
 inline long Gb_Cpu::remain() const
 {
 	return remain_;
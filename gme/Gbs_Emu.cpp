@@ -34,11 +34,6 @@ Gbs_Emu::equalizer_t const Gbs_Emu::headphones_eq = {   0.0, 300 };
 
 // RAM
 
-int Gbs_Emu::read_ram( Gbs_Emu* emu, gb_addr_t addr )
-{
-	return emu->ram [addr - ram_addr];
-}
-
 void Gbs_Emu::write_ram( Gbs_Emu* emu, gb_addr_t addr, int data )
 {
 	emu->ram [addr - ram_addr] = data;
@@ -59,14 +54,15 @@ void Gbs_Emu::write_unmapped( Gbs_Emu*, gb_addr_t addr, int )
 
 // ROM
 
-int Gbs_Emu::read_rom( Gbs_Emu* emu, gb_addr_t addr )
-{
-	return emu->rom [addr];
-}
-
-int Gbs_Emu::read_bank( Gbs_Emu* emu, gb_addr_t addr )
+// Banks that lie entirely within file data are mapped straight from it
+Gbs_Emu::byte const* Gbs_Emu::bank_data( int n ) const
 {
-	return emu->rom_bank [addr & (bank_size - 1)];
+	long offset = n * bank_size - (long) load_addr;
+	if ( offset >= 0 && offset + bank_size <= rom_size )
+		return rom_data + offset;
+	
+	int lead_banks = (load_addr + bank_size - 1) / bank_size;
+	return &rom_edges [(offset < 0 ? n : lead_banks) * bank_size];
 }
 
 void Gbs_Emu::set_bank( int n )
@@ -83,8 +79,8 @@ void Gbs_Emu::set_bank( int n )
 		//return;
 		//dprintf( "Selected ROM bank 0\n" );
 	}
-	rom_bank = &rom [n * bank_size];
-	cpu.map_code( bank_size, bank_size, rom_bank );
+	rom_bank = n;
+	cpu.map_code( bank_size, bank_size, bank_data( n ) );
 }
 
 void Gbs_Emu::write_rom( Gbs_Emu* emu, gb_addr_t addr, int data )
@@ -155,11 +151,16 @@ Gbs_Emu::Gbs_Emu( double gain ) : cpu( this )
  	// unmapped code is all HALT instructions
 	memset( unmapped_code, 0x76, sizeof unmapped_code );
 	
-	// cpu
+	rom_bank = 0;
+	rom_data = NULL;
+	rom_size = 0;
+	bank_count = 0;
+	
+	// cpu; pages with NULL readers are read directly from their code mapping
 	cpu.reset( unmapped_code, read_unmapped, write_unmapped );
-	cpu.map_memory( 0x0000, 0x4000, read_rom, write_rom );
-	cpu.map_memory( 0x4000, 0x4000, read_bank, write_rom );
-	cpu.map_memory( ram_addr, 0x4000, read_ram, write_ram );
+	cpu.map_memory( 0x0000, 0x4000, NULL, write_rom );
+	cpu.map_memory( 0x4000, 0x4000, NULL, write_rom );
+	cpu.map_memory( ram_addr, 0x4000, NULL, write_ram );
 	cpu.map_code(   ram_addr, 0x4000, ram );
 	cpu.map_code(   0xFF00, 0x0100, hi_page );
 	cpu.map_memory( 0xFF00, 0x0100, read_io, write_io );
@@ -173,6 +174,9 @@ void Gbs_Emu::unload()
 {
 	cpu.r.pc = halt_addr;
 	rom.clear();
+	rom_edges.clear();
+	rom_data = NULL;
+	rom_size = 0;
 }
 
 void Gbs_Emu::set_voice( int i, Blip_Buffer* c, Blip_Buffer* l, Blip_Buffer* r )
@@ -194,8 +198,29 @@ blargg_err_t Gbs_Emu::load( Data_Reader& in )
 
 blargg_err_t Gbs_Emu::load( const header_t& h, Data_Reader& in )
 {
-	header_ = h;
 	unload();
+	BLARGG_RETURN_ERR( rom.resize( in.remain() ) );
+	blargg_err_t err = in.read( rom.begin(), rom.size() );
+	if ( err )
+	{
+		unload();
+		return err;
+	}
+	return load_( h, rom.begin(), rom.size() );
+}
+
+blargg_err_t Gbs_Emu::load_mem( void const* data, long size )
+{
+	unload();
+	if ( size < (long) sizeof (header_t) )
+		return "Not a GBS file";
+	return load_( *(header_t const*) data, (byte const*) data + sizeof (header_t),
+			size - sizeof (header_t) );
+}
+
+blargg_err_t Gbs_Emu::load_( const header_t& h, byte const* data, long size )
+{
+	header_ = h;
 	
 	// check compatibility
 	if ( 0 != memcmp( header_.tag, "GBS", 3 ) )
@@ -226,20 +251,36 @@ blargg_err_t Gbs_Emu::load( const header_t& h, Data_Reader& in )
 	}
 	#endif
 	
-	// rom
-	bank_count = (load_addr + in.remain() + bank_size - 1) / bank_size;
-	BLARGG_RETURN_ERR( rom.resize( bank_count * bank_size ) );
-	memset( rom.begin(), 0, rom.size() );
-	blargg_err_t err = in.read( &rom [load_addr], in.remain() );
+	// rom; banks overlapping the start or end of file data are copied
+	rom_data = data;
+	rom_size = size;
+	bank_count = (load_addr + size + bank_size - 1) / bank_size;
+	int lead_banks = (load_addr + bank_size - 1) / bank_size;
+	blargg_err_t err = rom_edges.resize( (lead_banks + 1) * bank_size );
 	if ( err )
 	{
 		unload();
 		return err;
 	}
+	memset( rom_edges.begin(), 0, rom_edges.size() );
+	for ( int n = 0; n < bank_count; n++ )
+	{
+		long offset = n * bank_size - (long) load_addr;
+		long end = offset + bank_size;
+		if ( offset >= 0 && end <= size )
+			continue;
+		
+		byte* out = &rom_edges [(offset < 0 ? n : lead_banks) * bank_size];
+		long begin = (offset < 0 ? 0 : offset);
+		if ( end > size )
+			end = size;
+		if ( end > begin )
+			memcpy( out + (begin - offset), data + begin, end - begin );
+	}
 	
 	// cpu
 	cpu.rst_base = load_addr;
-	cpu.map_code( 0x0000, 0x4000, rom.begin() );
+	cpu.map_code( 0x0000, 0x4000, bank_data( 0 ) );
 	
 	set_voice_count( Gb_Apu::osc_count );
 	set_track_count( header_.track_count );
@@ -275,7 +316,7 @@ void Gbs_Emu::cpu_jsr( gb_addr_t addr )
 
 void Gbs_Emu::start_track( int track_index )
 {
-	require( rom.size() ); // file must be loaded
+	require( rom_edges.size() ); // file must be loaded
 	
 	Classic_Emu::start_track( track_index );
 	
@@ -306,9 +347,53 @@ void Gbs_Emu::start_track( int track_index )
 	cpu_jsr( init_addr );
 }
 
+// Save states
+
+struct Gbs_Emu::state_t
+{
+	Gb_Cpu::snapshot_t cpu;
+	Gb_Apu::snapshot_t apu;
+	long rom_bank;
+	gb_time_t play_period;
+	gb_time_t next_play;
+	byte hi_page [0x100];
+	byte ram [0x4000];
+};
+
+long Gbs_Emu::state_size() const
+{
+	return sizeof (state_t);
+}
+
+void Gbs_Emu::save_state( void* out ) const
+{
+	state_t* state = (state_t*) out;
+	cpu.save_snapshot( &state->cpu );
+	apu.save_snapshot( &state->apu );
+	state->rom_bank = rom_bank;
+	state->play_period = play_period;
+	state->next_play = next_play;
+	memcpy( state->hi_page, hi_page, sizeof hi_page );
+	memcpy( state->ram, ram, sizeof ram );
+}
+
+void Gbs_Emu::load_state( void const* in )
+{
+	Classic_Emu::load_state( in );
+	
+	state_t const* state = (state_t const*) in;
+	cpu.load_snapshot( state->cpu );
+	apu.load_snapshot( state->apu );
+	rom_bank = state->rom_bank;
+	play_period = state->play_period;
+	next_play = state->next_play;
+	memcpy( hi_page, state->hi_page, sizeof hi_page );
+	memcpy( ram, state->ram, sizeof ram );
+}
+
 blip_time_t Gbs_Emu::run_clocks( blip_time_t duration, bool* added_stereo )
 {
-	require( rom.size() ); // file must be loaded
+	require( rom_edges.size() ); // file must be loaded
 	
 	cpu_time = 0;
 	while ( cpu_time < duration )
@@ -44,6 +44,10 @@ public:
 	// Load GBS using already-loaded header and remaining data
 	blargg_err_t load( header_t const&, Data_Reader& );
 	
+	// Load GBS file in memory, referencing its ROM data rather than copying it.
+	// See Music_Emu::load_mem().
+	blargg_err_t load_mem( void const*, long size );
+	
 	// Header for currently loaded GBS
 	header_t const& header() const { return header_; }
 	
@@ -59,16 +63,23 @@ protected:
 	void set_voice( int, Blip_Buffer*, Blip_Buffer*, Blip_Buffer* );
 	void update_eq( blip_eq_t const& );
 	blip_time_t run_clocks( blip_time_t, bool* );
+	long state_size() const;
+	void save_state( void* ) const;
+	void load_state( void const* );
 private:
+	struct state_t;
 	// rom
-	const byte* rom_bank;
-	blargg_vector<byte> rom;
+	int rom_bank;
+	blargg_vector<byte> rom;        // file data when loaded from a Data_Reader
+	blargg_vector<byte> rom_edges;  // copies of banks not entirely within file data
+	byte const* rom_data;           // file data after header, at load address
+	long rom_size;
+	byte const* bank_data( int ) const;
+	blargg_err_t load_( header_t const&, byte const* data, long size );
 	void unload();
 	int bank_count;
 	void set_bank( int );
 	static void write_rom( Gbs_Emu*, gb_addr_t, int );
-	static int read_rom( Gbs_Emu*, gb_addr_t );
-	static int read_bank( Gbs_Emu*, gb_addr_t );
 	
 	// state
 	gb_addr_t load_addr;
@@ -100,7 +111,6 @@ private:
 	void cpu_jsr( gb_addr_t );
 	gb_time_t clock() const;
 	byte ram [0x4000];
-	static int read_ram( Gbs_Emu*, gb_addr_t );
 	static void write_ram( Gbs_Emu*, gb_addr_t, int );
 };
 
@@ -3,6 +3,10 @@
 
 #include "Multi_Buffer.h"
 
+#if BLIP_BUFFER_SSE2
+	#include <emmintrin.h>
+#endif
+
 /* Copyright (C) 2003-2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
 General Public License as published by the Free Software Foundation; either
@@ -165,6 +169,46 @@ void Stereo_Buffer::mix_stereo( blip_sample_t* out, long count )
 	right.begin( bufs [2] );
 	int bass = center.begin( bufs [0] );
 	
+#if BLIP_BUFFER_SSE2
+	// integrate a block of each channel, then sum, saturate and interleave with
+	// SIMD; fall back to the loop below for out-of-range blocks and the tail
+	int const block_size = 256;
+	int c [block_size];
+	int l [block_size];
+	int r [block_size];
+	while ( count >= block_size )
+	{
+		Blip_Reader saved_center = center;
+		Blip_Reader saved_left = left;
+		Blip_Reader saved_right = right;
+		if ( !center.read_block( c, block_size, bass ) ||
+				!left.read_block( l, block_size, bass ) ||
+				!right.read_block( r, block_size, bass ) )
+		{
+			center = saved_center;
+			left = saved_left;
+			right = saved_right;
+			break;
+		}
+		
+		for ( int i = 0; i < block_size; i += 8 )
+		{
+			__m128i c0 = _mm_loadu_si128( (__m128i const*) (c + i) );
+			__m128i c1 = _mm_loadu_si128( (__m128i const*) (c + i + 4) );
+			__m128i lo = _mm_packs_epi32(
+					_mm_add_epi32( c0, _mm_loadu_si128( (__m128i const*) (l + i) ) ),
+					_mm_add_epi32( c1, _mm_loadu_si128( (__m128i const*) (l + i + 4) ) ) );
+			__m128i ro = _mm_packs_epi32(
+					_mm_add_epi32( c0, _mm_loadu_si128( (__m128i const*) (r + i) ) ),
+					_mm_add_epi32( c1, _mm_loadu_si128( (__m128i const*) (r + i + 4) ) ) );
+			_mm_storeu_si128( (__m128i*) (out + i * 2), _mm_unpacklo_epi16( lo, ro ) );
+			_mm_storeu_si128( (__m128i*) (out + i * 2 + 8), _mm_unpackhi_epi16( lo, ro ) );
+		}
+		out += block_size * 2;
+		count -= block_size;
+	}
+#endif
+	
 	while ( count-- )
 	{
 		int c = center.read();
@@ -195,6 +239,30 @@ void Stereo_Buffer::mix_mono( blip_sample_t* out, long count )
 	Blip_Reader in;
 	int bass = in.begin( bufs [0] );
 	
+#if BLIP_BUFFER_SSE2
+	int const block_size = 256;
+	int block [block_size];
+	while ( count >= block_size )
+	{
+		Blip_Reader saved = in;
+		if ( !in.read_block( block, block_size, bass ) )
+		{
+			in = saved;
+			break;
+		}
+		
+		for ( int i = 0; i < block_size; i += 8 )
+		{
+			__m128i s = _mm_packs_epi32( _mm_loadu_si128( (__m128i const*) (block + i) ),
+					_mm_loadu_si128( (__m128i const*) (block + i + 4) ) );
+			_mm_storeu_si128( (__m128i*) (out + i * 2), _mm_unpacklo_epi16( s, s ) );
+			_mm_storeu_si128( (__m128i*) (out + i * 2 + 8), _mm_unpackhi_epi16( s, s ) );
+		}
+		out += block_size * 2;
+		count -= block_size;
+	}
+#endif
+	
 	while ( count-- )
 	{
 		long s = in.read();
@@ -213,3 +281,126 @@ void Stereo_Buffer::mix_mono( blip_sample_t* out, long count )
 	in.end( bufs [0] );
 }
 
+
+// Stem_Buffer
+
+Stem_Buffer::Stem_Buffer() : Multi_Buffer( 1 )
+{
+	channel_count = 1;
+}
+
+Stem_Buffer::~Stem_Buffer()
+{
+}
+
+blargg_err_t Stem_Buffer::set_channel_count( int n )
+{
+	if ( n > max_channels )
+		return "Too many channels for Stem_Buffer";
+	channel_count = (n > 0 ? n : 1);
+	channels_changed();
+	return blargg_success;
+}
+
+blargg_err_t Stem_Buffer::set_sample_rate( long rate, int msec )
+{
+	for ( int i = 0; i < max_channels; i++ )
+		BLARGG_RETURN_ERR( bufs [i].set_sample_rate( rate, msec ) );
+	return Multi_Buffer::set_sample_rate( bufs [0].sample_rate(), bufs [0].length() );
+}
+
+void Stem_Buffer::clock_rate( long rate )
+{
+	for ( int i = 0; i < max_channels; i++ )
+		bufs [i].clock_rate( rate );
+}
+
+void Stem_Buffer::bass_freq( int bass )
+{
+	for ( int i = 0; i < max_channels; i++ )
+		bufs [i].bass_freq( bass );
+}
+
+void Stem_Buffer::clear()
+{
+	for ( int i = 0; i < max_channels; i++ )
+		bufs [i].clear();
+}
+
+Stem_Buffer::channel_t Stem_Buffer::channel( int index )
+{
+	require( (unsigned) index < (unsigned) channel_count );
+	channel_t ch;
+	ch.center = &bufs [index];
+	ch.left   = &bufs [index];
+	ch.right  = &bufs [index];
+	return ch;
+}
+
+void Stem_Buffer::end_frame( blip_time_t clock_count, bool )
+{
+	for ( int i = 0; i < channel_count; i++ )
+		bufs [i].end_frame( clock_count );
+}
+
+long Stem_Buffer::read_channels( blip_sample_t* const* out, long count )
+{
+	long avail = bufs [0].samples_avail();
+	if ( count > avail )
+		count = avail;
+	if ( count )
+	{
+		for ( int i = 0; i < channel_count; i++ )
+		{
+			if ( out [i] )
+				bufs [i].read_samples( out [i], count );
+			else
+				bufs [i].remove_samples( count );
+		}
+	}
+	return count;
+}
+
+long Stem_Buffer::read_samples( blip_sample_t* out, long count )
+{
+	long avail = bufs [0].samples_avail();
+	if ( count > avail )
+		count = avail;
+	
+	// sum a block of every channel, then clamp it
+	int const block_size = 256;
+	long mix [block_size];
+	for ( long remain = count; remain; )
+	{
+		int n = block_size;
+		if ( n > remain )
+			n = remain;
+		remain -= n;
+		
+		for ( int i = 0; i < n; i++ )
+			mix [i] = 0;
+		
+		for ( int c = 0; c < channel_count; c++ )
+		{
+			Blip_Reader in;
+			int bass = in.begin( bufs [c] );
+			for ( int i = 0; i < n; i++ )
+			{
+				mix [i] += in.read();
+				in.next( bass );
+			}
+			in.end( bufs [c] );
+			bufs [c].remove_samples( n );
+		}
+		
+		for ( int i = 0; i < n; i++ )
+		{
+			long s = mix [i];
+			*out++ = s;
+			if ( (BOOST::int16_t) s != s )
+				out [-1] = 0x7FFF - (s >> 24);
+		}
+	}
+	
+	return count;
+}
@@ -1,5 +1,5 @@
 
-// Multi-channel sound buffer interface, and basic mono and stereo buffers
+// Multi-channel sound buffer interface, and basic mono, stereo and per-channel buffers
 
 // Blip_Buffer 0.4.0
 
@@ -120,6 +120,37 @@ private:
 	void mix_mono( blip_sample_t*, long );
 };
 
+// Uses a separate buffer for each channel, so that each channel's mono samples can
+// be read on their own with read_channels(). read_samples() outputs all channels
+// mixed to mono.
+class Stem_Buffer : public Multi_Buffer {
+public:
+	Stem_Buffer();
+	~Stem_Buffer();
+	
+	enum { max_channels = 8 };
+	
+	// Read at most 'count' samples of channel i into out [i] (or discard them if
+	// out [i] is NULL), for each channel set with set_channel_count(). Returns
+	// number of samples read per channel.
+	long read_channels( blip_sample_t* const* out, long count );
+	
+	// See Multi_Buffer
+	blargg_err_t set_channel_count( int );
+	blargg_err_t set_sample_rate( long, int msec = blip_default_length );
+	void clock_rate( long );
+	void bass_freq( int );
+	void clear();
+	channel_t channel( int index );
+	void end_frame( blip_time_t, bool unused = true );
+	long samples_avail() const;
+	long read_samples( blip_sample_t*, long );
+	
+private:
+	Blip_Buffer bufs [max_channels];
+	int channel_count;
+};
+
 // Silent_Buffer generates no samples, useful where no sound is wanted
 class Silent_Buffer : public Multi_Buffer {
 	channel_t chan;
@@ -157,6 +188,8 @@ inline long Stereo_Buffer::samples_avail() const { return bufs [0].samples_avail
 
 inline Stereo_Buffer::channel_t Stereo_Buffer::channel( int ) { return chan; }
 
+inline long Stem_Buffer::samples_avail() const { return bufs [0].samples_avail(); }
+
 inline long Multi_Buffer::sample_rate() const { return sample_rate_; }
 
 inline int Multi_Buffer::length() const { return length_; }
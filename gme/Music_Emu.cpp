@@ -30,12 +30,139 @@ Music_Emu::Music_Emu()
 	track_count_ = 0;
 	error_count_ = 0;
 	track_ended_ = false;
+	current_track = 0;
+	out_time = 0;
+	snapshot_period = 10 * 1000L;
+	snapshot_interval = 0;
+	next_snapshot = LONG_MAX;
+	snapshot_size = 0;
+	snapshot_count = 0;
 }
 
 Music_Emu::~Music_Emu()
 {
 }
 
+void Music_Emu::start_track( int track )
+{
+	assert( (unsigned) track <= (unsigned) track_count() );
+	assert( sample_rate_ ); // set_sample_rate() must have been called first
+	track_ended_ = false;
+	error_count_ = 0;
+	
+	if ( track != current_track || snapshot_size != state_size() )
+		clear_snapshots();
+	current_track = track;
+	out_time = 0;
+	
+	// snapshots are only taken beyond the furthest point already covered
+	snapshot_size = state_size();
+	if ( !snapshot_count )
+		snapshot_interval = snapshot_period * sample_rate_ / 1000 * 2;
+	next_snapshot = LONG_MAX;
+	if ( snapshot_size && snapshot_interval )
+		next_snapshot = (snapshot_count ? snapshot_pos [snapshot_count - 1] : 0) +
+				snapshot_interval;
+}
+
+void Music_Emu::set_snapshot_period( long msec )
+{
+	snapshot_period = msec;
+	clear_snapshots();
+	next_snapshot = LONG_MAX; // takes effect when next track is started
+}
+
+void Music_Emu::clear_snapshots()
+{
+	snapshot_count = 0;
+	snapshots.clear();
+}
+
+blargg_err_t Music_Emu::load_mem( void const* data, long size )
+{
+	Mem_File_Reader in( data, size );
+	return load( in );
+}
+
+blargg_err_t Music_Emu::play_voices( long, sample_t* const* )
+{
+	return "Emulator doesn't support per-voice output";
+}
+
+long Music_Emu::state_size() const { return 0; }
+
+void Music_Emu::save_state( void* ) const { }
+
+void Music_Emu::load_state( void const* ) { }
+
+void Music_Emu::take_snapshot( long pos )
+{
+	if ( snapshot_count >= max_snapshots )
+	{
+		// keep every other snapshot and take them half as often
+		for ( int i = 1; i < max_snapshots / 2; i++ )
+		{
+			snapshot_pos [i] = snapshot_pos [i * 2];
+			memcpy( &snapshots [i * snapshot_size], &snapshots [i * 2 * snapshot_size],
+					snapshot_size );
+		}
+		snapshot_count = max_snapshots / 2;
+		snapshot_interval *= 2;
+	}
+	
+	if ( snapshots.resize( (snapshot_count + 1) * snapshot_size ) )
+	{
+		next_snapshot = LONG_MAX; // out of memory; continue without snapshots
+		return;
+	}
+	save_state( &snapshots [snapshot_count * snapshot_size] );
+	snapshot_pos [snapshot_count++] = pos;
+	next_snapshot = pos + snapshot_interval;
+}
+
+void Music_Emu::seek( long msec )
+{
+	require( sample_rate_ ); // set_sample_rate() must have been called
+	
+	long pos = (long) ((double) msec * sample_rate_ / 1000) * 2;
+	
+	// latest snapshot at or before pos
+	int i = snapshot_count;
+	while ( i && snapshot_pos [i - 1] > pos )
+		i--;
+	long nearest = i ? snapshot_pos [i - 1] : 0;
+	
+	// only go back if seeking backwards or the snapshot saves time
+	if ( pos < out_time || nearest > out_time )
+	{
+		if ( i )
+		{
+			load_state( &snapshots [(i - 1) * snapshot_size] );
+			out_time = nearest;
+		}
+		else
+		{
+			start_track( current_track );
+		}
+	}
+	
+	// emulate remainder exactly, since skip() trades accuracy for speed
+	const int buf_size = 1024;
+	sample_t buf [buf_size];
+	while ( out_time < pos )
+	{
+		long n = pos - out_time;
+		if ( n > buf_size )
+			n = buf_size;
+		play( n, buf );
+	}
+}
+
+long Music_Emu::tell() const
+{
+	return (long) (out_time / 2 * 1000.0 / sample_rate_);
+}
+
 void Music_Emu::skip( long count )
 {
 	const int buf_size = 1024;
@@ -66,6 +193,14 @@ void Music_Emu::skip( long count )
 	}
 }
 
+void Music_Emu::skip_silence( long count )
+{
+	int saved_mute = mute_mask_;
+	mute_voices( ~0 );
+	skip( count );
+	mute_voices( saved_mute );
+}
+
 const char** Music_Emu::voice_names() const
 {
 	static const char* names [] = {
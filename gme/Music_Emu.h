@@ -34,6 +34,12 @@ public:
 	// Load music file data from custom source
 	virtual blargg_err_t load( Data_Reader& ) = 0;
 	
+	// Load music file data from memory. ROM data is referenced rather than copied
+	// where the format allows, so 'data' must stay valid and unchanged until another
+	// file is loaded or the emulator is destroyed. This lets several emulators share
+	// one image of a file, such as a mapped file or a loaded datafile object.
+	virtual blargg_err_t load_mem( void const* data, long size );
+	
 	// Sample rate sound is generated at
 	long sample_rate() const;
 	
@@ -46,6 +52,12 @@ public:
 	// Mute voice n if bit n (1 << n) of mask is set
 	virtual void mute_voices( int mask );
 	
+	// Generate 'count' mono samples of each voice in a single pass, voice n into
+	// bufs [n] (NULL to discard), for mixing voices separately. Muted voices are
+	// silent. Voices lose their stereo panning, and SPC echo isn't part of any voice.
+	// Switching between this and play() drops any output already buffered.
+	virtual blargg_err_t play_voices( long count, sample_t* const* bufs );
+	
 	// Frequency equalizer parameters (see notes.txt)
 	struct equalizer_t {
 		double treble; // -50.0 = muffled, 0 = flat, +5.0 = extra-crisp
@@ -67,6 +79,10 @@ public:
 	// Skip 'count' samples
 	virtual void skip( long count );
 	
+	// Skip 'count' samples of output already known to be silent. Emulation runs with
+	// all voices muted, so no sound is synthesized even for short counts.
+	void skip_silence( long count );
+	
 	// True if a track was started and has since ended. Currently only logged
 	// format tracks (VGM, GYM) without loop points have an ending.
 	bool track_ended() const;
@@ -76,16 +92,44 @@ public:
 	// logged formats.
 	int error_count() const;
 	
+	// Seek to 'msec' milliseconds into the current track. Restores the nearest
+	// earlier snapshot of emulator state taken during previous playback (if any)
+	// and only emulates the remainder.
+	void seek( long msec );
+	
+	// Number of milliseconds played since start of current track
+	long tell() const;
+	
+	// Take a snapshot of emulator state every 'msec' milliseconds of playback
+	// (0 disables). Default is 10 seconds. Snapshots of the current track are
+	// kept until another track is started or another file is loaded; when
+	// max_snapshots is reached, every other one is dropped and the period doubled.
+	enum { max_snapshots = 64 };
+	void set_snapshot_period( long msec );
+	
 	Music_Emu();
 	virtual ~Music_Emu();
 	
 protected:
 	typedef BOOST::uint8_t byte;
 	void set_voice_count( int n ) { voice_count_ = n; }
-	void set_track_count( int n ) { track_count_ = n; }
+	void set_track_count( int n );
 	void set_track_ended( bool b = true ) { track_ended_ = b; }
 	void log_error() { error_count_++; }
 	void remute_voices();
+	
+	// Save states used by seek(). A state only needs to be loadable into the same
+	// emulator with the same file loaded. state_size() returns 0 if unsupported.
+	virtual long state_size() const;
+	virtual void save_state( void* ) const;
+	virtual void load_state( void const* );
+	
+	// Implementations of play() and skip() report samples output, and call
+	// state_reached() whenever the emulator state can be saved, with the output
+	// position (in samples since start of track) that the state corresponds to.
+	void samples_played( long n ) { out_time += n; }
+	void state_reached( long pos );
+	long play_time() const { return out_time; }
 private:
 	// noncopyable
 	Music_Emu( const Music_Emu& );
@@ -98,6 +142,19 @@ private:
 	int track_count_;
 	int error_count_;
 	bool track_ended_;
+	
+	// snapshots
+	int current_track;
+	long out_time;
+	long snapshot_period; // msec
+	long snapshot_interval; // samples
+	long next_snapshot;
+	long snapshot_size;
+	int snapshot_count;
+	long snapshot_pos [max_snapshots];
+	blargg_vector<byte> snapshots;
+	void clear_snapshots();
+	void take_snapshot( long pos );
 };
 
 // Deprecated
@@ -121,12 +178,16 @@ inline blargg_err_t Music_Emu::set_sample_rate( long r )
 	return blargg_success;
 }
 
-inline void Music_Emu::start_track( int track )
+inline void Music_Emu::set_track_count( int n )
+{
+	track_count_ = n;
+	clear_snapshots(); // new file loaded
+}
+
+inline void Music_Emu::state_reached( long pos )
 {
-	assert( (unsigned) track <= (unsigned) track_count() );
-	assert( sample_rate_ ); // set_sample_rate() must have been called first
-	track_ended_ = false;
-	error_count_ = 0;
+	if ( pos >= next_snapshot )
+		take_snapshot( pos );
 }
 
 #endif
@@ -3,6 +3,8 @@
 
 #include "Nes_Apu.h"
 
+#include <string.h>
+
 /* Copyright (C) 2003-2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
 General Public License as published by the Free Software Foundation; either
@@ -127,6 +129,129 @@ void Nes_Apu::irq_changed()
 	}
 }
 
+// snapshots
+
+static void save_osc( Nes_Osc const& osc, apu_snapshot_t::osc_t* out )
+{
+	memset( out, 0, sizeof *out );
+	memcpy( out->regs, osc.regs, sizeof out->regs );
+	memcpy( out->reg_written, osc.reg_written, sizeof out->reg_written );
+	out->length_counter = osc.length_counter;
+	out->delay = osc.delay;
+}
+
+static void load_osc( Nes_Osc& osc, apu_snapshot_t::osc_t const& in )
+{
+	memcpy( osc.regs, in.regs, sizeof osc.regs );
+	memcpy( osc.reg_written, in.reg_written, sizeof osc.reg_written );
+	osc.length_counter = in.length_counter;
+	osc.delay = in.delay;
+	osc.last_amp = 0;
+}
+
+static void save_env( Nes_Envelope const& osc, apu_snapshot_t::osc_t* out )
+{
+	save_osc( osc, out );
+	out->envelope = osc.envelope;
+	out->env_delay = osc.env_delay;
+}
+
+static void load_env( Nes_Envelope& osc, apu_snapshot_t::osc_t const& in )
+{
+	load_osc( osc, in );
+	osc.envelope = in.envelope;
+	osc.env_delay = in.env_delay;
+}
+
+void Nes_Apu::save_snapshot( apu_snapshot_t* out ) const
+{
+	save_env( square1, &out->square1 );
+	out->square1.phase = square1.phase;
+	out->square1.sweep_delay = square1.sweep_delay;
+	
+	save_env( square2, &out->square2 );
+	out->square2.phase = square2.phase;
+	out->square2.sweep_delay = square2.sweep_delay;
+	
+	save_osc( triangle, &out->triangle );
+	out->triangle.phase = triangle.phase;
+	out->triangle.linear_counter = triangle.linear_counter;
+	
+	save_env( noise, &out->noise );
+	out->noise.noise = noise.noise;
+	
+	save_osc( dmc, &out->dmc );
+	apu_snapshot_t::dmc_t& d = out->dmc_state;
+	d.address = dmc.address;
+	d.period = dmc.period;
+	d.buf = dmc.buf;
+	d.bits_remain = dmc.bits_remain;
+	d.bits = dmc.bits;
+	d.dac = dmc.dac;
+	d.next_irq = dmc.next_irq;
+	d.buf_full = dmc.buf_full;
+	d.silence = dmc.silence;
+	d.irq_enabled = dmc.irq_enabled;
+	d.irq_flag = dmc.irq_flag;
+	
+	out->last_time = last_time;
+	out->last_dmc_time = last_dmc_time;
+	out->earliest_irq = earliest_irq_;
+	out->next_irq = next_irq;
+	out->frame_period = frame_period;
+	out->frame_delay = frame_delay;
+	out->frame = frame;
+	out->osc_enables = osc_enables;
+	out->frame_mode = frame_mode;
+	out->irq_flag = irq_flag;
+}
+
+void Nes_Apu::load_snapshot( apu_snapshot_t const& in )
+{
+	load_env( square1, in.square1 );
+	square1.phase = in.square1.phase;
+	square1.sweep_delay = in.square1.sweep_delay;
+	
+	load_env( square2, in.square2 );
+	square2.phase = in.square2.phase;
+	square2.sweep_delay = in.square2.sweep_delay;
+	
+	load_osc( triangle, in.triangle );
+	triangle.phase = in.triangle.phase;
+	triangle.linear_counter = in.triangle.linear_counter;
+	
+	load_env( noise, in.noise );
+	noise.noise = in.noise.noise;
+	
+	load_osc( dmc, in.dmc );
+	apu_snapshot_t::dmc_t const& d = in.dmc_state;
+	dmc.address = d.address;
+	dmc.period = d.period;
+	dmc.buf = d.buf;
+	dmc.bits_remain = d.bits_remain;
+	dmc.bits = d.bits;
+	dmc.dac = d.dac;
+	dmc.next_irq = d.next_irq;
+	dmc.buf_full = d.buf_full;
+	dmc.silence = d.silence;
+	dmc.irq_enabled = d.irq_enabled;
+	dmc.irq_flag = d.irq_flag;
+	
+	last_time = in.last_time;
+	last_dmc_time = in.last_dmc_time;
+	earliest_irq_ = in.earliest_irq;
+	next_irq = in.next_irq;
+	frame_period = in.frame_period;
+	frame_delay = in.frame_delay;
+	frame = in.frame;
+	osc_enables = in.osc_enables;
+	frame_mode = in.frame_mode;
+	irq_flag = in.irq_flag;
+	
+	if ( irq_notifier_ )
+		irq_notifier_( irq_data );
+}
+
 // frames
 
 void Nes_Apu::run_until( nes_time_t end_time )
@@ -215,9 +340,6 @@ void Nes_Apu::run_until_( nes_time_t end_time )
 	}
 }
 
-// to do: remove
-static long abs_time;
-
 template<class T>
 inline void zero_apu_osc( T* osc, nes_time_t time )
 {
@@ -233,8 +355,6 @@ void Nes_Apu::end_frame( nes_time_t end_time )
 	if ( end_time > last_time )
 		run_until_( end_time );
 	
-	abs_time += end_time;
-	
 	if ( dmc.nonlinear )
 	{
 		zero_apu_osc( &square1,  last_time );
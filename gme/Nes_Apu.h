@@ -53,7 +53,8 @@ public:
 	// any audible click.
 	void reset( bool pal_timing = false, int initial_dmc_dac = 0 );
 	
-	// Save/load snapshot of exact emulation state
+	// Save/load snapshot of exact emulation state. Loading resets oscillator
+	// amplitudes to zero, so output buffers should be cleared afterwards.
 	void save_snapshot( apu_snapshot_t* out ) const;
 	void load_snapshot( apu_snapshot_t const& );
 	
@@ -132,6 +133,55 @@ private:
 	void run_until_( nes_time_t );
 };
 
+struct apu_snapshot_t
+{
+	struct osc_t
+	{
+		unsigned char regs [4];
+		bool reg_written [4];
+		int length_counter;
+		int delay;
+		int envelope;       // squares and noise
+		int env_delay;
+		int phase;          // squares and triangle
+		int sweep_delay;    // squares
+		int linear_counter; // triangle
+		int noise;          // noise
+	};
+	osc_t square1;
+	osc_t square2;
+	osc_t triangle;
+	osc_t noise;
+	osc_t dmc;
+	
+	struct dmc_t
+	{
+		int address;
+		int period;
+		int buf;
+		int bits_remain;
+		int bits;
+		int dac;
+		nes_time_t next_irq;
+		bool buf_full;
+		bool silence;
+		bool irq_enabled;
+		bool irq_flag;
+	};
+	dmc_t dmc_state;
+	
+	nes_time_t last_time;
+	nes_time_t last_dmc_time;
+	nes_time_t earliest_irq;
+	nes_time_t next_irq;
+	int frame_period;
+	int frame_delay;
+	int frame;
+	int osc_enables;
+	int frame_mode;
+	bool irq_flag;
+};
+
 inline void Nes_Apu::osc_output( int osc, Blip_Buffer* buf )
 {
 	assert( (unsigned) osc < osc_count );
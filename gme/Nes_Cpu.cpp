@@ -100,7 +100,9 @@ void Nes_Cpu::set_writer( nes_addr_t start, unsigned long size, writer_t func )
 // Note: 'addr' is evaulated more than once in the following macros, so it
 // must not contain side-effects.
 
-#define READ( addr )        (data_reader [(addr) >> page_bits]( callback_data, addr ))
+// Pages without a reader function are read straight from their code mapping
+#define READ( addr )        (data_reader [(addr) >> page_bits] ? \
+		data_reader [(addr) >> page_bits]( callback_data, addr ) : READ_PROG( addr ))
 #define WRITE( addr, data ) (data_writer [(addr) >> page_bits]( callback_data, addr, data ))
 
 #define READ_LOW( addr )        (low_mem [int (addr)])
@@ -124,6 +126,30 @@ void Nes_Cpu::write( nes_addr_t addr, int value )
 	WRITE( addr, value );
 }
 
+void Nes_Cpu::save_snapshot( snapshot_t* out ) const
+{
+	out->r = r;
+	out->clock_limit = clock_limit;
+	out->base_time = base_time;
+	out->clock_count = clock_count;
+	out->irq_time = irq_time_;
+	out->end_time = end_time_;
+	memcpy( out->code_map, code_map, sizeof code_map );
+	memcpy( out->low_mem, low_mem, sizeof low_mem );
+}
+
+void Nes_Cpu::load_snapshot( snapshot_t const& in )
+{
+	r = in.r;
+	clock_limit = in.clock_limit;
+	base_time = in.base_time;
+	clock_count = in.clock_count;
+	irq_time_ = in.irq_time;
+	end_time_ = in.end_time;
+	memcpy( code_map, in.code_map, sizeof code_map );
+	memcpy( low_mem, in.low_mem, sizeof low_mem );
+}
+
 #ifndef NES_CPU_GLUE_ONLY
 
 static const unsigned char clock_table [256] = {
@@ -146,6 +172,37 @@ static const unsigned char clock_table [256] = {
 	3,5,2,8,4,4,6,6,2,4,2,7,4,4,7,7 // F
 };
 
+#if BLARGG_CPU_POWERPC
+	#define SYNC_CLOCK_COUNT() (void) (this->clock_count = clock_count)
+#else
+	#define SYNC_CLOCK_COUNT() (void) 0
+#endif
+
+#if BLARGG_COMPUTED_GOTO
+	// Each opcode's case also has a label, which dispatch jumps to directly
+	#define OP( n )         op_##n:
+	#define OP_LABEL( n )   n:
+	#define DISPATCH( op )  __extension__ ({ goto *dispatch [op]; })
+	
+	// Fetch and dispatch next instruction at the end of each handler, giving each
+	// its own indirect branch. Register asserts are only made at loop.
+	#define NEXT_INSTR() {                                  \
+		page = code_map [pc >> page_bits];                  \
+		opcode = page [PAGE_OFFSET( pc )];                  \
+		data = page [PAGE_OFFSET( pc ) + 1];                \
+		pc++;                                               \
+		if ( clock_count >= clock_limit )                   \
+			goto stop;                                      \
+		clock_count += clock_table [opcode];                \
+		SYNC_CLOCK_COUNT();                                 \
+		DISPATCH( opcode );                                 \
+	}
+#else
+	#define OP( n )
+	#define OP_LABEL( n )
+	#define NEXT_INSTR() goto loop
+#endif
+
 #include BLARGG_ENABLE_OPTIMIZER
 
 Nes_Cpu::result_t Nes_Cpu::run( nes_time_t end )
@@ -154,6 +211,43 @@ Nes_Cpu::result_t Nes_Cpu::run( nes_time_t end )
 	
 	volatile result_t result = result_cycles;
 	
+#if BLARGG_COMPUTED_GOTO
+	__extension__ static void* const dispatch [0x100] = {
+		&&op_0x00, &&indx0x05, &&op_0x02, &&op_0x03, &&op_0x04, &&zp0x05, &&op_0x06, &&op_0x07, // 0
+		&&op_0x08, &&imm0x05, &&op_0x0A, &&op_0x0B, &&op_0x0C, &&abs0x05, &&op_0x0E, &&op_0x0F,
+		&&op_0x10, &&indy0x05, &&op_0x12, &&op_0x13, &&op_0x14, &&zpx0x05, &&op_0x16, &&op_0x17, // 1
+		&&op_0x18, &&absy0x05, &&op_0x1A, &&op_0x1B, &&op_0x1C, &&absx0x05, &&op_0x1E, &&op_0x1F,
+		&&op_0x20, &&indx0x25, &&op_0x22, &&op_0x23, &&op_0x24, &&zp0x25, &&op_0x26, &&op_0x27, // 2
+		&&op_0x28, &&imm0x25, &&op_0x2A, &&op_0x2B, &&op_0x2C, &&abs0x25, &&op_0x2E, &&op_0x2F,
+		&&op_0x30, &&indy0x25, &&op_0x32, &&op_0x33, &&op_0x34, &&zpx0x25, &&op_0x36, &&op_0x37, // 3
+		&&op_0x38, &&absy0x25, &&op_0x3A, &&op_0x3B, &&op_0x3C, &&absx0x25, &&op_0x3E, &&op_0x3F,
+		&&op_0x40, &&indx0x45, &&op_0x42, &&op_0x43, &&op_0x44, &&zp0x45, &&op_0x46, &&op_0x47, // 4
+		&&op_0x48, &&imm0x45, &&op_0x4A, &&op_0x4B, &&op_0x4C, &&abs0x45, &&op_0x4E, &&op_0x4F,
+		&&op_0x50, &&indy0x45, &&op_0x52, &&op_0x53, &&op_0x54, &&zpx0x45, &&op_0x56, &&op_0x57, // 5
+		&&op_0x58, &&absy0x45, &&op_0x5A, &&op_0x5B, &&op_0x5C, &&absx0x45, &&op_0x5E, &&op_0x5F,
+		&&op_0x60, &&indx0x65, &&op_0x62, &&op_0x63, &&op_0x64, &&zp0x65, &&op_0x66, &&op_0x67, // 6
+		&&op_0x68, &&imm0x65, &&op_0x6A, &&op_0x6B, &&op_0x6C, &&abs0x65, &&op_0x6E, &&op_0x6F,
+		&&op_0x70, &&indy0x65, &&op_0x72, &&op_0x73, &&op_0x74, &&zpx0x65, &&op_0x76, &&op_0x77, // 7
+		&&op_0x78, &&absy0x65, &&op_0x7A, &&op_0x7B, &&op_0x7C, &&absx0x65, &&op_0x7E, &&op_0x7F,
+		&&op_0x80, &&op_0x81, &&op_0x82, &&op_0x83, &&op_0x84, &&op_0x85, &&op_0x86, &&op_0x87, // 8
+		&&op_0x88, &&op_0x89, &&op_0x8A, &&op_0x8B, &&op_0x8C, &&op_0x8D, &&op_0x8E, &&op_0x8F,
+		&&op_0x90, &&op_0x91, &&op_0x92, &&op_0x93, &&op_0x94, &&op_0x95, &&op_0x96, &&op_0x97, // 9
+		&&op_0x98, &&op_0x99, &&op_0x9A, &&op_0x9B, &&op_0x9C, &&op_0x9D, &&op_0x9E, &&op_0x9F,
+		&&op_0xA0, &&op_0xA1, &&op_0xA2, &&op_0xA3, &&op_0xA4, &&op_0xA5, &&op_0xA6, &&op_0xA7, // A
+		&&op_0xA8, &&op_0xA9, &&op_0xAA, &&op_0xAB, &&op_0xAC, &&op_0xAD, &&op_0xAE, &&op_0xAF,
+		&&op_0xB0, &&op_0xB1, &&op_0xB2, &&op_0xB3, &&op_0xB4, &&op_0xB5, &&op_0xB6, &&op_0xB7, // B
+		&&op_0xB8, &&op_0xB9, &&op_0xBA, &&op_0xBB, &&op_0xBC, &&op_0xBD, &&op_0xBE, &&op_0xBF,
+		&&op_0xC0, &&indx0xC5, &&op_0xC2, &&op_0xC3, &&op_0xC4, &&zp0xC5, &&op_0xC6, &&op_0xC7, // C
+		&&op_0xC8, &&imm0xC5, &&op_0xCA, &&op_0xCB, &&op_0xCC, &&abs0xC5, &&op_0xCE, &&op_0xCF,
+		&&op_0xD0, &&indy0xC5, &&op_0xD2, &&op_0xD3, &&op_0xD4, &&zpx0xC5, &&op_0xD6, &&op_0xD7, // D
+		&&op_0xD8, &&absy0xC5, &&op_0xDA, &&op_0xDB, &&op_0xDC, &&absx0xC5, &&op_0xDE, &&op_0xDF,
+		&&op_0xE0, &&indx0xE5, &&op_0xE2, &&op_0xE3, &&op_0xE4, &&zp0xE5, &&op_0xE6, &&op_0xE7, // E
+		&&op_0xE8, &&imm0xE5, &&op_0xEA, &&op_0xEB, &&op_0xEC, &&abs0xE5, &&op_0xEE, &&op_0xEF,
+		&&op_0xF0, &&indy0xE5, &&op_page_wrap_opcode, &&op_0xF3, &&op_0xF4, &&zpx0xE5, &&op_0xF6, &&op_0xF7, // F
+		&&op_0xF8, &&absy0xE5, &&op_0xFA, &&op_0xFB, &&op_0xFC, &&absx0xE5, &&op_0xFE, &&op_0xFF
+	};
+#endif
+	
 #if BLARGG_CPU_POWERPC
 	// cache commonly-used values in registers
 	long clock_count = this->clock_count;
@@ -227,9 +321,10 @@ loop:
 		goto stop;
 	
 	clock_count += clock_table [opcode];
+	SYNC_CLOCK_COUNT();
 	
-	#if BLARGG_CPU_POWERPC
-		this->clock_count = clock_count;
+	#if BLARGG_COMPUTED_GOTO
+		DISPATCH( opcode );
 	#endif
 	
 	switch ( opcode )
@@ -242,7 +337,7 @@ loop:
 
 #define HANDLE_PAGE_CROSSING( lsb ) clock_count += (lsb) >> 8;
 
-#define INC_DEC_XY( reg, n ) reg = uint8_t (nz = reg + n); goto loop;
+#define INC_DEC_XY( reg, n ) reg = uint8_t (nz = reg + n); NEXT_INSTR();
 
 #define IND_Y {                                                 \
 		int temp = READ_LOW( data ) + y;                        \
@@ -257,26 +352,33 @@ loop:
 	
 #define ARITH_ADDR_MODES( op )          \
 case op - 0x04: /* (ind,x) */           \
+OP_LABEL( indx##op )                    \
 	IND_X                               \
 	goto ptr##op;                       \
 case op + 0x0C: /* (ind),y */           \
+OP_LABEL( indy##op )                    \
 	IND_Y                               \
 	goto ptr##op;                       \
 case op + 0x10: /* zp,X */              \
+OP_LABEL( zpx##op )                     \
 	data = uint8_t (data + x);          \
 	/* fallthrough */                   \
 case op + 0x00: /* zp */                \
+OP_LABEL( zp##op )                      \
 	data = READ_LOW( data );            \
 	goto imm##op;                       \
 case op + 0x14: /* abs,Y */             \
+OP_LABEL( absy##op )                    \
 	data += y;                          \
 	goto ind##op;                       \
 case op + 0x18: /* abs,X */             \
+OP_LABEL( absx##op )                    \
 	data += x;                          \
 ind##op:                                \
 	HANDLE_PAGE_CROSSING( data );       \
 	/* fallthrough */                   \
 case op + 0x08: /* abs */               \
+OP_LABEL( abs##op )                     \
 	ADD_PAGE                            \
 ptr##op:                                \
 	data = READ( data );                \
@@ -292,38 +394,38 @@ imm##op:                                \
 	if ( !(cond) ) goto dec_clock_loop; \
 	pc += offset;       \
 	clock_count += (extra_clock >> 8) & 1;  \
-	goto loop;          \
+	NEXT_INSTR();       \
 }
 
 // Often-Used
 
-	case 0xB5: // LDA zp,x
+	case 0xB5: OP( 0xB5 ) // LDA zp,x
 		data = uint8_t (data + x);
 		//fallthrough
-	case 0xA5: // LDA zp
+	case 0xA5: OP( 0xA5 ) // LDA zp
 		a = nz = READ_LOW( data );
 		pc++;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xD0: // BNE
+	case 0xD0: OP( 0xD0 ) // BNE
 		BRANCH( (uint8_t) nz );
 	
-	case 0x20: { // JSR
+	case 0x20: OP( 0x20 ) { // JSR
 		int temp = pc + 1;
 		pc = READ_PROG16( pc );
 		WRITE_LOW( 0x100 | (sp - 1), temp >> 8 );
 		sp = (sp - 2) | 0x100;
 		WRITE_LOW( sp, temp );
-		goto loop;
+		NEXT_INSTR();
 	}
 	
-	case 0x4C: // JMP abs
+	case 0x4C: OP( 0x4C ) // JMP abs
 		pc = READ_PROG16( pc );
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xE8: INC_DEC_XY( x, 1 )  // INX
+	case 0xE8: OP( 0xE8 ) INC_DEC_XY( x, 1 )  // INX
 	
-	case 0x10: // BPL
+	case 0x10: OP( 0x10 ) // BPL
 		BRANCH( !IS_NEG )
 	
 	ARITH_ADDR_MODES( 0xC5 ) // CMP
@@ -331,249 +433,249 @@ imm##op:                                \
 		pc++;
 		c = ~nz;
 		nz &= 0xff;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x30: // BMI
+	case 0x30: OP( 0x30 ) // BMI
 		BRANCH( IS_NEG )
 	
-	case 0xF0: // BEQ
+	case 0xF0: OP( 0xF0 ) // BEQ
 		BRANCH( !(uint8_t) nz );
 	
-	case 0x95: // STA zp,x
+	case 0x95: OP( 0x95 ) // STA zp,x
 		data = uint8_t (data + x);
 		//fallthrough
-	case 0x85: // STA zp
+	case 0x85: OP( 0x85 ) // STA zp
 		pc++;
 		WRITE_LOW( data, a );
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xC8: INC_DEC_XY( y, 1 )  // INY
+	case 0xC8: OP( 0xC8 ) INC_DEC_XY( y, 1 )  // INY
 
-	case 0xA8: // TAY
+	case 0xA8: OP( 0xA8 ) // TAY
 		y = a;
 		//fallthrough
-	case 0x98: // TYA
+	case 0x98: OP( 0x98 ) // TYA
 		a = nz = y;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xB9: // LDA abs,Y
+	case 0xB9: OP( 0xB9 ) // LDA abs,Y
 		data += y;
 		goto lda_ind_common;
 	
-	case 0xBD: // LDA abs,X
+	case 0xBD: OP( 0xBD ) // LDA abs,X
 		data += x;
 	lda_ind_common:
 		HANDLE_PAGE_CROSSING( data );
 		//fallthrough
-	case 0xAD: // LDA abs
+	case 0xAD: OP( 0xAD ) // LDA abs
 		ADD_PAGE
 	lda_ptr:
 		a = nz = READ( data );
 		pc++;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x60: // RTS
+	case 0x60: OP( 0x60 ) // RTS
 		pc = 1 + READ_LOW( sp );
 		pc += READ_LOW( 0x100 | (sp - 0xff) ) * 0x100;
 		sp = (sp - 0xfe) | 0x100;
-		goto loop;
+		NEXT_INSTR();
 
-	case 0x99: // STA abs,Y
+	case 0x99: OP( 0x99 ) // STA abs,Y
 		data += y;
 		goto sta_ind_common;
 	
-	case 0x9D: // STA abs,X
+	case 0x9D: OP( 0x9D ) // STA abs,X
 		data += x;
 	sta_ind_common:
 		HANDLE_PAGE_CROSSING( data );
 		//fallthrough
-	case 0x8D: // STA abs
+	case 0x8D: OP( 0x8D ) // STA abs
 		ADD_PAGE
 	sta_ptr:
 		pc++;
 		WRITE( data, a );
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xA9: // LDA #imm
+	case 0xA9: OP( 0xA9 ) // LDA #imm
 		pc++;
 		a = data;
 		nz = data;
-		goto loop;
+		NEXT_INSTR();
 
 // Branch
 
-	case 0x50: // BVC
+	case 0x50: OP( 0x50 ) // BVC
 		BRANCH( !(status & st_v) )
 	
-	case 0x70: // BVS
+	case 0x70: OP( 0x70 ) // BVS
 		BRANCH( status & st_v )
 	
-	case 0xB0: // BCS
+	case 0xB0: OP( 0xB0 ) // BCS
 		BRANCH( c & 0x100 )
 	
-	case 0x90: // BCC
+	case 0x90: OP( 0x90 ) // BCC
 		BRANCH( !(c & 0x100) )
 	
 // Load/store
 	
-	case 0x94: // STY zp,x
+	case 0x94: OP( 0x94 ) // STY zp,x
 		data = uint8_t (data + x);
 		//fallthrough
-	case 0x84: // STY zp
+	case 0x84: OP( 0x84 ) // STY zp
 		pc++;
 		WRITE_LOW( data, y );
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x96: // STX zp,y
+	case 0x96: OP( 0x96 ) // STX zp,y
 		data = uint8_t (data + y);
 		//fallthrough
-	case 0x86: // STX zp
+	case 0x86: OP( 0x86 ) // STX zp
 		pc++;
 		WRITE_LOW( data, x );
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xB6: // LDX zp,y
+	case 0xB6: OP( 0xB6 ) // LDX zp,y
 		data = uint8_t (data + y);
 		//fallthrough
-	case 0xA6: // LDX zp
+	case 0xA6: OP( 0xA6 ) // LDX zp
 		data = READ_LOW( data );
 		//fallthrough
-	case 0xA2: // LDX #imm
+	case 0xA2: OP( 0xA2 ) // LDX #imm
 		pc++;
 		x = data;
 		nz = data;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xB4: // LDY zp,x
+	case 0xB4: OP( 0xB4 ) // LDY zp,x
 		data = uint8_t (data + x);
 		//fallthrough
-	case 0xA4: // LDY zp
+	case 0xA4: OP( 0xA4 ) // LDY zp
 		data = READ_LOW( data );
 		//fallthrough
-	case 0xA0: // LDY #imm
+	case 0xA0: OP( 0xA0 ) // LDY #imm
 		pc++;
 		y = data;
 		nz = data;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xB1: // LDA (ind),Y
+	case 0xB1: OP( 0xB1 ) // LDA (ind),Y
 		IND_Y
 		goto lda_ptr;
 	
-	case 0xA1: // LDA (ind,X)
+	case 0xA1: OP( 0xA1 ) // LDA (ind,X)
 		IND_X
 		goto lda_ptr;
 	
-	case 0x91: // STA (ind),Y
+	case 0x91: OP( 0x91 ) // STA (ind),Y
 		IND_Y
 		goto sta_ptr;
 	
-	case 0x81: // STA (ind,X)
+	case 0x81: OP( 0x81 ) // STA (ind,X)
 		IND_X
 		goto sta_ptr;
 	
-	case 0xBC: // LDY abs,X
+	case 0xBC: OP( 0xBC ) // LDY abs,X
 		data += x;
 		HANDLE_PAGE_CROSSING( data );
 		//fallthrough
-	case 0xAC:{// LDY abs
+	case 0xAC: OP( 0xAC ){// LDY abs
 		pc++;
 		unsigned addr = data + 0x100 * READ_PROG( pc );
 		pc++;
 		y = nz = READ( addr );
-		goto loop;
+		NEXT_INSTR();
 	}
 	
-	case 0xBE: // LDX abs,y
+	case 0xBE: OP( 0xBE ) // LDX abs,y
 		data += y;
 		HANDLE_PAGE_CROSSING( data );
 		//fallthrough
-	case 0xAE:{// LDX abs
+	case 0xAE: OP( 0xAE ){// LDX abs
 		pc++;
 		unsigned addr = data + 0x100 * READ_PROG( pc );
 		pc++;
 		x = nz = READ( addr );
-		goto loop;
+		NEXT_INSTR();
 	}
 	
 	{
 		int temp;
-	case 0x8C: // STY abs
+	case 0x8C: OP( 0x8C ) // STY abs
 		temp = y;
 		goto store_abs;
 	
-	case 0x8E: // STX abs
+	case 0x8E: OP( 0x8E ) // STX abs
 		temp = x;
 	store_abs:
 		unsigned addr = GET_ADDR();
 		WRITE( addr, temp );
 		pc += 2;
-		goto loop;
+		NEXT_INSTR();
 	}
 
 // Compare
 
-	case 0xEC:{// CPX abs
+	case 0xEC: OP( 0xEC ){// CPX abs
 		unsigned addr = GET_ADDR();
 		pc++;
 		data = READ( addr );
 		goto cpx_data;
 	}
 	
-	case 0xE4: // CPX zp
+	case 0xE4: OP( 0xE4 ) // CPX zp
 		data = READ_LOW( data );
 		//fallthrough
-	case 0xE0: // CPX #imm
+	case 0xE0: OP( 0xE0 ) // CPX #imm
 	cpx_data:
 		nz = x - data;
 		pc++;
 		c = ~nz;
 		nz &= 0xff;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xCC:{// CPY abs
+	case 0xCC: OP( 0xCC ){// CPY abs
 		unsigned addr = GET_ADDR();
 		pc++;
 		data = READ( addr );
 		goto cpy_data;
 	}
 	
-	case 0xC4: // CPY zp
+	case 0xC4: OP( 0xC4 ) // CPY zp
 		data = READ_LOW( data );
 		//fallthrough
-	case 0xC0: // CPY #imm
+	case 0xC0: OP( 0xC0 ) // CPY #imm
 	cpy_data:
 		nz = y - data;
 		pc++;
 		c = ~nz;
 		nz &= 0xff;
-		goto loop;
+		NEXT_INSTR();
 	
 // Logical
 
 	ARITH_ADDR_MODES( 0x25 ) // AND
 		nz = (a &= data);
 		pc++;
-		goto loop;
+		NEXT_INSTR();
 	
 	ARITH_ADDR_MODES( 0x45 ) // EOR
 		nz = (a ^= data);
 		pc++;
-		goto loop;
+		NEXT_INSTR();
 	
 	ARITH_ADDR_MODES( 0x05 ) // ORA
 		nz = (a |= data);
 		pc++;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x2C:{// BIT abs
+	case 0x2C: OP( 0x2C ){// BIT abs
 		unsigned addr = GET_ADDR();
 		pc++;
 		nz = READ( addr );
 		goto bit_common;
 	}
 	
-	case 0x24: // BIT zp
+	case 0x24: OP( 0x24 ) // BIT zp
 		nz = READ_LOW( data );
 	bit_common:
 		pc++;
@@ -582,12 +684,12 @@ imm##op:                                \
 		// if result is zero, might also be negative, so use secondary N bit
 		if ( !(a & nz) )
 			nz = (nz << 4) & 0x800;
-		goto loop;
+		NEXT_INSTR();
 		
 // Add/subtract
 
 	ARITH_ADDR_MODES( 0xE5 ) // SBC
-	case 0xEB: // unofficial equivalent
+	case 0xEB: OP( 0xEB ) // unofficial equivalent
 		data ^= 0xFF;
 		goto adc_imm;
 	
@@ -600,47 +702,47 @@ imm##op:                                \
 		c = nz = a + data + carry;
 		pc++;
 		a = (uint8_t) nz;
-		goto loop;
+		NEXT_INSTR();
 	}
 	
 // Shift/rotate
 
-	case 0x4A: // LSR A
+	case 0x4A: OP( 0x4A ) // LSR A
 		c = 0;
 		//fallthrough
-	case 0x6A: // ROR A
+	case 0x6A: OP( 0x6A ) // ROR A
 		nz = (c >> 1) & 0x80; // could use bit insert macro here
 		c = a << 8;
 		nz |= a >> 1;
 		a = nz;
-		goto loop;
+		NEXT_INSTR();
 
-	case 0x0A: // ASL A
+	case 0x0A: OP( 0x0A ) // ASL A
 		nz = a << 1;
 		c = nz;
 		a = (uint8_t) nz;
-		goto loop;
+		NEXT_INSTR();
 
-	case 0x2A: { // ROL A
+	case 0x2A: OP( 0x2A ) { // ROL A
 		nz = a << 1;
 		int temp = (c >> 8) & 1;
 		c = nz;
 		nz |= temp;
 		a = (uint8_t) nz;
-		goto loop;
+		NEXT_INSTR();
 	}
 	
-	case 0x3E: // ROL abs,X
+	case 0x3E: OP( 0x3E ) // ROL abs,X
 		data += x;
 		goto rol_abs;
 	
-	case 0x1E: // ASL abs,X
+	case 0x1E: OP( 0x1E ) // ASL abs,X
 		data += x;
 		//fallthrough
-	case 0x0E: // ASL abs
+	case 0x0E: OP( 0x0E ) // ASL abs
 		c = 0;
 		//fallthrough
-	case 0x2E: // ROL abs
+	case 0x2E: OP( 0x2E ) // ROL abs
 	rol_abs:
 		HANDLE_PAGE_CROSSING( data );
 		ADD_PAGE
@@ -649,19 +751,19 @@ imm##op:                                \
 	rotate_common:
 		pc++;
 		WRITE( data, (uint8_t) nz );
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x7E: // ROR abs,X
+	case 0x7E: OP( 0x7E ) // ROR abs,X
 		data += x;
 		goto ror_abs;
 	
-	case 0x5E: // LSR abs,X
+	case 0x5E: OP( 0x5E ) // LSR abs,X
 		data += x;
 		//fallthrough
-	case 0x4E: // LSR abs
+	case 0x4E: OP( 0x4E ) // LSR abs
 		c = 0;
 		//fallthrough
-	case 0x6E: // ROR abs
+	case 0x6E: OP( 0x6E ) // ROR abs
 	ror_abs: {
 		HANDLE_PAGE_CROSSING( data );
 		ADD_PAGE
@@ -671,17 +773,17 @@ imm##op:                                \
 		goto rotate_common;
 	}
 	
-	case 0x76: // ROR zp,x
+	case 0x76: OP( 0x76 ) // ROR zp,x
 		data = uint8_t (data + x);
 		goto ror_zp;
 	
-	case 0x56: // LSR zp,x
+	case 0x56: OP( 0x56 ) // LSR zp,x
 		data = uint8_t (data + x);
 		//fallthrough
-	case 0x46: // LSR zp
+	case 0x46: OP( 0x46 ) // LSR zp
 		c = 0;
 		//fallthrough
-	case 0x66: // ROR zp
+	case 0x66: OP( 0x66 ) // ROR zp
 	ror_zp: {
 		int temp = READ_LOW( data );
 		nz = ((c >> 1) & 0x80) | (temp >> 1);
@@ -689,17 +791,17 @@ imm##op:                                \
 		goto write_nz_zp;
 	}
 	
-	case 0x36: // ROL zp,x
+	case 0x36: OP( 0x36 ) // ROL zp,x
 		data = uint8_t (data + x);
 		goto rol_zp;
 	
-	case 0x16: // ASL zp,x
+	case 0x16: OP( 0x16 ) // ASL zp,x
 		data = uint8_t (data + x);
 		//fallthrough
-	case 0x06: // ASL zp
+	case 0x06: OP( 0x06 ) // ASL zp
 		c = 0;
 		//fallthrough
-	case 0x26: // ROL zp
+	case 0x26: OP( 0x26 ) // ROL zp
 	rol_zp:
 		nz = (c >> 8) & 1;
 		nz |= (c = READ_LOW( data ) << 1);
@@ -707,46 +809,46 @@ imm##op:                                \
 	
 // Increment/decrement
 
-	case 0xCA: INC_DEC_XY( x, -1 ) // DEX
+	case 0xCA: OP( 0xCA ) INC_DEC_XY( x, -1 ) // DEX
 	
-	case 0x88: INC_DEC_XY( y, -1 ) // DEY
+	case 0x88: OP( 0x88 ) INC_DEC_XY( y, -1 ) // DEY
 	
-	case 0xF6: // INC zp,x
+	case 0xF6: OP( 0xF6 ) // INC zp,x
 		data = uint8_t (data + x);
 		//fallthrough
-	case 0xE6: // INC zp
+	case 0xE6: OP( 0xE6 ) // INC zp
 		nz = 1;
 		goto add_nz_zp;
 	
-	case 0xD6: // DEC zp,x
+	case 0xD6: OP( 0xD6 ) // DEC zp,x
 		data = uint8_t (data + x);
 		//fallthrough
-	case 0xC6: // DEC zp
+	case 0xC6: OP( 0xC6 ) // DEC zp
 		nz = -1;
 	add_nz_zp:
 		nz += READ_LOW( data );
 	write_nz_zp:
 		pc++;
 		WRITE_LOW( data, nz );
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xFE: // INC abs,x
+	case 0xFE: OP( 0xFE ) // INC abs,x
 		HANDLE_PAGE_CROSSING( data + x );
 		data = x + GET_ADDR();
 		goto inc_ptr;
 	
-	case 0xEE: // INC abs
+	case 0xEE: OP( 0xEE ) // INC abs
 		data = GET_ADDR();
 	inc_ptr:
 		nz = 1;
 		goto inc_common;
 	
-	case 0xDE: // DEC abs,x
+	case 0xDE: OP( 0xDE ) // DEC abs,x
 		HANDLE_PAGE_CROSSING( data + x );
 		data = x + GET_ADDR();
 		goto dec_ptr;
 	
-	case 0xCE: // DEC abs
+	case 0xCE: OP( 0xCE ) // DEC abs
 		data = GET_ADDR();
 	dec_ptr:
 		nz = -1;
@@ -754,37 +856,37 @@ imm##op:                                \
 		nz += READ( data );
 		pc += 2;
 		WRITE( data, (uint8_t) nz );
-		goto loop;
+		NEXT_INSTR();
 		
 // Transfer
 
-	case 0xAA: // TAX
+	case 0xAA: OP( 0xAA ) // TAX
 		x = a;
 		//fallthrough
-	case 0x8A: // TXA
+	case 0x8A: OP( 0x8A ) // TXA
 		a = nz = x;
-		goto loop;
+		NEXT_INSTR();
 
-	case 0x9A: // TXS
+	case 0x9A: OP( 0x9A ) // TXS
 		SET_SP( x ); // verified (no flag change)
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xBA: // TSX
+	case 0xBA: OP( 0xBA ) // TSX
 		x = nz = GET_SP();
-		goto loop;
+		NEXT_INSTR();
 	
 // Stack
 	
-	case 0x48: // PHA
+	case 0x48: OP( 0x48 ) // PHA
 		PUSH( a ); // verified
-		goto loop;
+		NEXT_INSTR();
 		
-	case 0x68: // PLA
+	case 0x68: OP( 0x68 ) // PLA
 		a = nz = READ_LOW( sp );
 		sp = (sp - 0xff) | 0x100;
-		goto loop;
+		NEXT_INSTR();
 		
-	case 0x40: // RTI
+	case 0x40: OP( 0x40 ) // RTI
 		{
 			int temp = READ_LOW( sp );
 			pc   = READ_LOW( 0x100 | (sp - 0xff) );
@@ -794,45 +896,45 @@ imm##op:                                \
 			SET_STATUS( temp );
 		}
 		if ( !((data ^ status) & st_i) )
-			goto loop; // I flag didn't change
+			NEXT_INSTR(); // I flag didn't change
 	i_flag_changed:
 		//dprintf( "%6d %s\n", time(), (status & st_i ? "SEI" : "CLI") );
 		this->r.status = status; // update externally-visible I flag
 		// update clock_limit based on modified I flag
 		clock_limit = end_time_;
 		if ( end_time_ <= irq_time_ )
-			goto loop;
+			NEXT_INSTR();
 		if ( status & st_i )
-			goto loop;
+			NEXT_INSTR();
 		clock_limit = irq_time_;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x28:{// PLP
+	case 0x28: OP( 0x28 ){// PLP
 		int temp = READ_LOW( sp );
 		sp = (sp - 0xff) | 0x100;
 		data = status;
 		SET_STATUS( temp );
 		if ( !((data ^ status) & st_i) )
-			goto loop; // I flag didn't change
+			NEXT_INSTR(); // I flag didn't change
 		if ( !(status & st_i) )
 			goto handle_cli;
 		goto handle_sei;
 	}
 	
-	case 0x08: { // PHP
+	case 0x08: OP( 0x08 ) { // PHP
 		int temp;
 		CALC_STATUS( temp );
 		PUSH( temp | st_b | st_r );
-		goto loop;
+		NEXT_INSTR();
 	}
 	
-	case 0x6C: // JMP (ind)
+	case 0x6C: OP( 0x6C ) // JMP (ind)
 		data = GET_ADDR();
 		pc = READ( data );
 		pc |= READ( (data & 0xff00) | ((data + 1) & 0xff) ) << 8;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x00: { // BRK
+	case 0x00: OP( 0x00 ) { // BRK
 		pc++;
 		WRITE_LOW( 0x100 | (sp - 1), pc >> 8 );
 		WRITE_LOW( 0x100 | (sp - 2), pc );
@@ -847,29 +949,29 @@ imm##op:                                \
 	
 // Flags
 
-	case 0x38: // SEC
+	case 0x38: OP( 0x38 ) // SEC
 		c = ~0;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x18: // CLC
+	case 0x18: OP( 0x18 ) // CLC
 		c = 0;
-		goto loop;
+		NEXT_INSTR();
 		
-	case 0xB8: // CLV
+	case 0xB8: OP( 0xB8 ) // CLV
 		status &= ~st_v;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xD8: // CLD
+	case 0xD8: OP( 0xD8 ) // CLD
 		status &= ~st_d;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xF8: // SED
+	case 0xF8: OP( 0xF8 ) // SED
 		status |= st_d;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x58: // CLI
+	case 0x58: OP( 0x58 ) // CLI
 		if ( !(status & st_i) )
-			goto loop;
+			NEXT_INSTR();
 		status &= ~st_i;
 	handle_cli:
 		//dprintf( "%6d CLI\n", time() );
@@ -878,75 +980,87 @@ imm##op:                                \
 		{
 			assert( clock_limit == end_time_ );
 			if ( end_time_ <= irq_time_ )
-				goto loop; // irq is later
+				NEXT_INSTR(); // irq is later
 			if ( clock_count >= irq_time_ )
 				irq_time_ = clock_count + 1; // delay IRQ until after next instruction
 			clock_limit = irq_time_;
-			goto loop;
+			NEXT_INSTR();
 		}
 		// execution is stopping now, so delayed CLI must be handled by caller
 		result = result_cli;
 		goto end;
 		
-	case 0x78: // SEI
+	case 0x78: OP( 0x78 ) // SEI
 		if ( status & st_i )
-			goto loop;
+			NEXT_INSTR();
 		status |= st_i;
 	handle_sei:
 		//dprintf( "%6d SEI\n", time() );
 		this->r.status = status; // update externally-visible I flag
 		clock_limit = end_time_;
 		if ( clock_count < irq_time_ )
-			goto loop;
+			NEXT_INSTR();
 		result = result_sei; // IRQ will occur now, even though I flag is set
 		goto end;
 
 // Undocumented
 
-	case 0x0C: case 0x1C: case 0x3C: case 0x5C: case 0x7C: case 0xDC: case 0xFC: // SKW
+	case 0x0C: OP( 0x0C ) case 0x1C: OP( 0x1C ) case 0x3C: OP( 0x3C ) case 0x5C: OP( 0x5C ) // SKW
+	case 0x7C: OP( 0x7C ) case 0xDC: OP( 0xDC ) case 0xFC: OP( 0xFC )
 		pc++;
 		//fallthrough
-	case 0x74: case 0x04: case 0x14: case 0x34: case 0x44: case 0x54: case 0x64: // SKB
-	case 0x80: case 0x82: case 0x89: case 0xC2: case 0xD4: case 0xE2: case 0xF4:
+	case 0x74: OP( 0x74 ) case 0x04: OP( 0x04 ) case 0x14: OP( 0x14 ) case 0x34: OP( 0x34 ) // SKB
+	case 0x44: OP( 0x44 ) case 0x54: OP( 0x54 ) case 0x64: OP( 0x64 )
+	case 0x80: OP( 0x80 ) case 0x82: OP( 0x82 ) case 0x89: OP( 0x89 ) case 0xC2: OP( 0xC2 )
+	case 0xD4: OP( 0xD4 ) case 0xE2: OP( 0xE2 ) case 0xF4: OP( 0xF4 )
 		pc++;
-	case 0xEA: case 0x1A: case 0x3A: case 0x5A: case 0x7A: case 0xDA: case 0xFA: // NOP
-		goto loop;
+		//fallthrough
+	case 0xEA: OP( 0xEA ) case 0x1A: OP( 0x1A ) case 0x3A: OP( 0x3A ) case 0x5A: OP( 0x5A ) // NOP
+	case 0x7A: OP( 0x7A ) case 0xDA: OP( 0xDA ) case 0xFA: OP( 0xFA )
+		NEXT_INSTR();
 
 // Unimplemented
 	
-	case page_wrap_opcode: // HLT
+	case page_wrap_opcode: OP( page_wrap_opcode ) // HLT
 		if ( pc > 0x10000 )
 		{
 			// handle wrap-around (assumes caller has put page of HLT at 0x10000)
 			pc = (pc - 1) & 0xffff;
 			clock_count -= 2;
-			goto loop;
+			NEXT_INSTR();
 		}
 		// fall through
-	case 0x02: case 0x12: case 0x22: case 0x32: // HLT
-	case 0x42: case 0x52: case 0x62: case 0x72:
-	case 0x92: case 0xB2: case 0xD2:
-	case 0x9B: // TAS
-	case 0x9C: // SAY
-	case 0x9E: // XAS
-	case 0x93: // AXA
-	case 0x9F: // AXA
-	case 0x0B: // ANC
-	case 0x2B: // ANC
-	case 0xBB: // LAS
-	case 0x4B: // ALR
-	case 0x6B: // AAR
-	case 0x8B: // XAA
-	case 0xAB: // OAL
-	case 0xCB: // SAX
-	case 0x83: case 0x87: case 0x8F: case 0x97: // AXS
-	case 0xA3: case 0xA7: case 0xAF: case 0xB3: case 0xB7: case 0xBF: // LAX
-	case 0xE3: case 0xE7: case 0xEF: case 0xF3: case 0xF7: case 0xFB: case 0xFF: // INS
-	case 0xC3: case 0xC7: case 0xCF: case 0xD3: case 0xD7: case 0xDB: case 0xDF: // DCM
-	case 0x63: case 0x67: case 0x6F: case 0x73: case 0x77: case 0x7B: case 0x7F: // RRA
-	case 0x43: case 0x47: case 0x4F: case 0x53: case 0x57: case 0x5B: case 0x5F: // LSE
-	case 0x23: case 0x27: case 0x2F: case 0x33: case 0x37: case 0x3B: case 0x3F: // RLA
-	case 0x03: case 0x07: case 0x0F: case 0x13: case 0x17: case 0x1B: case 0x1F: // ASO
+	case 0x02: OP( 0x02 ) case 0x12: OP( 0x12 ) case 0x22: OP( 0x22 ) case 0x32: OP( 0x32 ) // HLT
+	case 0x42: OP( 0x42 ) case 0x52: OP( 0x52 ) case 0x62: OP( 0x62 ) case 0x72: OP( 0x72 )
+	case 0x92: OP( 0x92 ) case 0xB2: OP( 0xB2 ) case 0xD2: OP( 0xD2 )
+	case 0x9B: OP( 0x9B ) // TAS
+	case 0x9C: OP( 0x9C ) // SAY
+	case 0x9E: OP( 0x9E ) // XAS
+	case 0x93: OP( 0x93 ) // AXA
+	case 0x9F: OP( 0x9F ) // AXA
+	case 0x0B: OP( 0x0B ) // ANC
+	case 0x2B: OP( 0x2B ) // ANC
+	case 0xBB: OP( 0xBB ) // LAS
+	case 0x4B: OP( 0x4B ) // ALR
+	case 0x6B: OP( 0x6B ) // AAR
+	case 0x8B: OP( 0x8B ) // XAA
+	case 0xAB: OP( 0xAB ) // OAL
+	case 0xCB: OP( 0xCB ) // SAX
+	case 0x83: OP( 0x83 ) case 0x87: OP( 0x87 ) case 0x8F: OP( 0x8F ) case 0x97: OP( 0x97 ) // AXS
+	case 0xA3: OP( 0xA3 ) case 0xA7: OP( 0xA7 ) case 0xAF: OP( 0xAF ) case 0xB3: OP( 0xB3 ) // LAX
+	case 0xB7: OP( 0xB7 ) case 0xBF: OP( 0xBF )
+	case 0xE3: OP( 0xE3 ) case 0xE7: OP( 0xE7 ) case 0xEF: OP( 0xEF ) case 0xF3: OP( 0xF3 ) // INS
+	case 0xF7: OP( 0xF7 ) case 0xFB: OP( 0xFB ) case 0xFF: OP( 0xFF )
+	case 0xC3: OP( 0xC3 ) case 0xC7: OP( 0xC7 ) case 0xCF: OP( 0xCF ) case 0xD3: OP( 0xD3 ) // DCM
+	case 0xD7: OP( 0xD7 ) case 0xDB: OP( 0xDB ) case 0xDF: OP( 0xDF )
+	case 0x63: OP( 0x63 ) case 0x67: OP( 0x67 ) case 0x6F: OP( 0x6F ) case 0x73: OP( 0x73 ) // RRA
+	case 0x77: OP( 0x77 ) case 0x7B: OP( 0x7B ) case 0x7F: OP( 0x7F )
+	case 0x43: OP( 0x43 ) case 0x47: OP( 0x47 ) case 0x4F: OP( 0x4F ) case 0x53: OP( 0x53 ) // LSE
+	case 0x57: OP( 0x57 ) case 0x5B: OP( 0x5B ) case 0x5F: OP( 0x5F )
+	case 0x23: OP( 0x23 ) case 0x27: OP( 0x27 ) case 0x2F: OP( 0x2F ) case 0x33: OP( 0x33 ) // RLA
+	case 0x37: OP( 0x37 ) case 0x3B: OP( 0x3B ) case 0x3F: OP( 0x3F )
+	case 0x03: OP( 0x03 ) case 0x07: OP( 0x07 ) case 0x0F: OP( 0x0F ) case 0x13: OP( 0x13 ) // ASO
+	case 0x17: OP( 0x17 ) case 0x1B: OP( 0x1B ) case 0x1F: OP( 0x1F )
 		result = result_badop;
 		goto stop;
 	}
@@ -36,7 +36,8 @@ public:
 	// Map code memory (memory accessed via the program counter)
 	void map_code( nes_addr_t start, unsigned long size, const void* code );
 	
-	// Set read function for address range
+	// Set read function for address range. A NULL reader reads directly from the code
+	// memory mapped there, avoiding a function call.
 	void set_reader( nes_addr_t start, unsigned long size, reader_t );
 	
 	// Set write function for address range
@@ -82,6 +83,13 @@ public:
 	void set_end_time( nes_time_t t );
 	void set_irq_time( nes_time_t t );
 	
+	// Save/load exact CPU state, including low memory. Code mapping is saved as
+	// page pointers, so a snapshot can only be loaded back into the same CPU with
+	// the same memory still mapped.
+	struct snapshot_t;
+	void save_snapshot( snapshot_t* ) const;
+	void load_snapshot( snapshot_t const& );
+	
 	// If PC exceeds 0xFFFF and encounters page_wrap_opcode, it will be silently wrapped.
 	enum { page_wrap_opcode = 0xF2 };
 	
@@ -113,6 +121,18 @@ public:
 	uint8_t low_mem [page_size > 0x800 ? page_size : 0x800];
 };
 
+struct Nes_Cpu::snapshot_t
+{
+	registers_t r;
+	nes_time_t clock_limit;
+	nes_time_t base_time;
+	nes_time_t clock_count;
+	nes_time_t irq_time;
+	nes_time_t end_time;
+	uint8_t const* code_map [page_count + 1];
+	uint8_t low_mem [page_size > 0x800 ? page_size : 0x800];
+};
+
 inline BOOST::uint8_t* Nes_Cpu::get_code( nes_addr_t addr )
 {
 	#if BLARGG_NONPORTABLE
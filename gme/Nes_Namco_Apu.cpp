@@ -69,6 +69,34 @@ void Nes_Namco_Apu::reflect_state( Tagged_Data& data )
 }
 */
 
+void Nes_Namco_Apu::save_snapshot( namco_snapshot_t* out ) const
+{
+	for ( int r = 0; r < reg_count; r++ )
+		out->regs [r] = reg [r];
+	out->addr = addr_reg;
+	out->unused = 0;
+	
+	for ( int i = 0; i < osc_count; i++ )
+	{
+		out->positions [i] = oscs [i].wave_pos;
+		out->delays [i] = oscs [i].delay;
+	}
+}
+
+void Nes_Namco_Apu::load_snapshot( namco_snapshot_t const& in )
+{
+	reset();
+	for ( int r = 0; r < reg_count; r++ )
+		reg [r] = in.regs [r];
+	addr_reg = in.addr;
+	
+	for ( int i = 0; i < osc_count; i++ )
+	{
+		oscs [i].wave_pos = in.positions [i];
+		oscs [i].delay = in.delays [i];
+	}
+}
+
 void Nes_Namco_Apu::end_frame( nes_time_t time )
 {
 	if ( time > last_time )
@@ -33,7 +33,6 @@ public:
 	enum { addr_reg_addr = 0xF800 };
 	void write_addr( int );
 	
-	// to do: implement save/restore
 	void save_snapshot( namco_snapshot_t* out ) const;
 	void load_snapshot( namco_snapshot_t const& );
 	
@@ -61,7 +60,6 @@ private:
 	BOOST::uint8_t& access();
 	void run_until( nes_time_t );
 };
-/*
 struct namco_snapshot_t
 {
 	BOOST::uint8_t regs [0x80];
@@ -70,7 +68,6 @@ struct namco_snapshot_t
 	BOOST::uint8_t positions [8];
 	BOOST::uint32_t delays [8];
 };
-*/
 
 inline BOOST::uint8_t& Nes_Namco_Apu::access()
 {
@@ -54,9 +54,14 @@ Nes_Emu::equalizer_t const Nes_Emu::famicom_eq = { -15.0, 80 };
 
 // ROM
 
-int Nsf_Emu::read_code( Nsf_Emu* emu, nes_addr_t addr )
+// Banks that lie entirely within file data are mapped straight from it
+Nsf_Emu::byte const* Nsf_Emu::bank_data( int n ) const
 {
-	return *emu->cpu.get_code( addr );
+	if ( n == 0 )
+		return &rom_edges [0];
+	if ( n == total_banks - 1 )
+		return &rom_edges [page_size];
+	return rom_data + n * page_size - rom_pad;
 }
 
 void Nsf_Emu::write_exram( Nsf_Emu* emu, nes_addr_t addr, int data )
@@ -67,7 +72,7 @@ void Nsf_Emu::write_exram( Nsf_Emu* emu, nes_addr_t addr, int data )
 		if ( data < emu->total_banks )
 		{
 			emu->cpu.map_code( (bank + 8) * page_size, page_size,
-					&emu->rom [data * page_size] );
+					emu->bank_data( data ) );
 		}
 		else
 		{
@@ -99,11 +104,6 @@ int Nsf_Emu::pcm_read( void* emu, nes_addr_t addr )
 
 // Low Mem
 
-int Nsf_Emu::read_low_mem( Nsf_Emu* emu, nes_addr_t addr )
-{
-	return emu->cpu.low_mem [addr];
-}
-
 void Nsf_Emu::write_low_mem( Nsf_Emu* emu, nes_addr_t addr, int data )
 {
 	emu->cpu.low_mem [addr] = data;
@@ -111,11 +111,6 @@ void Nsf_Emu::write_low_mem( Nsf_Emu* emu, nes_addr_t addr, int data )
 
 // SRAM
 
-int Nsf_Emu::read_sram( Nsf_Emu* emu, nes_addr_t addr )
-{
-	return emu->sram [addr & (sram_size - 1)];
-}
-
 void Nsf_Emu::write_sram( Nsf_Emu* emu, nes_addr_t addr, int data )
 {
 	emu->sram [addr & (sram_size - 1)] = data;
@@ -206,6 +201,9 @@ Nes_Emu::Nes_Emu( double gain_ )
 	vrc6 = NULL;
 	namco = NULL;
 	fme7 = NULL;
+	rom_data = NULL;
+	rom_pad = 0;
+	total_banks = 0;
 	Music_Emu::set_equalizer( nes_eq );
 	
 	// set unmapped code to illegal instruction
@@ -232,6 +230,8 @@ void Nsf_Emu::unload()
 	#endif
 	
 	rom.clear();
+	rom_edges.clear();
+	rom_data = NULL;
 }
 
 const char** Nsf_Emu::voice_names() const
@@ -276,13 +276,14 @@ blargg_err_t Nsf_Emu::init_sound()
 	
 	// map memory
 	cpu.reset( unmapped_code, read_unmapped, write_unmapped );
-	cpu.map_memory( 0, low_mem_size, read_low_mem, write_low_mem );
+	// pages with NULL readers are read directly from their code mapping
+	cpu.map_memory( 0, low_mem_size, NULL, write_low_mem );
 	cpu.map_code( 0, low_mem_size, cpu.low_mem );
 	cpu.map_memory( 0x4000, Nes_Cpu::page_size, read_snd, write_snd );
 	cpu.map_memory( exram_addr, Nes_Cpu::page_size, read_unmapped, write_exram );
-	cpu.map_memory( 0x6000, sram_size, read_sram, write_sram );
+	cpu.map_memory( 0x6000, sram_size, NULL, write_sram );
 	cpu.map_code  ( 0x6000, sram_size, sram );
-	cpu.map_memory( rom_begin, ram_size - rom_begin, read_code, write_unmapped );
+	cpu.map_memory( rom_begin, ram_size - rom_begin, NULL, write_unmapped );
 	
 	set_voice_count( Nes_Apu::osc_count );
 	
@@ -306,7 +307,7 @@ blargg_err_t Nsf_Emu::init_sound()
 		cpu.map_memory( Nes_Namco_Apu::data_reg_addr, Nes_Cpu::page_size,
 				read_namco, write_namco );
 		cpu.map_memory( Nes_Namco_Apu::addr_reg_addr, Nes_Cpu::page_size,
-				 read_code, write_namco_addr );
+				NULL, write_namco_addr );
 	}
 	
 	// vrc6
@@ -318,7 +319,7 @@ blargg_err_t Nsf_Emu::init_sound()
 		adjusted_gain *= 0.75;
 		for ( int i = 0; i < Nes_Vrc6_Apu::osc_count; i++ )
 			cpu.map_memory( Nes_Vrc6_Apu::base_addr + i * Nes_Vrc6_Apu::addr_step,
-					Nes_Cpu::page_size, read_code, write_vrc6 );
+					Nes_Cpu::page_size, NULL, write_vrc6 );
 	}
 	
 	// fme7
@@ -329,7 +330,7 @@ blargg_err_t Nsf_Emu::init_sound()
 		
 		adjusted_gain *= 0.75;
 		cpu.map_memory( fme7->latch_addr, ram_size - fme7->latch_addr,
-				read_code, write_fme7 );
+				NULL, write_fme7 );
 	}
 	// to do: is gain adjustment even needed? other sound chip volumes should work
 	// naturally with the apu without change.
@@ -375,8 +376,29 @@ blargg_err_t Nsf_Emu::load( Data_Reader& in )
 
 blargg_err_t Nsf_Emu::load( const header_t& h, Data_Reader& in )
 {
-	header_ = h;
 	unload();
+	BLARGG_RETURN_ERR( rom.resize( in.remain() ) );
+	blargg_err_t err = in.read( rom.begin(), rom.size() );
+	if ( err )
+	{
+		unload();
+		return err;
+	}
+	return load_( h, rom.begin(), rom.size() );
+}
+
+blargg_err_t Nsf_Emu::load_mem( void const* data, long size )
+{
+	unload();
+	if ( size < (long) sizeof (header_t) )
+		return "Not an NSF file";
+	return load_( *(header_t const*) data, (byte const*) data + sizeof (header_t),
+			size - sizeof (header_t) );
+}
+
+blargg_err_t Nsf_Emu::load_( const header_t& h, byte const* data, long size )
+{
+	header_ = h;
 	
 	// check compatibility
 	if ( 0 != memcmp( header_.tag, "NESM\x1A", 5 ) )
@@ -401,15 +423,23 @@ blargg_err_t Nsf_Emu::load( const header_t& h, Data_Reader& in )
 		return "Invalid address in NSF";
 	
 	// set up rom
-	total_banks = (in.remain() + load_addr % page_size + page_size - 1) / page_size;
-	BLARGG_RETURN_ERR( rom.resize( total_banks * page_size ) );
-	memset( rom.begin(), 0, rom.size() );
-	err = in.read( &rom [load_addr % page_size], in.remain() );
+	rom_data = data;
+	rom_pad = load_addr % page_size;
+	total_banks = (size + rom_pad + page_size - 1) / page_size;
+	err = rom_edges.resize( 2 * page_size );
 	if ( err )
 	{
 		unload();
 		return err;
 	}
+	memset( rom_edges.begin(), 0, rom_edges.size() );
+	long first = page_size - rom_pad;
+	memcpy( &rom_edges [rom_pad], data, (size < first ? size : first) );
+	if ( total_banks > 1 )
+	{
+		long last = (total_banks - 1) * page_size - rom_pad;
+		memcpy( &rom_edges [page_size], data + last, size - last );
+	}
 	
 	// bank switching
 	int first_bank = (load_addr - rom_begin) / page_size;
@@ -495,7 +525,7 @@ void Nsf_Emu::set_voice( int i, Blip_Buffer* buf, Blip_Buffer*, Blip_Buffer* )
 
 void Nsf_Emu::start_track( int track )
 {
-	require( rom.size() ); // file must be loaded
+	require( rom_edges.size() ); // file must be loaded
 	
 	Classic_Emu::start_track( track );
 	
@@ -537,6 +567,73 @@ void Nsf_Emu::start_track( int track )
 	play_extra = 0;
 }
 
+// Save states
+
+struct Nsf_Emu::state_t
+{
+	Nes_Cpu::snapshot_t cpu;
+	apu_snapshot_t apu;
+	#if !NSF_EMU_APU_ONLY
+		namco_snapshot_t namco;
+		vrc6_snapshot_t vrc6;
+		fme7_snapshot_t fme7;
+	#endif
+	nes_time_t next_play;
+	int play_extra;
+	byte sram [sram_size];
+};
+
+long Nsf_Emu::state_size() const
+{
+	return sizeof (state_t);
+}
+
+void Nsf_Emu::save_state( void* out ) const
+{
+	state_t* state = (state_t*) out;
+	cpu.save_snapshot( &state->cpu );
+	apu.save_snapshot( &state->apu );
+	
+	#if !NSF_EMU_APU_ONLY
+		if ( namco )
+			namco->save_snapshot( &state->namco );
+		
+		if ( vrc6 )
+			vrc6->save_snapshot( &state->vrc6 );
+		
+		if ( fme7 )
+			fme7->save_snapshot( &state->fme7 );
+	#endif
+	
+	state->next_play = next_play;
+	state->play_extra = play_extra;
+	memcpy( state->sram, sram, sizeof sram );
+}
+
+void Nsf_Emu::load_state( void const* in )
+{
+	Classic_Emu::load_state( in );
+	
+	state_t const* state = (state_t const*) in;
+	cpu.load_snapshot( state->cpu );
+	apu.load_snapshot( state->apu );
+	
+	#if !NSF_EMU_APU_ONLY
+		if ( namco )
+			namco->load_snapshot( state->namco );
+		
+		if ( vrc6 )
+			vrc6->load_snapshot( state->vrc6 );
+		
+		if ( fme7 )
+			fme7->load_snapshot( state->fme7 );
+	#endif
+	
+	next_play = state->next_play;
+	play_extra = state->play_extra;
+	memcpy( sram, state->sram, sizeof sram );
+}
+
 void Nsf_Emu::cpu_jsr( nes_addr_t pc, int adj )
 {
 	unsigned addr = cpu.r.pc + adj;
@@ -49,6 +49,10 @@ public:
 	// Load NSF using already-loaded header and remaining data
 	blargg_err_t load( header_t const&, Data_Reader& );
 	
+	// Load NSF file in memory, referencing its ROM data rather than copying it.
+	// See Music_Emu::load_mem().
+	blargg_err_t load_mem( void const*, long size );
+	
 	// Header for currently loaded NSF
 	header_t const& header() const { return header_; }
 	
@@ -66,7 +70,11 @@ protected:
 	void update_eq( blip_eq_t const& );
 	blip_time_t run_clocks( blip_time_t, bool* );
 	virtual void call_play();
+	long state_size() const;
+	void save_state( void* ) const;
+	void load_state( void const* );
 protected:
+	struct state_t;
 	// initial state
 	enum { bank_count = 8 };
 	byte initial_banks [bank_count];
@@ -88,8 +96,12 @@ protected:
 	
 	// rom
 	int total_banks;
-	blargg_vector<byte> rom;
-	static int read_code( Nsf_Emu*, nes_addr_t );
+	blargg_vector<byte> rom;        // file data when loaded from a Data_Reader
+	blargg_vector<byte> rom_edges;  // copies of first and last banks, which can be partial
+	byte const* rom_data;           // file data after header, at load address
+	long rom_pad;                   // offset of load address in its bank
+	byte const* bank_data( int ) const;
+	blargg_err_t load_( header_t const&, byte const* data, long size );
 	void unload();
 	
 	blargg_err_t init_sound();
@@ -114,7 +126,6 @@ protected:
 	// cpu
 	Nes_Cpu cpu;
 	void cpu_jsr( unsigned pc, int adj );
-	static int read_low_mem( Nsf_Emu*, nes_addr_t );
 	static void write_low_mem( Nsf_Emu*, nes_addr_t, int );
 	static int read_unmapped( Nsf_Emu*, nes_addr_t );
 	static void write_unmapped( Nsf_Emu*, nes_addr_t, int );
@@ -129,7 +140,6 @@ protected:
 	// sram
 	enum { sram_size = 0x2000 };
 	byte sram [sram_size];
-	static int read_sram( Nsf_Emu*, nes_addr_t );
 	static void write_sram( Nsf_Emu*, nes_addr_t, int );
 };
 
@@ -148,6 +148,36 @@ blargg_err_t Snes_Spc::load_state( const registers_t& cpu_state, const void* new
 	return NULL; // success
 }
 
+void Snes_Spc::save_snapshot( snapshot_t* out ) const
+{
+	out->cpu = cpu.r;
+	dsp.save_snapshot( &out->dsp );
+	for ( int i = 0; i < timer_count; i++ )
+		out->timer [i] = timer [i];
+	out->extra_cycles = extra_cycles;
+	out->keys_pressed = keys_pressed;
+	out->keys_released = keys_released;
+	out->echo_accessed = echo_accessed;
+	out->rom_enabled = rom_enabled;
+	memcpy( out->extra_ram, extra_ram, sizeof extra_ram );
+	memcpy( out->ram, ram, ram_size );
+}
+
+void Snes_Spc::load_snapshot( snapshot_t const& in )
+{
+	cpu.r = in.cpu;
+	dsp.load_snapshot( in.dsp );
+	for ( int i = 0; i < timer_count; i++ )
+		timer [i] = in.timer [i];
+	extra_cycles = in.extra_cycles;
+	keys_pressed = in.keys_pressed;
+	keys_released = in.keys_released;
+	echo_accessed = in.echo_accessed;
+	rom_enabled = in.rom_enabled;
+	memcpy( extra_ram, in.extra_ram, sizeof extra_ram );
+	memcpy( ram, in.ram, ram_size );
+}
+
 // Hardware
 
 // Current time starts negative and ends at 0
@@ -473,3 +503,11 @@ blargg_err_t Snes_Spc::play( long count, sample_t* out )
 	return blargg_success;
 }
 
+blargg_err_t Snes_Spc::play_voices( long count, sample_t* const* bufs )
+{
+	dsp.set_voice_outputs( bufs );
+	blargg_err_t err = play( count * 2 );
+	dsp.set_voice_outputs( NULL );
+	return err;
+}
+
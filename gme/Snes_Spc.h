@@ -37,9 +37,18 @@ public:
 	typedef short sample_t;
 	blargg_err_t play( long count, sample_t* buf = NULL );
 	
+	// Generate 'count' mono samples of each voice n into bufs [n] (NULL to skip),
+	// without any echo. See Spc_Dsp::set_voice_outputs().
+	blargg_err_t play_voices( long count, sample_t* const* bufs );
+	
 	// Skip forward by the specified number of samples (64000 samples = 1 second)
 	blargg_err_t skip( long count );
 	
+	// Save/load exact emulation state between calls to play()
+	struct snapshot_t;
+	void save_snapshot( snapshot_t* ) const;
+	void load_snapshot( snapshot_t const& );
+	
 	// Set gain, where 1.0 is normal. When greater than 1.0, output is clamped the
 	// 16-bit sample range.
 	void set_gain( double );
@@ -103,6 +112,20 @@ private:
 	uint8_t ram [ram_size + 0x100]; // padding for catching jumps past end
 };
 
+struct Snes_Spc::snapshot_t
+{
+	registers_t cpu;
+	Spc_Dsp::snapshot_t dsp;
+	Timer timer [timer_count];
+	int extra_cycles;
+	int keys_pressed;
+	int keys_released;
+	bool echo_accessed;
+	bool rom_enabled;
+	uint8_t extra_ram [rom_size];
+	uint8_t ram [ram_size];
+};
+
 inline void Snes_Spc::disable_surround( bool disable ) { dsp.disable_surround( disable ); }
 
 inline void Snes_Spc::mute_voices( int mask ) { dsp.mute_voices( mask ); }
@@ -45,7 +45,8 @@ Spc_Cpu::Spc_Cpu( Snes_Spc* e, uint8_t* ram_in ) : ram( ram_in ), emu( *e )
 	BOOST_STATIC_ASSERT( sizeof (int) >= 4 );
 }
 
-#define READ( addr )            (emu.read( addr ))
+// Only the I/O registers at 0xF0-0xFF need to go through the emulator
+#define READ( addr )            (unsigned ((addr) - 0xf0) < 0x10 ? emu.read( addr ) : ram [addr])
 #define WRITE( addr, value )    (emu.write( addr, value ))
 
 #define READ_DP( addr )         READ( (addr) + dp )
@@ -94,6 +95,31 @@ unsigned Spc_Cpu::mem_bit( spc_addr_t pc )
 	return (t << 8) & 0x100;
 }
 
+#if BLARGG_COMPUTED_GOTO
+	// Each opcode's case also has a label, which dispatch jumps to directly
+	#define OP( n )         op_##n:
+	#define OP_LABEL( n )   n:
+	#define DISPATCH( op )  __extension__ ({ goto *dispatch [op]; })
+	
+	// Fetch and dispatch next instruction at the end of each handler, giving each
+	// its own indirect branch. Register checks are only made at loop.
+	#define NEXT_INSTR() {                                  \
+		opcode = READ_PROG( pc );                           \
+		pc++;                                               \
+		data = READ_PROG( pc );                             \
+		if ( remain_ <= 0 )                                 \
+			goto stop;                                      \
+		remain_ -= cycle_table [opcode];                    \
+		DISPATCH( opcode );                                 \
+	}
+	#define INC_PC_NEXT_INSTR() { pc++; NEXT_INSTR(); }
+#else
+	#define OP( n )
+	#define OP_LABEL( n )
+	#define NEXT_INSTR()        goto loop
+	#define INC_PC_NEXT_INSTR() goto inc_pc_loop
+#endif
+
 #include BLARGG_ENABLE_OPTIMIZER
 
 spc_time_t Spc_Cpu::run( spc_time_t cycle_count )
@@ -102,6 +128,44 @@ spc_time_t Spc_Cpu::run( spc_time_t cycle_count )
 	
 	uint8_t* const ram = this->ram; // cache
 	
+#if BLARGG_COMPUTED_GOTO
+	// opcodes without a handler go to stop, as when they fall out of the switch
+	__extension__ static void* const dispatch [0x100] = {
+		&&op_0x00, &&op_0x01, &&op_0x02, &&op_0x03, &&dp_0x08, &&abs_0x08, &&ind_x_0x08, &&ind_dp_x_0x08, // 0
+		&&imm_0x08, &&dp_dp_0x08, &&op_0x0A, &&op_0x0B, &&op_0x0C, &&op_0x0D, &&op_0x0E, &&op_0x0F,
+		&&op_0x10, &&op_0x11, &&op_0x12, &&op_0x13, &&dp_x_0x08, &&abs_x_0x08, &&abs_y_0x08, &&ind_dp_y_0x08, // 1
+		&&dp_imm_0x08, &&x_y_0x08, &&op_0x1A, &&op_0x1B, &&op_0x1C, &&op_0x1D, &&op_0x1E, &&op_0x1F,
+		&&op_0x20, &&op_0x21, &&op_0x22, &&op_0x23, &&dp_0x28, &&abs_0x28, &&ind_x_0x28, &&ind_dp_x_0x28, // 2
+		&&imm_0x28, &&dp_dp_0x28, &&op_0x2A, &&op_0x2B, &&op_0x2C, &&op_0x2D, &&op_0x2E, &&op_0x2F,
+		&&op_0x30, &&op_0x31, &&op_0x32, &&op_0x33, &&dp_x_0x28, &&abs_x_0x28, &&abs_y_0x28, &&ind_dp_y_0x28, // 3
+		&&dp_imm_0x28, &&x_y_0x28, &&op_0x3A, &&op_0x3B, &&op_0x3C, &&op_0x3D, &&op_0x3E, &&op_0x3F,
+		&&op_0x40, &&op_0x41, &&op_0x42, &&op_0x43, &&dp_0x48, &&abs_0x48, &&ind_x_0x48, &&ind_dp_x_0x48, // 4
+		&&imm_0x48, &&dp_dp_0x48, &&op_0x4A, &&op_0x4B, &&op_0x4C, &&op_0x4D, &&op_0x4E, &&op_0x4F,
+		&&op_0x50, &&op_0x51, &&op_0x52, &&op_0x53, &&dp_x_0x48, &&abs_x_0x48, &&abs_y_0x48, &&ind_dp_y_0x48, // 5
+		&&dp_imm_0x48, &&x_y_0x48, &&op_0x5A, &&op_0x5B, &&op_0x5C, &&op_0x5D, &&op_0x5E, &&op_0x5F,
+		&&op_0x60, &&op_0x61, &&op_0x62, &&op_0x63, &&dp_0x68, &&abs_0x68, &&ind_x_0x68, &&ind_dp_x_0x68, // 6
+		&&op_0x68, &&op_0x69, &&op_0x6A, &&op_0x6B, &&op_0x6C, &&op_0x6D, &&op_0x6E, &&op_0x6F,
+		&&op_0x70, &&op_0x71, &&op_0x72, &&op_0x73, &&dp_x_0x68, &&abs_x_0x68, &&abs_y_0x68, &&ind_dp_y_0x68, // 7
+		&&op_0x78, &&op_0x79, &&op_0x7A, &&op_0x7B, &&op_0x7C, &&op_0x7D, &&op_0x7E, &&op_0x7F,
+		&&op_0x80, &&op_0x81, &&op_0x82, &&op_0x83, &&dp_0x88, &&abs_0x88, &&ind_x_0x88, &&ind_dp_x_0x88, // 8
+		&&op_0x88, &&op_0x89, &&op_0x8A, &&op_0x8B, &&op_0x8C, &&op_0x8D, &&op_0x8E, &&op_0x8F,
+		&&op_0x90, &&op_0x91, &&op_0x92, &&op_0x93, &&dp_x_0x88, &&abs_x_0x88, &&abs_y_0x88, &&ind_dp_y_0x88, // 9
+		&&op_0x98, &&op_0x99, &&op_0x9A, &&op_0x9B, &&op_0x9C, &&op_0x9D, &&op_0x9E, &&op_0x9F,
+		&&op_0xA0, &&op_0xA1, &&op_0xA2, &&op_0xA3, &&dp_0x88, &&abs_0x88, &&ind_x_0x88, &&ind_dp_x_0x88, // A
+		&&op_0xA8, &&op_0xA9, &&op_0xAA, &&op_0xAB, &&op_0xAC, &&op_0xAD, &&op_0xAE, &&op_0xAF,
+		&&op_0xB0, &&op_0xB1, &&op_0xB2, &&op_0xB3, &&dp_x_0x88, &&abs_x_0x88, &&abs_y_0x88, &&ind_dp_y_0x88, // B
+		&&op_0xB8, &&op_0xB9, &&op_0xBA, &&op_0xBB, &&op_0xBC, &&op_0xBD, &&stop, &&op_0xBF,
+		&&op_0xC0, &&op_0xC1, &&op_0xC2, &&op_0xC3, &&dp_0xC8, &&abs_0xC8, &&ind_x_0xC8, &&ind_dp_x_0xC8, // C
+		&&op_0xC8, &&op_0xC9, &&op_0xCA, &&op_0xCB, &&op_0xCC, &&op_0xCD, &&op_0xCE, &&op_0xCF,
+		&&op_0xD0, &&op_0xD1, &&op_0xD2, &&op_0xD3, &&dp_x_0xC8, &&abs_x_0xC8, &&abs_y_0xC8, &&ind_dp_y_0xC8, // D
+		&&op_0xD8, &&op_0xD9, &&op_0xDA, &&op_0xDB, &&op_0xDC, &&op_0xDD, &&op_0xDE, &&stop,
+		&&op_0xE0, &&op_0xE1, &&op_0xE2, &&op_0xE3, &&dp_0xE8, &&abs_0xE8, &&ind_x_0xE8, &&ind_dp_x_0xE8, // E
+		&&op_0xE8, &&op_0xE9, &&op_0xEA, &&op_0xEB, &&op_0xEC, &&op_0xED, &&op_0xEE, &&stop,
+		&&op_0xF0, &&op_0xF1, &&op_0xF2, &&op_0xF3, &&dp_x_0xE8, &&abs_x_0xE8, &&abs_y_0xE8, &&ind_dp_y_0xE8, // F
+		&&op_0xF8, &&op_0xF9, &&op_0xFA, &&op_0xFB, &&op_0xFC, &&op_0xFD, &&op_0xFE, &&stop
+	};
+#endif
+	
 	// Stack pointer is kept one greater than usual SPC stack pointer to allow
 	// common pre-decrement and post-increment memory instructions that some
 	// processors have. Address wrap-around isn't supported.
@@ -166,7 +230,9 @@ spc_time_t Spc_Cpu::run( spc_time_t cycle_count )
 cbranch_taken_loop: // compare and branch
 	pc += (BOOST::int8_t) READ_PROG( pc );
 	remain_ -= 2;
+#if !BLARGG_COMPUTED_GOTO
 inc_pc_loop: // end of instruction with an operand
+#endif
 	pc++;
 loop:
 	
@@ -187,6 +253,10 @@ loop:
 	
 	remain_ -= cycle_table [opcode];
 	
+	#if BLARGG_COMPUTED_GOTO
+		DISPATCH( opcode );
+	#endif
+	
 	// Use 'data' for temporaries whose lifetime crosses read/write calls, otherwise
 	// use a local temporary.
 	switch ( opcode )
@@ -199,26 +269,26 @@ loop:
 			pc += offset;           \
 			remain_ -= 2;           \
 		}                           \
-		goto loop;                  \
+		NEXT_INSTR();               \
 	}
 	
 // Most-Common
 
-	case 0xF0: // BEQ (most common)
+	case 0xF0: OP( 0xF0 ) // BEQ (most common)
 		BRANCH( !(uint8_t) nz )
 	
-	case 0xD0: // BNE
+	case 0xD0: OP( 0xD0 ) // BNE
 		BRANCH( (uint8_t) nz )
 	
-	case 0x3F: // CALL
+	case 0x3F: OP( 0x3F ) // CALL
 		PUSH16( pc + 2 );
 		pc = READ_PROG16( pc );
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x6F: // RET
+	case 0x6F: OP( 0x6F ) // RET
 		pc = POP();
 		pc += POP() * 0x100;
-		goto loop;
+		NEXT_INSTR();
 
 #define CASE( n )	/* fallthrough */\
 					case n:
@@ -227,19 +297,24 @@ loop:
 // ends with data set to the address of the operand.
 #define ADDR_MODES( op )                \
 	CASE( op - 0x02 ) /* (X) */         \
+	OP_LABEL( ind_x_##op )              \
 		data = x + dp;                  \
 		pc--;                           \
 		goto end_##op;                  \
 	CASE( op + 0x0F ) /* (dp)+Y */      \
+	OP_LABEL( ind_dp_y_##op )           \
 		data = READ_PROG16( data + dp ) + y;\
 		goto end_##op;                  \
 	CASE( op - 0x01 ) /* (dp+X) */      \
+	OP_LABEL( ind_dp_x_##op )           \
 		data = READ_PROG16( uint8_t (data + x) + dp );\
 		goto end_##op;                  \
 	CASE( op + 0x0E ) /* abs+Y */       \
+	OP_LABEL( abs_y_##op )              \
 		data += y;                      \
 		goto abs_##op;                  \
 	CASE( op + 0x0D ) /* abs+X */       \
+	OP_LABEL( abs_x_##op )              \
 		data += x; /* fallthrough */    \
 	CASE( op - 0x03 ) /* abs */         \
 	abs_##op:                           \
@@ -247,8 +322,10 @@ loop:
 		data += 0x100 * READ_PROG( pc );\
 		goto end_##op;                  \
 	CASE( op + 0x0C ) /* dp+X */        \
+	OP_LABEL( dp_x_##op )               \
 		data = uint8_t (data + x); /* fallthrough */\
 	CASE( op - 0x04 ) /* dp */          \
+	OP_LABEL( dp_##op )                 \
 		data += dp;                     \
 	end_##op:
 
@@ -258,129 +335,129 @@ loop:
 	// case 0xE4: // MOV a,dp (most common)
 	mov_a_addr:
 		a = nz = READ( data );
-		goto inc_pc_loop;
-	case 0xBF: // MOV A,(X)+
+		INC_PC_NEXT_INSTR();
+	case 0xBF: OP( 0xBF ) // MOV A,(X)+
 		data = x + dp;
 		x = uint8_t (x + 1);
 		pc--;
 		goto mov_a_addr;
 	
-	case 0xE8: // MOV A,imm
+	case 0xE8: OP( 0xE8 ) // MOV A,imm
 		a = data;
 		nz = data;
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 	
-	case 0xF9: // MOV X,dp+Y
+	case 0xF9: OP( 0xF9 ) // MOV X,dp+Y
 		data = uint8_t (data + y);
 		//fallthrough
-	case 0xF8: // MOV X,dp
+	case 0xF8: OP( 0xF8 ) // MOV X,dp
 		data += dp;
 		goto mov_x_addr;
-	case 0xE9: // MOV X,abs
+	case 0xE9: OP( 0xE9 ) // MOV X,abs
 		data = READ_PROG16( pc );
 		pc++;
 	mov_x_addr:
 		data = READ( data );
 		//fallthrough
-	case 0xCD: // MOV X,imm
+	case 0xCD: OP( 0xCD ) // MOV X,imm
 		x = data;
 		nz = data;
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 	
-	case 0xFB: // MOV Y,dp+X
+	case 0xFB: OP( 0xFB ) // MOV Y,dp+X
 		data = uint8_t (data + x);
 		//fallthrough
-	case 0xEB: // MOV Y,dp
+	case 0xEB: OP( 0xEB ) // MOV Y,dp
 		data += dp;
 		goto mov_y_addr;
-	case 0xEC: // MOV Y,abs
+	case 0xEC: OP( 0xEC ) // MOV Y,abs
 		data = READ_PROG16( pc );
 		pc++;
 	mov_y_addr:
 		data = READ( data );
 		//fallthrough
-	case 0x8D: // MOV Y,imm
+	case 0x8D: OP( 0x8D ) // MOV Y,imm
 		y = data;
 		nz = data;
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 
 // 2. 8-BIT DATA TRANSMISSION COMMANDS, GROUP 2
 
 	ADDR_MODES( 0xC8 ) // MOV addr,A
 		WRITE( data, a );
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 	
 	{
 		int temp;
-	case 0xCC: // MOV abs,Y
+	case 0xCC: OP( 0xCC ) // MOV abs,Y
 		temp = y;
 		goto mov_abs_temp;
-	case 0xC9: // MOV abs,X
+	case 0xC9: OP( 0xC9 ) // MOV abs,X
 		temp = x;
 	mov_abs_temp:
 		WRITE( READ_PROG16( pc ), temp );
 		pc += 2;
-		goto loop;
+		NEXT_INSTR();
 	}
 	
-	case 0xD9: // MOV dp+Y,X
+	case 0xD9: OP( 0xD9 ) // MOV dp+Y,X
 		data = uint8_t (data + y);
 		//fallthrough
-	case 0xD8: // MOV dp,X
+	case 0xD8: OP( 0xD8 ) // MOV dp,X
 		WRITE( data + dp, x );
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 	
-	case 0xDB: // MOV dp+X,Y
+	case 0xDB: OP( 0xDB ) // MOV dp+X,Y
 		data = uint8_t (data + x);
 		//fallthrough
-	case 0xCB: // MOV dp,Y
+	case 0xCB: OP( 0xCB ) // MOV dp,Y
 		WRITE( data + dp, y );
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 
-	case 0xFA: // MOV dp,dp
+	case 0xFA: OP( 0xFA ) // MOV dp,dp
 		data = READ( data + dp );
 		//fallthrough
-	case 0x8F: // MOV dp,#imm
+	case 0x8F: OP( 0x8F ) // MOV dp,#imm
 		pc++;
 		WRITE_DP( READ_PROG( pc ), data );
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 	
 // 3. 8-BIT DATA TRANSMISSIN COMMANDS, GROUP 3.
 	
-	case 0x7D: // MOV A,X
+	case 0x7D: OP( 0x7D ) // MOV A,X
 		a = x;
 		nz = x;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xDD: // MOV A,Y
+	case 0xDD: OP( 0xDD ) // MOV A,Y
 		a = y;
 		nz = y;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x5D: // MOV X,A
+	case 0x5D: OP( 0x5D ) // MOV X,A
 		x = a;
 		nz = a;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xFD: // MOV Y,A
+	case 0xFD: OP( 0xFD ) // MOV Y,A
 		y = a;
 		nz = a;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x9D: // MOV X,SP
+	case 0x9D: OP( 0x9D ) // MOV X,SP
 		x = nz = GET_SP();
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xBD: // MOV SP,X
+	case 0xBD: OP( 0xBD ) // MOV SP,X
 		SET_SP( x );
-		goto loop;
+		NEXT_INSTR();
 	
 	//case 0xC6: // MOV (X),A (handled by MOV addr,A in group 2)
 	
-	case 0xAF: // MOV (X)+,A
+	case 0xAF: OP( 0xAF ) // MOV (X)+,A
 		WRITE_DP( x, a );
 		x++;
-		goto loop;
+		NEXT_INSTR();
 	
 // 5. 8-BIT LOGIC OPERATION COMMANDS
 	
@@ -389,23 +466,27 @@ loop:
 		data = READ( data );    \
 		/* fallthrough */       \
 	case op: /* imm */          \
+	OP_LABEL( imm_##op )        \
 		nz = a func##= data;    \
-		goto inc_pc_loop;       \
+		INC_PC_NEXT_INSTR();    \
 	{   unsigned addr;          \
 	case op + 0x11: /* X,Y */   \
+	OP_LABEL( x_y_##op )        \
 		data = READ_DP( y );    \
 		addr = x + dp;          \
 		pc--;                   \
 		goto addr_##op;         \
 	case op + 0x01: /* dp,dp */ \
+	OP_LABEL( dp_dp_##op )      \
 		data = READ_DP( data ); \
 	case op + 0x10: /*dp,imm*/\
+	OP_LABEL( dp_imm_##op )     \
 		pc++;                   \
 		addr = READ_PROG( pc ) + dp;\
 	addr_##op:                  \
 		nz = data func READ( addr );\
 		WRITE( addr, nz );      \
-		goto inc_pc_loop;       \
+		INC_PC_NEXT_INSTR();    \
 	}
 	
 	LOGICAL_OP( 0x28, & ); // AND
@@ -419,72 +500,72 @@ loop:
 	ADDR_MODES( 0x68 ) // CMP addr
 		data = READ( data );
 		//fallthrough
-	case 0x68: // CMP imm
+	case 0x68: OP( 0x68 ) // CMP imm
 		nz = a - data;
 		c = ~nz;
 		nz &= 0xff;
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 	
-	case 0x79: // CMP (X),(Y)
+	case 0x79: OP( 0x79 ) // CMP (X),(Y)
 		data = READ_DP( x );
 		nz = data - READ_DP( y );
 		c = ~nz;
 		nz &= 0xff;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x69: // CMP (dp),(dp)
+	case 0x69: OP( 0x69 ) // CMP (dp),(dp)
 		data = READ_DP( data );
 		//fallthrough
-	case 0x78: // CMP dp,imm
+	case 0x78: OP( 0x78 ) // CMP dp,imm
 		pc++;
 		nz = READ_DP( READ_PROG( pc ) ) - data;
 		c = ~nz;
 		nz &= 0xff;
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 	
-	case 0x3E: // CMP X,dp
+	case 0x3E: OP( 0x3E ) // CMP X,dp
 		data += dp;
 		goto cmp_x_addr;
-	case 0x1E: // CMP X,abs
+	case 0x1E: OP( 0x1E ) // CMP X,abs
 		data = READ_PROG16( pc );
 		pc++;
 	cmp_x_addr:
 		data = READ( data );
 		//fallthrough
-	case 0xC8: // CMP X,imm
+	case 0xC8: OP( 0xC8 ) // CMP X,imm
 		nz = x - data;
 		c = ~nz;
 		nz &= 0xff;
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 	
-	case 0x7E: // CMP Y,dp
+	case 0x7E: OP( 0x7E ) // CMP Y,dp
 		data += dp;
 		goto cmp_y_addr;
-	case 0x5E: // CMP Y,abs
+	case 0x5E: OP( 0x5E ) // CMP Y,abs
 		data = READ_PROG16( pc );
 		pc++;
 	cmp_y_addr:
 		data = READ( data );
 		//fallthrough
-	case 0xAD: // CMP Y,imm
+	case 0xAD: OP( 0xAD ) // CMP Y,imm
 		nz = y - data;
 		c = ~nz;
 		nz &= 0xff;
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 	
 	{
 		int addr;
-	case 0xB9: // SBC (x),(y)
-	case 0x99: // ADC (x),(y)
+	case 0xB9: OP( 0xB9 ) // SBC (x),(y)
+	case 0x99: OP( 0x99 ) // ADC (x),(y)
 		pc--; // compensate for inc later
 		data = READ_DP( x );
 		addr = y + dp;
 		goto adc_addr;
-	case 0xA9: // SBC dp,dp
-	case 0x89: // ADC dp,dp
+	case 0xA9: OP( 0xA9 ) // SBC dp,dp
+	case 0x89: OP( 0x89 ) // ADC dp,dp
 		data = READ_DP( data );
-	case 0xB8: // SBC dp,imm
-	case 0x98: // ADC dp,imm
+	case 0xB8: OP( 0xB8 ) // SBC dp,imm
+	case 0x98: OP( 0x98 ) // ADC dp,imm
 		pc++;
 		addr = READ_PROG( pc ) + dp;
 	adc_addr:
@@ -496,8 +577,8 @@ loop:
 #define CASE( n ) case n: case (n) + 0x20:
 	ADDR_MODES( 0x88 ) // ADC/SBC addr
 		data = READ( data );
-	case 0xA8: // SBC imm
-	case 0x88: // ADC imm
+	case 0xA8: OP( 0xA8 ) // SBC imm
+	case 0x88: OP( 0x88 ) // ADC imm
 		addr = -1; // A
 		nz = a;
 	adc_data: {
@@ -511,10 +592,10 @@ loop:
 		status = (status & ~(st_v | st_h)) | ((ov >> 2) & st_v) | ((hc >> 1) & st_h);
 		if ( addr < 0 ) {
 			a = (uint8_t) nz;
-			goto inc_pc_loop;
+			INC_PC_NEXT_INSTR();
 		}
 		WRITE( addr, (uint8_t) nz );
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 	}
 	
 	}
@@ -524,99 +605,99 @@ loop:
 #define INC_DEC_REG( reg, n )   \
 		nz = reg + n;           \
 		reg = (uint8_t) nz;     \
-		goto loop;
+		NEXT_INSTR();
 
-	case 0xBC: INC_DEC_REG( a, 1 )  // INC A
-	case 0x3D: INC_DEC_REG( x, 1 )  // INC X
-	case 0xFC: INC_DEC_REG( y, 1 )  // INC Y
+	case 0xBC: OP( 0xBC ) INC_DEC_REG( a, 1 )  // INC A
+	case 0x3D: OP( 0x3D ) INC_DEC_REG( x, 1 )  // INC X
+	case 0xFC: OP( 0xFC ) INC_DEC_REG( y, 1 )  // INC Y
 	
-	case 0x9C: INC_DEC_REG( a, -1 ) // DEC A
-	case 0x1D: INC_DEC_REG( x, -1 ) // DEC X
-	case 0xDC: INC_DEC_REG( y, -1 ) // DEC Y
+	case 0x9C: OP( 0x9C ) INC_DEC_REG( a, -1 ) // DEC A
+	case 0x1D: OP( 0x1D ) INC_DEC_REG( x, -1 ) // DEC X
+	case 0xDC: OP( 0xDC ) INC_DEC_REG( y, -1 ) // DEC Y
 
-	case 0x9B: // DEC dp+X
-	case 0xBB: // INC dp+X
+	case 0x9B: OP( 0x9B ) // DEC dp+X
+	case 0xBB: OP( 0xBB ) // INC dp+X
 		data = uint8_t (data + x);
 		//fallthrough
-	case 0x8B: // DEC dp
-	case 0xAB: // INC dp
+	case 0x8B: OP( 0x8B ) // DEC dp
+	case 0xAB: OP( 0xAB ) // INC dp
 		data += dp;
 		goto inc_abs;
-	case 0x8C: // DEC abs
-	case 0xAC: // INC abs
+	case 0x8C: OP( 0x8C ) // DEC abs
+	case 0xAC: OP( 0xAC ) // INC abs
 		data = READ_PROG16( pc );
 		pc++;
 	inc_abs:
 		nz = ((opcode >> 4) & 2) - 1;
 		nz += READ( data );
 		WRITE( data, (uint8_t) nz );
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 	
 // 7. SHIFT, ROTATION COMMANDS
 
-	case 0x5C: // LSR A
+	case 0x5C: OP( 0x5C ) // LSR A
 		c = 0;
 		//fallthrough
-	case 0x7C:{// ROR A
+	case 0x7C: OP( 0x7C ){// ROR A
 		nz = ((c >> 1) & 0x80) | (a >> 1);
 		c = a << 8;
 		a = nz;
-		goto loop;
+		NEXT_INSTR();
 	}
 	
-	case 0x1C: // ASL A
+	case 0x1C: OP( 0x1C ) // ASL A
 		c = 0;
 		//fallthrough
-	case 0x3C:{// ROL A
+	case 0x3C: OP( 0x3C ){// ROL A
 		int temp = (c >> 8) & 1;
 		c = a << 1;
 		nz = c | temp;
 		a = (uint8_t) nz;
-		goto loop;
+		NEXT_INSTR();
 	}
 	
-	case 0x0B: // ASL dp
+	case 0x0B: OP( 0x0B ) // ASL dp
 		c = 0;
 		data += dp;
 		goto rol_mem;
-	case 0x1B: // ASL dp+X
+	case 0x1B: OP( 0x1B ) // ASL dp+X
 		c = 0;
 		//fallthrough
-	case 0x3B: // ROL dp+X
+	case 0x3B: OP( 0x3B ) // ROL dp+X
 		data = uint8_t (data + x);
 		//fallthrough
-	case 0x2B: // ROL dp
+	case 0x2B: OP( 0x2B ) // ROL dp
 		data += dp;
 		goto rol_mem;
-	case 0x0C: // ASL abs
+	case 0x0C: OP( 0x0C ) // ASL abs
 		c = 0;
 		//fallthrough
-	case 0x2C: // ROL abs
+	case 0x2C: OP( 0x2C ) // ROL abs
 		data = READ_PROG16( pc );
 		pc++;
 	rol_mem:
 		nz = (c >> 8) & 1;
 		nz |= (c = READ( data ) << 1);
 		WRITE( data, (uint8_t) nz );
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 	
-	case 0x4B: // LSR dp
+	case 0x4B: OP( 0x4B ) // LSR dp
 		c = 0;
 		data += dp;
 		goto ror_mem;
-	case 0x5B: // LSR dp+X
+	case 0x5B: OP( 0x5B ) // LSR dp+X
 		c = 0;
 		//fallthrough
-	case 0x7B: // ROR dp+X
+	case 0x7B: OP( 0x7B ) // ROR dp+X
 		data = uint8_t (data + x);
 		//fallthrough
-	case 0x6B: // ROR dp
+	case 0x6B: OP( 0x6B ) // ROR dp
 		data += dp;
 		goto ror_mem;
-	case 0x4C: // LSR abs
+	case 0x4C: OP( 0x4C ) // LSR abs
 		c = 0;
 		//fallthrough
-	case 0x6C: // ROR abs
+	case 0x6C: OP( 0x6C ) // ROR abs
 		data = READ_PROG16( pc );
 		pc++;
 	ror_mem: {
@@ -624,31 +705,31 @@ loop:
 		nz = ((c >> 1) & 0x80) | (temp >> 1);
 		c = temp << 8;
 		WRITE( data, nz );
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 	}
 
-	case 0x9F: // XCN
+	case 0x9F: OP( 0x9F ) // XCN
 		nz = a = (a >> 4) | uint8_t (a << 4);
-		goto loop;
+		NEXT_INSTR();
 
 // 8. 16-BIT TRANSMISION COMMANDS
 
-	case 0xBA: // MOVW YA,dp
+	case 0xBA: OP( 0xBA ) // MOVW YA,dp
 		a = READ_DP( data );
 		nz = (a & 0x7f) | (a >> 1);
 		y = READ_DP( uint8_t (data + 1) );
 		nz |= y;
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 	
-	case 0xDA: // MOVW dp,YA
+	case 0xDA: OP( 0xDA ) // MOVW dp,YA
 		WRITE_DP( data, a );
 		WRITE_DP( uint8_t (data + 1), y );
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 	
 // 9. 16-BIT OPERATION COMMANDS
 
-	case 0x3A: // INCW dp
-	case 0x1A:{// DECW dp
+	case 0x3A: OP( 0x3A ) // INCW dp
+	case 0x1A: OP( 0x1A ){// DECW dp
 		data += dp;
 		
 		// low byte
@@ -664,11 +745,11 @@ loop:
 		nz |= temp;
 		WRITE( data, temp );
 		
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 	}
 		
-	case 0x9A: // SUBW YA,dp
-	case 0x7A: // ADDW YA,dp
+	case 0x9A: OP( 0x9A ) // SUBW YA,dp
+	case 0x7A: OP( 0x7A ) // ADDW YA,dp
 	{
 		// read 16-bit addend
 		int temp = READ_DP( data );
@@ -703,10 +784,10 @@ loop:
 		
 		y = (uint8_t) c;
 		
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 	}
 	
-	case 0x5A: { // CMPW YA,dp
+	case 0x5A: OP( 0x5A ) { // CMPW YA,dp
 		int temp = a - READ_DP( data );
 		nz = ((temp >> 1) | temp) & 0x7f;
 		temp = y + (temp >> 8);
@@ -714,21 +795,21 @@ loop:
 		nz |= temp;
 		c = ~temp;
 		nz &= 0xff;
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 	}
 	
 // 10. MULTIPLICATION & DIVISON COMMANDS
 
-	case 0xCF: { // MUL YA
+	case 0xCF: OP( 0xCF ) { // MUL YA
 		unsigned temp = y * a;
 		a = (uint8_t) temp;
 		nz = ((temp >> 1) | temp) & 0x7f;
 		y = temp >> 8;
 		nz |= y;
-		goto loop;
+		NEXT_INSTR();
 	}
 	
-	case 0x9E: // DIV YA,X
+	case 0x9E: OP( 0x9E ) // DIV YA,X
 	{
 		// behavior based on SPC CPU tests
 		
@@ -755,7 +836,7 @@ loop:
 		nz = (uint8_t) a;
 		a = (uint8_t) a;
 		
-		goto loop;
+		NEXT_INSTR();
 	}
 	
 // 11. DECIMAL COMPENSATION COMMANDS
@@ -766,86 +847,86 @@ loop:
 	
 // 12. BRANCHING COMMANDS
 
-	case 0x2F: // BRA rel
+	case 0x2F: OP( 0x2F ) // BRA rel
 		pc += (BOOST::int8_t) data;
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 	
-	case 0x30: // BMI
+	case 0x30: OP( 0x30 ) // BMI
 		BRANCH( IS_NEG )
 	
-	case 0x10: // BPL
+	case 0x10: OP( 0x10 ) // BPL
 		BRANCH( !IS_NEG )
 	
-	case 0xB0: // BCS
+	case 0xB0: OP( 0xB0 ) // BCS
 		BRANCH( c & 0x100 )
 	
-	case 0x90: // BCC
+	case 0x90: OP( 0x90 ) // BCC
 		BRANCH( !(c & 0x100) )
 	
-	case 0x70: // BVS
+	case 0x70: OP( 0x70 ) // BVS
 		BRANCH( status & st_v )
 	
-	case 0x50: // BVC
+	case 0x50: OP( 0x50 ) // BVC
 		BRANCH( !(status & st_v) )
 	
-	case 0x03: // BBS dp.bit,rel
-	case 0x23:
-	case 0x43:
-	case 0x63:
-	case 0x83:
-	case 0xA3:
-	case 0xC3:
-	case 0xE3:
+	case 0x03: OP( 0x03 ) // BBS dp.bit,rel
+	case 0x23: OP( 0x23 )
+	case 0x43: OP( 0x43 )
+	case 0x63: OP( 0x63 )
+	case 0x83: OP( 0x83 )
+	case 0xA3: OP( 0xA3 )
+	case 0xC3: OP( 0xC3 )
+	case 0xE3: OP( 0xE3 )
 		pc++;
 		if ( (READ_DP( data ) >> (opcode >> 5)) & 1 )
 			goto cbranch_taken_loop;
-		goto inc_pc_loop;
-	
-	case 0x13: // BBC dp.bit,rel
-	case 0x33:
-	case 0x53:
-	case 0x73:
-	case 0x93:
-	case 0xB3:
-	case 0xD3:
-	case 0xF3:
+		INC_PC_NEXT_INSTR();
+	
+	case 0x13: OP( 0x13 ) // BBC dp.bit,rel
+	case 0x33: OP( 0x33 )
+	case 0x53: OP( 0x53 )
+	case 0x73: OP( 0x73 )
+	case 0x93: OP( 0x93 )
+	case 0xB3: OP( 0xB3 )
+	case 0xD3: OP( 0xD3 )
+	case 0xF3: OP( 0xF3 )
 		pc++;
 		if ( !((READ_DP( data ) >> (opcode >> 5)) & 1) )
 			goto cbranch_taken_loop;
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 	
-	case 0xDE: // CBNE dp+X,rel
+	case 0xDE: OP( 0xDE ) // CBNE dp+X,rel
 		data = uint8_t (data + x);
 		// fall through
-	case 0x2E: // CBNE dp,rel
+	case 0x2E: OP( 0x2E ) // CBNE dp,rel
 		pc++;
 		if ( READ_DP( data ) != a )
 			goto cbranch_taken_loop;
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 	
-	case 0xFE: // DBNZ Y,rel
+	case 0xFE: OP( 0xFE ) // DBNZ Y,rel
 		y = uint8_t (y - 1);
 		BRANCH( y )
 	
-	case 0x6E: { // DBNZ dp,rel
+	case 0x6E: OP( 0x6E ) { // DBNZ dp,rel
 		pc++;
 		unsigned temp = READ_DP( data ) - 1;
 		WRITE_DP( (uint8_t) data, (uint8_t) temp );
 		if ( temp )
 			goto cbranch_taken_loop;
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 	}
 	
-	case 0x1F: // JMP (abs+X)
+	case 0x1F: OP( 0x1F ) // JMP (abs+X)
 		pc = READ_PROG16( pc ) + x;
 		// fall through
-	case 0x5F: // JMP abs
+	case 0x5F: OP( 0x5F ) // JMP abs
 		pc = READ_PROG16( pc );
-		goto loop;
+		NEXT_INSTR();
 	
 // 13. SUB-ROUTINE CALL RETURN COMMANDS
 	
-	case 0x0F: // BRK
+	case 0x0F: OP( 0x0F ) // BRK
 		check( false ); // untested
 		PUSH16( pc + 1 );
 		pc = READ_PROG16( 0xffde ); // vector address verified
@@ -853,110 +934,110 @@ loop:
 		CALC_STATUS( temp );
 		PUSH( temp );
 		status = (status | st_b) & ~st_i;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x4F: // PCALL offset
+	case 0x4F: OP( 0x4F ) // PCALL offset
 		pc++;
 		PUSH16( pc );
 		pc = 0xff00 + data;
-		goto loop;
-	
-	case 0x01: // TCALL n
-	case 0x11:
-	case 0x21:
-	case 0x31:
-	case 0x41:
-	case 0x51:
-	case 0x61:
-	case 0x71:
-	case 0x81:
-	case 0x91:
-	case 0xA1:
-	case 0xB1:
-	case 0xC1:
-	case 0xD1:
-	case 0xE1:
-	case 0xF1:
+		NEXT_INSTR();
+	
+	case 0x01: OP( 0x01 ) // TCALL n
+	case 0x11: OP( 0x11 )
+	case 0x21: OP( 0x21 )
+	case 0x31: OP( 0x31 )
+	case 0x41: OP( 0x41 )
+	case 0x51: OP( 0x51 )
+	case 0x61: OP( 0x61 )
+	case 0x71: OP( 0x71 )
+	case 0x81: OP( 0x81 )
+	case 0x91: OP( 0x91 )
+	case 0xA1: OP( 0xA1 )
+	case 0xB1: OP( 0xB1 )
+	case 0xC1: OP( 0xC1 )
+	case 0xD1: OP( 0xD1 )
+	case 0xE1: OP( 0xE1 )
+	case 0xF1: OP( 0xF1 )
 		PUSH16( pc );
 		pc = READ_PROG16( 0xffde - (opcode >> 3) );
-		goto loop;
+		NEXT_INSTR();
 	
 // 14. STACK OPERATION COMMANDS
 
 	{
 		int temp;
-	case 0x7F: // RET1
+	case 0x7F: OP( 0x7F ) // RET1
 		temp = POP();
 		pc = POP();
 		pc |= POP() << 8;
 		goto set_status;
-	case 0x8E: // POP PSW
+	case 0x8E: OP( 0x8E ) // POP PSW
 		temp = POP();
 	set_status:
 		SET_STATUS( temp );
-		goto loop;
+		NEXT_INSTR();
 	}
 	
-	case 0x0D: { // PUSH PSW
+	case 0x0D: OP( 0x0D ) { // PUSH PSW
 		int temp;
 		CALC_STATUS( temp );
 		PUSH( temp );
-		goto loop;
+		NEXT_INSTR();
 	}
 
-	case 0x2D: // PUSH A
+	case 0x2D: OP( 0x2D ) // PUSH A
 		PUSH( a );
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x4D: // PUSH X
+	case 0x4D: OP( 0x4D ) // PUSH X
 		PUSH( x );
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x6D: // PUSH Y
+	case 0x6D: OP( 0x6D ) // PUSH Y
 		PUSH( y );
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xAE: // POP A
+	case 0xAE: OP( 0xAE ) // POP A
 		a = POP();
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xCE: // POP X
+	case 0xCE: OP( 0xCE ) // POP X
 		x = POP();
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xEE: // POP Y
+	case 0xEE: OP( 0xEE ) // POP Y
 		y = POP();
-		goto loop;
+		NEXT_INSTR();
 	
 // 15. BIT OPERATION COMMANDS
 
-	case 0x02: // SET1
-	case 0x22:
-	case 0x42:
-	case 0x62:
-	case 0x82:
-	case 0xA2:
-	case 0xC2:
-	case 0xE2:
-	case 0x12: // CLR1
-	case 0x32:
-	case 0x52:
-	case 0x72:
-	case 0x92:
-	case 0xB2:
-	case 0xD2:
-	case 0xF2: {
+	case 0x02: OP( 0x02 ) // SET1
+	case 0x22: OP( 0x22 )
+	case 0x42: OP( 0x42 )
+	case 0x62: OP( 0x62 )
+	case 0x82: OP( 0x82 )
+	case 0xA2: OP( 0xA2 )
+	case 0xC2: OP( 0xC2 )
+	case 0xE2: OP( 0xE2 )
+	case 0x12: OP( 0x12 ) // CLR1
+	case 0x32: OP( 0x32 )
+	case 0x52: OP( 0x52 )
+	case 0x72: OP( 0x72 )
+	case 0x92: OP( 0x92 )
+	case 0xB2: OP( 0xB2 )
+	case 0xD2: OP( 0xD2 )
+	case 0xF2: OP( 0xF2 ) {
 		data += dp;
 		int bit = 1 << (opcode >> 5);
 		int mask = ~bit;
 		if ( opcode & 0x10 )
 			bit = 0;
 		WRITE( data, (READ( data ) & mask) | bit );
-		goto inc_pc_loop;
+		INC_PC_NEXT_INSTR();
 	}
 		
-	case 0x0E: // TSET1 abs
-	case 0x4E:{// TCLR1 abs
+	case 0x0E: OP( 0x0E ) // TSET1 abs
+	case 0x4E: OP( 0x4E ){// TCLR1 abs
 		data = READ_PROG16( pc );
 		pc += 2;
 		unsigned temp = READ( data );
@@ -965,101 +1046,101 @@ loop:
 		if ( !(opcode & 0x40) )
 			temp |= a;
 		WRITE( data, temp );
-		goto loop;
+		NEXT_INSTR();
 	}
 	
-	case 0x4A: // AND1 C,mem.bit
+	case 0x4A: OP( 0x4A ) // AND1 C,mem.bit
 		c &= mem_bit( pc );
 		pc += 2;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x6A: // AND1 C,/mem.bit
+	case 0x6A: OP( 0x6A ) // AND1 C,/mem.bit
 		check( false ); // untested
 		c &= ~mem_bit( pc );
 		pc += 2;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x0A: // OR1 C,mem.bit
+	case 0x0A: OP( 0x0A ) // OR1 C,mem.bit
 		check( false ); // untested
 		c |= mem_bit( pc );
 		pc += 2;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x2A: // OR1 C,/mem.bit
+	case 0x2A: OP( 0x2A ) // OR1 C,/mem.bit
 		check( false ); // untested
 		c |= ~mem_bit( pc );
 		pc += 2;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x8A: // EOR1 C,mem.bit
+	case 0x8A: OP( 0x8A ) // EOR1 C,mem.bit
 		c ^= mem_bit( pc );
 		pc += 2;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xEA: { // NOT1 mem.bit
+	case 0xEA: OP( 0xEA ) { // NOT1 mem.bit
 		data = READ_PROG16( pc );
 		pc += 2;
 		unsigned temp = READ( data & 0x1fff );
 		temp ^= 1 << (data >> 13);
 		WRITE( data & 0x1fff, temp );
-		goto loop;
+		NEXT_INSTR();
 	}
 	
-	case 0xCA: { // MOV1 mem.bit,C
+	case 0xCA: OP( 0xCA ) { // MOV1 mem.bit,C
 		data = READ_PROG16( pc );
 		pc += 2;
 		unsigned temp = READ( data & 0x1fff );
 		unsigned bit = data >> 13;
 		temp = (temp & ~(1 << bit)) | (((c >> 8) & 1) << bit);
 		WRITE( data & 0x1fff, temp );
-		goto loop;
+		NEXT_INSTR();
 	}
 	
-	case 0xAA: // MOV1 C,mem.bit
+	case 0xAA: OP( 0xAA ) // MOV1 C,mem.bit
 		c = mem_bit( pc );
 		pc += 2;
-		goto loop;
+		NEXT_INSTR();
 	
 // 16. PROGRAM STATUS FLAG OPERATION COMMANDS
 
-	case 0x60: // CLRC
+	case 0x60: OP( 0x60 ) // CLRC
 		c = 0;
-		goto loop;
+		NEXT_INSTR();
 		
-	case 0x80: // SETC
+	case 0x80: OP( 0x80 ) // SETC
 		c = ~0;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xED: // NOTC
+	case 0xED: OP( 0xED ) // NOTC
 		c ^= 0x100;
-		goto loop;
+		NEXT_INSTR();
 		
-	case 0xE0: // CLRV
+	case 0xE0: OP( 0xE0 ) // CLRV
 		status &= ~(st_v | st_h);
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x20: // CLRP
+	case 0x20: OP( 0x20 ) // CLRP
 		dp = 0;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0x40: // SETP
+	case 0x40: OP( 0x40 ) // SETP
 		dp = 0x100;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xA0: // EI
+	case 0xA0: OP( 0xA0 ) // EI
 		check( false ); // untested
 		status |= st_i;
-		goto loop;
+		NEXT_INSTR();
 	
-	case 0xC0: // DI
+	case 0xC0: OP( 0xC0 ) // DI
 		check( false ); // untested
 		status &= ~st_i;
-		goto loop;
+		NEXT_INSTR();
 	
 // 17. OTHER COMMANDS
 
-	case 0x00: // NOP
-		goto loop;
+	case 0x00: OP( 0x00 ) // NOP
+		NEXT_INSTR();
 	
 	//case 0xEF: // SLEEP
 	//case 0xFF: // STOP
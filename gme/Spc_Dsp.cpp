@@ -7,6 +7,10 @@
 
 #include <string.h>
 
+#if SPC_DSP_SSE2
+	#include <emmintrin.h>
+#endif
+
 #include "blargg_endian.h"
 
 /* Copyright (C) 2002 Brad Martin */
@@ -28,6 +32,7 @@ Spc_Dsp::Spc_Dsp( uint8_t* ram_ ) : ram( ram_ )
 	set_gain( 1.0 );
 	mute_voices( 0 );
 	disable_surround( false );
+	set_voice_outputs( NULL );
 	
 	BOOST_STATIC_ASSERT( sizeof (g) == register_count && sizeof (voice) == register_count );
 }
@@ -38,6 +43,13 @@ void Spc_Dsp::mute_voices( int mask )
 		voice_state [i].enabled = (mask >> i & 1) ? 31 : 7;
 }
 
+void Spc_Dsp::set_voice_outputs( short* const* bufs )
+{
+	voice_outs_set = (bufs != NULL);
+	for ( int i = 0; i < voice_count; i++ )
+		voice_outs [i] = bufs ? bufs [i] : NULL;
+}
+
 void Spc_Dsp::reset()
 {
 	keys = 0;
@@ -61,6 +73,41 @@ void Spc_Dsp::reset()
 	memset( fir_buf, 0, sizeof fir_buf );
 }
 
+void Spc_Dsp::save_snapshot( snapshot_t* out ) const
+{
+	memcpy( out->reg, reg, sizeof reg );
+	memcpy( out->fir_coeff, fir_coeff, sizeof fir_coeff );
+	memcpy( out->fir_buf, fir_buf, sizeof fir_buf );
+	out->fir_offset = fir_offset;
+	out->keyed_on = keyed_on;
+	out->keys = keys;
+	out->echo_ptr = echo_ptr;
+	out->noise_amp = noise_amp;
+	out->noise = noise;
+	out->noise_count = noise_count;
+	memcpy( out->voice_state, voice_state, sizeof voice_state );
+}
+
+void Spc_Dsp::load_snapshot( snapshot_t const& in )
+{
+	memcpy( reg, in.reg, sizeof reg );
+	memcpy( fir_coeff, in.fir_coeff, sizeof fir_coeff );
+	memcpy( fir_buf, in.fir_buf, sizeof fir_buf );
+	fir_offset = in.fir_offset;
+	keyed_on = in.keyed_on;
+	keys = in.keys;
+	echo_ptr = in.echo_ptr;
+	noise_amp = in.noise_amp;
+	noise = in.noise;
+	noise_count = in.noise_count;
+	for ( int i = 0; i < voice_count; i++ )
+	{
+		short enabled = voice_state [i].enabled; // keep current muting
+		voice_state [i] = in.voice_state [i];
+		voice_state [i].enabled = enabled;
+	}
+}
+
 void Spc_Dsp::write( int i, int data )
 {
 	require( (unsigned) i < register_count );
@@ -110,11 +157,10 @@ static const short env_rates [0x20] =
 
 const int env_range = 0x800;
 
-inline int Spc_Dsp::clock_envelope( int v )
+inline int Spc_Dsp::clock_envelope( int v, voice_t& voice )
 {                               /* Return value is current 
 								 * ENVX */
 	raw_voice_t& raw_voice = this->voice [v];
-	voice_t& voice = voice_state [v];
 	
 	int envx = voice.envx;
 	if ( voice.envstate == state_release )
@@ -297,30 +343,77 @@ inline int clamp_16( int n )
 	return n;
 }
 
-void Spc_Dsp::run( long count, short* out_buf )
+struct src_dir {
+	char start [2];
+	char loop [2];
+};
+
+static bool ranges_overlap( unsigned a, unsigned a_size, unsigned b, unsigned b_size )
+{
+	return ((b - a) & 0xFFFF) < a_size || ((a - b) & 0xFFFF) < b_size;
+}
+
+// True if echo buffer writes during the next 'count' samples might change memory
+// a voice reads in that time. Estimates are conservative: a sample decodes at most
+// 8 nybbles (pitch modulation can double the maximum rate), plus a block header
+// every 8 bytes.
+bool Spc_Dsp::echo_overlaps_voices( int count ) const
 {
-	// to do: make clock_envelope() inline so that this becomes a leaf function?
+	unsigned limit = (g.echo_delay & 15) * 0x800;
+	unsigned echo_start = echo_ptr;
+	unsigned echo_size = count * 4;
+	if ( echo_start + echo_size > limit )
+	{
+		// pointer wraps during block
+		echo_start = 0;
+		echo_size = (limit > (unsigned) echo_ptr ? limit : echo_ptr + 4);
+	}
+	echo_start += g.echo_page * 0x100;
 	
-	// Should we just fill the buffer with silence? Flags won't be cleared
-	// during this run so it seems it should keep resetting every sample.
-	if ( g.flags & 0x80 )
-		reset();
+	const src_dir* const sd = (src_dir*) &ram [g.wave_page * 0x100];
+	unsigned const span = count * 5 + 16;
+	for ( int vidx = 0; vidx < voice_count; vidx++ )
+	{
+		const int vbit = 1 << vidx;
+		voice_t const& v = voice_state [vidx];
+		bool keying_on = v.on_cnt || (g.key_ons & vbit & ~g.key_offs);
+		if ( !(keys & vbit) && !keying_on )
+			continue;
+		
+		const src_dir& dir = sd [voice [vidx].waveform];
+		if ( ranges_overlap( echo_start, echo_size, (uint8_t*) &dir - ram, sizeof dir ) ||
+				ranges_overlap( echo_start, echo_size, GET_LE16( dir.loop ), span ) ||
+				((keys & vbit) && ranges_overlap( echo_start, echo_size, v.addr, span )) ||
+				(keying_on && ranges_overlap( echo_start, echo_size, GET_LE16( dir.start ), span )) )
+			return true;
+	}
 	
-	struct src_dir {
-		char start [2];
-		char loop [2];
-	};
+	return false;
+}
+
+// Run voice for 'count' samples, writing its output level to 'out'. 'pmod' holds
+// the previous voice's output when pitch modulation is enabled for this voice.
+// Returns false if voice was off the whole time, leaving nothing to mix.
+inline bool Spc_Dsp::run_voice( int vidx, int count, int const* noise_amps, short const* pmod, short* out )
+{
+	const int vbit = 1 << vidx;
+	raw_voice_t& raw_voice = this->voice [vidx];
+	
+	if ( !(keys & vbit) && !voice_state [vidx].on_cnt && !(g.key_ons & vbit) )
+	{
+		raw_voice.envx = 0;
+		raw_voice.outx = 0;
+		for ( int i = 0; i < count; i++ )
+			out [i] = 0;
+		return false;
+	}
 	
 	const src_dir* const sd = (src_dir*) &ram [g.wave_page * 0x100];
 	
-	int left_volume  = g.left_volume;
-	int right_volume = g.right_volume;
-	if ( left_volume * right_volume < surround_threshold )
-		right_volume = -right_volume; // kill global surround
-	left_volume  *= emu_gain;
-	right_volume *= emu_gain;
+	// work on a copy, since register writes could otherwise alias it
+	voice_t voice = voice_state [vidx];
 	
-	while ( --count >= 0 )
+	for ( int i = 0; i < count; i++ )
 	{
 		// Here we check for keys on/off.  Docs say that successive writes
 		// to KON/KOF must be separated by at least 2 Ts periods or risk
@@ -329,223 +422,345 @@ void Spc_Dsp::run( long count, short* out_buf )
 		// once however, since the regs haven't changed over the whole
 		// period we need to catch up with. 
 		
-		g.wave_ended &= ~g.key_ons; // Keying on a voice resets that bit in ENDX.
+		g.wave_ended &= ~(g.key_ons & vbit); // Keying on a voice resets that bit in ENDX.
 		
-		if ( g.noise_enables )
+		if ( voice.on_cnt && !--voice.on_cnt )
 		{
-			noise_count -= env_rates [g.flags & 0x1F];
-			if ( noise_count <= 0 )
-			{
-				noise_count = env_rate_init;
-				
-				noise_amp = BOOST::int16_t (noise * 2);
-				
-				int feedback = (noise << 13) ^ (noise << 14);
-				noise = (feedback & 0x4000) | (noise >> 1);
-			}
+			// key on
+			keys |= vbit;
+			voice.addr = GET_LE16( sd [raw_voice.waveform].start );
+			voice.block_remain = 1;
+			voice.envx = 0;
+			voice.block_header = 0;
+			voice.fraction = 0x3fff; // decode three samples immediately
+			voice.interp0 = 0; // BRR decoder filter uses previous two samples
+			voice.interp1 = 0;
+			
+			// NOTE: Real SNES does *not* appear to initialize the
+			// envelope counter to anything in particular. The first
+			// cycle always seems to come at a random time sooner than 
+			// expected; as yet, I have been unable to find any
+			// pattern.  I doubt it will matter though, so we'll go
+			// ahead and do the full time for now. 
+			voice.envcnt = env_rate_init;
+			voice.envstate = state_attack;
 		}
 		
-		// What is the expected behavior when pitch modulation is enabled on
-		// voice 0? Jurassic Park 2 does this. Assume 0 for now.
-		long prev_outx = 0;
+		if ( g.key_ons & vbit & ~g.key_offs )
+		{
+			// voice doesn't come on if key off is set
+			g.key_ons &= ~vbit;
+			voice.on_cnt = 8;
+		}
 		
-		int echol = 0;
-		int echor = 0;
-		int left = 0;
-		int right = 0;
-		for ( int vidx = 0; vidx < voice_count; vidx++ )
+		if ( keys & g.key_offs & vbit )
 		{
-			const int vbit = 1 << vidx;
-			raw_voice_t& raw_voice = voice [vidx];
-			voice_t& voice = voice_state [vidx];
-			
-			if ( voice.on_cnt && !--voice.on_cnt )
+			// key off
+			voice.envstate = state_release;
+			voice.on_cnt = 0;
+		}
+		
+		int envx;
+		if ( !(keys & vbit) || (envx = clock_envelope( vidx, voice )) < 0 )
+		{
+			raw_voice.envx = 0;
+			raw_voice.outx = 0;
+			out [i] = 0;
+			continue;
+		}
+		
+		// Decode samples when fraction >= 1.0 (0x1000)
+		for ( int n = voice.fraction >> 12; --n >= 0; )
+		{
+			if ( !--voice.block_remain )
 			{
-				// key on
-				keys |= vbit;
-				voice.addr = GET_LE16( sd [raw_voice.waveform].start );
-				voice.block_remain = 1;
-				voice.envx = 0;
-				voice.block_header = 0;
-				voice.fraction = 0x3fff; // decode three samples immediately
-				voice.interp0 = 0; // BRR decoder filter uses previous two samples
-				voice.interp1 = 0;
+				if ( voice.block_header & 1 )
+				{
+					g.wave_ended |= vbit;
+				
+					if ( voice.block_header & 2 )
+					{
+						// verified (played endless looping sample and ENDX was set)
+						voice.addr = GET_LE16( sd [raw_voice.waveform].loop );
+					}
+					else
+					{
+						// first block was end block; don't play anything (verified)
+						goto sample_ended; // to do: find alternative to goto
+					}
+				}
 				
-				// NOTE: Real SNES does *not* appear to initialize the
-				// envelope counter to anything in particular. The first
-				// cycle always seems to come at a random time sooner than 
-				// expected; as yet, I have been unable to find any
-				// pattern.  I doubt it will matter though, so we'll go
-				// ahead and do the full time for now. 
-				voice.envcnt = env_rate_init;
-				voice.envstate = state_attack;
+				voice.block_header = ram [voice.addr++];
+				voice.block_remain = 16; // nybbles
 			}
 			
-			if ( g.key_ons & vbit & ~g.key_offs )
+			// if next block has end flag set, *this* block ends *early* (verified)
+			if ( voice.block_remain == 9 && (ram [voice.addr + 5] & 3) == 1 &&
+					(voice.block_header & 3) != 3 )
 			{
-				// voice doesn't come on if key off is set
-				g.key_ons &= ~vbit;
-				voice.on_cnt = 8;
+		sample_ended:
+				g.wave_ended |= vbit;
+				keys &= ~vbit;
+				raw_voice.envx = 0;
+				voice.envx = 0;
+				// add silence samples to interpolation buffer
+				do
+				{
+					voice.interp3 = voice.interp2;
+					voice.interp2 = voice.interp1;
+					voice.interp1 = voice.interp0;
+					voice.interp0 = 0;
+				}
+				while ( --n >= 0 );
+				break;
 			}
 			
-			if ( keys & g.key_offs & vbit )
+			int delta = ram [voice.addr];
+			if ( voice.block_remain & 1 )
 			{
-				// key off
-				voice.envstate = state_release;
-				voice.on_cnt = 0;
+				delta <<= 4; // use lower nybble
+				voice.addr++;
 			}
 			
-			int envx;
-			if ( !(keys & vbit) || (envx = clock_envelope( vidx )) < 0 )
+			// Use sign-extended upper nybble
+			delta = int8_t (delta) >> 4;
+			
+			// For invalid ranges (D,E,F): if the nybble is negative,
+			// the result is F000.  If positive, 0000. Nothing else
+			// like previous range, etc seems to have any effect.  If
+			// range is valid, do the shift normally.  Note these are
+			// both shifted right once to do the filters properly, but 
+			// the output will be shifted back again at the end.
+			int shift = voice.block_header >> 4;
+			delta = (delta << shift) >> 1;
+			if ( shift > 0x0C )
+				delta = (delta >> 14) & ~0x7FF;
+			
+			// One, two and three point IIR filters
+			int smp1 = voice.interp0;
+			int smp2 = voice.interp1;
+			switch ( (voice.block_header >> 2) & 3 )
 			{
-				raw_voice.envx = 0;
-				raw_voice.outx = 0;
-				prev_outx = 0;
-				continue;
+				case 0:
+					break;
+				
+				case 1:
+					delta += smp1 >> 1;
+					delta += (-smp1) >> 5;
+					break;
+				
+				case 2:
+					delta += smp1;
+					delta += (-(smp1 + (smp1 >> 1))) >> 5;
+					delta -= smp2 >> 1;
+					delta += smp2 >> 5;
+					break;
+				
+				case 3:
+					delta += smp1;
+					delta += (-(smp1 + (smp1 << 2) + (smp1 << 3))) >> 7;
+					delta -= smp2 >> 1;
+					delta += (smp2 + (smp2 >> 1)) >> 4;
+					break;
 			}
 			
-			// Decode samples when fraction >= 1.0 (0x1000)
-			for ( int n = voice.fraction >> 12; --n >= 0; )
+			voice.interp3 = voice.interp2;
+			voice.interp2 = smp2;
+			voice.interp1 = smp1;
+			voice.interp0 = BOOST::int16_t (clamp_16( delta ) * 2); // sign-extend
+		}
+		
+		// rate (with possible modulation)
+		int rate = GET_LE16( raw_voice.rate ) & 0x3FFF;
+		if ( pmod )
+			rate = (rate * (pmod [i] + 32768)) >> 15;
+		
+		// Gaussian interpolation using most recent 4 samples
+		int index = voice.fraction >> 2 & 0x3FC;
+		voice.fraction = (voice.fraction & 0x0FFF) + rate;
+		const BOOST::int16_t* table  = (BOOST::int16_t*) ((char*) gauss + index);
+		const BOOST::int16_t* table2 = (BOOST::int16_t*) ((char*) gauss + (255*4 - index));
+		int s = ((table  [0] * voice.interp3) >> 12) +
+				((table  [1] * voice.interp2) >> 12);
+		s +=    ((table2 [1] * voice.interp1) >> 12) +
+		// to do: should clamp here
+				((table2 [0] * voice.interp0) >> 12);
+		int output = noise_amps [i]; // noise is rarely used
+		if ( !(g.noise_enables & vbit) )
+			output = clamp_16( s * 2 );
+		
+		// scale output and set outx values
+		output = (output * envx) >> 11 & ~1;
+		out [i] = output;
+		raw_voice.outx = output >> 8;
+	}
+	
+	voice_state [vidx] = voice;
+	return true;
+}
+
+// Add voice output to left, right, echo left and echo right mixes. Muting is done
+// by setting voice.enabled to 31 (not a SNES feature).
+inline void Spc_Dsp::mix_voice( int vidx, int count, short const* in, int (*mix) [block_size] )
+{
+	voice_t const& voice = voice_state [vidx];
+	int const mix_count = (g.echo_ons >> vidx & 1) ? 4 : 2;
+	int i = 0;
+	
+	#if SPC_DSP_SSE2
+		__m128i const shift = _mm_cvtsi32_si128( voice.enabled );
+		for ( ; i + 8 <= count; i += 8 )
+		{
+			__m128i const in8 = _mm_loadu_si128( (__m128i const*) (in + i) );
+			for ( int ch = 0; ch < 2; ch++ )
 			{
-				if ( !--voice.block_remain )
+				// 16x16 -> 32-bit products
+				__m128i const vol = _mm_set1_epi16( voice.volume [ch] );
+				__m128i const lo = _mm_mullo_epi16( in8, vol );
+				__m128i const hi = _mm_mulhi_epi16( in8, vol );
+				__m128i const p0 = _mm_sra_epi32( _mm_unpacklo_epi16( lo, hi ), shift );
+				__m128i const p1 = _mm_sra_epi32( _mm_unpackhi_epi16( lo, hi ), shift );
+				for ( int m = ch; m < mix_count; m += 2 )
 				{
-					if ( voice.block_header & 1 )
-					{
-						g.wave_ended |= vbit;
-					
-						if ( voice.block_header & 2 )
-						{
-							// verified (played endless looping sample and ENDX was set)
-							voice.addr = GET_LE16( sd [raw_voice.waveform].loop );
-						}
-						else
-						{
-							// first block was end block; don't play anything (verified)
-							goto sample_ended; // to do: find alternative to goto
-						}
-					}
-					
-					voice.block_header = ram [voice.addr++];
-					voice.block_remain = 16; // nybbles
+					__m128i* out = (__m128i*) (mix [m] + i);
+					_mm_storeu_si128( out    , _mm_add_epi32( _mm_loadu_si128( out     ), p0 ) );
+					_mm_storeu_si128( out + 1, _mm_add_epi32( _mm_loadu_si128( out + 1 ), p1 ) );
 				}
-				
-				// if next block has end flag set, *this* block ends *early* (verified)
-				if ( voice.block_remain == 9 && (ram [voice.addr + 5] & 3) == 1 &&
-						(voice.block_header & 3) != 3 )
+			}
+		}
+	#endif
+	
+	for ( ; i < count; i++ )
+	{
+		int l = (voice.volume [0] * in [i]) >> voice.enabled;
+		int r = (voice.volume [1] * in [i]) >> voice.enabled;
+		mix [0] [i] += l;
+		mix [1] [i] += r;
+		if ( mix_count > 2 )
+		{
+			mix [2] [i] += l;
+			mix [3] [i] += r;
+		}
+	}
+}
+
+// Write voice's samples through main volume to its own output, or silence if 'in'
+// is NULL
+void Spc_Dsp::write_voice_out( int vidx, int count, short const* in )
+{
+	voice_t const& voice = voice_state [vidx];
+	short* out = voice_outs [vidx];
+	voice_outs [vidx] = out + count;
+	
+	if ( !in || voice.enabled != 7 || (g.flags & 0x40) )
+	{
+		memset( out, 0, count * sizeof *out );
+		return;
+	}
+	
+	int left_volume  = g.left_volume;
+	int right_volume = g.right_volume;
+	if ( left_volume * right_volume < surround_threshold )
+		right_volume = -right_volume; // kill global surround
+	left_volume  *= emu_gain;
+	right_volume *= emu_gain;
+	
+	for ( int i = 0; i < count; i++ )
+	{
+		int l = (voice.volume [0] * in [i]) >> 7;
+		int r = (voice.volume [1] * in [i]) >> 7;
+		l = (l * left_volume ) >> (7 + emu_gain_bits);
+		r = (r * right_volume) >> (7 + emu_gain_bits);
+		out [i] = clamp_16( (l + r) >> 1 );
+	}
+}
+
+// Apply main volume and echo to mixed voices, update echo buffer, and write
+// 'count' stereo samples to 'out' if not NULL.
+inline void Spc_Dsp::run_echo( int count, int (*mix) [block_size], short* out_buf )
+{
+	int left_volume  = g.left_volume;
+	int right_volume = g.right_volume;
+	if ( left_volume * right_volume < surround_threshold )
+		right_volume = -right_volume; // kill global surround
+	left_volume  *= emu_gain;
+	right_volume *= emu_gain;
+	
+	int const echo_limit = (g.echo_delay & 15) * 0x800;
+	
+	// When the echo buffer can't be written before being read within this block,
+	// fetch its samples first and run the FIR over all of them at once.
+	// hist [ch] [i + 7] is the echo input for sample i, preceded by the last 7.
+	short hist [2] [block_size + 16];
+	int fir [2] [block_size];
+	bool const batch = count >= 8 && ((g.flags & 0x20) || echo_limit >= count * 4);
+	if ( batch )
+	{
+		for ( int i = 0; i < 7; i++ )
+		{
+			hist [0] [i] = fir_buf [fir_offset + 7 - i] [0];
+			hist [1] [i] = fir_buf [fir_offset + 7 - i] [1];
+		}
+		
+		int echo_ptr = this->echo_ptr;
+		for ( int i = 0; i < count; i++ )
+		{
+			uint8_t const* echo_buf = &ram [(g.echo_page * 0x100 + echo_ptr) & 0xFFFF];
+			echo_ptr += 4;
+			if ( echo_ptr >= echo_limit )
+				echo_ptr = 0;
+			hist [0] [i + 7] = GET_LE16( echo_buf     );
+			hist [1] [i + 7] = GET_LE16( echo_buf + 2 );
+		}
+		
+		int i = 0;
+		#if SPC_DSP_SSE2
+			memset( &hist [0] [count + 7], 0, (block_size + 9 - count) * sizeof (short) );
+			memset( &hist [1] [count + 7], 0, (block_size + 9 - count) * sizeof (short) );
+			
+			// Pairs of adjacent taps per multiply-add, 8 outputs at a time
+			__m128i coeff [4];
+			for ( int m = 0; m < 4; m++ )
+				coeff [m] = _mm_set1_epi32( (fir_coeff [m * 2] & 0xFFFF) |
+						(fir_coeff [m * 2 + 1] << 16) );
+			for ( ; i < count; i += 8 )
+			{
+				for ( int ch = 0; ch < 2; ch++ )
 				{
-			sample_ended:
-					g.wave_ended |= vbit;
-					keys &= ~vbit;
-					raw_voice.envx = 0;
-					voice.envx = 0;
-					// add silence samples to interpolation buffer
-					do
+					short const* h = &hist [ch] [i];
+					__m128i sum0 = _mm_setzero_si128();
+					__m128i sum1 = _mm_setzero_si128();
+					for ( int m = 0; m < 4; m++ )
 					{
-						voice.interp3 = voice.interp2;
-						voice.interp2 = voice.interp1;
-						voice.interp1 = voice.interp0;
-						voice.interp0 = 0;
+						__m128i const a = _mm_loadu_si128( (__m128i const*) (h + m * 2) );
+						__m128i const b = _mm_loadu_si128( (__m128i const*) (h + m * 2 + 1) );
+						sum0 = _mm_add_epi32( sum0, _mm_madd_epi16( _mm_unpacklo_epi16( a, b ), coeff [m] ) );
+						sum1 = _mm_add_epi32( sum1, _mm_madd_epi16( _mm_unpackhi_epi16( a, b ), coeff [m] ) );
 					}
-					while ( --n >= 0 );
-					break;
+					_mm_storeu_si128( (__m128i*) &fir [ch] [i]    , sum0 );
+					_mm_storeu_si128( (__m128i*) &fir [ch] [i + 4], sum1 );
 				}
-				
-				int delta = ram [voice.addr];
-				if ( voice.block_remain & 1 )
-				{
-					delta <<= 4; // use lower nybble
-					voice.addr++;
-				}
-				
-				// Use sign-extended upper nybble
-				delta = int8_t (delta) >> 4;
-				
-				// For invalid ranges (D,E,F): if the nybble is negative,
-				// the result is F000.  If positive, 0000. Nothing else
-				// like previous range, etc seems to have any effect.  If
-				// range is valid, do the shift normally.  Note these are
-				// both shifted right once to do the filters properly, but 
-				// the output will be shifted back again at the end.
-				int shift = voice.block_header >> 4;
-				delta = (delta << shift) >> 1;
-				if ( shift > 0x0C )
-					delta = (delta >> 14) & ~0x7FF;
-				
-				// One, two and three point IIR filters
-				int smp1 = voice.interp0;
-				int smp2 = voice.interp1;
-				switch ( (voice.block_header >> 2) & 3 )
-				{
-					case 0:
-						break;
-					
-					case 1:
-						delta += smp1 >> 1;
-						delta += (-smp1) >> 5;
-						break;
-					
-					case 2:
-						delta += smp1;
-						delta += (-(smp1 + (smp1 >> 1))) >> 5;
-						delta -= smp2 >> 1;
-						delta += smp2 >> 5;
-						break;
-					
-					case 3:
-						delta += smp1;
-						delta += (-(smp1 + (smp1 << 2) + (smp1 << 3))) >> 7;
-						delta -= smp2 >> 1;
-						delta += (smp2 + (smp2 >> 1)) >> 4;
-						break;
-				}
-				
-				voice.interp3 = voice.interp2;
-				voice.interp2 = smp2;
-				voice.interp1 = smp1;
-				voice.interp0 = BOOST::int16_t (clamp_16( delta ) * 2); // sign-extend
 			}
-			
-			// rate (with possible modulation)
-			int rate = GET_LE16( raw_voice.rate ) & 0x3FFF;
-			if ( g.pitch_mods & vbit )
-				rate = (rate * (prev_outx + 32768)) >> 15;
-			
-			// Gaussian interpolation using most recent 4 samples
-			int index = voice.fraction >> 2 & 0x3FC;
-			voice.fraction = (voice.fraction & 0x0FFF) + rate;
-			const BOOST::int16_t* table  = (BOOST::int16_t*) ((char*) gauss + index);
-			const BOOST::int16_t* table2 = (BOOST::int16_t*) ((char*) gauss + (255*4 - index));
-			int s = ((table  [0] * voice.interp3) >> 12) +
-					((table  [1] * voice.interp2) >> 12);
-			s +=    ((table2 [1] * voice.interp1) >> 12) +
-			// to do: should clamp here
-					((table2 [0] * voice.interp0) >> 12);
-			int output = noise_amp; // noise is rarely used
-			if ( !(g.noise_enables & vbit) )
-				output = clamp_16( s * 2 );
-			
-			// scale output and set outx values
-			output = (output * envx) >> 11 & ~1;
-			
-			// output and apply muting (by setting voice.enabled to 31)
-			// if voice is externally disabled (not a SNES feature)
-			int l = (voice.volume [0] * output) >> voice.enabled;
-			int r = (voice.volume [1] * output) >> voice.enabled;
-			prev_outx = output;
-			raw_voice.outx = output >> 8;
-			if ( g.echo_ons & vbit )
+		#endif
+		
+		for ( ; i < count; i++ )
+		{
+			for ( int ch = 0; ch < 2; ch++ )
 			{
-				echol += l;
-				echor += r;
+				short const* h = &hist [ch] [i];
+				int sum = 0;
+				for ( int m = 0; m < 8; m++ )
+					sum += h [m] * fir_coeff [m];
+				fir [ch] [i] = sum;
 			}
-			left += l;
-			right += r;
 		}
-		// end of channel loop
-		
+	}
+	
+	for ( int i = 0; i < count; i++ )
+	{
 		// main volume control
-		left  = (left  * left_volume ) >> (7 + emu_gain_bits);
-		right = (right * right_volume) >> (7 + emu_gain_bits);
+		int left  = (mix [0] [i] * left_volume ) >> (7 + emu_gain_bits);
+		int right = (mix [1] [i] * right_volume) >> (7 + emu_gain_bits);
 		
 		// Echo FIR filter
 		
@@ -553,7 +768,7 @@ void Spc_Dsp::run( long count, short* out_buf )
 		int echo_ptr = this->echo_ptr;
 		uint8_t* echo_buf = &ram [(g.echo_page * 0x100 + echo_ptr) & 0xFFFF];
 		echo_ptr += 4;
-		if ( echo_ptr >= (g.echo_delay & 15) * 0x800 )
+		if ( echo_ptr >= echo_limit )
 			echo_ptr = 0;
 		int fb_left  = (BOOST::int16_t) GET_LE16( echo_buf     ); // sign-extend
 		int fb_right = (BOOST::int16_t) GET_LE16( echo_buf + 2 ); // sign-extend
@@ -569,23 +784,31 @@ void Spc_Dsp::run( long count, short* out_buf )
 		fir_pos [8] [1] = fb_right;
 		
 		// FIR
-		fb_left =       fb_left * fir_coeff [7] +
-				fir_pos [1] [0] * fir_coeff [6] +
-				fir_pos [2] [0] * fir_coeff [5] +
-				fir_pos [3] [0] * fir_coeff [4] +
-				fir_pos [4] [0] * fir_coeff [3] +
-				fir_pos [5] [0] * fir_coeff [2] +
-				fir_pos [6] [0] * fir_coeff [1] +
-				fir_pos [7] [0] * fir_coeff [0];
-		
-		fb_right =     fb_right * fir_coeff [7] +
-				fir_pos [1] [1] * fir_coeff [6] +
-				fir_pos [2] [1] * fir_coeff [5] +
-				fir_pos [3] [1] * fir_coeff [4] +
-				fir_pos [4] [1] * fir_coeff [3] +
-				fir_pos [5] [1] * fir_coeff [2] +
-				fir_pos [6] [1] * fir_coeff [1] +
-				fir_pos [7] [1] * fir_coeff [0];
+		if ( batch )
+		{
+			fb_left  = fir [0] [i];
+			fb_right = fir [1] [i];
+		}
+		else
+		{
+			fb_left =       fb_left * fir_coeff [7] +
+					fir_pos [1] [0] * fir_coeff [6] +
+					fir_pos [2] [0] * fir_coeff [5] +
+					fir_pos [3] [0] * fir_coeff [4] +
+					fir_pos [4] [0] * fir_coeff [3] +
+					fir_pos [5] [0] * fir_coeff [2] +
+					fir_pos [6] [0] * fir_coeff [1] +
+					fir_pos [7] [0] * fir_coeff [0];
+			
+			fb_right =     fb_right * fir_coeff [7] +
+					fir_pos [1] [1] * fir_coeff [6] +
+					fir_pos [2] [1] * fir_coeff [5] +
+					fir_pos [3] [1] * fir_coeff [4] +
+					fir_pos [4] [1] * fir_coeff [3] +
+					fir_pos [5] [1] * fir_coeff [2] +
+					fir_pos [6] [1] * fir_coeff [1] +
+					fir_pos [7] [1] * fir_coeff [0];
+		}
 		
 		left  += (fb_left  * g.left_echo_volume ) >> 14;
 		right += (fb_right * g.right_echo_volume) >> 14;
@@ -593,8 +816,8 @@ void Spc_Dsp::run( long count, short* out_buf )
 		// echo buffer feedback
 		if ( !(g.flags & 0x20) )
 		{
-			echol += (fb_left  * g.echo_feedback) >> 14;
-			echor += (fb_right * g.echo_feedback) >> 14;
+			int echol = mix [2] [i] + ((fb_left  * g.echo_feedback) >> 14);
+			int echor = mix [3] [i] + ((fb_right * g.echo_feedback) >> 14);
 			SET_LE16( echo_buf    , clamp_16( echol ) );
 			SET_LE16( echo_buf + 2, clamp_16( echor ) );
 		}
@@ -622,6 +845,71 @@ void Spc_Dsp::run( long count, short* out_buf )
 	}
 }
 
+void Spc_Dsp::run( long count, short* out_buf )
+{
+	// Should we just fill the buffer with silence? Flags won't be cleared
+	// during this run so it seems it should keep resetting every sample.
+	if ( g.flags & 0x80 )
+		reset();
+	
+	// Each voice is run over a block of samples, then the mix goes through the
+	// echo one sample at a time. This only differs from running everything a sample
+	// at a time if echo writes change sample data during the block, so in that case
+	// blocks are limited to a single sample.
+	while ( count > 0 )
+	{
+		int n = block_size;
+		if ( n > count )
+			n = count;
+		if ( n > 1 && !(g.flags & 0x20) && echo_overlaps_voices( n ) )
+			n = 1;
+		count -= n;
+		
+		int noise_amps [block_size];
+		for ( int i = 0; i < n; i++ )
+		{
+			if ( g.noise_enables )
+			{
+				noise_count -= env_rates [g.flags & 0x1F];
+				if ( noise_count <= 0 )
+				{
+					noise_count = env_rate_init;
+					
+					noise_amp = BOOST::int16_t (noise * 2);
+					
+					int feedback = (noise << 13) ^ (noise << 14);
+					noise = (feedback & 0x4000) | (noise >> 1);
+				}
+			}
+			noise_amps [i] = noise_amp;
+		}
+		
+		// left, right, echo left, echo right
+		int mix [4] [block_size];
+		for ( int i = 0; i < n; i++ )
+			mix [0] [i] = mix [1] [i] = mix [2] [i] = mix [3] [i] = 0;
+		
+		// What is the expected behavior when pitch modulation is enabled on
+		// voice 0? Jurassic Park 2 does this. Assume 0 for now.
+		short outx [voice_count] [block_size];
+		for ( int vidx = 0; vidx < voice_count; vidx++ )
+		{
+			short const* pmod = NULL;
+			if ( vidx && (g.pitch_mods >> vidx & 1) )
+				pmod = outx [vidx - 1];
+			bool active = run_voice( vidx, n, noise_amps, pmod, outx [vidx] );
+			if ( active )
+				mix_voice( vidx, n, outx [vidx], mix );
+			if ( voice_outs_set && voice_outs [vidx] )
+				write_voice_out( vidx, n, active ? outx [vidx] : NULL );
+		}
+		
+		run_echo( n, mix, out_buf );
+		if ( out_buf )
+			out_buf += n * 2;
+	}
+}
+
 // Base normal_gauss table is almost exactly (with an error of 0 or -1 for each entry):
 // int normal_gauss [512];
 // normal_gauss [i] = exp((i-511)*(i-511)*-9.975e-6)*pow(sin(0.00307096*i),1.7358)*1304.45
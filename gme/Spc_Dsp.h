@@ -8,6 +8,11 @@
 
 #include "blargg_common.h"
 
+// Use SSE2 for the voice mix and echo FIR
+#if !defined (SPC_DSP_SSE2) && (defined (__SSE2__) || defined (_M_X64))
+	#define SPC_DSP_SSE2 1
+#endif
+
 class Spc_Dsp {
 	typedef BOOST::int8_t int8_t;
 	typedef BOOST::uint8_t uint8_t;
@@ -38,6 +43,17 @@ public:
 	// Run DSP for 'count' samples. Write resulting samples to 'buf' if not NULL.
 	void run( long count, short* buf = NULL );
 	
+	// Also write each voice's own samples to bufs [n] during run(), mono and after
+	// main volume but without echo, advancing an internal copy of each pointer.
+	// Voices with a NULL pointer are skipped. Passing NULL stops it.
+	void set_voice_outputs( short* const* bufs );
+	
+	// Save/load exact emulation state. Muting, gain and surround settings are
+	// not part of the state.
+	struct snapshot_t;
+	void save_snapshot( snapshot_t* ) const;
+	void load_snapshot( snapshot_t const& );
+	
 	
 // End of public interface
 private:
@@ -109,6 +125,9 @@ private:
 	
 	int surround_threshold;
 	
+	short* voice_outs [voice_count];
+	bool voice_outs_set;
+	
 	static const BOOST::int16_t gauss [];
 	
 	enum state_t {
@@ -138,7 +157,30 @@ private:
 	
 	voice_t voice_state [voice_count];
 	
-	int clock_envelope( int );
+	// Samples generated per pass over the voices
+	enum { block_size = 32 };
+	
+	int clock_envelope( int, voice_t& );
+	bool echo_overlaps_voices( int count ) const;
+	bool run_voice( int vidx, int count, int const* noise_amps, short const* pmod, short* out );
+	void mix_voice( int vidx, int count, short const* in, int (*mix) [block_size] );
+	void run_echo( int count, int (*mix) [block_size], short* out );
+	void write_voice_out( int vidx, int count, short const* in );
+};
+
+struct Spc_Dsp::snapshot_t
+{
+	uint8_t reg [register_count];
+	short fir_coeff [voice_count];
+	short fir_buf [16] [2];
+	int fir_offset;
+	int keyed_on;
+	int keys;
+	int echo_ptr;
+	int noise_amp;
+	int noise;
+	int noise_count;
+	voice_t voice_state [voice_count];
 };
 
 inline void Spc_Dsp::disable_surround( bool disable ) { surround_threshold = disable ? 0 : -0x7FFF; }
@@ -23,6 +23,8 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA */
 Spc_Emu::Spc_Emu( double gain )
 {
 	apu.set_gain( gain );
+	file_data = NULL;
+	file_size = 0;
 }
 
 Spc_Emu::~Spc_Emu()
@@ -78,20 +80,72 @@ blargg_err_t Spc_Emu::load( const header_t& h, Data_Reader& in )
 	set_voice_count( Snes_Spc::voice_count );
 	
 	memcpy( spc_data.begin(), &h, sizeof h );
+	file_data = spc_data.begin();
+	file_size = spc_data.size();
 	return in.read( &spc_data [sizeof h], remain );
 }
 
+blargg_err_t Spc_Emu::load_mem( void const* data, long size )
+{
+	// trailer must be in memory after the full SPC data
+	if ( size < trailer_offset )
+	{
+		Mem_File_Reader in( data, size );
+		return load( in );
+	}
+	
+	header_t const& h = *(header_t const*) data;
+	if ( strncmp( h.tag, "SNES-SPC700 Sound File Data", 27 ) != 0 )
+		return "Not an SPC file";
+	
+	spc_data.clear();
+	file_data = (byte const*) data;
+	file_size = size;
+	
+	set_track_count( 1 );
+	set_voice_count( Snes_Spc::voice_count );
+	
+	return blargg_success;
+}
+
 void Spc_Emu::start_track( int track )
 {
 	Music_Emu::start_track( track );
 	
 	resampler.clear();
-	if ( apu.load_spc( spc_data.begin(), spc_data.size() ) )
+	if ( apu.load_spc( file_data, file_size ) )
 		check( false );
 }
 
+// Save states are only supported at the native sample rate, since the
+// resampler's buffered input would otherwise need to be saved as well.
+
+long Spc_Emu::state_size() const
+{
+	return sample_rate() == native_sample_rate ? sizeof (Snes_Spc::snapshot_t) : 0;
+}
+
+void Spc_Emu::save_state( void* out ) const
+{
+	apu.save_snapshot( (Snes_Spc::snapshot_t*) out );
+}
+
+void Spc_Emu::load_state( void const* in )
+{
+	apu.load_snapshot( *(Snes_Spc::snapshot_t const*) in );
+}
+
 void Spc_Emu::skip( long count )
 {
+	samples_played( count );
+	
+	if ( sample_rate() == native_sample_rate )
+	{
+		if ( apu.skip( count & ~1 ) )
+			log_error();
+		return;
+	}
+	
 	count = long (count * resampler.ratio()) & ~1;
 	
 	count -= resampler.skip_input( count );
@@ -112,8 +166,11 @@ void Spc_Emu::play( long count, sample_t* out )
 	{
 		if ( apu.play( count, out ) )
 			log_error();
+		samples_played( count );
+		state_reached( play_time() );
 		return;
 	}
+	samples_played( count );
 	
 	long remain = count;
 	while ( remain > 0 )
@@ -131,3 +188,18 @@ void Spc_Emu::play( long count, sample_t* out )
 	assert( remain == 0 );
 }
 
+blargg_err_t Spc_Emu::play_voices( long count, sample_t* const* bufs )
+{
+	require( track_count() ); // file must be loaded
+	
+	// voices would each need their own resampler
+	if ( sample_rate() != native_sample_rate )
+		return "Per-voice output requires native sample rate";
+	
+	if ( apu.play_voices( count, bufs ) )
+		log_error();
+	samples_played( count * 2 );
+	state_reached( play_time() );
+	
+	return blargg_success;
+}
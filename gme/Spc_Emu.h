@@ -53,12 +53,16 @@ public:
 	// Load SPC using already-loaded header and remaining data
 	blargg_err_t load( header_t const&, Data_Reader& );
 	
+	// Load SPC file in memory, referencing it rather than copying it unless it's
+	// shorter than a full SPC with extra RAM. See Music_Emu::load_mem().
+	blargg_err_t load_mem( void const*, long size );
+	
 	// Header for currently loaded SPC
-	header_t const& header() const { return *(header_t*) spc_data.begin(); }
+	header_t const& header() const { return *(header_t const*) file_data; }
 	
 	// Pointer and size for trailer data
-	byte const* trailer() const { return &spc_data [trailer_offset]; }
-	long trailer_size() const { return spc_data.size() - trailer_offset; }
+	byte const* trailer() const { return &file_data [trailer_offset]; }
+	long trailer_size() const { return file_size - trailer_offset; }
 	
 	// If true, prevents channels and global volumes from being phase-negated
 	void disable_surround( bool disable = true );
@@ -69,13 +73,20 @@ public:
 	void mute_voices( int );
 	void start_track( int );
 	void play( long, sample_t* );
+	blargg_err_t play_voices( long, sample_t* const* );
 	void skip( long );
 	const char** voice_names() const;
+protected:
+	long state_size() const;
+	void save_state( void* ) const;
+	void load_state( void const* );
 public:
 	// deprecated
 	blargg_err_t init( long r) { return set_sample_rate( r ); }
 private:
-	blargg_vector<byte> spc_data;
+	blargg_vector<byte> spc_data; // file data when not referenced
+	byte const* file_data;
+	long file_size;
 	Fir_Resampler<24> resampler;
 	Snes_Spc apu;
 };
@@ -21,6 +21,17 @@
 	#define BLARGG_NONPORTABLE 0
 #endif
 
+// BLARGG_COMPUTED_GOTO: If 1, CPU emulators dispatch instructions through a table
+// of label addresses (GCC's "labels as values") instead of a switch statement.
+// Defaults to on for GCC-compatible compilers.
+#ifndef BLARGG_COMPUTED_GOTO
+	#if defined (__GNUC__)
+		#define BLARGG_COMPUTED_GOTO 1
+	#else
+		#define BLARGG_COMPUTED_GOTO 0
+	#endif
+#endif
+
 // BLARGG_BIG_ENDIAN, BLARGG_LITTLE_ENDIAN: Determined automatically, otherwise only
 // one must be #defined to 1. Only needed if something actually depends on byte order.
 #if !defined (BLARGG_BIG_ENDIAN) && !defined (BLARGG_LITTLE_ENDIAN)
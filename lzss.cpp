@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 #include "alport.h"
 
 /*
@@ -18,8 +19,8 @@
    length> pair or an unencoded character, and these flags are stored as
    an eight bit mask every eight items.
 
-   This implementation uses binary trees to speed up the search for the
-   longest match.
+   This implementation uses hash chains to speed up the search for the
+   longest match, see lzss_write().
 
    Original code by Haruhiko Okumura, 4/6/1989.
    12-2-404 Green Heights, 580 Nagasawa, Yokosuka 239, Japan.
@@ -35,21 +36,25 @@
 #define THRESHOLD    2              /* LZ encode string into pos and length
                                        if match size is greater than this */
 
+#define WIN_SIZE     (8 * N)        /* history plus input kept for packing */
+#define HASH_BITS    14
+#define HASH_SIZE    (1 << HASH_BITS)
+
 
 struct LZSS_PACK_DATA               /* stuff for doing LZ compression */
 {
    int state;                       /* where have we got to in the pack? */
-   int i, c, len, r, s;
-   int last_match_length, code_buf_ptr;
+   int max_chain, lazy;             /* how hard to look for matches */
+   int code_buf_ptr;
    unsigned char mask;
    char code_buf[17];
-   int match_position;
-   int match_length;
-   int lson[N + 1];                    /* left children, */
-   int rson[N + 257];                  /* right children, */
-   int dad[N + 1];                     /* and parents, = binary search trees */
-   unsigned char text_buf[N + F - 1];  /* ring buffer, with F-1 extra bytes
-                                          for string comparison */
+   int pos, end;                    /* next byte to pack, end of the input */
+   int ring;                        /* ring buffer position of win[0] */
+   unsigned char *out;              /* lzss_pack_block() output, */
+   long out_size;                   /* and how much is in it */
+   int head[HASH_SIZE];             /* last position for each hash */
+   int prev[WIN_SIZE];              /* previous position, same hash */
+   unsigned char win[WIN_SIZE];     /* packed history and input to pack */
 };
 
 
@@ -65,21 +70,30 @@ struct LZSS_UNPACK_DATA                   /* for reading LZ files */
 
 /*** Compression (writing) ***/
 
+/* search depth and lazy matching for each compression level */
+static const struct
+{
+   int max_chain;
+   int lazy;
+} lzss_levels[10] =
+{
+   { 0, 0 }, { 4, 0 }, { 8, 0 }, { 16, 0 }, { 16, 1 },
+   { 32, 1 }, { 64, 1 }, { 128, 1 }, { 512, 1 }, { N, 1 }
+};
+
+
 /* create_lzss_pack_data:
  *  Creates a PACK_DATA structure.
  */
 LZSS_PACK_DATA *create_lzss_pack_data(void)
 {
    LZSS_PACK_DATA *dat;
-   int c;
 
    if ((dat = (LZSS_PACK_DATA *)malloc(sizeof(LZSS_PACK_DATA))) == NULL)
       return NULL;
 
-   for (c = 0; c < N - F; c++)
-      dat->text_buf[c] = 0;
-
    dat->state = 0;
+   lzss_set_level(dat, LZSS_DEFAULT_LEVEL);
 
    return dat;
 }
@@ -95,322 +109,297 @@ void free_lzss_pack_data(LZSS_PACK_DATA *dat)
 }
 
 
-/* lzss_inittree:
- *  For i = 0 to N-1, rson[i] and lson[i] will be the right and left
- *  children of node i. These nodes need not be initialized. Also, dad[i]
- *  is the parent of node i. These are initialized to N, which stands for
- *  'not used.' For i = 0 to 255, rson[N+i+1] is the root of the tree for
- *  strings that begin with character i. These are initialized to N. Note
- *  there are 256 trees.
+/* lzss_set_level:
+ *  Sets how hard lzss_write() looks for matches, from 1 (fastest) to 9
+ *  (smallest output). All levels write the same format.
  */
-static void lzss_inittree(LZSS_PACK_DATA *dat)
+void lzss_set_level(LZSS_PACK_DATA *dat, int level)
 {
-   int i;
+   level = CLAMP(1, level, 9);
+
+   dat->max_chain = lzss_levels[level].max_chain;
+   dat->lazy = lzss_levels[level].lazy;
+}
 
-   for (i = N + 1; i <= N + 256; i++)
-      dat->rson[i] = N;
 
-   for (i = 0; i < N; i++)
-      dat->dad[i] = N;
+/* lzss_hash:
+ *  Hashes the THRESHOLD + 1 bytes a match has to start with.
+ */
+static inline int lzss_hash(const unsigned char *p)
+{
+   return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >> (32 - HASH_BITS);
 }
 
 
-/* lzss_insertnode:
- *  Inserts a string of length F, text_buf[r..r+F-1], into one of the trees
- *  (text_buf[r]'th tree) and returns the longest-match position and length
- *  via match_position and match_length. If match_length = F, then removes
- *  the old node in favor of the new one, because the old one will be
- *  deleted sooner. Note r plays double role, as tree node and position in
- *  the buffer.
+/* lzss_insert:
+ *  Adds the string starting at window position p to its hash chain.
  */
-static void lzss_insertnode(int r, LZSS_PACK_DATA *dat)
+static inline void lzss_insert(int p, LZSS_PACK_DATA *dat)
 {
-   int i, p, cmp;
-   unsigned char *key;
-   unsigned char *text_buf = dat->text_buf;
+   int h;
 
-   cmp = 1;
-   key = &text_buf[r];
-   p = N + 1 + key[0];
-   dat->rson[r] = dat->lson[r] = N;
-   dat->match_length = 0;
+   if (p + THRESHOLD + 1 > dat->end)
+      return;
 
-   for (;;)
-   {
+   h = lzss_hash(dat->win + p);
+   dat->prev[p] = dat->head[h];
+   dat->head[h] = p;
+}
 
-      if (cmp >= 0)
-      {
-         if (dat->rson[p] != N)
-            p = dat->rson[p];
-         else
-         {
-            dat->rson[p] = r;
-            dat->dad[r] = p;
-            return;
-         }
-      }
-      else
-      {
-         if (dat->lson[p] != N)
-            p = dat->lson[p];
-         else
-         {
-            dat->lson[p] = r;
-            dat->dad[r] = p;
-            return;
-         }
-      }
 
-      for (i = 1; i < F; i++)
-         if ((cmp = key[i] - text_buf[p + i]) != 0)
-            break;
+/* lzss_find:
+ *  Walks the hash chain for window position p, which must not be in it
+ *  yet, and returns the length of the longest match found within the
+ *  last N - 1 bytes, storing where it starts in match_pos.
+ */
+static int lzss_find(int p, LZSS_PACK_DATA *dat, int *match_pos)
+{
+   const unsigned char *win = dat->win;
+   const unsigned char *key = win + p;
+   int max_len = MIN(F, dat->end - p);
+   int chain = dat->max_chain;
+   int best = THRESHOLD;
+   int q, i;
+
+   if (max_len <= THRESHOLD)
+      return 0;
+
+   for (q = dat->head[lzss_hash(key)]; (q >= 0) && (p - q < N) && (chain > 0);
+         q = dat->prev[q], chain--)
+   {
+      if ((win[q + best] != key[best]) || (win[q] != key[0]))
+         continue;
 
-      if (i > dat->match_length)
+      for (i = 1; (i < max_len) && (win[q + i] == key[i]); i++)
+         ;
+
+      if (i > best)
       {
-         dat->match_position = p;
-         if ((dat->match_length = i) >= F)
+         best = i;
+         *match_pos = q;
+         if (best >= max_len)
             break;
       }
    }
 
-   dat->dad[r] = dat->dad[p];
-   dat->lson[r] = dat->lson[p];
-   dat->rson[r] = dat->rson[p];
-   dat->dad[dat->lson[p]] = r;
-   dat->dad[dat->rson[p]] = r;
-   if (dat->rson[dat->dad[p]] == p)
-      dat->rson[dat->dad[p]] = r;
-   else
-      dat->lson[dat->dad[p]] = r;
-   dat->dad[p] = N;                 /* remove p */
+   return (best > THRESHOLD) ? best : 0;
 }
 
 
-/* lzss_deletenode:
- *  Removes a node from a tree.
+/* lzss_put_code:
+ *  Writes out a group of up to eight units, and the flag byte in front.
+ *  Without a file, they are added to the lzss_pack_block() output instead.
  */
-static void lzss_deletenode(int p, LZSS_PACK_DATA *dat)
+static int lzss_put_code(PACKFILE *file, LZSS_PACK_DATA *dat)
 {
-   int q;
+   int i;
 
-   if (dat->dad[p] == N)
-      return;     /* not in tree */
+   if (!file)
+   {
+      memcpy(dat->out + dat->out_size, dat->code_buf, dat->code_buf_ptr);
+      dat->out_size += dat->code_buf_ptr;
+      dat->code_buf[0] = 0;
+      dat->code_buf_ptr = dat->mask = 1;
+      return 0;
+   }
 
-   if (dat->rson[p] == N)
-      q = dat->lson[p];
-   else if (dat->lson[p] == N)
-      q = dat->rson[p];
-   else
+   if ((file->is_normal_packfile) && (file->normal.passpos) &&
+         (file->normal.flags & PACKFILE_FLAG_OLD_CRYPT))
    {
-      q = dat->lson[p];
-      if (dat->rson[q] != N)
-      {
-         do
-         {
-            q = dat->rson[q];
-         }
-         while (dat->rson[q] != N);
-         dat->rson[dat->dad[q]] = dat->lson[q];
-         dat->dad[dat->lson[q]] = dat->dad[q];
-         dat->lson[q] = dat->lson[p];
-         dat->dad[dat->lson[p]] = q;
-      }
-      dat->rson[q] = dat->rson[p];
-      dat->dad[dat->rson[p]] = q;
+      dat->code_buf[0] ^= *file->normal.passpos;
+      file->normal.passpos++;
+      if (!*file->normal.passpos)
+         file->normal.passpos = file->normal.passdata;
    }
 
-   dat->dad[q] = dat->dad[p];
-   if (dat->rson[dat->dad[p]] == p)
-      dat->rson[dat->dad[p]] = q;
-   else
-      dat->lson[dat->dad[p]] = q;
+   for (i = 0; i < dat->code_buf_ptr; i++)     /* send at most 8 units of */
+      pack_putc(dat->code_buf[i], file);       /* code together */
 
-   dat->dad[p] = N;
+   dat->code_buf[0] = 0;
+   dat->code_buf_ptr = dat->mask = 1;
+
+   return pack_ferror(file) ? EOF : 0;
+}
+
+
+/* lzss_slide:
+ *  Drops all but the last N bytes before position pos from the window, to
+ *  make room for more input.
+ */
+static void lzss_slide(int pos, LZSS_PACK_DATA *dat)
+{
+   int d = pos - N;
+   int i;
+
+   if (d <= 0)
+      return;
+
+   memmove(dat->win, dat->win + d, dat->end - d);
+   dat->end -= d;
+   dat->pos -= d;
+   dat->ring = (dat->ring + d) & (N - 1);
+
+   for (i = 0; i < HASH_SIZE; i++)
+      dat->head[i] = (dat->head[i] >= d) ? dat->head[i] - d : -1;
+
+   for (i = 0; i < dat->pos; i++)
+      dat->prev[i] = (dat->prev[i + d] >= d) ? dat->prev[i + d] - d : -1;
 }
 
 
 /* lzss_write:
  *  Packs size bytes from buf, using the pack information contained in dat.
  *  Returns 0 on success.
+ *
+ *  Input is gathered in a window holding the last N bytes already packed
+ *  and the ones still to come. Every position goes on a hash chain keyed by
+ *  its first three bytes, and matches are looked for by walking the chain,
+ *  up to a depth set by the compression level. Higher levels also try
+ *  the next position before taking a match, and send a literal first if
+ *  that gives a longer one. Positions are only packed while F bytes of
+ *  input (F + 1 with lazy matching) are known to follow, unless this is
+ *  the last block.
  */
 int lzss_write(PACKFILE *file, LZSS_PACK_DATA *dat, int size,
                unsigned char *buf, int last)
 {
-   int i = dat->i;
-   int c = dat->c;
-   int len = dat->len;
-   int r = dat->r;
-   int s = dat->s;
-   int last_match_length = dat->last_match_length;
-   int code_buf_ptr = dat->code_buf_ptr;
-   unsigned char mask = dat->mask;
-   int ret = 0;
+   int pos, limit, len, len2, match_pos, match_pos2, n, i;
 
-   if (dat->state == 2)
-      goto pos2;
-   else if (dat->state == 1)
-      goto pos1;
+   if (dat->state == 0)
+   {
+      dat->code_buf[0] = 0;
+      /* code_buf[1..16] saves eight units of code, and code_buf[0] works
+      as eight flags, "1" representing that the unit is an unencoded
+      letter (1 byte), "0" a position-and-length pair (2 bytes).
+      Thus, eight units require at most 16 bytes of code. */
 
-   dat->code_buf[0] = 0;
-   /* code_buf[1..16] saves eight units of code, and code_buf[0] works
-   as eight flags, "1" representing that the unit is an unencoded
-   letter (1 byte), "0" a position-and-length pair (2 bytes).
-   Thus, eight units require at most 16 bytes of code. */
+      dat->code_buf_ptr = dat->mask = 1;
 
-   code_buf_ptr = mask = 1;
+      dat->pos = dat->end = 0;
+      dat->ring = N - F;
 
-   s = 0;
-   r = N - F;
-   lzss_inittree(dat);
+      for (i = 0; i < HASH_SIZE; i++)
+         dat->head[i] = -1;
 
-   for (len = 0; (len < F) && (size > 0); len++)
-   {
-      dat->text_buf[r + len] = *(buf++);
-      if (--size == 0)
-      {
-         if (!last)
-         {
-            dat->state = 1;
-            goto getout;
-         }
-      }
-pos1:
-      ;
+      dat->state = 1;
    }
 
-   if (len == 0)
-      goto getout;
-
-   for (i = 1; i <= F; i++)
-      lzss_insertnode(r - i, dat);
-   /* Insert the F strings, each of which begins with one or
-      more 'space' characters. Note the order in which these
-      strings are inserted. This way, degenerate trees will be
-      less likely to occur. */
-
-   lzss_insertnode(r, dat);
-   /* Finally, insert the whole string just read. match_length
-      and match_position are set. */
-
-   do
+   while ((size > 0) || (last))
    {
-      if (dat->match_length > len)
-         dat->match_length = len;  /* match_length may be long near the end */
-
-      if (dat->match_length <= THRESHOLD)
-      {
-         dat->match_length = 1;  /* not long enough match: send one byte */
-         dat->code_buf[0] |= mask;    /* 'send one byte' flag */
-         dat->code_buf[code_buf_ptr++] = dat->text_buf[r]; /* send uncoded */
-      }
+      /* take in as much as fits */
+      if ((size > 0) && (dat->end == WIN_SIZE))
+         lzss_slide(dat->pos, dat);
+
+      n = MIN(size, WIN_SIZE - dat->end);
+      memcpy(dat->win + dat->end, buf, n);
+      dat->end += n;
+      buf += n;
+      size -= n;
+
+      if ((last) && (size == 0))
+         limit = dat->end;
       else
-      {
-         /* send position and length pair. Note match_length > THRESHOLD */
-         dat->code_buf[code_buf_ptr++] = (unsigned char) dat->match_position;
-         dat->code_buf[code_buf_ptr++] = (unsigned char)
-                                         (((dat->match_position >> 4) & 0xF0) |
-                                          (dat->match_length - (THRESHOLD + 1)));
-      }
+         limit = dat->end - F - dat->lazy;
+
+      pos = dat->pos;
+      len = 0;
 
-      if ((mask <<= 1) == 0)                    /* shift mask left one bit */
+      while (pos < limit)
       {
+         if (len == 0)
+            len = lzss_find(pos, dat, &match_pos);
 
-         if ((file->is_normal_packfile) && (file->normal.passpos) &&
-               (file->normal.flags & PACKFILE_FLAG_OLD_CRYPT))
+         lzss_insert(pos, dat);
+
+         if ((len > 0) && (len < F) && (dat->lazy) && (pos + 1 < dat->end))
          {
-            dat->code_buf[0] ^= *file->normal.passpos;
-            file->normal.passpos++;
-            if (!*file->normal.passpos)
-               file->normal.passpos = file->normal.passdata;
+            len2 = lzss_find(pos + 1, dat, &match_pos2);
+            if (len2 > len)
+            {
+               /* a better match starts at the next byte */
+               len = 0;
+               match_pos = match_pos2;
+               len2 = -len2;
+            }
          }
+         else
+            len2 = 0;
 
-         for (i = 0; i < code_buf_ptr; i++)     /* send at most 8 units of */
-            pack_putc(dat->code_buf[i], file);  /* code together */
-
-         if (pack_ferror(file))
+         if (len == 0)
          {
-            ret = EOF;
-            goto getout;
+            dat->code_buf[0] |= dat->mask;      /* 'send one byte' flag */
+            dat->code_buf[dat->code_buf_ptr++] = dat->win[pos];
+            pos++;
+         }
+         else
+         {
+            /* send position and length pair. Note len > THRESHOLD */
+            n = (dat->ring + match_pos) & (N - 1);
+            dat->code_buf[dat->code_buf_ptr++] = (unsigned char)n;
+            dat->code_buf[dat->code_buf_ptr++] = (unsigned char)
+                                                 (((n >> 4) & 0xF0) |
+                                                  (len - (THRESHOLD + 1)));
+            for (i = 1; i < len; i++)
+               lzss_insert(pos + i, dat);
+            pos += len;
          }
-         dat->code_buf[0] = 0;
-         code_buf_ptr = mask = 1;
-      }
-
-      last_match_length = dat->match_length;
 
-      for (i = 0; (i < last_match_length) && (size > 0); i++)
-      {
-         c = *(buf++);
-         if (--size == 0)
+         if ((dat->mask <<= 1) == 0)             /* shift mask left one bit */
          {
-            if (!last)
+            if (lzss_put_code(file, dat))
             {
-               dat->state = 2;
-               goto getout;
+               dat->pos = pos;
+               return EOF;
             }
          }
-pos2:
-         lzss_deletenode(s, dat);   /* delete old strings and */
-         dat->text_buf[s] = c;      /* read new bytes */
-         if (s < F - 1)
-            dat->text_buf[s + N] = c; /* if the position is near the end of
-                   buffer, extend the buffer to make
-                   string comparison easier */
-         s = (s + 1) & (N - 1);
-         r = (r + 1) & (N - 1);         /* since this is a ring buffer,
-                   increment the position modulo N */
-
-         lzss_insertnode(r, dat);    /* register the string in
-                   text_buf[r..r+F-1] */
-      }
 
-      while (i++ < last_match_length)     /* after the end of text, */
-      {
-         lzss_deletenode(s, dat);         /* no need to read, but */
-         s = (s + 1) & (N - 1);           /* buffer may not be empty */
-         r = (r + 1) & (N - 1);
-         if (--len)
-            lzss_insertnode(r, dat);
+         /* carry the lazy match found above over to the next position */
+         len = (len2 < 0) ? -len2 : 0;
       }
 
+      dat->pos = pos;
+
+      if ((last) && (size == 0))
+         break;
    }
-   while (len > 0);     /* until length of string to be processed is zero */
 
-   if (code_buf_ptr > 1)           /* send remaining code */
+   if (last)
    {
-
-      if ((file->is_normal_packfile) && (file->normal.passpos) &&
-            (file->normal.flags & PACKFILE_FLAG_OLD_CRYPT))
+      if (dat->code_buf_ptr > 1)            /* send remaining code */
       {
-         dat->code_buf[0] ^= *file->normal.passpos;
-         file->normal.passpos++;
-         if (!*file->normal.passpos)
-            file->normal.passpos = file->normal.passdata;
+         if (lzss_put_code(file, dat))
+            return EOF;
       }
 
-      for (i = 0; i < code_buf_ptr; i++)
-      {
-         pack_putc(dat->code_buf[i], file);
-         if (pack_ferror(file))
-         {
-            ret = EOF;
-            goto getout;
-         }
-      }
+      dat->state = 0;
    }
 
-   dat->state = 0;
+   return 0;
+}
 
-getout:
 
-   dat->i = i;
-   dat->c = c;
-   dat->len = len;
-   dat->r = r;
-   dat->s = s;
-   dat->last_match_length = last_match_length;
-   dat->code_buf_ptr = code_buf_ptr;
-   dat->mask = mask;
+/* lzss_pack_block:
+ *  Packs size bytes from src into dst as a stream of its own, and returns
+ *  the packed size or -1 if out of memory. dst must have room for
+ *  LZSS_PACK_BOUND(size) bytes. This is safe to call from several threads.
+ */
+long lzss_pack_block(const unsigned char *src, long size, unsigned char *dst,
+                     int level)
+{
+   LZSS_PACK_DATA *dat;
+   long ret;
+
+   if ((dat = create_lzss_pack_data()) == NULL)
+      return -1;
+
+   lzss_set_level(dat, level);
+   dat->out = dst;
+   dat->out_size = 0;
+
+   lzss_write(NULL, dat, size, (unsigned char *)src, TRUE);
+
+   ret = dat->out_size;
+   free_lzss_pack_data(dat);
 
    return ret;
 }
@@ -448,6 +437,100 @@ void free_lzss_unpack_data(LZSS_UNPACK_DATA *dat)
 }
 
 
+/* lzss_read_fast:
+ *  Unpacks whole items straight out of the input buffer of file into buf,
+ *  for as long as there is plenty of both input and output room, and
+ *  returns the number of bytes added to buf. Matches are copied from the
+ *  output itself when they reach back no further than this call, so the
+ *  ring buffer only has to be brought up to date once, on the way out.
+ *  The last byte of input is always left for pack_getc(), so that the end
+ *  of file is noticed exactly as lzss_read() would notice it.
+ */
+static int lzss_read_fast(PACKFILE *file, LZSS_UNPACK_DATA *dat, int *rp,
+                          unsigned int *flagsp, unsigned char *buf, int s)
+{
+   const unsigned char *in = file->normal.buf_pos;
+   const unsigned char *in_end = in + file->normal.buf_size;
+   unsigned char *out = buf;
+   unsigned char *out_end = buf + s;
+   unsigned char *text_buf = dat->text_buf;
+   unsigned int flags = *flagsp;
+   int r = *rp;
+   int i, j, k, d, w, n;
+
+   /* an item takes at most 3 bytes of input, and a match writes at most
+    * F bytes, rounded up to whole 8 byte words
+    */
+   while ((in_end - in >= 4) && (out_end - out >= F + 8))
+   {
+      if (((flags >>= 1) & 256) == 0)
+      {
+         flags = *(in++) | 0xFF00;
+
+         if ((flags == 0xFFFF) && (in_end - in >= 9))
+         {
+            /* eight literals in a row */
+            memcpy(out, in, 8);
+            in += 8;
+            out += 8;
+            flags >>= 7;
+            continue;
+         }
+      }
+
+      if (flags & 1)
+      {
+         *(out++) = *(in++);
+         continue;
+      }
+
+      i = in[0] | ((in[1] & 0xF0) << 4);
+      j = (in[1] & 0x0F) + THRESHOLD + 1;
+      in += 2;
+
+      /* how far back the match starts, from 1 to N */
+      w = out - buf;
+      d = ((r + w - i - 1) & (N - 1)) + 1;
+
+      if (d > w)
+      {
+         /* starts in the ring buffer, from before this call */
+         for (k = 0; k < j; k++, out++)
+            *out = (w - d + k < 0) ? text_buf[(i + k) & (N - 1)] : out[-d];
+      }
+      else if (d >= 8)
+      {
+         memcpy(out, out - d, 8);
+         memcpy(out + 8, out + 8 - d, 8);
+         if (j > 16)
+            memcpy(out + 16, out + 16 - d, 8);
+         out += j;
+      }
+      else
+      {
+         /* overlapping run */
+         for (k = 0; k < j; k++, out++)
+            *out = out[-d];
+      }
+   }
+
+   /* bring the ring buffer up to date with the last N bytes unpacked */
+   w = out - buf;
+   n = MIN(w, N);
+   k = (r + w - n) & (N - 1);
+   d = MIN(n, N - k);
+   memcpy(text_buf + k, out - n, d);
+   memcpy(text_buf, out - n + d, n - d);
+
+   file->normal.buf_size -= in - file->normal.buf_pos;
+   file->normal.buf_pos = (unsigned char *)in;
+   *rp = (r + w) & (N - 1);
+   *flagsp = flags;
+
+   return w;
+}
+
+
 /* lzss_read:
  *  Unpacks from dat into buf, until either EOF is reached or s bytes have
  *  been extracted. Returns the number of bytes added to the buffer
@@ -472,6 +555,14 @@ int lzss_read(PACKFILE *file, LZSS_UNPACK_DATA *dat, int s, unsigned char *buf)
 
    for (;;)
    {
+      if ((file->is_normal_packfile) &&
+            (!((file->normal.passpos) && (file->normal.flags & PACKFILE_FLAG_OLD_CRYPT))))
+      {
+         i = lzss_read_fast(file, dat, &r, &flags, buf, s - size);
+         buf += i;
+         size += i;
+      }
+
       if (((flags >>= 1) & 256) == 0)
       {
          if ((c = pack_getc(file)) == EOF)
@@ -544,6 +635,85 @@ getout:
 }
 
 
+/* lzss_unpack_block:
+ *  Unpacks a stream made by lzss_pack_block() from src into dst, without
+ *  writing more than dst_size bytes. Returns the unpacked size, or -1 if
+ *  the data is corrupt. This is safe to call from several threads.
+ */
+long lzss_unpack_block(const unsigned char *src, long src_size,
+                       unsigned char *dst, long dst_size)
+{
+   const unsigned char *in = src;
+   const unsigned char *in_end = src + src_size;
+   unsigned char *out = dst;
+   unsigned char *out_end = dst + dst_size;
+   unsigned int flags = 0;
+   long d;
+   int i, j, k;
+
+   for (;;)
+   {
+      if (((flags >>= 1) & 256) == 0)
+      {
+         if (in >= in_end)
+            break;
+
+         flags = *(in++) | 0xFF00;
+
+         if ((flags == 0xFFFF) && (in_end - in >= 8) && (out_end - out >= 8))
+         {
+            /* eight literals in a row */
+            memcpy(out, in, 8);
+            in += 8;
+            out += 8;
+            flags >>= 7;
+            continue;
+         }
+      }
+
+      if (flags & 1)
+      {
+         if ((in >= in_end) || (out >= out_end))
+            break;
+
+         *(out++) = *(in++);
+      }
+      else
+      {
+         if (in_end - in < 2)
+            break;
+
+         i = in[0] | ((in[1] & 0xF0) << 4);
+         j = (in[1] & 0x0F) + THRESHOLD + 1;
+         in += 2;
+
+         /* the stream starts at ring buffer position N - F, and can only
+          * refer back to what it has unpacked itself
+          */
+         d = ((N - F + (out - dst) - i - 1) & (N - 1)) + 1;
+         if ((d > out - dst) || (j > out_end - out))
+            return -1;
+
+         if ((d >= 8) && (out_end - out >= 24))
+         {
+            memcpy(out, out - d, 8);
+            memcpy(out + 8, out + 8 - d, 8);
+            if (j > 16)
+               memcpy(out + 16, out + 16 - d, 8);
+            out += j;
+         }
+         else
+         {
+            for (k = 0; k < j; k++, out++)
+               *out = out[-d];
+         }
+      }
+   }
+
+   return out - dst;
+}
+
+
 /* _al_lzss_incomplete_state:
  *  Return non-zero if the previous lzss_read() call was in the middle of
  *  unpacking a sequence of bytes into the supplied buffer, but had to suspend
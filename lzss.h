@@ -10,14 +10,24 @@ extern "C" {
 typedef struct LZSS_PACK_DATA LZSS_PACK_DATA;
 typedef struct LZSS_UNPACK_DATA LZSS_UNPACK_DATA;
 
+#define LZSS_DEFAULT_LEVEL    6     /* compression level, from 1 to 9 */
+
+/* room needed to pack n bytes with lzss_pack_block() */
+#define LZSS_PACK_BOUND(n)    ((n) + ((n) + 7) / 8 + 16)
+
 LZSS_PACK_DATA *create_lzss_pack_data(void);
 void free_lzss_pack_data(LZSS_PACK_DATA *dat);
+void lzss_set_level(LZSS_PACK_DATA *dat, int level);
 int lzss_write(PACKFILE *file, LZSS_PACK_DATA *dat, int size,
                unsigned char *buf, int last);
 LZSS_UNPACK_DATA *create_lzss_unpack_data(void);
 void free_lzss_unpack_data(LZSS_UNPACK_DATA *dat);
 int lzss_read(PACKFILE *file, LZSS_UNPACK_DATA *dat, int s, unsigned char *buf);
 int _al_lzss_incomplete_state(const LZSS_UNPACK_DATA *dat);
+long lzss_pack_block(const unsigned char *src, long size, unsigned char *dst,
+                     int level);
+long lzss_unpack_block(const unsigned char *src, long src_size,
+                       unsigned char *dst, long dst_size);
 
 #ifdef __cplusplus
 }
@@ -1,6 +1,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <pthread.h>
 #include "alport.h"
 #define TSF_IMPLEMENTATION
 #include "tsf/tsf.h"
@@ -22,6 +23,8 @@
 #define VOLUME_GAIN        0.0f /* (>0 means higher, <0 means lower) */
 #define AUDIO_CHANNELS     2
 #define MAX_MIDI_SIZE      INT_MAX
+#define MIDI_CACHE_SIZE    16    /* Max pre-rendered midis kept around */
+#define MIDI_TAIL_SECONDS  4     /* Max release tail rendered after the end */
 
 
 typedef struct MIDI_TRACK
@@ -30,19 +33,49 @@ typedef struct MIDI_TRACK
    int len;             /* length of the track data */
 } MIDI_TRACK;
 
-static SAMPLE *_midiSpl; /* sample object to pass midi output to the mixer */
-static tsf *_tinySF;
-static tml_message *_tml = NULL; /* pointer to first midi message */
-static tml_message *_tmlNext = NULL; /* next midi message to be played */
-static float _mtime = -1.0f;
+struct MIDI_PLAYER
+{
+   SAMPLE *spl;         /* sample object to pass midi output to the mixer */
+   tsf *sf;             /* player copy of the SoundFont (own channels/voices) */
+   tml_message *tml;    /* pointer to first midi message */
+   tml_message *next;   /* next midi message to be played */
+   int64_t frame;       /* playback position in frames, -1 if stopped */
+   int voice;           /* voice index in the mixer */
+   int loop;
+   int loop_start;
+   int loop_end;
+   int playing;
+};
+
+typedef struct MIDI_CACHE_ENTRY
+{
+   uint64_t hash;       /* hash of the midi data and render length */
+   SAMPLE *spl;         /* pre-rendered audio */
+   int refs;            /* references handed out and not yet released */
+   int orphan;          /* cleared while held, freed on the last release */
+   unsigned int used;   /* last use stamp, for evicting */
+} MIDI_CACHE_ENTRY;
+
+struct MIDI_RENDER
+{
+   pthread_t thread;
+   pthread_mutex_t lock;
+   MIDI_PLAYER mp;      /* private sequencer state used by the render */
+   SAMPLE *spl;         /* render output */
+   uint64_t hash;
+   int max_frames;
+   int done;
+   int cached;          /* TRUE if spl came from the cache */
+};
+
+static tsf *_tinySF = NULL; /* shared SoundFont, never rendered directly */
+static MIDI_PLAYER *_players[MIDI_MAX_PLAYERS];
+static MIDI_PLAYER *_default_player = NULL; /* used by the midi_* calls */
 static float _delta;
-static int _mvoice = -1; /* voice index in the mixer */
 static int _rate;
 static int _sample_size;
-static int _loop = FALSE;
-static int _loop_start = -1;
-static int _loop_end = -1;
-static int _playing = FALSE;
+static MIDI_CACHE_ENTRY _cache[MIDI_CACHE_SIZE];
+static unsigned int _cache_stamp = 0;
 
 
 /* read_midi:
@@ -83,7 +116,7 @@ void *read_midi(PACKFILE *f)
    }
 
    /* Now restore it as standard MIDI format */
-   m = malloc(MIDI_HDR_SIZE + tracks_size);
+   m = _datafile_malloc(MIDI_HDR_SIZE + tracks_size);
    if (!m)
       goto DEL_TEMP;
 
@@ -153,12 +186,16 @@ void destroy_midi(void *midi)
 
 /* midi_init:
  *  Setup the midi engine to be used together with the mixer and
- * tsf / tml engine.
+ * tsf / tml engine. The SoundFont is loaded once and shared by
+ * all the midi players. A default player is created to be used
+ * by the midi_* functions.
  */
 int midi_init(int rate, float delta, const char *sf2_path)
 {
+   int i;
+
    /* Already initialized */
-   if (_mvoice >= 0)
+   if (_tinySF)
       return FALSE;
 
    _rate = rate;
@@ -170,110 +207,200 @@ int midi_init(int rate, float delta, const char *sf2_path)
    if (!_tinySF)
       return FALSE;
 
-   /* Set the SoundFont rendering output mode */
+   /* Set the SoundFont rendering output mode, it is inherited
+    * by every player copy */
    tsf_set_output(_tinySF, TSF_STEREO_INTERLEAVED, _rate, VOLUME_GAIN);
 
-   /* Create a sample to store the output of TSF */
-   _midiSpl = create_sample(SAMPLE_BIT_DEPTH, TRUE, _rate, _sample_size);
-   if (!_midiSpl)
+   for (i = 0; i < MIDI_MAX_PLAYERS; i++)
+      _players[i] = NULL;
+
+   _default_player = midi_player_create();
+   if (!_default_player)
    {
       tsf_close(_tinySF);
       _tinySF = NULL;
       return FALSE;
    }
 
-   /* Reserve voice for the midi in the mixer */
-   _mvoice = allocate_voice((const SAMPLE *)_midiSpl);
-
-   _playing = FALSE;
-
    return TRUE;
 }
 
 
 /* midi_deinit:
  *  Stop music and frees any resource being used by the midi
- * engine.
+ * engine, including every player still alive. Pre-rendered samples
+ * not yet released stay valid until midi_release_sample().
  */
 void midi_deinit(void)
 {
+   int i;
+
    /* not initialized? */
-   if (_mvoice < 0)
+   if (!_tinySF)
       return;
 
-   _playing = FALSE;
-   _mtime = -1.0f;
+   for (i = 0; i < MIDI_MAX_PLAYERS; i++)
+      midi_player_destroy(_players[i]);
+
+   _default_player = NULL;
 
-   deallocate_voice(_mvoice);
-   _mvoice = -1;
+   midi_clear_render_cache();
 
-   destroy_sample(_midiSpl);
    tsf_close(_tinySF);
    _tinySF = NULL;
-   if (_tml)
-      tml_free(_tml);
-   _tmlNext = _tml = NULL;
 }
 
 
-/* midi_play:
- *  Loads a midi file from buffer and starts playing it.
- * if the midi engine is not initiated yet or the buffer is
- * null it does nothing. Returns TRUE if successful or
- * zero (FALSE) otherwise. Doesn't behave exactly
- * like the allegro version.
+/* midi_player_create:
+ *  Creates a new midi player sharing the SoundFont loaded by
+ * midi_init(). Each player has its own channel state, voice pool
+ * and mixer voice so several songs can be played at the same time.
+ * Returns NULL if the engine is not initialized or no player or
+ * mixer voice is available.
  */
-int midi_play(void *midi, int loop)
+MIDI_PLAYER *midi_player_create(void)
 {
+   MIDI_PLAYER *mp;
+   int slot;
+
+   if (!_tinySF)
+      return NULL;
+
+   for (slot = 0; slot < MIDI_MAX_PLAYERS; slot++)
+   {
+      if (!_players[slot])
+         break;
+   }
+
+   if (slot == MIDI_MAX_PLAYERS)
+      return NULL;
+
+   mp = (MIDI_PLAYER *)malloc(sizeof(MIDI_PLAYER));
+   if (!mp)
+      return NULL;
+
+   mp->spl = NULL;
+   mp->tml = mp->next = NULL;
+
+   /* Create the player copy of the SoundFont */
+   mp->sf = tsf_copy(_tinySF);
+   if (!mp->sf)
+      goto Error;
+
+   /* Create a sample to store the output of TSF */
+   mp->spl = create_sample(SAMPLE_BIT_DEPTH, TRUE, _rate, _sample_size);
+   if (!mp->spl)
+      goto Error;
+
+   /* Reserve voice for the midi in the mixer */
+   mp->voice = allocate_voice((const SAMPLE *)mp->spl);
+   if (mp->voice < 0)
+      goto Error;
+
+   mp->frame = -1;
+   mp->loop = FALSE;
+   mp->loop_start = -1;
+   mp->loop_end = -1;
+   mp->playing = FALSE;
+
+   _players[slot] = mp;
+
+   return mp;
+
+Error:
+   if (mp->sf)
+      tsf_close(mp->sf);
+   if (mp->spl)
+      destroy_sample(mp->spl);
+   free(mp);
+   return NULL;
+}
+
+
+/* midi_player_destroy:
+ *  Stops the player and frees every resource it was using.
+ */
+void midi_player_destroy(MIDI_PLAYER *mp)
+{
+   int i;
+
+   if (!mp)
+      return;
+
+   for (i = 0; i < MIDI_MAX_PLAYERS; i++)
+   {
+      if (_players[i] == mp)
+         _players[i] = NULL;
+   }
+
+   if (mp == _default_player)
+      _default_player = NULL;
 
-   /* Has the engine been initiated and
-    * the midi buffer is valid? */
-   if (_mvoice < 0 || !midi)
+   deallocate_voice(mp->voice);
+   destroy_sample(mp->spl);
+   tsf_close(mp->sf);
+   if (mp->tml)
+      tml_free(mp->tml);
+   free(mp);
+}
+
+
+/* midi_player_play:
+ *  Loads a midi file from buffer and starts playing it on the
+ * passed player. If the player or the buffer is null it does
+ * nothing. Returns TRUE if successful or zero (FALSE) otherwise.
+ * Doesn't behave exactly like the allegro version.
+ */
+int midi_player_play(MIDI_PLAYER *mp, void *midi, int loop)
+{
+   /* Is the player and the midi buffer valid? */
+   if (!mp || !midi)
       return FALSE;
 
    /* release tml if a previous midi was on memory */
-   if (_tml)
-      tml_free(_tml);
+   if (mp->tml)
+      tml_free(mp->tml);
+   mp->tml = mp->next = NULL;
 
    /* Stop all playing notes immediatly and reset all channel 
     * parameters. Initialize preset on special 10th MIDI channel 
     * to use percussion sound bank (128) if available */
-   tsf_reset(_tinySF);
-   tsf_channel_set_bank_preset(_tinySF, 9, 128, 0);
+   tsf_reset(mp->sf);
+   tsf_channel_set_bank_preset(mp->sf, 9, 128, 0);
 
    /* Normally we need to pass the buffer size but in this case we 
     * cheat since we don't have this value at this point 
     * and it is not really used */
-   _tml = tml_load_memory(midi, MAX_MIDI_SIZE);
-   if (!_tml)
+   mp->tml = tml_load_memory(midi, MAX_MIDI_SIZE);
+   if (!mp->tml)
       return FALSE;
 
    /* Set up the midi message pointer to the first MIDI message */
-   _tmlNext = _tml;
+   mp->next = mp->tml;
 
-   _mtime = 0.0f;
-   _loop = loop;
-   _loop_start = -1;
-   _loop_end = -1;
-   _playing = TRUE;
+   mp->frame = 0;
+   mp->loop = loop;
+   mp->loop_start = -1;
+   mp->loop_end = -1;
+   mp->playing = TRUE;
 
    return TRUE;
 }
 
 
-/* midi_stop:
+/* midi_player_stop:
  *  Stop midi music from being played and reset playing
  * control variables.
  */
-void midi_stop(void)
+void midi_player_stop(MIDI_PLAYER *mp)
 {
-   if (_mtime < 0.0f)
+   if (!mp || mp->frame < 0)
       return;
 
-   _mtime = -1.0f;
-   _loop = FALSE;
-   _playing = FALSE;
-   _tmlNext = NULL;
+   mp->frame = -1;
+   mp->loop = FALSE;
+   mp->playing = FALSE;
+   mp->next = NULL;
 }
 
 
@@ -281,195 +408,761 @@ void midi_stop(void)
  *  Process the current midi msg depending its type. If apply_note is false
  * it skips the notes processing. Useful for the Fast Forward functionality.
  */
-static void process_midi_msg(int apply_note)
+static void process_midi_msg(MIDI_PLAYER *mp, int apply_note)
 {
-   switch (_tmlNext->type)
+   tml_message *msg = mp->next;
+
+   switch (msg->type)
    {
       case TML_PROGRAM_CHANGE: /* channel program (preset) change (special 
                                 * handling for 10th MIDI channel with 
                                 * drums) */
-         tsf_channel_set_presetnumber(_tinySF, _tmlNext->channel, 
-                                      _tmlNext->program, 
-                                      (_tmlNext->channel == 9));
+         tsf_channel_set_presetnumber(mp->sf, msg->channel, msg->program,
+                                      (msg->channel == 9));
          break;
       case TML_NOTE_ON: /* play a note, skip on FF */
          if (apply_note)
-            tsf_channel_note_on(_tinySF, _tmlNext->channel, _tmlNext->key, 
-                                _tmlNext->velocity / 127.0f);
+            tsf_channel_note_on(mp->sf, msg->channel, msg->key,
+                                msg->velocity / 127.0f);
          break;
       case TML_NOTE_OFF: /* stop a note, skip on FF */
          if (apply_note)
-            tsf_channel_note_off(_tinySF, _tmlNext->channel, _tmlNext->key);
+            tsf_channel_note_off(mp->sf, msg->channel, msg->key);
          break;
       case TML_PITCH_BEND: /* pitch wheel modification */
-         tsf_channel_set_pitchwheel(_tinySF, _tmlNext->channel,
-                                    _tmlNext->pitch_bend);
+         tsf_channel_set_pitchwheel(mp->sf, msg->channel, msg->pitch_bend);
          break;
       case TML_CONTROL_CHANGE: /* MIDI controller messages */
-         tsf_channel_midi_control(_tinySF, _tmlNext->channel,
-                                  _tmlNext->control, _tmlNext->control_value);
+         tsf_channel_midi_control(mp->sf, msg->channel, msg->control,
+                                  msg->control_value);
          break;
    }
 }
 
 
-/* midi_fastforward:
+/* msg_frame:
+ *  Returns the frame, at the engine sample rate, a midi message is due.
+ */
+static inline int64_t msg_frame(const tml_message *msg)
+{
+   return (int64_t)msg->time * _rate / 1000;
+}
+
+
+/* midi_player_fastforward:
  *  Process the midi messages accordingly up to the target beat position.
  * It skips notes messages to avoid any sound being applied. If -1 or 0 is
  * provided as target or no midi is currently playing, no work will be done.
  */
-void midi_fastforward(int target)
+void midi_player_fastforward(MIDI_PLAYER *mp, int target)
 {
-   if (_mtime < 0.0f)
+   if (!mp || mp->frame < 0)
       return;
 
    /* Loop through all MIDI messages in the list until the target 
     * beat number is reached */
-   for (; _tmlNext && _tmlNext->beat_no < target; _tmlNext = _tmlNext->next, 
-                                                _mtime = _tmlNext->time)
-      process_midi_msg(FALSE);
+   for (; mp->next && mp->next->beat_no < target; mp->next = mp->next->next)
+      process_midi_msg(mp, FALSE);
+
+   if (mp->next)
+      mp->frame = msg_frame(mp->next);
 }
 
 
 /* midi_render:
  *  Process the midi messages accordingly to the requested frameCount
  * and generated the audio into the provided buffer.
+ * Render blocks are split at the exact frame each message is due, so
+ * notes start sample-accurately instead of being quantized to the
+ * TSF_RENDER_EFFECTSAMPLEBLOCK size.
  * If we reach the end of the song or the defined loop end, finish
  * the processing.
  */
-static void midi_render(short *buf, int frameCount)
+static void midi_render(MIDI_PLAYER *mp, short *buf, int frameCount)
 {
    int sampleBlock;
+   int64_t due;
 
-   for (sampleBlock = TSF_RENDER_EFFECTSAMPLEBLOCK; frameCount; 
-        frameCount -= sampleBlock, buf += (sampleBlock * AUDIO_CHANNELS))
+   while (frameCount > 0)
    {
-      if (sampleBlock > frameCount) sampleBlock = frameCount;
-
-      /* Loop through all MIDI messages which need to be played up 
-       * until the current playback time */
-      for (_mtime += sampleBlock * (1000.0 / _rate);
-           _tmlNext && _mtime >= _tmlNext->time;
-           _tmlNext = _tmlNext->next)
+      /* Loop through all MIDI messages which need to be played 
+       * at the current playback time */
+      for (; mp->next && mp->frame >= msg_frame(mp->next);
+           mp->next = mp->next->next)
       {
          /* stop processing if loop end is reached */
-         if (_tmlNext->beat_no == _loop_end)
+         if (mp->next->beat_no == mp->loop_end)
          {
-            _tmlNext = NULL; /* set to null to mark it as finished */
+            mp->next = NULL; /* set to null to mark it as finished */
             break;
          }
 
-         process_midi_msg(TRUE);
+         process_midi_msg(mp, TRUE);
+      }
+
+      sampleBlock = MIN(frameCount, TSF_RENDER_EFFECTSAMPLEBLOCK);
+
+      /* End the block right where the next message is due */
+      if (mp->next)
+      {
+         due = msg_frame(mp->next) - mp->frame;
+         if (due < sampleBlock) sampleBlock = (int)due;
       }
 
       /* Render the block of audio samples in short format */
-      tsf_render_short(_tinySF, buf, sampleBlock, 0);
+      tsf_render_short(mp->sf, buf, sampleBlock, 0);
+
+      mp->frame += sampleBlock;
+      frameCount -= sampleBlock;
+      buf += sampleBlock * AUDIO_CHANNELS;
    }
 }
 
 
-/* midi_fill_buffer:
- *  If a midi is set for playing, it will call the
+/* midi_player_fill_buffer:
+ *  If a midi is set for playing on the player, it will call the
  * midi sequencer and fill the buffer with the data
  * ready for the audio mixer. If the midi is set for
  * looping it will rewind and continue playing. Otherwise
  * it will stop playing automatically.
  */
-void midi_fill_buffer(void)
+static void midi_player_fill_buffer(MIDI_PLAYER *mp)
 {
    int i;
    short *buf;
 
-   if (!_playing)
+   if (!mp->playing)
       return;
 
    /* reloop the song if needed */
-   if (!_tmlNext)
+   if (!mp->next)
    {
-      if (_loop)
+      if (mp->loop)
       {
-         _mtime = 0.0f;
-         _tmlNext = _tml; /* point again to the start message  */
+         mp->frame = 0;
+         mp->next = mp->tml; /* point again to the start message  */
 
          /* fast forward the song if loop start was set */
-         if (_loop_start > 0)
+         if (mp->loop_start > 0)
          {
-            tsf_note_off_all(_tinySF);
-            midi_fastforward(_loop_start);
+            tsf_note_off_all(mp->sf);
+            midi_player_fastforward(mp, mp->loop_start);
          }
       }
       else
       {
-         midi_stop();
+         midi_player_stop(mp);
          return;
       }
    }
 
-   buf = (short *)_midiSpl->data;
-   midi_render(buf, _sample_size);
+   buf = (short *)mp->spl->data;
+   midi_render(mp, buf, _sample_size);
 
    /* Convert to unsigned as required by the mixer */
    for (i = 0; i < _sample_size * AUDIO_CHANNELS; i++)
       buf[i] ^= 0x8000;
 
    /* queue the samples into the mixer */
-   voice_start(_mvoice);
+   voice_start(mp->voice);
 }
 
 
-/* midi_pause:
+/* midi_fill_buffer:
+ *  Fills the mixer buffers of every midi player that is
+ * currently playing.
+ */
+void midi_fill_buffer(void)
+{
+   int i;
+
+   for (i = 0; i < MIDI_MAX_PLAYERS; i++)
+   {
+      if (_players[i])
+         midi_player_fill_buffer(_players[i]);
+   }
+}
+
+
+/* midi_data_size:
+ *  Walks the chunks of a standard MIDI file buffer (as returned by
+ * read_midi()) and returns its size in bytes.
+ */
+static long midi_data_size(const void *midi)
+{
+   const unsigned char *p = (const unsigned char *)midi;
+   long size;
+   int tracks;
+
+   size = 8 + ((p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7]);
+   tracks = (p[10] << 8) | p[11];
+
+   while (tracks--)
+   {
+      p = (const unsigned char *)midi + size;
+      size += TRACK_HDR_SIZE + ((p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7]);
+   }
+
+   return size;
+}
+
+
+/* midi_hash:
+ *  FNV-1a hash of the midi data together with the render length,
+ * used as the key of the pre-render cache.
+ */
+static uint64_t midi_hash(const void *midi, int max_frames)
+{
+   const unsigned char *p = (const unsigned char *)midi;
+   long i, size = midi_data_size(midi);
+   uint64_t h = 0xCBF29CE484222325ULL;
+
+   for (i = 0; i < size; i++)
+      h = (h ^ p[i]) * 0x100000001B3ULL;
+
+   for (i = 0; i < (long)sizeof(max_frames); i++)
+      h = (h ^ ((max_frames >> (i * 8)) & 0xFF)) * 0x100000001B3ULL;
+
+   return h;
+}
+
+
+/* cache_lookup:
+ *  Returns a new reference to a cached pre-render or NULL.
+ */
+static SAMPLE *cache_lookup(uint64_t hash)
+{
+   int i;
+
+   for (i = 0; i < MIDI_CACHE_SIZE; i++)
+   {
+      if (_cache[i].spl && !_cache[i].orphan && _cache[i].hash == hash)
+      {
+         _cache[i].refs++;
+         _cache[i].used = ++_cache_stamp;
+         return _cache[i].spl;
+      }
+   }
+
+   return NULL;
+}
+
+
+/* cache_insert:
+ *  Stores a fresh pre-render in the cache, evicting the least recently
+ * used entry nobody holds. Returns FALSE if every entry is in use, in
+ * which case the sample is left uncached.
+ */
+static int cache_insert(uint64_t hash, SAMPLE *spl)
+{
+   int i, slot = -1;
+
+   for (i = 0; i < MIDI_CACHE_SIZE; i++)
+   {
+      if (!_cache[i].spl)
+      {
+         slot = i;
+         break;
+      }
+
+      if (!_cache[i].refs && (slot < 0 || _cache[i].used < _cache[slot].used))
+         slot = i;
+   }
+
+   if (slot < 0)
+      return FALSE;
+
+   if (_cache[slot].spl)
+      destroy_sample(_cache[slot].spl);
+
+   _cache[slot].hash = hash;
+   _cache[slot].spl = spl;
+   _cache[slot].refs = 1;
+   _cache[slot].orphan = FALSE;
+   _cache[slot].used = ++_cache_stamp;
+
+   return TRUE;
+}
+
+
+/* render_job_init:
+ *  Prepares the private sequencer of a render job. Everything touching
+ * the shared SoundFont reference count is done here, on the caller
+ * thread. Returns FALSE on failure.
+ */
+static int render_job_init(MIDI_RENDER *job, void *midi, int max_frames)
+{
+   job->spl = NULL;
+   job->done = FALSE;
+   job->cached = FALSE;
+   job->max_frames = max_frames;
+
+   job->mp.spl = NULL;
+   job->mp.voice = -1;
+   job->mp.frame = 0;
+   job->mp.loop = FALSE;
+   job->mp.loop_start = -1;
+   job->mp.loop_end = -1;
+   job->mp.playing = TRUE;
+
+   job->mp.sf = tsf_copy(_tinySF);
+   if (!job->mp.sf)
+      return FALSE;
+
+   tsf_channel_set_bank_preset(job->mp.sf, 9, 128, 0);
+
+   job->mp.tml = job->mp.next = tml_load_memory(midi, MAX_MIDI_SIZE);
+   if (!job->mp.tml)
+   {
+      tsf_close(job->mp.sf);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/* render_job_run:
+ *  Runs the sequencer and the synthesizer of a render job until the
+ * song and the release tail of its notes are over, or max_frames are
+ * rendered. The output is stored as an unsigned 16 bit stereo SAMPLE
+ * ready for the mixer. Only touches data owned by the job, so it can
+ * be used from a worker thread.
+ */
+static void render_job_run(MIDI_RENDER *job)
+{
+   MIDI_PLAYER *mp = &job->mp;
+   int tail = _rate * MIDI_TAIL_SECONDS;
+   int frames = 0, block, i;
+   short *buf;
+   SAMPLE *spl;
+
+   spl = create_sample(SAMPLE_BIT_DEPTH, TRUE, _rate, job->max_frames);
+   if (!spl)
+      return;
+
+   buf = (short *)spl->data;
+
+   while (frames < job->max_frames)
+   {
+      block = MIN(_sample_size, job->max_frames - frames);
+
+      /* song over, keep rendering only while notes are releasing */
+      if (!mp->next)
+      {
+         if (!tsf_active_voice_count(mp->sf) || tail <= 0)
+            break;
+         tail -= block;
+      }
+
+      midi_render(mp, buf + frames * AUDIO_CHANNELS, block);
+      frames += block;
+   }
+
+   /* Convert to unsigned as required by the mixer */
+   for (i = 0; i < frames * AUDIO_CHANNELS; i++)
+      buf[i] ^= 0x8000;
+
+   if (frames < job->max_frames && frames > 0)
+   {
+      buf = (short *)realloc(spl->data, frames * AUDIO_CHANNELS * sizeof(short));
+      if (buf)
+         spl->data = buf;
+   }
+
+   spl->len = spl->loop_end = frames;
+   job->spl = spl;
+}
+
+
+/* render_job_thread:
+ *  Worker thread entry point for midi_render_to_sample_async().
+ */
+static void *render_job_thread(void *arg)
+{
+   MIDI_RENDER *job = (MIDI_RENDER *)arg;
+
+   render_job_run(job);
+
+   pthread_mutex_lock(&job->lock);
+   job->done = TRUE;
+   pthread_mutex_unlock(&job->lock);
+
+   return NULL;
+}
+
+
+/* render_job_collect:
+ *  Releases the job sequencer and stores its output in the cache.
+ * Must be called on the same thread that created the job.
+ */
+static SAMPLE *render_job_collect(MIDI_RENDER *job)
+{
+   SAMPLE *spl = job->spl;
+
+   tml_free(job->mp.tml);
+   tsf_close(job->mp.sf);
+
+   if (spl && (spl->len == 0))
+   {
+      destroy_sample(spl);
+      return NULL;
+   }
+
+   if (spl)
+      cache_insert(job->hash, spl);
+
+   return spl;
+}
+
+
+/* midi_render_to_sample:
+ *  Renders a midi file buffer offline into a 16 bit stereo SAMPLE
+ * at the engine sample rate, that can be played with allocate_voice().
+ * Rendering stops at the end of the song (plus the release of the
+ * last notes) or after max_seconds. Identical midis are rendered only
+ * once: the result is kept in a small cache keyed by the content of
+ * the midi. Release the sample with midi_release_sample(), never with
+ * destroy_sample(). Returns NULL on error.
+ */
+SAMPLE *midi_render_to_sample(void *midi, float max_seconds)
+{
+   MIDI_RENDER job;
+   SAMPLE *spl;
+   int max_frames;
+
+   if (!_tinySF || !midi || max_seconds <= 0.0f)
+      return NULL;
+
+   max_frames = max_seconds * _rate;
+   job.hash = midi_hash(midi, max_frames);
+
+   spl = cache_lookup(job.hash);
+   if (spl)
+      return spl;
+
+   if (!render_job_init(&job, midi, max_frames))
+      return NULL;
+
+   render_job_run(&job);
+
+   return render_job_collect(&job);
+}
+
+
+/* midi_render_to_sample_async:
+ *  Same as midi_render_to_sample() but the synthesis runs on a
+ * background thread. The midi buffer must stay valid until the job
+ * is finished with midi_render_finish(), which must be called before
+ * midi_deinit(). Returns NULL on error.
+ */
+MIDI_RENDER *midi_render_to_sample_async(void *midi, float max_seconds)
+{
+   MIDI_RENDER *job;
+   int max_frames;
+
+   if (!_tinySF || !midi || max_seconds <= 0.0f)
+      return NULL;
+
+   job = (MIDI_RENDER *)malloc(sizeof(MIDI_RENDER));
+   if (!job)
+      return NULL;
+
+   max_frames = max_seconds * _rate;
+   job->hash = midi_hash(midi, max_frames);
+
+   /* Already rendered, nothing to do in background */
+   job->spl = cache_lookup(job->hash);
+   if (job->spl)
+   {
+      job->done = TRUE;
+      job->cached = TRUE;
+      return job;
+   }
+
+   if (!render_job_init(job, midi, max_frames))
+   {
+      free(job);
+      return NULL;
+   }
+
+   pthread_mutex_init(&job->lock, NULL);
+
+   if (pthread_create(&job->thread, NULL, render_job_thread, job) != 0)
+   {
+      /* no thread available, render it right away */
+      pthread_mutex_destroy(&job->lock);
+      render_job_run(job);
+      job->spl = render_job_collect(job);
+      job->done = TRUE;
+      job->cached = TRUE;
+   }
+
+   return job;
+}
+
+
+/* midi_render_isdone:
+ *  Returns TRUE if the background render has finished and
+ * midi_render_finish() will not block.
+ */
+int midi_render_isdone(MIDI_RENDER *job)
+{
+   int done;
+
+   if (!job)
+      return TRUE;
+
+   if (job->cached)
+      return TRUE;
+
+   pthread_mutex_lock(&job->lock);
+   done = job->done;
+   pthread_mutex_unlock(&job->lock);
+
+   return done;
+}
+
+
+/* midi_render_finish:
+ *  Waits for a background render to finish, frees the job and returns
+ * the rendered SAMPLE (see midi_render_to_sample()) or NULL on error.
+ */
+SAMPLE *midi_render_finish(MIDI_RENDER *job)
+{
+   SAMPLE *spl;
+
+   if (!job)
+      return NULL;
+
+   if (job->cached)
+      spl = job->spl;
+   else
+   {
+      pthread_join(job->thread, NULL);
+      pthread_mutex_destroy(&job->lock);
+      spl = render_job_collect(job);
+   }
+
+   free(job);
+
+   return spl;
+}
+
+
+/* midi_release_sample:
+ *  Releases a SAMPLE returned by the midi render functions. Cached
+ * samples are kept around for later requests until the cache needs
+ * the room or midi_clear_render_cache() is called.
+ */
+void midi_release_sample(SAMPLE *spl)
+{
+   int i;
+
+   if (!spl)
+      return;
+
+   for (i = 0; i < MIDI_CACHE_SIZE; i++)
+   {
+      if (_cache[i].spl == spl)
+      {
+         if (_cache[i].refs > 0)
+            _cache[i].refs--;
+
+         /* dropped by midi_clear_render_cache() while held */
+         if (_cache[i].orphan && !_cache[i].refs)
+         {
+            destroy_sample(spl);
+            _cache[i].spl = NULL;
+            _cache[i].orphan = FALSE;
+         }
+         return;
+      }
+   }
+
+   /* it didn't fit in the cache */
+   destroy_sample(spl);
+}
+
+
+/* midi_clear_render_cache:
+ *  Frees every pre-rendered sample in the cache nobody holds. Samples
+ * not yet released are no longer handed out and get freed by their
+ * last midi_release_sample().
+ */
+void midi_clear_render_cache(void)
+{
+   int i;
+
+   for (i = 0; i < MIDI_CACHE_SIZE; i++)
+   {
+      if (!_cache[i].spl)
+         continue;
+
+      if (_cache[i].refs)
+      {
+         _cache[i].orphan = TRUE;
+         continue;
+      }
+
+      destroy_sample(_cache[i].spl);
+      _cache[i].spl = NULL;
+   }
+}
+
+
+/* midi_player_pause:
  *  Pauses music from playing for later resuming.
- * midi. If already paused it does nothing.
+ * If already paused it does nothing.
  */
-void midi_pause(void)
+void midi_player_pause(MIDI_PLAYER *mp)
 {
-   _playing = FALSE;
+   if (mp)
+      mp->playing = FALSE;
 }
 
 
-/* midi_resume:
+/* midi_player_resume:
  *  Resumes music play after being paused.
  * Does nothing if no midi has been set for playing
- * using play_midi().
+ * using midi_player_play().
  */
-void midi_resume(void)
+void midi_player_resume(MIDI_PLAYER *mp)
 {
-   if (_mtime >= 0.0f)
-      _playing = TRUE;
+   if (mp && mp->frame >= 0)
+      mp->playing = TRUE;
 }
 
 
-/* midi_loopstart:
+/* midi_player_loopstart:
  *  Sets the loop start within the midi song.
  * -1 means the original start of the midi.
  * Does nothing if no midi has been set for playing.
  */
-void midi_loopstart(int value)
+void midi_player_loopstart(MIDI_PLAYER *mp, int value)
 {
-   if (_mtime >= 0.0f)
-      _loop_start = value;
+   if (mp && mp->frame >= 0)
+      mp->loop_start = value;
 }
 
 
-/* midi_loopend:
+/* midi_player_loopend:
  *  Sets the loop end within the midi song.
  * -1 means the original end of the midi.
  * Does nothing if no midi has been set for playing.
  */
+void midi_player_loopend(MIDI_PLAYER *mp, int value)
+{
+   if (mp && mp->frame >= 0)
+      mp->loop_end = value;
+}
+
+
+/* midi_player_isplaying:
+ *  Returns TRUE if a midi is set for playing on the player
+ * (even if it has been paused), FALSE otherwise.
+ */
+int midi_player_isplaying(MIDI_PLAYER *mp)
+{
+   return (mp && mp->frame >= 0);
+}
+
+
+/* midi_player_get_volume:
+ *  Returns the actual volume used for the player output.
+ */
+int midi_player_get_volume(MIDI_PLAYER *mp)
+{
+   if (!mp)
+      return 0;
+
+   return voice_get_volume(mp->voice);
+}
+
+
+/* midi_player_set_volume:
+ *  Sets the volume used for the player output.
+ */
+void midi_player_set_volume(MIDI_PLAYER *mp, int volume)
+{
+   if (!mp)
+      return;
+
+   volume = CLAMP(0, volume, 255);
+   voice_set_volume(mp->voice, volume);
+}
+
+
+/* midi_play:
+ *  Starts playing a midi file buffer on the default player.
+ */
+int midi_play(void *midi, int loop)
+{
+   return midi_player_play(_default_player, midi, loop);
+}
+
+
+/* midi_stop:
+ *  Stops the midi being played on the default player.
+ */
+void midi_stop(void)
+{
+   midi_player_stop(_default_player);
+}
+
+
+/* midi_fastforward:
+ *  Fast forwards the default player up to the target beat position.
+ */
+void midi_fastforward(int target)
+{
+   midi_player_fastforward(_default_player, target);
+}
+
+
+/* midi_pause:
+ *  Pauses the default player.
+ */
+void midi_pause(void)
+{
+   midi_player_pause(_default_player);
+}
+
+
+/* midi_resume:
+ *  Resumes the default player after being paused.
+ */
+void midi_resume(void)
+{
+   midi_player_resume(_default_player);
+}
+
+
+/* midi_loopstart:
+ *  Sets the loop start of the song on the default player.
+ */
+void midi_loopstart(int value)
+{
+   midi_player_loopstart(_default_player, value);
+}
+
+
+/* midi_loopend:
+ *  Sets the loop end of the song on the default player.
+ */
 void midi_loopend(int value)
 {
-   if (_mtime >= 0.0f)
-      _loop_end = value;
+   midi_player_loopend(_default_player, value);
 }
 
 
 /* midi_isplaying:
- *  Returns TRUE if a midi is set for playing (even if
- * it has been paused), FALSE otherwise.
+ *  Returns TRUE if a midi is set for playing on the default
+ * player (even if it has been paused), FALSE otherwise.
  */
 int midi_isplaying(void)
 {
-   return (_mtime >= 0.0f);
+   return midi_player_isplaying(_default_player);
 }
 
 
@@ -478,22 +1171,14 @@ int midi_isplaying(void)
  */
 int midi_get_volume(void)
 {
-   /* not initialized? */
-   if (_mvoice < 0)
-      return 0;
-
-   return voice_get_volume(_mvoice);
+   return midi_player_get_volume(_default_player);
 }
 
+
 /* midi_set_volume:
- *  Returns the actual music volume used for midi output.
+ *  Sets the music volume used for midi output.
  */
 void midi_set_volume(int volume)
 {
-   /* not initialized? */
-   if (_mvoice < 0)
-      return;
-
-   volume = CLAMP(0, volume, 255);
-   voice_set_volume(_mvoice, volume);
+   midi_player_set_volume(_default_player, volume);
 }
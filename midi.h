@@ -7,6 +7,12 @@
 extern "C" {
 #endif
 
+#define MIDI_MAX_PLAYERS   8
+
+typedef struct MIDI_PLAYER MIDI_PLAYER;
+typedef struct MIDI_RENDER MIDI_RENDER;
+
+
 void destroy_midi(void *midi);
 void *load_midi_object(PACKFILE *f, long size);
 void midi_deinit(void);
@@ -23,6 +29,24 @@ void midi_loopstart(int value);
 void midi_loopend(int value);
 void midi_stop(void);
 void *read_midi(PACKFILE *f);
+MIDI_PLAYER *midi_player_create(void);
+void midi_player_destroy(MIDI_PLAYER *mp);
+int midi_player_play(MIDI_PLAYER *mp, void *midi, int loop);
+void midi_player_stop(MIDI_PLAYER *mp);
+void midi_player_pause(MIDI_PLAYER *mp);
+void midi_player_resume(MIDI_PLAYER *mp);
+int midi_player_isplaying(MIDI_PLAYER *mp);
+void midi_player_fastforward(MIDI_PLAYER *mp, int target);
+void midi_player_loopstart(MIDI_PLAYER *mp, int value);
+void midi_player_loopend(MIDI_PLAYER *mp, int value);
+int midi_player_get_volume(MIDI_PLAYER *mp);
+void midi_player_set_volume(MIDI_PLAYER *mp, int volume);
+SAMPLE *midi_render_to_sample(void *midi, float max_seconds);
+MIDI_RENDER *midi_render_to_sample_async(void *midi, float max_seconds);
+int midi_render_isdone(MIDI_RENDER *job);
+SAMPLE *midi_render_finish(MIDI_RENDER *job);
+void midi_release_sample(SAMPLE *spl);
+void midi_clear_render_cache(void);
 
 #ifdef __cplusplus
 }
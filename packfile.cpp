@@ -5,7 +5,9 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <pthread.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include "alport.h"
 
 #ifndef O_BINARY
@@ -25,12 +27,43 @@
 
 #define OPEN_PERMS   (S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)
 
+#define PACK_MAX_THREADS   8     /* blocks packed or unpacked at the same time */
+
+
+struct PACK_BLOCK_DATA              /* for block packed files */
+{
+   int level;                       /* compression level for writing */
+   int threads;                     /* blocks worked on at the same time */
+   long next_packed;                /* header of the next block to read */
+   long next_raw;
+   unsigned char *scratch;          /* packed data of the blocks in hand */
+};
+
+typedef struct PACK_BLOCK_JOB
+{
+   const unsigned char *src;
+   long src_size;
+   unsigned char *dst;
+   long dst_size;
+   int stored;                      /* src is not packed, just copy it */
+   long result;                     /* size made, -1 on error */
+} PACK_BLOCK_JOB;
+
+typedef struct PACK_BLOCK_POOL
+{
+   pthread_mutex_t lock;
+   PACK_BLOCK_JOB *jobs;
+   int count;
+   int next;                        /* next block to be taken by a worker */
+   int level;                       /* compression level, 0 to unpack */
+} PACK_BLOCK_POOL;
+
 
 static char the_password[256] = EMPTY_STRING;
-static char pack_error = FALSE;
-int _packfile_filesize = 0;
-int _packfile_datasize = 0;
-int _packfile_type = 0;
+static thread_local char pack_error = FALSE;
+thread_local int _packfile_filesize = 0;
+thread_local int _packfile_datasize = 0;
+thread_local int _packfile_type = 0;
 
 
 /* Signature of some functions declared later in this file */
@@ -46,6 +79,7 @@ static int normal_fseek(void *_f, int offset);
 static int normal_feof(void *_f);
 static int normal_ferror(void *_f);
 static int normal_refill_buffer(PACKFILE *f);
+static long normal_read_input(PACKFILE *f, unsigned char *buf, long size);
 static int normal_flush_buffer(PACKFILE *f, int last);
 
 
@@ -281,14 +315,15 @@ static int clone_password(PACKFILE *f)
 
 
 /* create_packfile:
- *  Helper function for creating a PACKFILE structure.
+ *  Helper function for creating a PACKFILE structure. Normal packfiles get
+ *  a data buffer of bufsize bytes, allocated along with the structure.
  */
-static PACKFILE *create_packfile(int is_normal_packfile)
+static PACKFILE *create_packfile(int is_normal_packfile, long bufsize)
 {
    PACKFILE *f;
 
    if (is_normal_packfile)
-      f = (PACKFILE *)malloc(sizeof(PACKFILE));
+      f = (PACKFILE *)malloc(sizeof(PACKFILE) + bufsize);
    else
       f = (PACKFILE *)malloc(sizeof(PACKFILE) - sizeof(struct
                              _al_normal_packfile_details));
@@ -311,6 +346,8 @@ static PACKFILE *create_packfile(int is_normal_packfile)
       f->userdata = f;
       f->is_normal_packfile = TRUE;
 
+      f->normal.buf = (unsigned char *)(f + 1);
+      f->normal.buf_cap = bufsize;
       f->normal.buf_pos = f->normal.buf;
       f->normal.flags = 0;
       f->normal.buf_size = 0;
@@ -320,6 +357,7 @@ static PACKFILE *create_packfile(int is_normal_packfile)
       f->normal.parent = NULL;
       f->normal.pack_data = NULL;
       f->normal.unpack_data = NULL;
+      f->normal.block_data = NULL;
       f->normal.todo = 0;
    }
 
@@ -347,24 +385,378 @@ static void free_packfile(PACKFILE *f)
 }
 
 
+/* pack_block_worker:
+ *  Worker thread of run_block_jobs(), it keeps taking blocks from the
+ *  pool and packs or unpacks them until every one has been handed out.
+ */
+static void *pack_block_worker(void *arg)
+{
+   PACK_BLOCK_POOL *pool = (PACK_BLOCK_POOL *)arg;
+   PACK_BLOCK_JOB *job;
+   int n;
+
+   for (;;)
+   {
+      pthread_mutex_lock(&pool->lock);
+      n = pool->next++;
+      pthread_mutex_unlock(&pool->lock);
+
+      if (n >= pool->count)
+         break;
+
+      job = pool->jobs + n;
+
+      if (pool->level > 0)
+         job->result = lzss_pack_block(job->src, job->src_size, job->dst, pool->level);
+      else if (job->stored)
+      {
+         memcpy(job->dst, job->src, job->dst_size);
+         job->result = job->dst_size;
+      }
+      else
+         job->result = lzss_unpack_block(job->src, job->src_size, job->dst, job->dst_size);
+   }
+
+   return NULL;
+}
+
+
+/* run_block_jobs:
+ *  Packs (level > 0) or unpacks (level 0) count blocks, on up to threads
+ *  threads counting the calling one.
+ */
+static void run_block_jobs(PACK_BLOCK_JOB *jobs, int count, int level, int threads)
+{
+   pthread_t tid[PACK_MAX_THREADS];
+   PACK_BLOCK_POOL pool;
+   int i, started;
+
+   pool.jobs = jobs;
+   pool.count = count;
+   pool.next = 0;
+   pool.level = level;
+   pthread_mutex_init(&pool.lock, NULL);
+
+   threads = CLAMP(1, threads, count);
+
+   for (started = 0; started < threads - 1; started++)
+   {
+      if (pthread_create(&tid[started], NULL, pack_block_worker, &pool) != 0)
+         break;
+   }
+
+   pack_block_worker(&pool);
+
+   for (i = 0; i < started; i++)
+      pthread_join(tid[i], NULL);
+
+   pthread_mutex_destroy(&pool.lock);
+}
+
+
+/* create_block_data:
+ *  Creates the PACK_BLOCK_DATA of a block packed file, along with a
+ *  buffer for as many blocks as there are CPUs to work on them, and makes
+ *  that the file buffer. Returns FALSE if out of memory.
+ */
+static int create_block_data(PACKFILE *f, int level)
+{
+   PACK_BLOCK_DATA *bd;
+   long threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+   threads = CLAMP(1, threads, PACK_MAX_THREADS);
+
+   /* one spare byte, so the buffer is flushed with whole blocks in it */
+   bd = (PACK_BLOCK_DATA *)malloc(sizeof(PACK_BLOCK_DATA) + threads * F_BLOCK_SIZE + 1);
+   if (!bd)
+   {
+      pack_error = TRUE;
+      return FALSE;
+   }
+
+   bd->level = (level > 0) ? level : LZSS_DEFAULT_LEVEL;
+   bd->threads = threads;
+   bd->next_packed = 0;
+   bd->next_raw = 0;
+   bd->scratch = NULL;
+
+   f->normal.block_data = bd;
+   f->normal.buf = (unsigned char *)(bd + 1);
+   f->normal.buf_cap = threads * F_BLOCK_SIZE + 1;
+   f->normal.buf_pos = f->normal.buf;
+   f->normal.buf_size = 0;
+
+   return TRUE;
+}
+
+
+/* free_block_data:
+ *  Frees the PACK_BLOCK_DATA of a block packed file.
+ */
+static void free_block_data(PACKFILE *f)
+{
+   if (f->normal.block_data)
+   {
+      free(f->normal.block_data->scratch);
+      free(f->normal.block_data);
+      f->normal.block_data = NULL;
+   }
+}
+
+
+/* block_scratch:
+ *  Returns the scratch memory for the packed data of the blocks in hand,
+ *  or NULL if out of memory.
+ */
+static unsigned char *block_scratch(PACK_BLOCK_DATA *bd)
+{
+   if (!bd->scratch)
+      bd->scratch = (unsigned char *)malloc(bd->threads * LZSS_PACK_BOUND(F_BLOCK_SIZE));
+
+   return bd->scratch;
+}
+
+
+/* pack_next_block:
+ *  Reads the header of the next block of a block packed file. Each one
+ *  holds the packed size of the block, negative if it is stored as it is,
+ *  and the unpacked size, 0 after the last block. Returns -1 if the
+ *  header makes no sense.
+ */
+static int pack_next_block(PACKFILE *f)
+{
+   PACK_BLOCK_DATA *bd = f->normal.block_data;
+   int packed, raw;
+
+   packed = pack_mgetl(f->normal.parent);
+   raw = pack_mgetl(f->normal.parent);
+
+   if ((pack_feof(f->normal.parent)) && (raw != 0))
+      raw = -1;
+
+   if ((raw < 0) || (raw > F_BLOCK_SIZE) ||
+       ((packed < 0) && (-packed != raw)) ||
+       (packed > LZSS_PACK_BOUND(F_BLOCK_SIZE)) || ((packed == 0) != (raw == 0)))
+   {
+      bd->next_packed = 0;
+      bd->next_raw = 0;
+      return -1;
+   }
+
+   bd->next_packed = packed;
+   bd->next_raw = raw;
+   return 0;
+}
+
+
+/* normal_read_blocks:
+ *  Unpacks as many whole blocks of a block packed file as fit in size
+ *  bytes into buf, several at a time if there are CPUs to spare. Packed
+ *  data of a mapped file is unpacked from where it is. Returns the number
+ *  of bytes unpacked, or -1 on error.
+ */
+static long normal_read_blocks(PACKFILE *f, unsigned char *buf, long size)
+{
+   PACK_BLOCK_DATA *bd = f->normal.block_data;
+   PACK_BLOCK_JOB jobs[PACK_MAX_THREADS];
+   const unsigned char *src;
+   long done = 0, used = 0, packed;
+   int count = 0, i;
+
+   while ((count < bd->threads) && (bd->next_raw > 0) && (bd->next_raw <= size - done))
+   {
+      packed = (bd->next_packed < 0) ? -bd->next_packed : bd->next_packed;
+
+      src = (const unsigned char *)pack_fview(packed, f->normal.parent);
+      if (!src)
+      {
+         if (!block_scratch(bd))
+            return -1;
+
+         if (pack_fread(bd->scratch + used, packed, f->normal.parent) < packed)
+            return -1;
+
+         src = bd->scratch + used;
+         used += packed;
+      }
+
+      jobs[count].src = src;
+      jobs[count].src_size = packed;
+      jobs[count].dst = buf + done;
+      jobs[count].dst_size = bd->next_raw;
+      jobs[count].stored = (bd->next_packed < 0);
+      done += bd->next_raw;
+      count++;
+
+      if (pack_next_block(f))
+         return -1;
+   }
+
+   if (count > 0)
+      run_block_jobs(jobs, count, 0, bd->threads);
+
+   for (i = 0; i < count; i++)
+   {
+      if (jobs[i].result != jobs[i].dst_size)
+         return -1;
+   }
+
+   return done;
+}
+
+
+/* normal_flush_blocks:
+ *  Packs the buffer of a block packed file, a block per CPU at the same
+ *  time, and writes the blocks out. Blocks that don't get any smaller
+ *  are stored as they are. The last flush ends the file with an empty
+ *  block.
+ */
+static int normal_flush_blocks(PACKFILE *f, int last)
+{
+   PACK_BLOCK_DATA *bd = f->normal.block_data;
+   PACK_BLOCK_JOB jobs[PACK_MAX_THREADS];
+   PACKFILE *parent = f->normal.parent;
+   long pos;
+   int count = 0, i;
+
+   if (f->normal.buf_size > 0)
+   {
+      if (!block_scratch(bd))
+         goto Error;
+
+      for (pos = 0; pos < f->normal.buf_size; pos += F_BLOCK_SIZE, count++)
+      {
+         jobs[count].src = f->normal.buf + pos;
+         jobs[count].src_size = MIN(F_BLOCK_SIZE, f->normal.buf_size - pos);
+         jobs[count].dst = bd->scratch + count * LZSS_PACK_BOUND(F_BLOCK_SIZE);
+         jobs[count].dst_size = LZSS_PACK_BOUND(F_BLOCK_SIZE);
+         jobs[count].stored = FALSE;
+      }
+
+      run_block_jobs(jobs, count, bd->level, bd->threads);
+
+      for (i = 0; i < count; i++)
+      {
+         if (jobs[i].result < 0)
+            goto Error;
+
+         if (jobs[i].result < jobs[i].src_size)
+         {
+            pack_mputl(jobs[i].result, parent);
+            pack_mputl(jobs[i].src_size, parent);
+            pack_fwrite(jobs[i].dst, jobs[i].result, parent);
+         }
+         else
+         {
+            pack_mputl(-jobs[i].src_size, parent);
+            pack_mputl(jobs[i].src_size, parent);
+            pack_fwrite(jobs[i].src, jobs[i].src_size, parent);
+         }
+      }
+
+      f->normal.todo += f->normal.buf_size;
+   }
+
+   if (last)
+   {
+      pack_mputl(0, parent);
+      pack_mputl(0, parent);
+   }
+
+   if (pack_ferror(parent))
+      goto Error;
+
+   f->normal.buf_pos = f->normal.buf;
+   f->normal.buf_size = 0;
+   return 0;
+
+Error:
+   pack_error = TRUE;
+   f->normal.flags |= PACKFILE_FLAG_ERROR;
+   return EOF;
+}
+
+
+/* pack_buffer_size:
+ *  Works out how big a buffer to give a file opened on fd with the given
+ *  mode, when the caller asked for bufsize bytes (0 for the default). Plain
+ *  files opened for reading never get more than they hold, so opening lots
+ *  of small files stays cheap.
+ */
+static long pack_buffer_size(int fd, const char *mode, long bufsize)
+{
+   struct stat st;
+
+   if (bufsize <= 0)
+      bufsize = F_BUF_SIZE;
+
+   bufsize = MAX(bufsize, F_MIN_BUF_SIZE);
+
+   if ((!strpbrk(mode, "wWpP")) && (fstat(fd, &st) == 0) && (S_ISREG(st.st_mode)))
+   {
+      /* files that don't fit are mapped instead, see pack_map_file(), the
+       * buffer is only used if that fails
+       */
+      if ((st.st_size > bufsize) && (!the_password[0]))
+         return F_MIN_BUF_SIZE;
+
+      bufsize = CLAMP(F_MIN_BUF_SIZE, (long)st.st_size, bufsize);
+   }
+
+   return MIN(bufsize, INT_MAX);
+}
+
+
+/* pack_map_file:
+ *  Maps the rest of a plain, unencrypted file opened for reading and makes
+ *  the mapping its buffer, so reading and seeking become pointer arithmetic.
+ *  Leaves the file alone if it can't be mapped.
+ */
+static void pack_map_file(PACKFILE *f)
+{
+   void *map;
+
+   if ((f->normal.passpos) || (f->normal.todo <= f->normal.buf_cap) ||
+       (f->normal.todo > INT_MAX))
+      return;
+
+   /* pages are read in as they are touched, many opens only look at a
+    * small part of the file
+    */
+   map = mmap(NULL, f->normal.todo, PROT_READ, MAP_PRIVATE, f->normal.hndl, 0);
+   if (map == MAP_FAILED)
+      return;
+
+   f->normal.buf = (unsigned char *)map;
+   f->normal.buf_cap = f->normal.todo;
+   f->normal.buf_pos = f->normal.buf;
+   f->normal.buf_size = f->normal.todo;
+   f->normal.todo = 0;
+   f->normal.flags |= PACKFILE_FLAG_MAPPED;
+}
+
+
 /* _pack_fdopen:
  *  Converts the given file descriptor into a PACKFILE. The mode can have
  *  the same values as for pack_fopen() and must be compatible with the
- *  mode of the file descriptor. Unlike the libc fdopen(), pack_fdopen()
+ *  mode of the file descriptor. bufsize is the size of the data buffer,
+ *  see pack_fopen_ex(). Unlike the libc fdopen(), pack_fdopen()
  *  is unable to convert an already partially read or written file (i.e.
  *  the file offset must be 0).
  *  On success, it returns a pointer to a file structure, and on error it
  *  returns NULL and stores an error code in errno. An attempt to read
  *  a normal file in packed mode will cause errno to be set to TRUE.
  */
-PACKFILE *_pack_fdopen(int fd, const char *mode)
+PACKFILE *_pack_fdopen(int fd, const char *mode, long bufsize)
 {
    PACKFILE *f, *f2;
    long header = FALSE;
+   int blocks = FALSE;
+   int level = 0;
+   int flags = 0;
    int c;
 
-   if ((f = create_packfile(TRUE)) == NULL)
-      return NULL;
+   bufsize = pack_buffer_size(fd, mode, bufsize);
 
    while ((c = *(mode++)) != 0)
    {
@@ -372,26 +764,64 @@ PACKFILE *_pack_fdopen(int fd, const char *mode)
       {
          case 'r':
          case 'R':
-            f->normal.flags &= ~PACKFILE_FLAG_WRITE;
+            flags &= ~PACKFILE_FLAG_WRITE;
             break;
          case 'w':
          case 'W':
-            f->normal.flags |= PACKFILE_FLAG_WRITE;
+            flags |= PACKFILE_FLAG_WRITE;
             break;
          case 'p':
          case 'P':
-            f->normal.flags |= PACKFILE_FLAG_PACK;
+            flags |= PACKFILE_FLAG_PACK;
             break;
          case '!':
-            f->normal.flags &= ~PACKFILE_FLAG_PACK;
+            flags &= ~PACKFILE_FLAG_PACK;
             header = TRUE;
             break;
+         case '#':
+            blocks = TRUE;
+            break;
+         case '1': case '2': case '3': case '4': case '5':
+         case '6': case '7': case '8': case '9':
+            level = c - '0';
+            break;
       }
    }
 
+   /* block packed files buffer in their PACK_BLOCK_DATA, see create_block_data() */
+   blocks = ((flags & PACKFILE_FLAG_WRITE) && (flags & PACKFILE_FLAG_PACK) && (blocks));
+
+   if ((f = create_packfile(TRUE, (blocks) ? 0 : bufsize)) == NULL)
+      return NULL;
+
+   f->normal.flags = flags;
+
    if (f->normal.flags & PACKFILE_FLAG_WRITE)
    {
-      if (f->normal.flags & PACKFILE_FLAG_PACK)
+      if ((f->normal.flags & PACKFILE_FLAG_PACK) && (blocks))
+      {
+         /* write a block packed file */
+         if (!create_block_data(f, level))
+         {
+            free_packfile(f);
+            return NULL;
+         }
+
+         f->normal.flags &= ~PACKFILE_FLAG_PACK;
+         f->normal.flags |= PACKFILE_FLAG_BLOCKS;
+
+         if ((f->normal.parent = _pack_fdopen(fd, F_WRITE, bufsize)) == NULL)
+         {
+            free_block_data(f);
+            free_packfile(f);
+            return NULL;
+         }
+
+         pack_mputl(encrypt_id(F_BLOCK_MAGIC, TRUE), f->normal.parent);
+
+         f->normal.todo = 4;
+      }
+      else if (f->normal.flags & PACKFILE_FLAG_PACK)
       {
          /* write a packed file */
          f->normal.pack_data = create_lzss_pack_data();
@@ -402,7 +832,10 @@ PACKFILE *_pack_fdopen(int fd, const char *mode)
             return NULL;
          }
 
-         if ((f->normal.parent = _pack_fdopen(fd, F_WRITE)) == NULL)
+         if (level)
+            lzss_set_level(f->normal.pack_data, level);
+
+         if ((f->normal.parent = _pack_fdopen(fd, F_WRITE, bufsize)) == NULL)
          {
             free_lzss_pack_data(f->normal.pack_data);
             f->normal.pack_data = NULL;
@@ -445,7 +878,7 @@ PACKFILE *_pack_fdopen(int fd, const char *mode)
             return NULL;
          }
 
-         if ((f->normal.parent = _pack_fdopen(fd, F_READ)) == NULL)
+         if ((f->normal.parent = _pack_fdopen(fd, F_READ, bufsize)) == NULL)
          {
             free_lzss_unpack_data(f->normal.unpack_data);
             f->normal.unpack_data = NULL;
@@ -485,7 +918,7 @@ PACKFILE *_pack_fdopen(int fd, const char *mode)
             /* re-open the parent file */
             lseek(fd2, 0, SEEK_SET);
 
-            if ((f->normal.parent = _pack_fdopen(fd2, F_READ)) == NULL)
+            if ((f->normal.parent = _pack_fdopen(fd2, F_READ, bufsize)) == NULL)
             {
                free_packfile(f);
                return NULL;
@@ -503,6 +936,39 @@ PACKFILE *_pack_fdopen(int fd, const char *mode)
 
          if (header == encrypt_id(F_PACK_MAGIC, TRUE))
             f->normal.todo = LONG_MAX;
+         else if (header == encrypt_id(F_BLOCK_MAGIC, TRUE))
+         {
+            /* read a block packed file */
+            free_lzss_unpack_data(f->normal.unpack_data);
+            f->normal.unpack_data = NULL;
+
+            /* the block buffer replaces the inline one, so give that back */
+            if ((f2 = (PACKFILE *)realloc(f, sizeof(PACKFILE))) != NULL)
+            {
+               f = f2;
+               f->userdata = f;
+            }
+
+            if (!create_block_data(f, 0))
+            {
+               pack_fclose(f->normal.parent);
+               free_packfile(f);
+               return NULL;
+            }
+
+            f->normal.flags &= ~PACKFILE_FLAG_PACK;
+            f->normal.flags |= PACKFILE_FLAG_BLOCKS;
+            f->normal.todo = LONG_MAX;
+
+            if (pack_next_block(f))
+            {
+               pack_fclose(f->normal.parent);
+               free_block_data(f);
+               free_packfile(f);
+               pack_error = TRUE;
+               return NULL;
+            }
+         }
          else if (header == encrypt_id(F_NOPACK_MAGIC, TRUE))
          {
             f2 = f->normal.parent;
@@ -540,7 +1006,13 @@ PACKFILE *_pack_fdopen(int fd, const char *mode)
             return NULL;
          }
 
+#ifdef POSIX_FADV_SEQUENTIAL
+         /* we only ever read forward, so let the kernel read ahead */
+         posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
          f->normal.hndl = fd;
+         pack_map_file(f);
       }
    }
 
@@ -560,6 +1032,9 @@ PACKFILE *_pack_fdopen(int fd, const char *mode)
  *       F_NOPACK_MAGIC to the start of the file, so that it can be opened
  *       in packed mode and Allegro will automatically detect that the
  *       data does not need to be decompressed.
+ *  '1' to '9': compression level for 'p' when writing, from fastest to
+ *       smallest (default LZSS_DEFAULT_LEVEL). Every level can be read back
+ *       the same way.
  *
  *  Instead of these flags, one of the constants F_READ, F_WRITE,
  *  F_READ_PACKED, F_WRITE_PACKED or F_WRITE_NOPACK may be used as the second
@@ -570,6 +1045,18 @@ PACKFILE *_pack_fdopen(int fd, const char *mode)
  *  normal file in packed mode will cause errno to be set to TRUE.
  */
 PACKFILE *pack_fopen(const char *filename, const char *mode)
+{
+   return pack_fopen_ex(filename, mode, 0);
+}
+
+
+/* pack_fopen_ex:
+ *  Like pack_fopen(), but lets the caller pick how many bytes the file
+ *  buffers between reads from or writes to the disk. Pass 0 for the
+ *  default of F_BUF_SIZE. Files opened for reading are never given a
+ *  bigger buffer than their size.
+ */
+PACKFILE *pack_fopen_ex(const char *filename, const char *mode, long bufsize)
 {
    int fd;
 
@@ -593,7 +1080,38 @@ PACKFILE *pack_fopen(const char *filename, const char *mode)
       return NULL;
    }
 
-   return _pack_fdopen(fd, mode);
+   return _pack_fdopen(fd, mode, bufsize);
+}
+
+
+/* pack_fopen_memory:
+ *  Opens size bytes of memory for reading, as if it was an uncompressed
+ *  file. The memory is used in place rather than copied, so it must stay
+ *  valid until the file is closed. Files opened this way share no state,
+ *  so they can be read by different threads at the same time.
+ */
+PACKFILE *pack_fopen_memory(const void *data, long size)
+{
+   PACKFILE *f;
+
+   if ((size < 0) || (size > INT_MAX))
+   {
+      pack_error = EINVAL;
+      return NULL;
+   }
+
+   if ((f = create_packfile(TRUE, 0)) == NULL)
+      return NULL;
+
+   /* mapped files are never written through their buffer */
+   f->normal.flags = PACKFILE_FLAG_MAPPED | PACKFILE_FLAG_MEMORY;
+   f->normal.hndl = -1;
+   f->normal.buf = (unsigned char *)data;
+   f->normal.buf_cap = size;
+   f->normal.buf_pos = f->normal.buf;
+   f->normal.buf_size = size;
+
+   return f;
 }
 
 
@@ -688,7 +1206,8 @@ PACKFILE *pack_fopen_chunk(PACKFILE *f, int pack)
          return NULL;
       }
 
-      chunk = _pack_fdopen(tmp_fd, (pack ? F_WRITE_PACKED : F_WRITE_NOPACK));
+      chunk = _pack_fdopen(tmp_fd, (pack ? F_WRITE_PACKED : F_WRITE_NOPACK),
+                           f->normal.buf_cap);
 
       if (chunk)
       {
@@ -711,7 +1230,28 @@ PACKFILE *pack_fopen_chunk(PACKFILE *f, int pack)
       _packfile_filesize = pack_mgetl(f);
       _packfile_datasize = pack_mgetl(f);
 
-      if ((chunk = create_packfile(TRUE)) == NULL)
+      if ((f->normal.flags & PACKFILE_FLAG_MAPPED) && (_packfile_datasize >= 0) &&
+          (f->normal.buf_size >= _packfile_datasize))
+      {
+         /* an uncompressed chunk of a mapped file is just a view of it */
+         if ((chunk = create_packfile(TRUE, 0)) == NULL)
+            return NULL;
+
+         chunk->normal.flags = PACKFILE_FLAG_CHUNK | PACKFILE_FLAG_MAPPED;
+         chunk->normal.parent = f;
+         chunk->normal.buf = f->normal.buf_pos;
+         chunk->normal.buf_cap = _packfile_datasize;
+         chunk->normal.buf_pos = chunk->normal.buf;
+         chunk->normal.buf_size = _packfile_datasize;
+
+         pack_fseek(f, _packfile_datasize);
+
+         return chunk;
+      }
+
+      /* the chunk never needs a bigger buffer than the data it holds */
+      if ((chunk = create_packfile(TRUE, CLAMP(F_MIN_BUF_SIZE, (long)_packfile_filesize,
+                                               f->normal.buf_cap))) == NULL)
          return NULL;
 
       chunk->normal.flags = PACKFILE_FLAG_CHUNK;
@@ -822,11 +1362,11 @@ PACKFILE *pack_fclose_chunk(PACKFILE *f)
       lseek(hndl, 0, SEEK_SET);
 
       /* create a readable pack file */
-      tmp = _pack_fdopen(hndl, F_READ);
+      tmp = _pack_fdopen(hndl, F_READ, 0);
       if (!tmp)
          return NULL;
 
-      _packfile_filesize = tmp->normal.todo - 4;
+      _packfile_filesize = tmp->normal.todo + tmp->normal.buf_size - 4;
 
       header = pack_mgetl(tmp);
 
@@ -1187,6 +1727,33 @@ int pack_fputs(const char *p, PACKFILE *f)
 }
 
 
+/* pack_fview:
+ *  Returns a pointer to the next n bytes of the file and skips past them,
+ *  without copying anything. This only works for files that are memory
+ *  mapped (plain, unencrypted files opened for reading, and uncompressed
+ *  chunks within them), and the pointer stays valid until the file is
+ *  closed. Otherwise, or if fewer than n bytes are left, returns NULL and
+ *  leaves the file untouched, so the caller can pack_fread() instead.
+ */
+const void *pack_fview(long n, PACKFILE *f)
+{
+   const void *p;
+
+   if ((!f->is_normal_packfile) || (!(f->normal.flags & PACKFILE_FLAG_MAPPED)) ||
+       (n < 0) || (n > f->normal.buf_size))
+      return NULL;
+
+   p = f->normal.buf_pos;
+   f->normal.buf_pos += n;
+   f->normal.buf_size -= n;
+
+   if ((f->normal.buf_size == 0) && (f->normal.todo <= 0))
+      f->normal.flags |= PACKFILE_FLAG_EOF;
+
+   return p;
+}
+
+
 /* pack_get_userdata:
  *  Returns the userdata field of packfiles using user-defined vtables.
  */
@@ -1222,8 +1789,13 @@ static int normal_fclose(void *_f)
 
    if (f->normal.parent)
       ret = pack_fclose(f->normal.parent);
+   else if (f->normal.flags & PACKFILE_FLAG_MEMORY)
+      ret = 0;                      /* the memory is the caller's */
    else
    {
+      if (f->normal.flags & PACKFILE_FLAG_MAPPED)
+         munmap(f->normal.buf, f->normal.buf_cap);
+
       ret = close(f->normal.hndl);
       if (ret != 0)
          pack_error = errno;
@@ -1241,6 +1813,8 @@ static int normal_fclose(void *_f)
       f->normal.unpack_data = NULL;
    }
 
+   free_block_data(f);
+
    if (f->normal.passdata)
    {
       free(f->normal.passdata);
@@ -1298,6 +1872,17 @@ static int normal_ungetc(int c, void *_f)
 
    if (f->normal.buf_pos == f->normal.buf)
       return EOF;
+   else if (f->normal.flags & PACKFILE_FLAG_MAPPED)
+   {
+      /* the mapping is read-only, so only what was just read can go back */
+      if (f->normal.buf_pos[-1] != (unsigned char)c)
+         return EOF;
+
+      f->normal.buf_pos--;
+      f->normal.buf_size++;
+      f->normal.flags &= ~PACKFILE_FLAG_EOF;
+      return (unsigned char)c;
+   }
    else
    {
       *(--f->normal.buf_pos) = (unsigned char)c;
@@ -1312,15 +1897,47 @@ static long normal_fread(void *p, long n, void *_f)
 {
    PACKFILE *f = (PACKFILE *)_f;
    unsigned char *cp = (unsigned char *)p;
-   long i;
+   long i = 0, sz;
    int c;
 
-   for (i = 0; i < n; i++)
+   while (i < n)
    {
-      if ((c = normal_getc(f)) == EOF)
-         break;
+      if (f->normal.buf_size > 0)
+      {
+         /* copy out what is left in the buffer */
+         sz = MIN(f->normal.buf_size, n - i);
+         memcpy(cp + i, f->normal.buf_pos, sz);
+         f->normal.buf_pos += sz;
+         f->normal.buf_size -= sz;
+         i += sz;
+
+         if ((f->normal.buf_size == 0) && normal_no_more_input(f))
+            f->normal.flags |= PACKFILE_FLAG_EOF;
+      }
+      else if ((n - i >= f->normal.buf_cap) && (f->normal.todo >= f->normal.buf_cap) &&
+               !(f->normal.flags & PACKFILE_FLAG_EOF))
+      {
+         /* big reads go straight into the caller memory */
+         sz = normal_read_input(f, cp + i, MIN(MIN(n - i, f->normal.todo), INT_MAX));
+         if (sz < 0)
+         {
+            pack_error = TRUE;
+            f->normal.flags |= PACKFILE_FLAG_ERROR;
+            break;
+         }
+         i += sz;
+
+         if (normal_no_more_input(f))
+            f->normal.flags |= PACKFILE_FLAG_EOF;
+      }
+      else
+      {
+         /* refill the buffer */
+         if ((c = normal_getc(f)) == EOF)
+            break;
 
-      *(cp++) = c;
+         cp[i++] = c;
+      }
    }
 
    return i;
@@ -1331,7 +1948,7 @@ static int normal_putc(int c, void *_f)
 {
    PACKFILE *f = (PACKFILE *)_f;
 
-   if (f->normal.buf_size + 1 >= F_BUF_SIZE)
+   if (f->normal.buf_size + 1 >= f->normal.buf_cap)
    {
       if (normal_flush_buffer(f, FALSE))
          return EOF;
@@ -1346,21 +1963,80 @@ static long normal_fwrite(const void *p, long n, void *_f)
 {
    PACKFILE *f = (PACKFILE *)_f;
    const unsigned char *cp = (const unsigned char *)p;
-   long i;
+   long i = 0, sz;
 
-   for (i = 0; i < n; i++)
+   while (i < n)
    {
-      if (normal_putc(*cp++, f) == EOF)
-         break;
+      /* same as normal_putc(), the buffer is flushed one byte short */
+      if (f->normal.buf_size + 1 >= f->normal.buf_cap)
+      {
+         if (normal_flush_buffer(f, FALSE))
+            break;
+      }
+
+      sz = MIN(f->normal.buf_cap - 1 - f->normal.buf_size, n - i);
+      memcpy(f->normal.buf_pos, cp + i, sz);
+      f->normal.buf_pos += sz;
+      f->normal.buf_size += sz;
+      i += sz;
    }
 
    return i;
 }
 
 
+/* skip_password:
+ *  Advances the password position of the packfile by size bytes, as
+ *  xor_password() would have done, without touching any data.
+ */
+static void skip_password(PACKFILE *f, long size)
+{
+   long len = strlen(f->normal.passdata);
+   long pos = f->normal.passpos - f->normal.passdata;
+
+   f->normal.passpos = f->normal.passdata + (pos + size % len) % len;
+}
+
+
+/* normal_skip_decoded:
+ *  Skips size bytes of a compressed or block packed file by decoding them
+ *  a buffer at a time into the file buffer, which is left holding whatever
+ *  was decoded past them. The buffer must be empty.
+ */
+static void normal_skip_decoded(PACKFILE *f, long size)
+{
+   long sz;
+
+   while ((size > 0) && (!normal_no_more_input(f)))
+   {
+      /* same request as normal_refill_buffer(), as block files need room
+       * for whole blocks
+       */
+      sz = normal_read_input(f, f->normal.buf, MIN(f->normal.buf_cap, f->normal.todo));
+      if (sz < 0)
+      {
+         pack_error = TRUE;
+         f->normal.flags |= PACKFILE_FLAG_ERROR;
+         return;
+      }
+
+      if (sz == 0)
+         break;
+
+      f->normal.buf_pos = f->normal.buf + MIN(size, sz);
+      f->normal.buf_size = sz - MIN(size, sz);
+      size -= sz - f->normal.buf_size;
+   }
+
+   if ((f->normal.buf_size <= 0) && normal_no_more_input(f))
+      f->normal.flags |= PACKFILE_FLAG_EOF;
+}
+
+
 static int normal_fseek(void *_f, int offset)
 {
    PACKFILE *f = (PACKFILE *)_f;
+   long sz;
    int i;
 
    if (f->normal.flags & PACKFILE_FLAG_WRITE)
@@ -1384,14 +2060,41 @@ static int normal_fseek(void *_f, int offset)
    {
       i = MIN(offset, f->normal.todo);
 
-      if ((f->normal.flags & PACKFILE_FLAG_PACK) || (f->normal.passpos))
+      if (f->normal.flags & PACKFILE_FLAG_PACK)
+      {
+         /* for compressed files, we just have to decode through the data,
+          * todo drops to zero while LZSS may still hold output, so it must
+          * not cut the seek short
+          */
+         normal_skip_decoded(f, offset);
+      }
+      else if (f->normal.flags & PACKFILE_FLAG_BLOCKS)
       {
-         /* for compressed or encrypted files, we just have to read through the data */
-         while (i > 0)
+         /* whole blocks are skipped without unpacking them */
+         while ((f->normal.block_data->next_raw > 0) &&
+                (f->normal.block_data->next_raw <= i))
+         {
+            sz = f->normal.block_data->next_packed;
+            pack_fseek(f->normal.parent, (sz < 0) ? -sz : sz);
+            i -= f->normal.block_data->next_raw;
+            f->normal.todo -= f->normal.block_data->next_raw;
+
+            if (pack_next_block(f))
+            {
+               pack_error = TRUE;
+               f->normal.flags |= PACKFILE_FLAG_ERROR;
+               break;
+            }
+         }
+
+         if (f->normal.block_data->next_raw == 0)
          {
-            pack_getc(f);
-            i--;
+            f->normal.todo = 0;
+            f->normal.flags |= PACKFILE_FLAG_EOF;
          }
+
+         /* and the rest is unpacked */
+         normal_skip_decoded(f, i);
       }
       else
       {
@@ -1404,6 +2107,10 @@ static int normal_fseek(void *_f, int offset)
          {
             /* do a real seek */
             lseek(f->normal.hndl, i, SEEK_CUR);
+
+            /* and move the key along as if the bytes had been read */
+            if ((f->normal.passpos) && (!(f->normal.flags & PACKFILE_FLAG_OLD_CRYPT)))
+               skip_password(f, i);
          }
          f->normal.todo -= i;
          if (normal_no_more_input(f))
@@ -1435,71 +2142,132 @@ static int normal_ferror(void *_f)
 }
 
 
-/* normal_refill_buffer:
- *  Refills the read buffer. The file must have been opened in read mode,
- *  and the buffer must be empty.
+/* xor_password:
+ *  Encrypts or decrypts size bytes of buf with the password of the
+ *  packfile, a machine word at a time, and advances the password
+ *  position accordingly.
  */
-static int normal_refill_buffer(PACKFILE *f)
+static void xor_password(PACKFILE *f, unsigned char *buf, long size)
 {
-   int i, sz, done, offset;
+   const char *key = f->normal.passdata;
+   long len = strlen(key);
+   long pos = f->normal.passpos - key;
+   unsigned char ring[sizeof(the_password) + sizeof(uint64_t)];
+   uint64_t w, k;
+   long i;
 
-   if (f->normal.flags & PACKFILE_FLAG_EOF)
-      return EOF;
+   /* the password followed by its start again, so that a word of it
+    * can be read from any position */
+   for (i = 0; i < len + (long)sizeof(uint64_t); i++)
+      ring[i] = key[i % len];
 
-   if (normal_no_more_input(f))
+   for (i = 0; i + (long)sizeof(uint64_t) <= size; i += sizeof(uint64_t))
    {
-      f->normal.flags |= PACKFILE_FLAG_EOF;
-      return EOF;
+      memcpy(&w, buf + i, sizeof(w));
+      memcpy(&k, ring + pos, sizeof(k));
+      w ^= k;
+      memcpy(buf + i, &w, sizeof(w));
+
+      pos += sizeof(uint64_t);
+      while (pos >= len)
+         pos -= len;
    }
 
-   if (f->normal.parent)
+   for (; i < size; i++)
+   {
+      buf[i] ^= key[pos];
+      if (++pos == len)
+         pos = 0;
+   }
+
+   f->normal.passpos = f->normal.passdata + pos;
+}
+
+
+/* normal_read_input:
+ *  Reads up to size bytes of input into buf, which may be the file
+ *  buffer or any other memory, and takes them off the `todo' count.
+ *  size must not be bigger than `todo'. Returns the number of bytes
+ *  read, or -1 on error.
+ */
+static long normal_read_input(PACKFILE *f, unsigned char *buf, long size)
+{
+   long sz, done;
+
+   if (f->normal.flags & PACKFILE_FLAG_BLOCKS)
+   {
+      size = normal_read_blocks(f, buf, size);
+      if (size < 0)
+         return -1;
+      if (f->normal.block_data->next_raw == 0)
+         f->normal.todo = size;     /* that was the last block */
+   }
+   else if (f->normal.parent)
    {
       if (f->normal.flags & PACKFILE_FLAG_PACK)
-         f->normal.buf_size = lzss_read(f->normal.parent, f->normal.unpack_data,
-                                        MIN(F_BUF_SIZE, f->normal.todo), f->normal.buf);
+         size = lzss_read(f->normal.parent, f->normal.unpack_data, size, buf);
       else
-         f->normal.buf_size = pack_fread(f->normal.buf, MIN(F_BUF_SIZE, f->normal.todo),
-                                         f->normal.parent);
+         size = pack_fread(buf, size, f->normal.parent);
       if (f->normal.parent->normal.flags & PACKFILE_FLAG_EOF)
          f->normal.todo = 0;
       if (f->normal.parent->normal.flags & PACKFILE_FLAG_ERROR)
-         goto Error;
+         return -1;
    }
    else
    {
-      f->normal.buf_size = MIN(F_BUF_SIZE, f->normal.todo);
-
-      offset = lseek(f->normal.hndl, 0, SEEK_CUR);
+      /* a failed or short read leaves the file offset just past the
+       * bytes that did arrive, so simply carry on from there
+       */
       done = 0;
 
-      errno = 0;
-      sz = read(f->normal.hndl, f->normal.buf, f->normal.buf_size);
-
-      while (sz + done < f->normal.buf_size)
+      while (done < size)
       {
-         if ((sz < 0) && ((errno != EINTR) && (errno != EAGAIN)))
-            goto Error;
+         errno = 0;
+         sz = read(f->normal.hndl, buf + done, size - done);
 
          if (sz > 0)
             done += sz;
-
-         lseek(f->normal.hndl, offset + done, SEEK_SET);
-         errno = 0;
-         sz = read(f->normal.hndl, f->normal.buf + done, f->normal.buf_size - done);
-      }
-
-      if ((f->normal.passpos) && (!(f->normal.flags & PACKFILE_FLAG_OLD_CRYPT)))
-      {
-         for (i = 0; i < f->normal.buf_size; i++)
+         else if (sz == 0)
          {
-            f->normal.buf[i] ^= *(f->normal.passpos++);
-            if (!*f->normal.passpos)
-               f->normal.passpos = f->normal.passdata;
+            /* the file got shorter since we opened it */
+            f->normal.todo = done;
+            size = done;
          }
+         else if ((errno != EINTR) && (errno != EAGAIN))
+            return -1;
       }
+
+      if ((f->normal.passpos) && (!(f->normal.flags & PACKFILE_FLAG_OLD_CRYPT)))
+         xor_password(f, buf, size);
    }
 
-   f->normal.todo -= f->normal.buf_size;
+   f->normal.todo -= size;
+   return size;
+}
+
+
+/* normal_refill_buffer:
+ *  Refills the read buffer. The file must have been opened in read mode,
+ *  and the buffer must be empty.
+ */
+static int normal_refill_buffer(PACKFILE *f)
+{
+   long sz;
+
+   if (f->normal.flags & PACKFILE_FLAG_EOF)
+      return EOF;
+
+   if (normal_no_more_input(f))
+   {
+      f->normal.flags |= PACKFILE_FLAG_EOF;
+      return EOF;
+   }
+
+   sz = normal_read_input(f, f->normal.buf, MIN(f->normal.buf_cap, f->normal.todo));
+   if (sz < 0)
+      goto Error;
+
+   f->normal.buf_size = sz;
    f->normal.buf_pos = f->normal.buf;
    f->normal.buf_size--;
    if (f->normal.buf_size <= 0)
@@ -1523,7 +2291,10 @@ Error:
  */
 static int normal_flush_buffer(PACKFILE *f, int last)
 {
-   int i, sz, done, offset;
+   int sz, done;
+
+   if (f->normal.flags & PACKFILE_FLAG_BLOCKS)
+      return normal_flush_blocks(f, last);
 
    if (f->normal.buf_size > 0)
    {
@@ -1536,32 +2307,19 @@ static int normal_flush_buffer(PACKFILE *f, int last)
       else
       {
          if ((f->normal.passpos) && (!(f->normal.flags & PACKFILE_FLAG_OLD_CRYPT)))
-         {
-            for (i = 0; i < f->normal.buf_size; i++)
-            {
-               f->normal.buf[i] ^= *(f->normal.passpos++);
-               if (!*f->normal.passpos)
-                  f->normal.passpos = f->normal.passdata;
-            }
-         }
+            xor_password(f, f->normal.buf, f->normal.buf_size);
 
-         offset = lseek(f->normal.hndl, 0, SEEK_CUR);
          done = 0;
 
-         errno = 0;
-         sz = write(f->normal.hndl, f->normal.buf, f->normal.buf_size);
-
-         while (sz + done < f->normal.buf_size)
+         while (done < f->normal.buf_size)
          {
-            if ((sz < 0) && ((errno != EINTR) && (errno != EAGAIN)))
-               goto Error;
+            errno = 0;
+            sz = write(f->normal.hndl, f->normal.buf + done, f->normal.buf_size - done);
 
             if (sz > 0)
                done += sz;
-
-            lseek(f->normal.hndl, offset + done, SEEK_SET);
-            errno = 0;
-            sz = write(f->normal.hndl, f->normal.buf + done, f->normal.buf_size - done);
+            else if ((sz == 0) || ((errno != EINTR) && (errno != EAGAIN)))
+               goto Error;
          }
       }
       f->normal.todo += f->normal.buf_size;
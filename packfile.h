@@ -16,11 +16,15 @@ extern "C" {
 #define F_READ_PACKED   "rp"
 #define F_WRITE_PACKED  "wp"
 #define F_WRITE_NOPACK  "w!"
+#define F_WRITE_BLOCKS  "wp#"
 
-#define F_BUF_SIZE      4096           /* 4K buffer for caching data */
+#define F_BUF_SIZE      65536          /* default buffer for caching data */
+#define F_MIN_BUF_SIZE  4096           /* smallest buffer a file is given */
 #define F_PACK_MAGIC    0x736C6821L    /* magic number for packed files */
 #define F_NOPACK_MAGIC  0x736C682EL    /* magic number for autodetect */
 #define F_EXE_MAGIC     0x736C682BL    /* magic number for appended data */
+#define F_BLOCK_MAGIC   0x736C6842L    /* magic number for block packed files */
+#define F_BLOCK_SIZE    262144         /* data in each block of those */
 
 #define PACKFILE_FLAG_WRITE      1     /* the file is being written */
 #define PACKFILE_FLAG_PACK       2     /* data is compressed */
@@ -29,6 +33,9 @@ extern "C" {
 #define PACKFILE_FLAG_ERROR      16    /* an error has occurred */
 #define PACKFILE_FLAG_OLD_CRYPT  32    /* backward compatibility mode */
 #define PACKFILE_FLAG_EXEDAT     64    /* reading from our executable */
+#define PACKFILE_FLAG_MAPPED     128   /* buffer is a view of a mapping */
+#define PACKFILE_FLAG_BLOCKS     256   /* data is packed in blocks */
+#define PACKFILE_FLAG_MEMORY     512   /* buffer is the caller's memory */
 
 
 typedef struct PACKFILE_VTABLE PACKFILE_VTABLE;
@@ -36,6 +43,7 @@ typedef struct PACKFILE PACKFILE;
 
 struct LZSS_PACK_DATA;
 struct LZSS_UNPACK_DATA;
+struct PACK_BLOCK_DATA;
 
 struct _al_normal_packfile_details
 {
@@ -47,10 +55,12 @@ struct _al_normal_packfile_details
    struct PACKFILE *parent;               /* nested, parent file */
    struct LZSS_PACK_DATA *pack_data;      /* for LZSS compression */
    struct LZSS_UNPACK_DATA *unpack_data;  /* for LZSS decompression */
+   struct PACK_BLOCK_DATA *block_data;    /* for block packed files */
    char *filename;                        /* name of the file */
    char *passdata;                        /* encryption key data */
    char *passpos;                         /* current key position */
-   unsigned char buf[F_BUF_SIZE];         /* the actual data buffer */
+   int buf_cap;                           /* allocated size of the buffer */
+   unsigned char *buf;                    /* the actual data buffer */
 };
 
 struct PACKFILE
@@ -62,7 +72,7 @@ struct PACKFILE
    /* The following is only to be used for the "normal" PACKFILE vtable,
     * i.e. what is implemented by Allegro itself. If is_normal_packfile is
     * false then the following is not even allocated. This must be the last
-    * member in the structure.
+    * member in the structure, the data buffer is allocated right after it.
     */
    struct _al_normal_packfile_details normal;
 };
@@ -83,6 +93,8 @@ struct PACKFILE_VTABLE
 
 void packfile_password(const char *password);
 PACKFILE *pack_fopen(const char *filename, const char *mode);
+PACKFILE *pack_fopen_ex(const char *filename, const char *mode, long bufsize);
+PACKFILE *pack_fopen_memory(const void *data, long size);
 int pack_fclose(PACKFILE *f);
 int pack_fseek(PACKFILE *f, int offset);
 PACKFILE *pack_fopen_chunk(PACKFILE *f, int pack);
@@ -100,6 +112,7 @@ long pack_mgetl(PACKFILE *f);
 int pack_mputw(int w, PACKFILE *f);
 long pack_mputl(long l, PACKFILE *f);
 long pack_fread(void *p, long n, PACKFILE *f);
+const void *pack_fview(long n, PACKFILE *f);
 long pack_fwrite(const void *p, long n, PACKFILE *f);
 int pack_ungetc(int c, PACKFILE *f);
 char *pack_fgets(char *p, int max, PACKFILE *f);
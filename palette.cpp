@@ -360,7 +360,7 @@ void *load_dat_palette(PACKFILE *f, long size)
    if ((size / 4) != PAL_SIZE)
       return NULL;
 
-   p = (RGB *)malloc(sizeof(PALETTE));
+   p = (RGB *)_datafile_malloc(sizeof(PALETTE));
    if (!p)
       return NULL;
 
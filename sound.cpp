@@ -66,7 +66,7 @@ void *load_sample_object(PACKFILE *f, long size)
 
    (void)size;
 
-   s = (SAMPLE *)malloc(sizeof(SAMPLE));
+   s = (SAMPLE *)_datafile_malloc(sizeof(SAMPLE));
    if (!s)
       return NULL;
 
@@ -89,28 +89,27 @@ void *load_sample_object(PACKFILE *f, long size)
    s->loop_end = s->len;
 
    if (s->bits == 8)
-      s->data = read_block(f, s->len * ((s->stereo) ? 2 : 1), 0);
+      s->data = _datafile_read_block(f, s->len * ((s->stereo) ? 2 : 1));
    else
    {
-      s->data = malloc(s->len * sizeof(short) * ((s->stereo) ? 2 : 1));
+      /* 16 bit samples are stored in little-endian order */
+      s->data = _datafile_read_block(f, s->len * sizeof(short) * ((s->stereo) ? 2 : 1));
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
       if (s->data)
       {
-         int i;
-
-         for (i = 0; i < (int)s->len * ((s->stereo) ? 2 : 1); i++)
-            ((unsigned short *)s->data)[i] = pack_igetw(f);
+         unsigned short *p = (unsigned short *)s->data;
+         long i;
 
-         if (pack_ferror(f))
-         {
-            free(s->data);
-            s->data = NULL;
-         }
+         for (i = 0; i < (long)s->len * ((s->stereo) ? 2 : 1); i++)
+            p[i] = __builtin_bswap16(p[i]);
       }
+#endif
    }
 
    if (!s->data)
    {
-      free(s);
+      _datafile_free(s);
       return NULL;
    }
 
@@ -0,0 +1,212 @@
+// Checks the SSE2 read paths of Blip_Buffer and Stereo_Buffer against the
+// scalar Blip_Reader loop they replace, with random deltas including blocks
+// driven far enough out of range to need the exact scalar clamp.
+
+#include "gme/Multi_Buffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef Blip_Synth<blip_good_quality,20> Synth;
+
+const long sample_rate = 44100;
+const long clock_rate = 1789773;
+const int frame_length = 30000;     // clocks, about 739 samples
+const int frame_count = 400;
+const int max_read = 2000;
+
+static unsigned long rng_state;
+
+static int rng( int range )
+{
+	rng_state = rng_state * 1103515245 + 12345;
+	return (int) ((rng_state >> 8) % range);
+}
+
+// Add one frame of random transitions, loud enough to overdrive some blocks
+static void add_frame( Synth& synth, Blip_Buffer* buf )
+{
+	int overdrive = (rng( 8 ) == 0);
+	for ( int t = rng( 40 ); t < frame_length; t += 1 + rng( 120 ) )
+	{
+		int delta = rng( 41 ) - 20;
+		if ( overdrive )
+			delta *= 400;
+		synth.offset( t, delta, buf );
+	}
+}
+
+static blargg_err_t setup( Blip_Buffer& buf )
+{
+	blargg_err_t err = buf.set_sample_rate( sample_rate, 1000 );
+	if ( err )
+		return err;
+	buf.clock_rate( clock_rate );
+	buf.bass_freq( 16 );
+	return 0;
+}
+
+static blip_sample_t clamp( long s )
+{
+	if ( (blip_sample_t) s != s )
+		s = 0x7FFF - (s >> 24);
+	return (blip_sample_t) s;
+}
+
+// Scalar reference for Blip_Buffer::read_samples()
+static long reference_read( Blip_Buffer& buf, blip_sample_t* out, long count, int stereo )
+{
+	if ( count > buf.samples_avail() )
+		count = buf.samples_avail();
+
+	Blip_Reader in;
+	int bass = in.begin( buf );
+	for ( long i = 0; i < count; i++ )
+	{
+		out [i << stereo] = clamp( in.read() );
+		in.next( bass );
+	}
+	in.end( buf );
+	buf.remove_samples( count );
+	return count;
+}
+
+// Scalar reference for Stereo_Buffer::read_samples(), mixing the three buffers
+static long reference_mix( Stereo_Buffer& buf, blip_sample_t* out, long count, bool stereo )
+{
+	count = buf.samples_avail() < count * 2 ? buf.samples_avail() / 2 : count;
+
+	Blip_Reader center, left, right;
+	int bass = center.begin( *buf.center() );
+	left.begin( *buf.left() );
+	right.begin( *buf.right() );
+	for ( long i = 0; i < count; i++ )
+	{
+		long c = center.read();
+		out [i * 2]     = clamp( stereo ? c + left.read() : c );
+		out [i * 2 + 1] = clamp( stereo ? c + right.read() : c );
+		center.next( bass );
+		left.next( bass );
+		right.next( bass );
+	}
+	center.end( *buf.center() );
+	left.end( *buf.left() );
+	right.end( *buf.right() );
+
+	buf.center()->remove_samples( count );
+	buf.left()->remove_samples( count );
+	buf.right()->remove_samples( count );
+	return count * 2;
+}
+
+static int failures;
+
+static void compare( const char* name, const blip_sample_t* a, long na,
+		const blip_sample_t* b, long nb, int frame )
+{
+	if ( na != nb || memcmp( a, b, na * sizeof *a ) )
+	{
+		if ( failures++ < 10 )
+			printf( "%s: mismatch in frame %d (%ld vs %ld samples)\n", name, frame, na, nb );
+	}
+}
+
+// Blip_Buffer::read_samples(), packed and into every other sample
+static void test_blip_buffer( int stereo )
+{
+	Blip_Buffer buf [2];
+	Synth synth;
+	if ( setup( buf [0] ) || setup( buf [1] ) )
+	{
+		printf( "Blip_Buffer setup failed\n" );
+		failures++;
+		return;
+	}
+	synth.volume( 1.0 );
+
+	static blip_sample_t out [2] [max_read * 2];
+	for ( int f = 0; f < frame_count; f++ )
+	{
+		// same transitions into both buffers
+		unsigned long seed = rng_state;
+		add_frame( synth, &buf [0] );
+		rng_state = seed;
+		add_frame( synth, &buf [1] );
+		buf [0].end_frame( frame_length );
+		buf [1].end_frame( frame_length );
+
+		// read a random amount, leaving tails shorter than a block
+		long n = 1 + rng( max_read );
+		memset( out, 0x55, sizeof out );
+		long na = buf [0].read_samples( out [0], n, stereo );
+		long nb = reference_read( buf [1], out [1], n, stereo );
+		compare( stereo ? "read_samples stride" : "read_samples mono",
+				out [0], na << stereo, out [1], nb << stereo, f );
+	}
+}
+
+// Stereo_Buffer::read_samples(), through mix_stereo() or mix_mono()
+static void test_stereo_buffer( bool stereo )
+{
+	Stereo_Buffer buf [2];
+	Synth synth;
+	for ( int i = 0; i < 2; i++ )
+	{
+		if ( buf [i].set_sample_rate( sample_rate, 1000 ) )
+		{
+			printf( "Stereo_Buffer setup failed\n" );
+			failures++;
+			return;
+		}
+		buf [i].clock_rate( clock_rate );
+		buf [i].bass_freq( 16 );
+	}
+	synth.volume( 1.0 );
+
+	static blip_sample_t out [2] [max_read * 2];
+	for ( int f = 0; f < frame_count; f++ )
+	{
+		unsigned long seed = rng_state;
+		for ( int i = 0; i < 2; i++ )
+		{
+			rng_state = seed;
+			add_frame( synth, buf [i].center() );
+			if ( stereo )
+			{
+				add_frame( synth, buf [i].left() );
+				add_frame( synth, buf [i].right() );
+			}
+		}
+
+		buf [0].end_frame( frame_length, stereo );
+		buf [1].center()->end_frame( frame_length );
+		buf [1].left()->end_frame( frame_length );
+		buf [1].right()->end_frame( frame_length );
+
+		long n = 1 + rng( max_read );
+		memset( out, 0x55, sizeof out );
+		long na = buf [0].read_samples( out [0], n * 2 );
+		long nb = reference_mix( buf [1], out [1], n, stereo );
+		compare( stereo ? "Stereo_Buffer stereo" : "Stereo_Buffer mono",
+				out [0], na, out [1], nb, f );
+	}
+}
+
+int main()
+{
+	rng_state = 1;
+	test_blip_buffer( 0 );
+	test_blip_buffer( 1 );
+	test_stereo_buffer( false );
+	test_stereo_buffer( true );
+
+	if ( failures )
+	{
+		printf( "blip_buffer_test: %d failures\n", failures );
+		return EXIT_FAILURE;
+	}
+
+	printf( "blip_buffer_test: passed (BLIP_BUFFER_SSE2=%d)\n", BLIP_BUFFER_SSE2 + 0 );
+	return 0;
+}
@@ -0,0 +1,139 @@
+/* Checks pack_fseek() on plain, packed and block packed files: every
+ * seek is followed by a read that must return the original data, and a
+ * seek that ends exactly at the end of the file must leave it at EOF.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alport.h"
+
+#define TEST_FILE    "packfile_test.tmp"
+#define TEST_SIZE    262145         /* one byte over a block */
+#define TEST_STEP    499
+
+
+static unsigned long rng_state = 1;
+
+static int rng(int range)
+{
+   rng_state = rng_state * 1103515245 + 12345;
+   return (int)((rng_state >> 8) % range);
+}
+
+
+/* make_data:
+ *  Fills data with one of a few patterns, from incompressible to runs
+ *  long enough that LZSS holds output back past the end of its input.
+ */
+static void make_data(unsigned char *data, long size, int pattern)
+{
+   long i;
+
+   for (i = 0; i < size; i++)
+   {
+      switch (pattern)
+      {
+         case 0:
+            data[i] = rng(256);
+            break;
+         case 1:
+            data[i] = i % 251;
+            break;
+         default:
+            data[i] = (i * 7 / 13) & 0xFF;
+            break;
+      }
+   }
+}
+
+
+/* check_seeks:
+ *  Writes data with the given mode and seeks through it in two steps,
+ *  the second ending at the end of the file. Returns the number of
+ *  failures.
+ */
+static int check_seeks(const char *mode, const unsigned char *data, long size, int pattern)
+{
+   PACKFILE *f;
+   long first;
+   int failures = 0;
+   int c;
+
+   f = pack_fopen(TEST_FILE, mode);
+   if ((!f) || (pack_fwrite(data, size, f) != size))
+   {
+      printf("%s pattern %d: write failed\n", mode, pattern);
+      if (f)
+         pack_fclose(f);
+      return 1;
+   }
+   pack_fclose(f);
+
+   for (first = 0; first < size; first += TEST_STEP)
+   {
+      f = pack_fopen(TEST_FILE, (strcmp(mode, F_WRITE) == 0) ? F_READ : F_READ_PACKED);
+      if (!f)
+      {
+         printf("%s pattern %d: open failed\n", mode, pattern);
+         return failures + 1;
+      }
+
+      /* a seek followed by a read */
+      pack_fseek(f, first);
+      c = pack_getc(f);
+      if (c != data[first])
+      {
+         if (failures++ < 5)
+            printf("%s pattern %d: byte %ld is %d, not %d\n", mode, pattern, first, c, data[first]);
+      }
+
+      /* and one ending exactly at the end */
+      pack_fseek(f, size - first - 1);
+      c = pack_getc(f);
+      if ((c != EOF) || (!pack_feof(f)))
+      {
+         if (failures++ < 5)
+            printf("%s pattern %d: seek %ld + %ld: got %d, eof %d\n", mode, pattern,
+                   first + 1, size - first - 1, c, pack_feof(f));
+      }
+
+      pack_fclose(f);
+   }
+
+   return failures;
+}
+
+
+int main(void)
+{
+   static const char *modes[] = { F_WRITE, F_WRITE_PACKED, F_WRITE_BLOCKS };
+   unsigned char *data;
+   int failures = 0;
+   int pattern, m;
+
+   data = (unsigned char *)malloc(TEST_SIZE);
+   if (!data)
+      return EXIT_FAILURE;
+
+   for (pattern = 0; pattern < 3; pattern++)
+   {
+      make_data(data, TEST_SIZE, pattern);
+
+      for (m = 0; m < (int)(sizeof(modes) / sizeof(modes[0])); m++)
+         failures += check_seeks(modes[m], data, TEST_SIZE, pattern);
+   }
+
+   free(data);
+   delete_file(TEST_FILE);
+
+   if (failures)
+   {
+      printf("packfile_test: %d failures\n", failures);
+      return EXIT_FAILURE;
+   }
+
+   printf("packfile_test: passed\n");
+   return 0;
+}